@@ -0,0 +1,105 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   at_cmd.c
+ *
+ *  @brief  AT command line parsing and table lookup
+ *
+ *          A line is "AT+<NAME>" optionally followed by a space and one
+ *          decimal argument. Commands are looked up by binary search in a
+ *          table sorted by name, the table and the handlers live in main.c.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "at_cmd.h"
+
+
+/**
+ * @brief Find an AT command by name
+ *
+ * @param[in] table  Commands sorted by name
+ * @param[in] count  Number of commands
+ * @param[in] name   Name without the AT+ prefix, NUL terminated
+ *
+ * @return Table entry, or NULL if the command does not exist
+ */
+const at_command_t *at_find(const at_command_t *table, size_t count, const char *name)
+{
+  int lo = 0;
+  int hi = (int)count - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = strcmp(name, table[mid].name);
+
+    if (cmp == 0) return &table[mid];
+    if (cmp < 0) hi = mid - 1;
+    else lo = mid + 1;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Parse the argument of an AT command
+ *
+ * @param[in]  text   Text after the command name
+ * @param[in]  kind   AT_ARG_* kind of the command
+ * @param[out] args   Parsed argument
+ *
+ * @return false if a required argument is missing or not a decimal integer
+ */
+bool at_parse_args(const char *text, uint8_t kind, at_args_t *args)
+{
+  char *end;
+
+  args->given = false;
+  args->value = 0;
+
+  if (kind == AT_ARG_NONE) return true;
+
+  while (*text == ' ') text++;
+  if (*text == '\0') return kind == AT_ARG_OPT;
+
+  long value = strtol(text, &end, 10);
+  if (end == text) return false;
+
+  while (*end == ' ') end++;
+  if (*end != '\0') return false;
+
+  args->given = true;
+  args->value = value;
+  return true;
+}
+
+/**
+ * @brief Split an input line into its command and argument
+ *
+ * @param[in]  line   Input line, the name is cut off in place
+ * @param[in]  table  Commands sorted by name
+ * @param[in]  count  Number of commands
+ * @param[out] cmd    Command found, when AT_OK
+ * @param[out] args   Parsed argument, when AT_OK
+ */
+at_status_t at_parse_line(char *line, const at_command_t *table, size_t count, const at_command_t **cmd, at_args_t *args)
+{
+  if (strncmp(line, "AT+", 3) != 0) {
+    return (strncmp(line, "AT", 2) == 0) ? AT_ERR_NO_PLUS : AT_ERR_NOT_AT;
+  }
+
+  // Split the name from the argument
+  char *name = line + 3;
+  char *arg = strchr(name, ' ');
+  if (arg != NULL) *arg++ = '\0';
+  else arg = name + strlen(name);
+
+  *cmd = at_find(table, count, name);
+  if (*cmd == NULL) return AT_ERR_UNKNOWN;
+
+  if (!at_parse_args(arg, (*cmd)->arg, args)) return AT_ERR_PARAM;
+  return AT_OK;
+}
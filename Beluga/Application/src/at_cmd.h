@@ -0,0 +1,46 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   at_cmd.h
+ *
+ *  @brief  AT command line parsing and table lookup --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _AT_CMD_H_
+#define _AT_CMD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Argument kinds of an AT command */
+#define AT_ARG_NONE   0   /**< No argument, anything after the name is ignored */
+#define AT_ARG_INT    1   /**< One required decimal integer */
+#define AT_ARG_OPT    2   /**< One optional decimal integer */
+
+typedef struct {
+  bool given;       /**< An argument was given */
+  int32_t value;    /**< Parsed argument, 0 if not given */
+} at_args_t;
+
+typedef struct {
+  const char *name;                       /**< Name without the AT+ prefix */
+  uint8_t arg;                            /**< AT_ARG_* kind */
+  void (*handler)(const at_args_t *args);
+} at_command_t;
+
+typedef enum {
+  AT_OK,
+  AT_ERR_NOT_AT,      /**< The line does not start with AT */
+  AT_ERR_NO_PLUS,     /**< AT without + */
+  AT_ERR_UNKNOWN,     /**< No such command */
+  AT_ERR_PARAM        /**< Missing or malformed argument */
+} at_status_t;
+
+const at_command_t *at_find(const at_command_t *table, size_t count, const char *name);
+bool at_parse_args(const char *text, uint8_t kind, at_args_t *args);
+at_status_t at_parse_line(char *line, const at_command_t *table, size_t count, const at_command_t **cmd, at_args_t *args);
+
+#endif
@@ -67,7 +67,11 @@
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
 
+#include "FreeRTOS.h"
+#include "task.h"
 #include "ble_app.h"
+#include "boot_time.h"
+#include "timestamp.h"
 
 
 
@@ -134,8 +138,6 @@ typedef struct
 } data_t;
 
 
-static bool in_seen_list(uint16_t UUID);
-static int get_seen_list_idx(uint16_t UUID);
 
 
 static ble_hrs_t m_hrs;                                             /**< Heart rate service instance. */
@@ -164,13 +166,9 @@ uint16_t NODE_UUID = 1;
 #define BLE_UWB_RANGE1 0x0000
 #define BLE_UWB_RANGE2 0x0000
 
-uint32_t time_keeper;
 int ble_started;
-int node_added;
-int last_seen_idx = 0;
 
-
-node seen_list[MAX_ANCHOR_COUNT];
+extern TaskHandle_t monitor_task_handle;
 
 
 ble_uuid_t m_adv_uuids[2];
@@ -588,6 +586,22 @@ static uint8_t find_adv_manu(ble_gap_evt_adv_report_t const * p_adv_report)
 
 
 
+/**@brief Wake the monitor task up to schedule the expiry of a new neighbor.
+ *
+ * @details Called from the BLE event interrupt. The monitor task sleeps while the
+ *          neighbor table is empty.
+ */
+static void monitor_wake(void)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (monitor_task_handle != NULL)
+    {
+        vTaskNotifyGiveFromISR(monitor_task_handle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
 /**@brief   Function for handling BLE events from central applications.
  *
  * @details This function parses scanning reports and initiates a connection to peripherals when a
@@ -707,48 +721,34 @@ static void on_ble_central_evt(ble_evt_t const * p_ble_evt)
 
                      
                      uint16_t found_UUID = find_adv_uuid_next(&p_gap_evt->params.adv_report);
-                     if(found_UUID != NODE_UUID && !in_seen_list(found_UUID)){
-                       
-
-                       uint16_t index = get_seen_list_idx(0); //Get empty index
-                       if(index == -1) //If list is full
-                       {
-                        index = MAX_ANCHOR_COUNT-1; //Evict least RSSI
-                       }
-                       seen_list[last_seen_idx].UUID = found_UUID;
-                       seen_list[last_seen_idx].RSSI = p_ble_evt->evt.gap_evt.params.adv_report.rssi;
-                       seen_list[last_seen_idx].ble_time_stamp = time_keeper;
-
-                       if (found_pollflag == '1') {
-                          seen_list[last_seen_idx].polling_flag = 1;
-                       }
-                       if (found_pollflag == '0') {
-                          seen_list[last_seen_idx].polling_flag = 0;
+                     if(found_UUID != NODE_UUID) {
+                       int8_t rssi = p_ble_evt->evt.gap_evt.params.adv_report.rssi;
+                       int index = neighbor_find(found_UUID);
+
+                       if(index < 0) {
+                         // Add to list, evicting the weakest neighbor if the list is full
+                         index = neighbor_insert(found_UUID, rssi);
+                         if(index >= 0) {
+                           boot_mark(BOOT_FIRST_NEIGHBOR);
+                           monitor_wake();
+                         }
                        }
-                       //printf("%d \r\n",p_ble_evt->evt.gap_evt.params.adv_report.rssi); 
-                       //seen_list[last_seen_idx].time_stamp = time_keeper;
-
-                       last_seen_idx += 1;
-                       last_seen_idx %= MAX_ANCHOR_COUNT;
-                       node_added = 1;
-
-                     }
-
-                     if((found_UUID != NODE_UUID) && in_seen_list(found_UUID) ) //Update
-                     {
-                       int index = get_seen_list_idx(found_UUID);
-                       seen_list[index].RSSI = p_ble_evt->evt.gap_evt.params.adv_report.rssi;
-                       seen_list[index].ble_time_stamp = time_keeper;
 
-                       if (found_pollflag == '1') {
-                          seen_list[index].polling_flag = 1;
-                       }
-                       if (found_pollflag == '0') {
-                          seen_list[index].polling_flag = 0;
+                       if(index >= 0) //Update
+                       {
+                         neighbor_write_begin(index);
+                         seen_list[index].RSSI = rssi;
+                         seen_list[index].ble_time_stamp = timestamp_ms();
+                         neighbor_write_end(index);
+                         neighbor_reorder(index);
+
+                         if (found_pollflag == '1') {
+                            neighbor_flag_set(index, NEIGHBOR_POLLING);
+                         }
+                         if (found_pollflag == '0') {
+                            neighbor_flag_clear(index, NEIGHBOR_POLLING);
+                         }
                        }
-                       //seen_list[index].time_stamp = time_keeper;
-                       //printf("update time stamp \r\n");
-
                      }
                      
 
@@ -1264,31 +1264,3 @@ void power_manage(void)
     ret_code_t err_code = sd_app_evt_wait();
     APP_ERROR_CHECK(err_code);
 }
-
-
-
-static bool in_seen_list(uint16_t UUID) {
-
-  for(int i = 0; i < MAX_ANCHOR_COUNT; i++){
-
-    if(seen_list[i].UUID == UUID){
-      
-      return true;
-      
-      }
-  }
-  return false;
-}
-
-static int get_seen_list_idx(uint16_t UUID) {
-
-  for(int i = 0; i < MAX_ANCHOR_COUNT; i++){
-
-    if(seen_list[i].UUID == UUID){
-      
-      return i;
-      
-    }
-  }
-  return -1;
-}
@@ -12,18 +12,8 @@
 #define _BLE_APP_
 
 #include "deca_device_api.h"
+#include "neighbor.h"
 
-typedef struct node{
-    uint8 UUID;
-    int8_t RSSI;
-    int time_stamp;
-    float range;
-    int update_flag;
-    int polling_flag;
-    int ble_time_stamp;
-} node;
-
-#define MAX_ANCHOR_COUNT 12
 
 void scan_start(void);
 void adv_scan_start(void);
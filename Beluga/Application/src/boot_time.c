@@ -0,0 +1,105 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   boot_time.c
+ *
+ *  @brief  Timestamps of the boot phases
+ *
+ *          Phases up to the scheduler start are stamped with the DWT cycle
+ *          counter, which is started at the top of main() and runs at the
+ *          64 MHz core clock, giving microsecond resolution before the RTOS
+ *          tick RTC is running. The cycle counter stops while the core
+ *          sleeps in tickless idle, so later phases are stamped with the
+ *          tick RTC instead, at millisecond resolution.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "nrf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timestamp.h"
+#include "boot_time.h"
+
+#define BOOT_CYCLES_PER_US   (SystemCoreClock / 1000000)
+
+typedef struct
+{
+  uint32_t us;          /**< Time since main() was entered */
+  bool rtc;             /**< Stamped with the tick RTC, to the millisecond */
+  bool reached;
+} boot_stamp_t;
+
+static boot_stamp_t m_stamps[BOOT_PHASE_COUNT];
+
+static const char * const m_names[BOOT_PHASE_COUNT] =
+{
+  [BOOT_MAIN]           = "Main",
+  [BOOT_BLE_STACK]      = "BLE stack",
+  [BOOT_FLASH]          = "Flash settings",
+  [BOOT_SCHEDULER]      = "Scheduler",
+  [BOOT_UWB_RESET]      = "UWB reset",
+  [BOOT_UWB_READY]      = "UWB ready",
+  [BOOT_FIRST_NEIGHBOR] = "First neighbor",
+  [BOOT_FIRST_RANGE]    = "First range",
+};
+
+
+/**
+ * @brief Start the cycle counter, call first thing in main()
+ */
+void boot_time_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Stamp a boot phase, only the first call per phase counts
+ *
+ * Safe from any task and from interrupts.
+ */
+void boot_mark(boot_phase_t phase)
+{
+  boot_stamp_t *stamp = &m_stamps[phase];
+
+  if (stamp->reached) return;
+
+  if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+    stamp->us = DWT->CYCCNT / BOOT_CYCLES_PER_US;
+  }
+  else {
+    // The tick RTC starts with the scheduler
+    uint64_t rtc_us = ((uint64_t)timestamp_ticks() * 1000000) / configTICK_RATE_HZ;
+
+    stamp->us = m_stamps[BOOT_SCHEDULER].us + (uint32_t)rtc_us;
+    stamp->rtc = true;
+  }
+  stamp->reached = true;
+}
+
+/**
+ * @brief Print the time of each boot phase since main() was entered
+ */
+void boot_time_print(void)
+{
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    boot_stamp_t *stamp = &m_stamps[i];
+
+    if (!stamp->reached) {
+      printf("%s: not reached \r\n", m_names[i]);
+      continue;
+    }
+
+    if (stamp->rtc) {
+      printf("%s: %lu ms \r\n", m_names[i], stamp->us / 1000);
+    }
+    else {
+      printf("%s: %lu us \r\n", m_names[i], stamp->us);
+    }
+  }
+}
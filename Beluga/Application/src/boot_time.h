@@ -0,0 +1,33 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   boot_time.h
+ *
+ *  @brief  Timestamps of the boot phases --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _BOOT_TIME_H_
+#define _BOOT_TIME_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+  BOOT_MAIN,            /**< main() entered */
+  BOOT_BLE_STACK,       /**< SoftDevice enabled, GAP and advertising set up */
+  BOOT_FLASH,           /**< FDS ready and settings loaded */
+  BOOT_SCHEDULER,       /**< Scheduler about to start */
+  BOOT_UWB_RESET,       /**< DW1000 left reset */
+  BOOT_UWB_READY,       /**< DW1000 initialised and configured */
+  BOOT_FIRST_NEIGHBOR,  /**< First BLE neighbor added */
+  BOOT_FIRST_RANGE,     /**< First range measured */
+  BOOT_PHASE_COUNT
+} boot_phase_t;
+
+void boot_time_init(void);
+void boot_mark(boot_phase_t phase);
+void boot_time_print(void);
+
+#endif
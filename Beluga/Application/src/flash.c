@@ -3,17 +3,219 @@
  *
  *  @brief  An implementation of modify and retrive data through flash data storage
  *
+ *          All settings are kept in one versioned, CRC protected record that
+ *          is read once at boot. Setting a value only changes the RAM copy
+ *          and restarts a commit timer, so a burst of AT commands ends in a
+ *          single flash write. Deleted record versions are reclaimed by
+ *          fds_gc() in the background.
+ *
  *  @date   2020/06
  *
- *  @author WiseLab-CMU 
+ *  @author WiseLab-CMU
  */
 
 #include "flash.h"
 #include "fds.h"
+#include "crc16.h"
+#include "app_util.h"
+#include "FreeRTOS.h"
+#include "timers.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define CONFIG_VERSION        1
+#define CONFIG_COMMIT_DELAY   pdMS_TO_TICKS(1000)   /**< Quiet time before changes are written */
+#define CONFIG_GC_DIRTY       8                     /**< Dirty records that trigger garbage collection */
+#define LEGACY_SETTINGS       13                    /**< Settings stored by the one record per setting layout */
+#define CONFIG_MIN_LEN        28                    /**< Size of the first settings record layout */
+
+/* Settings record, laid out without padding. New fields go just before crc,
+ * so records of older firmware are a prefix. */
+typedef struct
+{
+  uint16_t version;
+  uint16_t present;       /**< Bit (n - 1) set when setting n (1 to 16) was configured */
+  uint16_t node_id;       /**< 1: AT+ID */
+  uint16_t rate;          /**< 3: AT+RATE */
+  uint16_t tdma_slot;     /**< 11: AT+TDMA */
+  uint16_t reply_delay;   /**< 13: AT+CALIBRATE */
+  uint32_t timeout;       /**< 5: AT+TIMEOUT */
+  uint8_t  boot_mode;     /**< 2: AT+BOOTMODE */
+  uint8_t  channel;       /**< 4: AT+CHANNEL */
+  uint8_t  tx_power;      /**< 6: AT+TXPOWER */
+  uint8_t  stream_mode;   /**< 7: AT+STREAMMODE */
+  uint8_t  twr_mode;      /**< 8: AT+TWRMODE */
+  uint8_t  led_mode;      /**< 9: AT+LEDMODE */
+  uint8_t  format;        /**< 10: AT+FORMAT */
+  uint8_t  rx_mode;       /**< 12: AT+RXMODE */
+  uint8_t  pwr_mode;      /**< 14: AT+PWRMODE */
+  uint8_t  sniff_duty;    /**< 15: AT+SNIFF */
+  uint8_t  filter_mode;   /**< 16: AT+FILTER */
+  uint8_t  poll_mode;     /**< 17: AT+POLLMODE */
+  uint8_t  present_ext;   /**< Bit (n - 17) set when setting n (17 to 24) was configured */
+  uint8_t  reserved;
+  uint16_t autorate_min;  /**< 18: AT+AUTORATE */
+  uint16_t reserved2;
+  uint16_t crc;           /**< CRC16 of all fields above */
+} flash_config_t;
+
+STATIC_ASSERT(sizeof(flash_config_t) == 36);
+
+static flash_config_t m_config;          /**< Working copy */
+static flash_config_t m_flash_copy;      /**< Copy being written, FDS reads it until the write completes */
+static fds_record_desc_t m_desc;         /**< Descriptor of the stored record */
+static bool m_stored = false;            /**< The record exists in flash */
+static volatile bool m_busy = false;     /**< A write or update is in flight */
+static volatile bool m_dirty = false;    /**< The working copy differs from flash */
+static volatile bool m_gc_retry = false; /**< Commit again once garbage collection is done */
+static TimerHandle_t m_commit_timer;
+
+static const uint16_t legacy_keys[LEGACY_SETTINGS] =
+{
+  RECORD_KEY_1, RECORD_KEY_2, RECORD_KEY_3, RECORD_KEY_4, RECORD_KEY_5, RECORD_KEY_6, RECORD_KEY_7,
+  RECORD_KEY_8, RECORD_KEY_9, RECORD_KEY_10, RECORD_KEY_11, RECORD_KEY_12, RECORD_KEY_13
+};
+
+
+/**
+ * @brief CRC16 of a settings record
+ */
+static uint16_t config_crc(const flash_config_t *cfg)
+{
+  return crc16_compute((const uint8_t *)cfg, offsetof(flash_config_t, crc), NULL);
+}
+
+/**
+ * @brief Restart the commit timer
+ */
+static void config_schedule(void)
+{
+  m_dirty = true;
+  (void) xTimerReset(m_commit_timer, 0);
+}
+
+/**
+ * @brief Start garbage collection if enough space can be reclaimed
+ */
+static void config_gc_check(void)
+{
+  fds_stat_t stat;
+
+  if (fds_stat(&stat) == FDS_SUCCESS && stat.dirty_records >= CONFIG_GC_DIRTY) {
+    (void) fds_gc();
+  }
+}
+
+/**
+ * @brief Write the working copy to flash
+ *
+ * Called by the commit timer. A commit requested while a write is still in
+ * flight is done from the FDS event of that write.
+ */
+static void config_commit(void)
+{
+  if (m_busy || !m_dirty) return;
+
+  m_flash_copy = m_config;
+  m_flash_copy.version = CONFIG_VERSION;
+  m_flash_copy.crc = config_crc(&m_flash_copy);
+
+  fds_record_t record;
+  record.file_id           = FILE_ID;
+  record.key               = CONFIG_RECORD_KEY;
+  record.data.p_data       = &m_flash_copy;
+  record.data.length_words = sizeof(m_flash_copy) / 4;
+
+  m_dirty = false;
+  m_busy = true;
+
+  ret_code_t rc = m_stored ? fds_record_update(&m_desc, &record) : fds_record_write(&m_desc, &record);
+  if (rc == FDS_SUCCESS) return;
+
+  m_busy = false;
+  m_dirty = true;
+  if (rc == FDS_ERR_NO_SPACE_IN_FLASH) {
+    m_gc_retry = true;
+    (void) fds_gc();
+  }
+  else {
+    printf("Config write error \r\n");
+  }
+}
+
+/**
+ * @brief Commit timer callback
+ */
+static void config_commit_timeout(TimerHandle_t timer)
+{
+  UNUSED_PARAMETER(timer);
+  config_commit();
+}
+
+/**
+ * @brief Read one legacy string record
+ *
+ * @return true if the record exists
+ */
+static bool legacy_read(uint16_t key, uint32_t *value, fds_record_desc_t *desc)
+{
+  fds_flash_record_t  flash_record;
+  fds_find_token_t    ftok;
+  char str[8] = {0};
+
+  memset(&ftok, 0x00, sizeof(fds_find_token_t));
+  if (fds_record_find(FILE_ID, key, desc, &ftok) != FDS_SUCCESS) return false;
+  if (fds_record_open(desc, &flash_record) != FDS_SUCCESS) return false;
+
+  // The string is not NUL terminated when it fills the whole record
+  uint32_t len = flash_record.p_header->length_words * 4;
+  memcpy(str, flash_record.p_data, MIN(len, sizeof(str) - 1));
+  *value = atoi(str);
+
+  (void) fds_record_close(desc);
+  return true;
+}
+
+/**
+ * @brief Move the settings of the one record per setting layout into the settings record
+ */
+static void config_migrate(void)
+{
+  fds_record_desc_t desc[LEGACY_SETTINGS];
+  bool found[LEGACY_SETTINGS];
+  uint32_t value;
+  int count = 0;
+
+  for (int n = 1; n <= LEGACY_SETTINGS; n++) {
+    found[n - 1] = legacy_read(legacy_keys[n - 1], &value, &desc[n - 1]);
+    if (found[n - 1]) {
+      writeFlashID(value, n);
+      count++;
+    }
+  }
+
+  if (count == 0) return;
+
+  // FDS runs operations in order, so the old records go only after the new one is written
+  config_commit();
+  for (int n = 0; n < LEGACY_SETTINGS; n++) {
+    if (found[n]) (void) fds_record_delete(&desc[n]);
+  }
+  printf("Flash settings migrated \r\n");
+}
+
+
+/**
+ * @brief Restart the commit timer from the FDS handler, which runs in the SoftDevice interrupt
+ */
+static void config_schedule_from_isr(void)
+{
+  BaseType_t woken = pdFALSE;
+  (void) xTimerResetFromISR(m_commit_timer, &woken);
+  portYIELD_FROM_ISR(woken);
+}
 
 /**@brief FDS event handler to handle errors during initialization */
 void fds_evt_handler(fds_evt_t const * p_fds_evt)
@@ -26,131 +228,169 @@ void fds_evt_handler(fds_evt_t const * p_fds_evt)
                 // Initialization failed.
             }
             break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (p_fds_evt->write.record_key != CONFIG_RECORD_KEY) break;
+            m_busy = false;
+            if (p_fds_evt->result == FDS_SUCCESS)
+            {
+                m_stored = true;
+                config_gc_check();
+            }
+            else
+            {
+                m_dirty = true;
+            }
+            // Changes made during the write
+            if (m_dirty) config_schedule_from_isr();
+            break;
+
+        case FDS_EVT_GC:
+            if (m_gc_retry)
+            {
+                m_gc_retry = false;
+                config_schedule_from_isr();
+            }
+            break;
+
         default:
             break;
     }
 }
 
-
 /**
- * @brief Modify storage information
+ * @brief Load the settings record, call once after fds_init()
+ *
+ * Settings stored by older firmware are migrated. A record with a bad CRC
+ * or an unknown version is ignored, so all settings fall back to default.
  */
-void writeFlashID(uint32_t id, int record) {
-
-  uint32_t record_key;
-  if(record == 1) record_key = RECORD_KEY_1;
-  if(record == 2) record_key = RECORD_KEY_2;
-  if(record == 3) record_key = RECORD_KEY_3;
-  if(record == 4) record_key = RECORD_KEY_4;
-  if(record == 5) record_key = RECORD_KEY_5;
-  if(record == 6) record_key = RECORD_KEY_6;
-  if(record == 7) record_key = RECORD_KEY_7;
-  if(record == 8) record_key = RECORD_KEY_8;
-  if(record == 9) record_key = RECORD_KEY_9;
-
-  static char str[(sizeof("1") + 3) / 4];
-  sprintf(str, "%d", id);
-
-  fds_record_desc_t   record_desc_2;
-  fds_find_token_t    ftok_2;
-
-  /* It is required to zero the token before first use. */
-  memset(&ftok_2, 0x00, sizeof(fds_find_token_t));
-
-  // Write a new record if the record not exist in flash
-  if (fds_record_find(FILE_ID, record_key, &record_desc_2, &ftok_2) != FDS_SUCCESS) {
-       
-    fds_record_t        record;
-    fds_record_desc_t   record_desc;
-
-    // Set up record.
-    record.file_id           = FILE_ID;
-    record.key               = record_key;
-    record.data.p_data       = &str;
-    record.data.length_words = (sizeof("1") + 3) / 4;   /* one word is four bytes. */
-
-    ret_code_t rc;
-    rc = fds_record_write(&record_desc, &record);
-    if (rc != FDS_SUCCESS) {
-      printf("Write 1 Failed\r\n"); /* Handle error. */
-    }
-  }
-  //if(debug_print)printf("Done write\r\n");
-
-
+void flash_config_load(void)
+{
   fds_flash_record_t  flash_record;
-  fds_record_desc_t   record_desc_1;
   fds_find_token_t    ftok;
-  /* It is required to zero the token before first use. */
+
+  memset(&m_config, 0x00, sizeof(m_config));
+  m_commit_timer = xTimerCreate("CFG", CONFIG_COMMIT_DELAY, pdFALSE, NULL, config_commit_timeout);
+
   memset(&ftok, 0x00, sizeof(fds_find_token_t));
-    
-  /* Loop until all records with the given key and file ID have been found. */
-  /* Update a new record if the record exist in flash */
-  while (fds_record_find(FILE_ID, record_key, &record_desc_1, &ftok) == FDS_SUCCESS) {
-        
-    if (fds_record_open(&record_desc_1, &flash_record) != FDS_SUCCESS) {
-      printf("error opening\r\n"); /* Handle error. */
-    }
+  if (fds_record_find(FILE_ID, CONFIG_RECORD_KEY, &m_desc, &ftok) == FDS_SUCCESS) {
+    m_stored = true;
+
+    if (fds_record_open(&m_desc, &flash_record) == FDS_SUCCESS) {
+      const uint8_t *data = flash_record.p_data;
+      uint32_t len = flash_record.p_header->length_words * 4;
 
-    if (fds_record_close(&record_desc_1) != FDS_SUCCESS) {
-      printf("close error\r\n");  /* Handle error. */
+      // A shorter record was written by older firmware, the settings it lacks stay default
+      if (len >= CONFIG_MIN_LEN && len <= sizeof(flash_config_t) &&
+          uint16_decode(data) == CONFIG_VERSION &&
+          uint16_decode(&data[len - 2]) == crc16_compute(data, len - 2, NULL)) {
+        memcpy(&m_config, data, len - 2);
+      }
+      else {
+        printf("Flash settings invalid, using defaults \r\n");
+      }
+      (void) fds_record_close(&m_desc);
     }
-        
-    fds_record_t        record;
-       
-    // Set up record.
-    record.file_id           = FILE_ID;
-    record.key               = record_key;
-    record.data.p_data       = &str;
-    record.data.length_words = (sizeof(str) + 3) / 4;   /* one word is four bytes. */
-    ret_code_t rc;
-    rc = fds_record_update(&record_desc_1, &record);
-    if( rc != FDS_SUCCESS){
-      printf("UPDATE ERROR\r\n"); /* Handle error. */
-    }          
   }
-}
+  else {
+    config_migrate();
+  }
 
+  config_gc_check();
+}
 
+/**
+ * @brief Whether a setting was configured
+ *
+ * @param[in] record   Setting number, 1 to CONFIG_SETTINGS
+ */
+bool flash_config_has(int record)
+{
+  if (record < 1 || record > CONFIG_SETTINGS) return false;
+  if (record > 16) return (m_config.present_ext & (1 << (record - 17))) != 0;
+  return (m_config.present & (1 << (record - 1))) != 0;
+}
 
 /**
- * @brief Retrive storage information
+ * @brief Forget all settings, written like any other change
  */
-uint32_t getFlashID(uint32_t record_key) {
+void flash_config_reset(void)
+{
+  memset(&m_config, 0x00, sizeof(m_config));
+  config_schedule();
+}
 
-  uint32_t rec;
-  if (record_key == 1) rec = RECORD_KEY_1;
-  else if (record_key == 2) rec = RECORD_KEY_2;
-  else if (record_key == 3) rec = RECORD_KEY_3;
-  else if (record_key == 4) rec = RECORD_KEY_4;
-  else if (record_key == 5) rec = RECORD_KEY_5;
-  else if (record_key == 6) rec = RECORD_KEY_6;
-  else if (record_key == 7) rec = RECORD_KEY_7;
-  else if (record_key == 8) rec = RECORD_KEY_8;
-  else if (record_key == 9) rec = RECORD_KEY_9;
-
-  uint32_t ret_val;
-  fds_flash_record_t  flash_record;
-  fds_record_desc_t   record_desc_1;
-  fds_find_token_t    ftok;
+/**
+ * @brief Modify storage information
+ *
+ * Only the RAM copy changes here, it is written to flash once no other
+ * setting changed for CONFIG_COMMIT_DELAY.
+ *
+ * @param[in] id       New value
+ * @param[in] record   Setting number, 1 to CONFIG_SETTINGS
+ */
+void writeFlashID(uint32_t id, int record) {
 
-  /* It is required to zero the token before first use. */
-  memset(&ftok, 0x00, sizeof(fds_find_token_t));
+  switch (record) {
+    case 1:  m_config.node_id = id;     break;
+    case 2:  m_config.boot_mode = id;   break;
+    case 3:  m_config.rate = id;        break;
+    case 4:  m_config.channel = id;     break;
+    case 5:  m_config.timeout = id;     break;
+    case 6:  m_config.tx_power = id;    break;
+    case 7:  m_config.stream_mode = id; break;
+    case 8:  m_config.twr_mode = id;    break;
+    case 9:  m_config.led_mode = id;    break;
+    case 10: m_config.format = id;      break;
+    case 11: m_config.tdma_slot = id;   break;
+    case 12: m_config.rx_mode = id;     break;
+    case 13: m_config.reply_delay = id; break;
+    case 14: m_config.pwr_mode = id;    break;
+    case 15: m_config.sniff_duty = id;  break;
+    case 16: m_config.filter_mode = id; break;
+    case 17: m_config.poll_mode = id;   break;
+    case 18: m_config.autorate_min = id; break;
+    default: return;
+  }
 
-  while (fds_record_find(FILE_ID, rec, &record_desc_1, &ftok) == FDS_SUCCESS) {
-    
-    if (fds_record_open(&record_desc_1, &flash_record) != FDS_SUCCESS) {
-      printf("error opening\r\n"); /* Handle error. */
-    }
+  if (record > 16) {
+    m_config.present_ext |= 1 << (record - 17);
+  }
+  else {
+    m_config.present |= 1 << (record - 1);
+  }
+  config_schedule();
+}
 
-    /* Access the record through the flash_record structure. */
-    ret_val = atoi(flash_record.p_data);
+/**
+ * @brief Retrive storage information
+ *
+ * @param[in] record_key   Setting number, 1 to CONFIG_SETTINGS
+ *
+ * @return The value, 0 if the setting was not configured
+ */
+uint32_t getFlashID(uint32_t record_key) {
 
-    //printf("flash: %s \r\n", flash_record.p_data);
-    if (fds_record_close(&record_desc_1) != FDS_SUCCESS) {
-      printf("close error\r\n");  /* Handle error. */
-    }      
+  switch (record_key) {
+    case 1:  return m_config.node_id;
+    case 2:  return m_config.boot_mode;
+    case 3:  return m_config.rate;
+    case 4:  return m_config.channel;
+    case 5:  return m_config.timeout;
+    case 6:  return m_config.tx_power;
+    case 7:  return m_config.stream_mode;
+    case 8:  return m_config.twr_mode;
+    case 9:  return m_config.led_mode;
+    case 10: return m_config.format;
+    case 11: return m_config.tdma_slot;
+    case 12: return m_config.rx_mode;
+    case 13: return m_config.reply_delay;
+    case 14: return m_config.pwr_mode;
+    case 15: return m_config.sniff_duty;
+    case 16: return m_config.filter_mode;
+    case 17: return m_config.poll_mode;
+    case 18: return m_config.autorate_min;
+    default: return 0;
   }
-
-  return ret_val;
-}
\ No newline at end of file
+}
@@ -11,9 +11,14 @@
 #ifndef _FLASH_H_
 #define _FLASH_H_
 #include <stdint.h>
+#include <stdbool.h>
 #include "fds.h"
 
 #define FILE_ID         0x0015  /* The ID of the file to write the records into. */
+#define CONFIG_RECORD_KEY 0xC0F1  /* Key of the settings record */
+#define CONFIG_SETTINGS 18      /* Number of settings in the settings record */
+
+/* Keys of the one record per setting layout of older firmware, migrated at boot */
 #define RECORD_KEY_1    0x1111  /* A key for the first record. (ID) */
 #define RECORD_KEY_2    0x2222  /* A key for the second record. (BOOTMODE) */
 #define RECORD_KEY_3    0x3333  /* A key for the third record. (RATE)*/
@@ -23,8 +28,15 @@
 #define RECORD_KEY_7    0x7777  /* A key for the seventh record. (STREAMMODE)*/
 #define RECORD_KEY_8    0x8888  /* A key for the eighth record. (TWRMODE)*/
 #define RECORD_KEY_9    0x9999  /* A key for the ninth record. (LEDMODE)*/
+#define RECORD_KEY_10   0xAAAA  /* A key for the tenth record. (FORMAT)*/
+#define RECORD_KEY_11   0xBBBB  /* A key for the eleventh record. (TDMA slot)*/
+#define RECORD_KEY_12   0xCCCC  /* A key for the twelfth record. (RXMODE)*/
+#define RECORD_KEY_13   0xDDDD  /* A key for the thirteenth record. (Reply delay)*/
 
 void fds_evt_handler(fds_evt_t const * p_fds_evt);
+void flash_config_load(void);
+bool flash_config_has(int record);
+void flash_config_reset(void);
 void writeFlashID(uint32_t id, int record);
 uint32_t getFlashID(uint32_t record_key);
 
@@ -29,17 +29,20 @@
 #include "timers.h"
 #include "semphr.h"
 #include "random.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "uwb_calib.h"
+#include "uwb_power.h"
+#include "uwb_prof.h"
+#include "uwb_range.h"
 
 /* Frames used in the ranging process. See NOTE 1,2 below. */
-static uint8 tx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x61, 0, 0};
-static uint8 rx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x69, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static uint8 rx_report_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0xE3, 0, 0, 0, 0, 0, 0};
-
-/* Length of the common part of the message (up to and including the function code, see NOTE 1 below). */
-#define ALL_MSG_COMMON_LEN 10
-/* Indexes to access some of the fields in the frames defined above. */
-#define ALL_MSG_SN_IDX 2
+static uint8 tx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, FRAME_FUNC_POLL, 0, 0};
+static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, FRAME_FUNC_FINAL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8 tx_mpoll_msg[MPOLL_LEN(MTWR_MAX_RESPONDERS)] = {0x41, 0x88, 0, 0xCA, 0xDE, 0xFF, 0xFF, 0, 0, FRAME_FUNC_MPOLL};
+static uint8 tx_mfinal_msg[MFINAL_LEN(MTWR_MAX_RESPONDERS)] = {0x41, 0x88, 0, 0xCA, 0xDE, 0xFF, 0xFF, 0, 0, FRAME_FUNC_MFINAL};
+
+/* Indexes to access some of the fields in the frames defined above. Header fields are in uwb_frame.h. */
 #define RESP_MSG_POLL_RX_TS_IDX 10
 #define RESP_MSG_RESP_TX_TS_IDX 14
 #define FINAL_MSG_FINAL_TX_TS_IDX 18
@@ -50,28 +53,29 @@ static uint8 rx_report_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0
 #define RX_BUF_LEN 20
 static uint8 rx_buffer[RX_BUF_LEN];
 
-/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
-static uint32 status_reg = 0;
-
 /* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
 * 1 uus = 512 / 499.2 s and 1 s = 499.2 * 128 dtu. */
 #define UUS_TO_DWT_TIME 65536
 
-/* Speed of light in air, in metres per second. */
-#define SPEED_OF_LIGHT 299702547
-
 #define POLL_RX_TO_RESP_TX_DLY_UUS  1100
+/* Default response RX to final TX delay, until AT+CALIBRATE is run. */
+#define RESP_RX_TO_FINAL_TX_DLY_UUS 2000
 
+/* The final is prebuilt at this TX buffer offset while the poll is sent from offset 0. See NOTE 8 below. */
+#define FINAL_TX_BUF_OFFSET 128
 
-/* Hold copies of computed time of flight and distance here for reference so that it can be examined at a debug breakpoint. */
-static double tof;
-static double distance;
+
+/* Hold a copy of the computed distance here for reference so that it can be examined at a debug breakpoint. */
+static int32 distance;
 
 /* Declaration of static functions. */
 static void resp_msg_get_ts(uint8 *ts_field, uint32 *ts);
 static void resp_msg_set_ts(uint8 *ts_field, const uint64 ts);
 static uint64 get_tx_timestamp_u64(void);
 static uint64 get_rx_timestamp_u64(void);
+static int mtwr_rx_enable(uint32 end_time);
+static int mtwr_index(const uint16 *ids, int n, uint16 id);
+static void prof_rx_end(uint32 event);
 
 /* Delay between frames, in UWB microseconds. See NOTE 1 below. */
 //#define POLL_TX_TO_RESP_RX_DLY_UUS 100 
@@ -80,13 +84,11 @@ static uint64 get_rx_timestamp_u64(void);
 #define RESP_TX_TO_FINAL_RX_DLY_UUS 500
 #define FINAL_RX_TIMEOUT_UUS 4500
 
+/* Safety bound on waiting for a DW1000 event, in ticks. The DW1000 RX timeout normally fires first. */
+#define UWB_EVT_TIMEOUT_TICKS 10
+/* Same bound for the longer windows of a broadcast poll exchange. */
+#define MTWR_WAIT_TICKS 20
 
-APP_TIMER_DEF(tx_timekeeper);
-static int tx_time;
-static void tx_timer_function(void* p_context)
-{
-    tx_time = 1;   
-}
 
 /*! ------------------------------------------------------------------------------------------------------------------
 * @fn ds_init_run()
@@ -95,15 +97,10 @@ static void tx_timer_function(void* p_context)
 *
 * @param  node ID
 *
-* @return distance between sending nodes and id node
+* @return distance between sending nodes and id node in mm, UWB_RANGE_NONE on failure
 */
-double ds_init_run(uint8 id)
+int32 ds_init_run(uint16 id)
 {
-  static int total = 0;
-  static int success = 0;
-  printf("total: %d \r\n", total);
-  printf("success: %d \r\n", success);
-  
 
 //--
  // dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
@@ -113,12 +110,18 @@ double ds_init_run(uint8 id)
 //printf("DIS SMARTX: %x \r\n", dwt_read32bitreg(SYS_CFG_ID));
 
   /* Write frame data to DW1000 and prepare transmission. See NOTE 3 below. */
-  tx_poll_msg[ALL_MSG_SN_IDX] = id;
-  dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS); /* Clear Transmit sent frame flag */
+  uwb_frame_header(tx_poll_msg, id);
+  uwb_clear_events();
   dwt_writetxdata(sizeof(tx_poll_msg), tx_poll_msg, 0); /* Zero offset in TX buffer. */
   dwt_writetxfctrl(sizeof(tx_poll_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+  uwb_sniff_poll_preamble(); /* Long enough for sniffing responders. See NOTE 12 of resp_main.c. */
+
+  /* Prebuild the final, only its timestamps are written once the response arrives. */
+  uwb_frame_header(tx_final_msg, id);
+  dwt_writetxdata(sizeof(tx_final_msg), tx_final_msg, FINAL_TX_BUF_OFFSET);
 
   /* ----- Send Poll message ----- */
+  uwb_prof_start(); /* See NOTE 9 below. */
   int check_poll_msg = dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
   nrf_gpio_pin_set(12);
   
@@ -126,53 +129,50 @@ double ds_init_run(uint8 id)
   {
     if (debug_print) printf("Poll msg send success! \r\n");
 
-    /* Poll DW1000 until TX frame sent event set. See NOTE 5 below. */
-    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
-    {};
+    /* Block until the DW1000 reports TX frame sent. See NOTE 5 below. */
+    if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) == 0)
+    {
+      nrf_gpio_pin_clear(12);
+      uwb_prof_mark(UWB_PHASE_TIMEOUT);
+      dwt_forcetrxoff();
+      dwt_rxreset();
+      return UWB_RANGE_NONE;
+    }
     nrf_gpio_pin_clear(12);
-
-    /* Clear TXFRS event. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+    uwb_prof_mark(UWB_PHASE_POLL_TX);
   }
   else
   {
     if (debug_print) printf("Poll msg send fail! \r\n");
     nrf_gpio_pin_clear(12);
+    uwb_prof_mark(UWB_PHASE_FAIL);
     //dwt_rxreset();
-    return -1;
+    return UWB_RANGE_NONE;
   }
-
-  total++;
   
-  /*  Poll for reception of 1. a frame 2. error 3. timeout. See NOTE 4 below. */
-  while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-  {
-    nrf_gpio_pin_set(27);
-  };
+  /* Wait for reception of 1. a frame 2. error 3. timeout. See NOTE 4 below. */
+  nrf_gpio_pin_set(27);
+  uint32 event = uwb_wait_event(UWB_EVT_RX_ANY, UWB_EVT_TIMEOUT_TICKS);
   nrf_gpio_pin_clear(27);
 
-  /* Check the status register is a frame or not */
-  if (status_reg & SYS_STATUS_RXFCG)
+  /* Check the event is a frame or not */
+  if (event & UWB_EVT_RX_OK)
   {   
     uint32 frame_len;
 
-    /* Clear good RX frame event in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
-
     /* A frame has been received, read it into the local buffer. */
-    frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+    frame_len = uwb_rx_length();
 
     if (frame_len <= RX_BUF_LEN)
     {
       dwt_readrxdata(rx_buffer, frame_len, 0);
     }
 
-    /* Check that the frame is the expected response from the companion frame and extract ID from sender's message */
-    int got = rx_buffer[ALL_MSG_SN_IDX];
-    rx_buffer[ALL_MSG_SN_IDX] = 0;
-    if ((got == id) && memcmp(rx_buffer, rx_resp_msg, ALL_MSG_COMMON_LEN) == 0)
+    /* Check that the frame is the expected response from the polled node. Frames for other nodes are dropped by the DW1000 frame filter. */
+    if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_RESP, id))
     { 
       if (debug_print) printf("Second msg receive \r\n");
+      uwb_prof_mark(UWB_PHASE_RESP_RX);
 
       /* Retrieve poll transmission and response reception timestamps. See NOTE 4 below. */
       uint64 poll_tx_ts, resp_rx_ts;
@@ -183,7 +183,7 @@ double ds_init_run(uint8 id)
 
       uint32 resp_tx_time;
       //resp_tx_time = (resp_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
-      resp_tx_time = (resp_rx_ts + (2000 * UUS_TO_DWT_TIME)) >> 8;
+      resp_tx_time = (resp_rx_ts + ((uint64)uwb_reply_delay(RESP_RX_TO_FINAL_TX_DLY_UUS) * UUS_TO_DWT_TIME)) >> 8;
       dwt_setdelayedtrxtime(resp_tx_time);
 
       /* Response TX timestamp is the transmission time we programmed plus the antenna delay. */
@@ -201,10 +201,9 @@ double ds_init_run(uint8 id)
       resp_msg_set_ts(&tx_final_msg[RESP_MSG_RESP_TX_TS_IDX], resp_rx_ts);
       resp_msg_set_ts(&tx_final_msg[FINAL_MSG_FINAL_TX_TS_IDX], ts_replyA_end);
 
-      /* Write and send the response message. */
-      tx_final_msg[ALL_MSG_SN_IDX] = id;
-      dwt_writetxdata(sizeof(tx_final_msg), tx_final_msg, 0); /* Zero offset in TX buffer. See Note 5 below.*/
-      dwt_writetxfctrl(sizeof(tx_final_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+      /* Write the timestamps into the prebuilt final and send it. */
+      dwt_writetxdata(3 * RESP_MSG_TS_LEN + 2, &tx_final_msg[RESP_MSG_POLL_RX_TS_IDX], FINAL_TX_BUF_OFFSET + RESP_MSG_POLL_RX_TS_IDX);
+      dwt_writetxfctrl(sizeof(tx_final_msg), FINAL_TX_BUF_OFFSET, 1); /* Ranging. */
       
       /* Send Final message */
       int ret = dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
@@ -215,64 +214,51 @@ double ds_init_run(uint8 id)
       {
         if (debug_print) printf("Final message sent! \r\n");
 
-        /* Poll DW1000 until TX frame sent event set. See NOTE 5 below. */
-        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
-        {};
+        /* Block until the DW1000 reports TX frame sent. See NOTE 5 below. */
+        if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) == 0)
+        {
+          nrf_gpio_pin_clear(12);
+          uwb_prof_mark(UWB_PHASE_TIMEOUT);
+          dwt_forcetrxoff();
+          dwt_rxreset();
+          return UWB_RANGE_NONE;
+        }
         nrf_gpio_pin_clear(12);
-
-        /* Clear TXFRS event. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
-
+        uwb_prof_mark(UWB_PHASE_FINAL_TX);
       }
       else
       {
         if (debug_print) printf("Final msg error! \r\n");
         nrf_gpio_pin_clear(12);
+        uwb_prof_mark(UWB_PHASE_FAIL);
         /* Reset RX to properly reinitialise LDE operation. */
         //dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
         dwt_rxreset();
-        return -1;
+        return UWB_RANGE_NONE;
       }
 
 
       /* ------ Receive Report message ------ */
       
-      /* Poll for reception of a frame or error/timeout. See NOTE 5 below. */
-      while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-      {
-        nrf_gpio_pin_set(27);
-      };
+      /* Wait for reception of a frame or error/timeout. See NOTE 5 below. */
+      nrf_gpio_pin_set(27);
+      event = uwb_wait_event(UWB_EVT_RX_ANY, UWB_EVT_TIMEOUT_TICKS);
       nrf_gpio_pin_clear(27);
 
-        #if 0	  // Include to determine the type of timeout if required.
-        int temp = 0;
-        // (frame wait timeout and preamble detect timeout)
-        if(status_reg & SYS_STATUS_RXRFTO )
-        temp =1;
-        else if(status_reg & SYS_STATUS_RXPTO )
-        temp =2;
-        #endif
-
-      if (status_reg & SYS_STATUS_RXFCG)
+      if (event & UWB_EVT_RX_OK)
       {
         uint32 frame_len;
 
-        /* Clear good RX frame event in the DW1000 status register. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
-
         /* A frame has been received, read it into the local buffer. */
-        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-        if (frame_len <= RX_BUFFER_LEN)
+        frame_len = uwb_rx_length();
+        if (frame_len <= RX_BUF_LEN)
         {
           dwt_readrxdata(rx_buffer, frame_len, 0);
         }
 
 
-        /* Check that the frame is a poll sent by "SS TWR initiator" example.
-        * As the sequence number field of the frame is not relevant, it is cleared to simplify the validation of the frame. */
-        int got = rx_buffer[ALL_MSG_SN_IDX];
-        rx_buffer[ALL_MSG_SN_IDX] = 0;
-        if ((got == id) && memcmp(rx_buffer, rx_report_msg, ALL_MSG_COMMON_LEN) == 0)
+        /* Check that the frame is the report of the polled node. */
+        if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_REPORT, id))
         {
           if (debug_print) printf("Report msg receive \r\n");
 
@@ -281,12 +267,12 @@ double ds_init_run(uint8 id)
           /* Get timestamps embedded in response message. */
           resp_msg_get_ts(&rx_buffer[RESP_MSG_POLL_RX_TS_IDX], &msg_tof_dtu);
 
-          /* Compute time of flight and distance, using clock offset ratio to correct for differing local and remote clock rates */
-          tof = msg_tof_dtu * DWT_TIME_UNITS;
-          distance = tof * SPEED_OF_LIGHT;
+          /* Compute the distance from the time of flight computed by the responder. See NOTE 10 below. */
+          distance = uwb_range_mm(msg_tof_dtu);
           
-          //printf("SDS-TWR Distance : %f\r\n", distance);
-          success++;
+          //printf("SDS-TWR Distance : %ld mm\r\n", distance);
+          uwb_prof_mark(UWB_PHASE_REPORT_RX);
+          uwb_prof_done();
           return distance; 
         }
         else
@@ -297,13 +283,12 @@ double ds_init_run(uint8 id)
         }
 
       }
-      else
+      else if (event == 0)
       {
         //if (debug_print) printf("init rx fail\r\n");
 
-        /* Clear RX error events in the DW1000 status register. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
-  
+        /* No event from the DW1000, the RX error/timeout events were already handled by dwt_isr(). */
+        dwt_forcetrxoff();
         dwt_rxreset();
       }
     }
@@ -314,18 +299,170 @@ double ds_init_run(uint8 id)
 //      return -1;
     }
   }
-  else
+  else if (event == 0)
   {
-    
-    /* Clear RX error/timeout events in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+    /* No event from the DW1000, the RX error/timeout events were already handled by dwt_isr(). */
+    dwt_forcetrxoff();
+    dwt_rxreset();
+  }
+
+  prof_rx_end(event);
+  return UWB_RANGE_NONE;
+}
 
-    /* Reset RX to properly reinitialise LDE operation. */
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn ds_init_run_multi()
+*
+* @brief Initiate UWB double-sided two way ranging with several nodes at once. A broadcast poll lists the nodes, which
+*        respond in turn, one broadcast final carries the reception time of every response and the nodes report their
+*        time of flight in turn. See NOTE 7 below.
+*
+* @param  ids     node IDs, at most MTWR_MAX_RESPONDERS
+*         n       number of node IDs
+*         ranges  distance to each node in mm, UWB_RANGE_NONE when the node did not answer
+*
+* @return number of nodes ranged
+*/
+int ds_init_run_multi(const uint16 *ids, int n, int32 *ranges)
+{
+  uint32 resp_rx_ts[MTWR_MAX_RESPONDERS];
+  int got_resp = 0;
+  int got_report = 0;
+  uint32 event;
+
+  if (n > MTWR_MAX_RESPONDERS) n = MTWR_MAX_RESPONDERS;
+
+  for (int i = 0; i < n; i++) {
+    resp_rx_ts[i] = 0;
+    ranges[i] = UWB_RANGE_NONE;
+  }
+
+  /* ----- Send broadcast Poll message listing the responders ----- */
+  uwb_frame_header(tx_mpoll_msg, UWB_ADDR_BROADCAST);
+  tx_mpoll_msg[MPOLL_N_IDX] = n;
+  for (int i = 0; i < n; i++) {
+    tx_mpoll_msg[MPOLL_ID_IDX + 2 * i] = ids[i] & 0xFF;
+    tx_mpoll_msg[MPOLL_ID_IDX + 2 * i + 1] = ids[i] >> 8;
+  }
+
+  uwb_clear_events();
+  dwt_writetxdata(MPOLL_LEN(n), tx_mpoll_msg, 0); /* Zero offset in TX buffer. */
+  dwt_writetxfctrl(MPOLL_LEN(n), 0, 1); /* Zero offset in TX buffer, ranging. */
+  uwb_sniff_poll_preamble(); /* Long enough for sniffing responders. See NOTE 12 of resp_main.c. */
+
+  /* Listen for the whole response window, the receiver is re-enabled after each response. */
+  dwt_setrxtimeout(MTWR_RESP_DLY_UUS + n * MTWR_SLOT_UUS);
+  if (dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS)
+  {
+    if (debug_print) printf("Poll msg send fail! \r\n");
+    return 0;
+  }
+
+  if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) == 0)
+  {
+    dwt_forcetrxoff();
     dwt_rxreset();
+    return 0;
+  }
 
+  uint64 poll_tx_ts = get_tx_timestamp_u64();
+  uint32 resp_end = (uint32)(poll_tx_ts >> 8) + (MTWR_RESP_DLY_UUS + n * MTWR_SLOT_UUS) * (UUS_TO_DWT_TIME >> 8);
+
+  /* ----- Collect the staggered Response messages ----- */
+  while (got_resp < n)
+  {
+    event = uwb_wait_event(UWB_EVT_RX_ANY, MTWR_WAIT_TICKS);
+    if (event == 0 || (event & UWB_EVT_RX_TO)) break;
+
+    if (event & UWB_EVT_RX_OK)
+    {
+      uint32 frame_len = uwb_rx_length();
+      if (frame_len <= RX_BUF_LEN)
+      {
+        dwt_readrxdata(rx_buffer, frame_len, 0);
+        if (uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_RESP, UWB_ADDR_BROADCAST))
+        {
+          int idx = mtwr_index(ids, n, uwb_frame_src(rx_buffer));
+          if (idx >= 0 && resp_rx_ts[idx] == 0)
+          {
+            resp_rx_ts[idx] = (uint32)get_rx_timestamp_u64();
+            got_resp++;
+          }
+        }
+      }
+    }
+
+    if (got_resp < n && mtwr_rx_enable(resp_end) != DWT_SUCCESS) break;
   }
+  dwt_forcetrxoff();
 
-  return -1;
+  if (got_resp == 0) return 0;
+
+  /* ----- Send broadcast Final message with all response timestamps ----- */
+  uint32 final_tx_time = resp_end + MTWR_FINAL_DLY_UUS * (UUS_TO_DWT_TIME >> 8);
+  uint64 final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
+  dwt_setdelayedtrxtime(final_tx_time);
+
+  resp_msg_set_ts(&tx_mfinal_msg[MFINAL_POLL_TX_IDX], poll_tx_ts);
+  resp_msg_set_ts(&tx_mfinal_msg[MFINAL_FINAL_TX_IDX], final_tx_ts);
+  tx_mfinal_msg[MFINAL_N_IDX] = n;
+  for (int i = 0; i < n; i++) {
+    resp_msg_set_ts(&tx_mfinal_msg[MFINAL_RESP_RX_IDX + 4 * i], resp_rx_ts[i]);
+  }
+
+  uwb_frame_header(tx_mfinal_msg, UWB_ADDR_BROADCAST);
+  dwt_writetxdata(MFINAL_LEN(n), tx_mfinal_msg, 0); /* Zero offset in TX buffer. */
+  dwt_writetxfctrl(MFINAL_LEN(n), 0, 1); /* Zero offset in TX buffer, ranging. */
+
+  dwt_setrxtimeout(MTWR_RESP_DLY_UUS + n * MTWR_SLOT_UUS);
+  if (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS)
+  {
+    if (debug_print) printf("Final msg error! \r\n");
+    dwt_rxreset();
+    return 0;
+  }
+
+  if (uwb_wait_event(UWB_EVT_TX_DONE, MTWR_WAIT_TICKS) == 0)
+  {
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    return 0;
+  }
+
+  uint32 report_end = final_tx_time + (MTWR_RESP_DLY_UUS + n * MTWR_SLOT_UUS) * (UUS_TO_DWT_TIME >> 8);
+
+  /* ----- Collect the staggered Report messages ----- */
+  while (got_report < got_resp)
+  {
+    event = uwb_wait_event(UWB_EVT_RX_ANY, MTWR_WAIT_TICKS);
+    if (event == 0 || (event & UWB_EVT_RX_TO)) break;
+
+    if (event & UWB_EVT_RX_OK)
+    {
+      uint32 frame_len = uwb_rx_length();
+      if (frame_len <= RX_BUF_LEN)
+      {
+        dwt_readrxdata(rx_buffer, frame_len, 0);
+        if (uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_REPORT, UWB_ADDR_BROADCAST))
+        {
+          int idx = mtwr_index(ids, n, uwb_frame_src(rx_buffer));
+          if (idx >= 0 && ranges[idx] == UWB_RANGE_NONE)
+          {
+            uint32 msg_tof_dtu;
+            resp_msg_get_ts(&rx_buffer[RESP_MSG_POLL_RX_TS_IDX], &msg_tof_dtu);
+            ranges[idx] = uwb_range_mm(msg_tof_dtu);
+            got_report++;
+          }
+        }
+      }
+    }
+
+    if (got_report < got_resp && mtwr_rx_enable(report_end) != DWT_SUCCESS) break;
+  }
+  dwt_forcetrxoff();
+
+  return got_report;
 }
 
 
@@ -336,58 +473,61 @@ double ds_init_run(uint8 id)
 *
 * @param  node ID
 *
-* @return distance between sending nodes and id node
+* @return distance between sending nodes and id node in mm, UWB_RANGE_NONE on failure
 */
-double ss_init_run(uint8 id)
+int32 ss_init_run(uint16 id)
 {
 
   /* Write frame data to DW1000 and prepare transmission. See NOTE 3 below. */
-  tx_poll_msg[ALL_MSG_SN_IDX] = id;
-  dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+  uwb_frame_header(tx_poll_msg, id);
+  uwb_clear_events();
   dwt_writetxdata(sizeof(tx_poll_msg), tx_poll_msg, 0); /* Zero offset in TX buffer. */
   dwt_writetxfctrl(sizeof(tx_poll_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+  uwb_sniff_poll_preamble(); /* Long enough for sniffing responders. See NOTE 12 of resp_main.c. */
 
   /* Start transmission, indicating that a response is expected so that reception is enabled automatically after the frame is sent and the delay
   * set by dwt_setrxaftertxdelay() has elapsed. */
+  uwb_prof_start(); /* See NOTE 9 below. */
   int c = dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+  if (c != DWT_SUCCESS)
+  {
+    uwb_prof_mark(UWB_PHASE_FAIL);
+    return UWB_RANGE_NONE;
+  }
 
   if (debug_print) printf("sent tx\r\n");
   
 
   if (debug_print) printf("Waiting for rx\r\n");
-  while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-  {};
+  uint32 event = uwb_wait_event(UWB_EVT_RX_ANY, UWB_EVT_TIMEOUT_TICKS);
 
-    if (status_reg & SYS_STATUS_RXFCG)
+    if (event & UWB_EVT_RX_OK)
     {   
       uint32 frame_len;
-      dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
 
       /* A frame has been received, read it into the local buffer. */
-      frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+      frame_len = uwb_rx_length();
       if (frame_len <= RX_BUF_LEN)
       {
         dwt_readrxdata(rx_buffer, frame_len, 0);
       }
 
-    /* Check that the frame is the expected response from the companion "SS TWR responder" example.
-    * As the sequence number field of the frame is not relevant, it is cleared to simplify the validation of the frame. */   
-    int got = rx_buffer[ALL_MSG_SN_IDX];
-    rx_buffer[ALL_MSG_SN_IDX] = 0;
-    if ((got == id) && memcmp(rx_buffer, rx_resp_msg, ALL_MSG_COMMON_LEN) == 0)
+    /* Check that the frame is the expected response from the polled node. */
+    if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_RESP, id))
     { 
       if (debug_print) printf("init rx succ\r\n");
+      uwb_prof_mark(UWB_PHASE_RESP_RX);
  
       uint32 poll_tx_ts, resp_rx_ts, poll_rx_ts, resp_tx_ts;
       int32 rtd_init, rtd_resp;
-      float clockOffsetRatio ;
+      int32 carrier_int;
 
       /* Retrieve poll transmission and response reception timestamps. See NOTE 4 below. */
       poll_tx_ts = dwt_readtxtimestamplo32();
       resp_rx_ts = dwt_readrxtimestamplo32();
 
-      /* Read carrier integrator value and calculate clock offset ratio. See NOTE 6 below. */
-      clockOffsetRatio = dwt_readcarrierintegrator() * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_5 / 1.0e6) ;
+      /* Read carrier integrator value, the clock offset ratio is derived from it. See NOTE 6 below. */
+      carrier_int = dwt_readcarrierintegrator();
 
       /* Get timestamps embedded in response message. */
       resp_msg_get_ts(&rx_buffer[RESP_MSG_POLL_RX_TS_IDX], &poll_rx_ts);
@@ -397,8 +537,8 @@ double ss_init_run(uint8 id)
       rtd_init = resp_rx_ts - poll_tx_ts;
       rtd_resp = resp_tx_ts - poll_rx_ts;
 
-      tof = ((rtd_init - rtd_resp * (1.0f - clockOffsetRatio)) / 2.0f) * DWT_TIME_UNITS; // Specifying 1.0f and 2.0f are floats to clear warning 
-      distance = tof * SPEED_OF_LIGHT;   
+      distance = uwb_range_ss_mm(rtd_init, rtd_resp, carrier_int); /* See NOTE 10 below. */
+      uwb_prof_done();
       return distance;
       
     }
@@ -409,20 +549,82 @@ double ss_init_run(uint8 id)
 
    }
 
-  else
+  else if (event == 0)
   {
-    /* Clear RX error/timeout events in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
-
-    /* Reset RX to properly reinitialise LDE operation. */
+    /* No event from the DW1000, the RX error/timeout events were already handled by dwt_isr(). */
+    dwt_forcetrxoff();
     dwt_rxreset();
   }
 
-    return -1;
+    prof_rx_end(event);
+    return UWB_RANGE_NONE;
 }
 
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn prof_rx_end()
+*
+* @brief Count an exchange that ended while waiting for a frame as a timeout or a failure
+*
+* @param  event  events returned by the last wait, 0 if it timed out
+*
+* @return none
+*/
+static void prof_rx_end(uint32 event)
+{
+  if (event & (UWB_EVT_RX_OK | UWB_EVT_RX_ERR))
+  {
+    /* An RX error, or a frame that is not the expected one */
+    uwb_prof_mark(UWB_PHASE_FAIL);
+  }
+  else
+  {
+    uwb_prof_mark(UWB_PHASE_TIMEOUT);
+  }
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn mtwr_rx_enable()
+*
+* @brief Re-enable the receiver until a given DW1000 time, for the rest of a response or report window
+*
+* @param  end_time  end of the window, in the units of dwt_setdelayedtrxtime()
+*
+* @return DWT_SUCCESS, or DWT_ERROR if the window is over
+*/
+static int mtwr_rx_enable(uint32 end_time)
+{
+  int32 remaining = (int32)(end_time - dwt_readsystimestamphi32()) / (UUS_TO_DWT_TIME >> 8);
+
+  if (remaining <= 0) return DWT_ERROR;
+
+  dwt_setrxtimeout((uint16)remaining);
+  return dwt_rxenable(DWT_START_RX_IMMEDIATE);
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn mtwr_index()
+*
+* @brief Position of a node in the responder list of a broadcast poll
+*
+* @param  ids  node IDs
+*         n    number of node IDs
+*         id   node ID to look for
+*
+* @return position in the list, or -1 if the node is not listed
+*/
+static int mtwr_index(const uint16 *ids, int n, uint16 id)
+{
+  for (int i = 0; i < n; i++) {
+    if (ids[i] == id) return i;
+  }
+  return -1;
+}
+
+
 /*! ------------------------------------------------------------------------------------------------------------------
 * @fn resp_msg_get_ts()
 *
@@ -539,9 +741,8 @@ static uint64 get_rx_timestamp_u64(void)
 *     - byte 10 -> 13: poll message reception timestamp.
 *     - byte 14 -> 17: response message transmission timestamp.
 *    All messages end with a 2-byte checksum automatically set by DW1000.
-* 2. Source and destination addresses are hard coded constants in this example to keep it simple but for a real product every device should have a
-*    unique ID. Here, 16-bit addressing is used to keep the messages as short as possible but, in an actual application, this should be done only
-*    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange.
+* 2. Source and destination addresses are the 16-bit node IDs set with AT+ID. The same ID is programmed as the DW1000 short address and frame
+*    filtering is enabled (see uwb_frame.c), so frames addressed to other nodes are rejected by the DW1000 without waking up the host.
 * 3. dwt_writetxdata() takes the full size of the message as a parameter but only copies (size - 2) bytes as the check-sum at the end of the frame is
 *    automatically appended by the DW1000. This means that our variable could be two bytes shorter without losing any data (but the sizeof would not
 *    work anymore then as we would still have to indicate the full length of the frame to dwt_writetxdata()).
@@ -553,5 +754,19 @@ static uint64 get_rx_timestamp_u64(void)
 * 6. The use of the carrier integrator value to correct the TOF calculation, was added Feb 2017 for v1.3 of this example.  This significantly
 *     improves the result of the SS-TWR where the remote responder unit's clock is a number of PPM offset from the local inmitiator unit's clock.
 *     As stated in NOTE 2 a fixed offset in range will be seen unless the antenna delsy is calibratred and set correctly.
+* 7. In broadcast poll DS-TWR (AT+TWRMODE 2) one exchange ranges with up to MTWR_MAX_RESPONDERS nodes in N+2 frames instead of 4N:
+*     - a broadcast poll lists the responder IDs, the position of a node in the list is its slot.
+*     - responder i sends its response MTWR_RESP_DLY_UUS + i * MTWR_SLOT_UUS after receiving the poll. The slot must cover the response air
+*       time plus the time for the initiator to read the frame and re-enable its receiver.
+*     - a broadcast final carries the poll TX, final TX and every response RX timestamp (0 for a missed response), so each responder can
+*       compute its own DS-TWR time of flight.
+*     - responder i sends its report with the same delay after receiving the final.
+* 8. Reply frames are written to the DW1000 TX buffer before the frame they answer arrives, at an offset of their own, so that only the
+*    timestamp bytes are written (dwt_writetxdata() at an offset, 2 bytes more than written for the CRC) between reception and the delayed
+*    transmission. The reply delay can then be as short as the calibrated firmware turnaround, see uwb_calib.c and AT+CALIBRATE.
+* 9. Each phase of an exchange is stamped with the DW1000 system time into latency histograms (see uwb_prof.c and AT+RNGSTATS), replacing the
+*    per-exchange prints. A stamp is a 4-byte SPI read taken after the awaited event, so it adds a few microseconds to the exchange.
+*10. Time of flight and distance are computed with 64-bit integers in uwb_range.c, as the FPU only handles single precision and double math
+*    runs in software. Distances are in millimetres, within 1 mm of the double precision computation of the DecaWave examples.
 *
 ****************************************************************************************************************************************************/
@@ -18,8 +18,9 @@ extern SemaphoreHandle_t rxSemaphore, txSemaphore, sus_resp, sus_init;
 extern int debug_print;
 extern uint16_t NODE_UUID;
 
-double ds_init_run(uint8 id);
-double ss_init_run(uint8 id);
+int32 ds_init_run(uint16 id);
+int ds_init_run_multi(const uint16 *ids, int n, int32 *ranges);
+int32 ss_init_run(uint16 id);
 
 
 
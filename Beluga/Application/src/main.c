@@ -7,6 +7,9 @@
  *  @author WiseLab-CMU 
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 /* Inlcudes for BLE library */
 #include "ble_types.h"
 #include "ble_gap.h"
@@ -27,7 +30,6 @@
 #include "nrf_delay.h"
 #include "nrf.h"
 #include "app_error.h"
-#include "app_uart.h"
 #include "port_platform.h"
 #include "deca_types.h"
 #include "deca_param_types.h"
@@ -47,6 +49,22 @@
 #include "uart.h"
 #include "ble_app.h"
 #include "random.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "stream.h"
+#include "tdma.h"
+#include "uwb_calib.h"
+#include "boot_time.h"
+#include "timestamp.h"
+#include "uwb_power.h"
+#include "task_stats.h"
+#include "uwb_prof.h"
+#include "uwb_range.h"
+#include "range_bench.h"
+#include "range_filter.h"
+#include "poll_select.h"
+#include "rate_ctl.h"
+#include "at_cmd.h"
 
 #if defined (UART_PRESENT)
 #include "nrf_uart.h"
@@ -67,23 +85,33 @@
 /* Delay between frames, in UWB microseconds. See NOTE 1 below. */
 #define POLL_TX_TO_RESP_RX_DLY_UUS 100 
 
+/* Period of folding the DW1000 event counters into the RX statistics, in ticks */
+#define RX_STATS_PERIOD 1000
+
+/* Longest sleep of the suspended responder, below the 2 s watchdog timeout */
+#define RESP_SUSPEND_WAIT pdMS_TO_TICKS(1000)
+
+/* Plausible ranges in mm, others are dropped */
+#define RANGE_MIN_MM (-5000)
+#define RANGE_MAX_MM 100000
+
 
 static int mode;
 
 extern ble_uuid_t m_adv_uuids[2];
-extern node seen_list[MAX_ANCHOR_COUNT];
 extern int ble_started;
 static int uwb_started;
-extern uint32_t time_keeper;
-extern int node_added;
 
 int debug_print;
 int streaming_mode;
+int output_format;
 int twr_mode;
+int rx_mode;
+int pwr_mode;
+int filter_mode;
 int leds_mode;
 
 SemaphoreHandle_t rxSemaphore, txSemaphore, sus_resp, sus_init, print_list_sem;
-QueueHandle_t uart_queue;
 
 static int initiator_freq = 100;
 static int time_out = 9000;
@@ -107,9 +135,6 @@ enum pgdelay_ch uwb_pgdelay;
  *               Timer functions                *
  ***********************************************/
 
-APP_TIMER_DEF(m_timestamp_keeper);    /**< Handler for repeated timer used to blink LED 1. */
-
-
 /**
  * @brief Function for initializing the timer.
  */
@@ -121,14 +146,6 @@ static void timer_init(void)
     APP_ERROR_CHECK(err_code);
 }
 
-/**
- * @brief Timeout handler for the repeated timer.
- */
-static void timestamp_handler(void * p_context)
-{ 
-    time_keeper += 1; 
-}
-
 /**
  * @brief Watchdog handler when watchdog timer expire.
  */
@@ -169,6 +186,9 @@ dwt_txconfig_t config_tx = {
  */
 void init_reconfig() {
 
+  // The initiator reads frames from the DW1000 directly
+  uwb_rx_continuous(false);
+  uwb_sniff_rx(false);
   dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
   dwt_setrxtimeout(2000);
 
@@ -208,6 +228,55 @@ void ble_task_fuction(void * pvParameter) {
 
 }
 
+/**
+ * @brief Output one neighbor of the seen list in the format set by AT+FORMAT
+ *
+ * @param[in] j   Slot of the neighbor in seen list
+ */
+static void print_node(int j)
+{
+  node n;
+
+  // Skip an entry being written, it is printed with the next list
+  if (!neighbor_read(j, &n)) return;
+
+  int quality = (filter_mode != RANGE_FILTER_OFF) ? range_filter_quality(&n.filter) : -1;
+
+  if (output_format == 1) {
+    stream_add_range(n.UUID, n.range, n.RSSI, n.time_stamp, quality);
+  }
+  else {
+    char line[56];
+    int len;
+
+    if (quality < 0) {
+      len = snprintf(line, sizeof(line), "%d, %f, %d, %d \r\n", n.UUID, n.range, n.RSSI, n.time_stamp);
+    }
+    else {
+      len = snprintf(line, sizeof(line), "%d, %f, %d, %d, %d \r\n", n.UUID, n.range, n.RSSI, n.time_stamp, quality);
+    }
+    if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+    if (len > 0) (void) uart_write(UART_CH_STREAM, (const uint8_t *)line, len);
+  }
+}
+
+/**
+ * @brief Output the header line of the text neighbor list
+ */
+static void print_list_header(void)
+{
+  static const char header[] = "# ID, RANGE, RSSI, TIMESTAMP\r\n";
+  static const char header_q[] = "# ID, RANGE, RSSI, TIMESTAMP, QUALITY\r\n";
+
+  if (output_format != 0) return;
+  if (filter_mode == RANGE_FILTER_OFF) {
+    (void) uart_write(UART_CH_STREAM, (const uint8_t *)header, sizeof(header) - 1);
+  }
+  else {
+    (void) uart_write(UART_CH_STREAM, (const uint8_t *)header_q, sizeof(header_q) - 1);
+  }
+}
+
 /**
  * @brief Task to print out visible nodes information
  *
@@ -218,21 +287,25 @@ void list_task_function(void * pvParameter)
 
   while(1){
       
-      vTaskDelay(50);
+      // Streaming mode only prints new ranges, so sleep until the ranging task has some
+      if (streaming_mode == 1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+      else {
+        vTaskDelay(50);
+      }
       if (debug_print == 1) printf("list task in \r\n");
       
       xSemaphoreTake(print_list_sem, portMAX_DELAY);
       
-      message new_message = {0};
-
       /* Normal mode to print all neighbor nodes */
       if (streaming_mode == 0) {
-        printf("# ID, RANGE, RSSI, TIMESTAMP\r\n");
+        print_list_header();
 
-        for(int j = 0; j < MAX_ANCHOR_COUNT; j++)
+        for(int r = 0; r < neighbor_count(); r++)
         {
-          if(seen_list[j].UUID != 0) printf("%d, %f, %d, %d \r\n", seen_list[j].UUID, seen_list[j].range, seen_list[j].RSSI, seen_list[j].time_stamp); 
-          //if(seen_list[j].UUID != 0) printf("%f \r\n", seen_list[j].range); 
+          int j = neighbor_at_rank(r);
+          if(j >= 0) print_node(j); 
         }
       }
 
@@ -243,443 +316,799 @@ void list_task_function(void * pvParameter)
         // Check whether alive nodes have update flag or not
         for(int i = 0; i < MAX_ANCHOR_COUNT; i++)
         {
-          if(seen_list[i].UUID != 0 && seen_list[i].update_flag != 0) {
+          if(seen_list[i].UUID != 0 && (seen_list[i].flags & NEIGHBOR_UPDATED)) {
             count_flag++;
           }      
         }
         // If one of node has update flag, print it
         if (count_flag != 0) {
-          printf("# ID, RANGE, RSSI, TIMESTAMP\r\n");
+          print_list_header();
 
-          for(int j = 0; j < MAX_ANCHOR_COUNT; j++)
+          for(int r = 0; r < neighbor_count(); r++)
           {
-            if(seen_list[j].UUID != 0 && seen_list[j].update_flag == 1) printf("%d, %f, %d, %d \r\n", seen_list[j].UUID, seen_list[j].range, seen_list[j].RSSI, seen_list[j].time_stamp); 
-            
-            // Reset update flag of the node
-            seen_list[j].update_flag = 0;
+            int j = neighbor_at_rank(r);
+            if(j < 0) continue;
+            if(seen_list[j].flags & NEIGHBOR_UPDATED) {
+              // Reset update flag of the node first, a range stored meanwhile sets it again
+              neighbor_flag_clear(j, NEIGHBOR_UPDATED);
+              print_node(j);
+            }
           }
         }
       }
       
+      // Send the last partial batch in binary format
+      if (output_format == 1) stream_flush();
+
       if (debug_print == 1) printf("list task out \r\n");
       xSemaphoreGive(print_list_sem);
    }
 }
 
 
+/************************************************
+ *               AT command handlers            *
+ ***********************************************/
+
+/* Size of the task list read for the idle ratio */
+#define IDLE_STAT_MAX_TASKS  12
+
+static bool radio_resp_taken;    /**< uwb_radio_take() suspended responding */
+static bool radio_was_asleep;    /**< uwb_radio_take() woke the DW1000 up */
+
 /**
- * @brief Task to receive UART message from freertos UART queue and parse
+ * @brief Take the radio from the ranging tasks, it is already free when UWB is stopped
  *
- * @param[in] pvParameter   Pointer that will be used as the parameter for the task.
+ * The responder holds sus_init while it uses the DW1000, so waiting for
+ * sus_init after suspending responding waits for the responder to leave
+ * its SPI transactions. The DW1000 is woken up if it sleeps.
  */
-void uart_task_function(void * pvParameter){
+static void uwb_radio_take(void)
+{
+  radio_resp_taken = false;
+  if (uwb_started == 1) {
+    radio_resp_taken = (xSemaphoreTake(sus_resp, 0) == pdTRUE);
+    uwb_cancel_wait(responder_task_handle);
+    xSemaphoreTake(sus_init, portMAX_DELAY);
+  }
+  radio_was_asleep = uwb_asleep();
+  (void) uwb_wake();
+}
 
-  UNUSED_PARAMETER(pvParameter);
+/**
+ * @brief Hand the radio back to the ranging tasks
+ *
+ * Responding is only resumed, and the DW1000 only put back to sleep, if
+ * uwb_radio_take() changed them.
+ */
+static void uwb_radio_give(void)
+{
+  if (radio_was_asleep) uwb_sleep();
+  if (uwb_started == 1) {
+    xSemaphoreGive(sus_init);
+    if (radio_resp_taken) xSemaphoreGive(sus_resp);
+  }
+}
 
-  message incoming_message = {0};
+static void at_autorate(const at_args_t *args)
+{
+  rate_ctl_stats_t stats;
 
-  while(1) {
-    vTaskDelay(100);
-    if (debug_print == 1) printf("uart task in \r\n");
-    
-    if(xQueueReceive(uart_queue, &incoming_message, 0) == pdPASS) {  
+  if (args->given) {
+    if (args->value < 0 || args->value > 500) {
+      printf("Autorate parameter input error \r\n");
+      return;
+    }
 
-      //Handle valid AT command begining with AT+
+    writeFlashID(args->value, 18);
+    rate_ctl_set_min(args->value);
+  }
 
-      if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+", (size_t)3)) {
-        
-        //Handle specific AT commands
-        if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+STARTUWB", (size_t)11)) {
-            
-            uwb_started = 1;
-            // Give the suspension semaphore so UWB can continue
-            xSemaphoreGive(sus_resp);
-            xSemaphoreGive(sus_init);
-            if (leds_mode == 0) bsp_board_led_on(BSP_BOARD_LED_2);
-            printf("OK \r\n");
-           
-        }
+  rate_ctl_stats_get(initiator_freq, &stats);
+  if (stats.min_ms == 0) {
+    printf("Autorate: off, period: %lu ms \r\n", stats.period_ms);
+  }
+  else {
+    printf("Autorate: %lu - %d ms, period: %lu ms \r\n", stats.min_ms, initiator_freq, stats.period_ms);
+  }
+  printf("Success: %lu %%, increases: %lu, backoffs: %lu \r\n", stats.success, stats.increases, stats.backoffs);
+  printf("OK \r\n");
+}
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+STOPUWB", (size_t)10)) {
-            
-            uwb_started = 0;
-            // Take UWB suspension semaphore
-            xSemaphoreTake(sus_resp, portMAX_DELAY);
-            xSemaphoreTake(sus_init, portMAX_DELAY);
-            if (leds_mode == 0) bsp_board_led_off(BSP_BOARD_LED_2);
-            printf("OK \r\n");
-            
-        }
+static void at_baud(const at_args_t *args)
+{
+  int32_t baud = args->value;
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+STARTBLE", (size_t)11)) {
-            
-            ble_started = 1;
-            // Give print list semaphore
-            xSemaphoreGive(print_list_sem);
-            adv_scan_start();
-            if (leds_mode == 0) bsp_board_led_on(BSP_BOARD_LED_1);
-            printf("OK \r\n");
-                    
-        }
+  if (baud != 9600 && baud != 19200 && baud != 38400 && baud != 57600 && baud != 115200 &&
+      baud != 230400 && baud != 460800 && baud != 921600 && baud != 1000000) {
+    printf("Baud rate parameter input error \r\n");
+    return;
+  }
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+STOPBLE", (size_t)10)) {
-            
-            ble_started = 0;
-            sd_ble_gap_adv_stop();
-            sd_ble_gap_scan_stop();
-            // Take print list semaphore to stop printing
-            xSemaphoreTake(print_list_sem, portMAX_DELAY);
-            if (leds_mode == 0) bsp_board_led_off(BSP_BOARD_LED_1);
-            printf("OK \r\n");
-        }
+  // Reply at the current rate, then switch
+  printf("OK \r\n");
+  uart_flush(100);
+  uart_set_baudrate(baud);
+}
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+ID", (size_t)5)) {
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t rec_uuid = atoi(uuid_char);
-            
-            NODE_UUID = rec_uuid;
-            m_adv_uuids[1].uuid = NODE_UUID;
-
-            // Setup UUID into BLE 
-            advertising_init();
-            writeFlashID(rec_uuid, 1);
-            printf("OK\r\n");
-            
-        }
+static void at_bootmode(const at_args_t *args)
+{
+  int32_t mode = args->value;
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+BOOTMODE", (size_t)11)) {
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t mode = atoi(uuid_char);
-            
-            if (mode < 0 || mode > 2) {
-              printf("Invalid bootmode parameter \r\n");
-            }
-            else {
-              if (mode == 1) {
-                writeFlashID(1, 2);
-              }
-              else if (mode == 2) {
-                 writeFlashID(2, 2);
-              }
-              else {
-                writeFlashID(0, 2);
-              }
-
-              printf("Bootmode: %d OK \r\n", mode);
-            }
-        }
+  if (mode < 0 || mode > 2) {
+    printf("Invalid bootmode parameter \r\n");
+    return;
+  }
 
-        else if(0 == strncmp((const char *)incoming_message.data, (const char *)"AT+RATE", (size_t)7)) {
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t rate = atoi(uuid_char);
-            
-            if (rate < 0 || rate > 500) {
-              printf("Invalid rate parameter \r\n"); 
-            }
-            else {
-              writeFlashID(rate, 3);
-              initiator_freq = rate;
-
-              // reconfig BLE advertising data
-              if (rate == 0) {
-                advertising_reconfig(0);
-              }
-              else {
-                advertising_reconfig(1);
-              }
-
-              printf("Rate: %d OK \r\n", rate);
-            }
-        }
+  writeFlashID(mode, 2);
+  printf("Bootmode: %d OK \r\n", mode);
+}
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+CHANNEL", (size_t)10)) {
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t channel = atoi(uuid_char);
+static void at_boottime(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
 
-            if (channel < 1 || channel > 7 || channel == 6) {
-              printf("Invalid Channel number \r\n");
-            }
-            else {
-              writeFlashID(channel, 4);
-              switch (channel) {
-                case 1: uwb_pgdelay = ch1;
-                        break;
-                case 2: uwb_pgdelay = ch2;
-                        break;
-                case 3: uwb_pgdelay = ch3;
-                        break;
-                case 4: uwb_pgdelay = ch4;
-                        break;
-                case 5: uwb_pgdelay = ch5;
-                        break;
-                case 7: uwb_pgdelay = ch7;
-                        break;
-              }
-              config_tx.PGdly = uwb_pgdelay;
-              config.chan = channel;
-              dwt_configure(&config);
-              dwt_configuretxrf(&config_tx);
-              printf("OK \r\n");
-            }
+  boot_time_print();
+  printf("OK \r\n");
+}
 
-        }
+static void at_calibrate(const at_args_t *args)
+{
+  if (args->given && args->value == 0) {
+    // Back to the default reply delays
+    writeFlashID(0, 13);
+    uwb_reply_delay_set(0);
+    printf("OK \r\n");
+    return;
+  }
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+RESET", (size_t)8)) {
+  uint16_t turnaround = 0;
+  uint16_t delay;
 
-          // Delete ID record
-          fds_record_desc_t   record_desc_1;
-          fds_find_token_t    ftok_1;
-          memset(&ftok_1, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_1, &record_desc_1, &ftok_1) == FDS_SUCCESS) {
-            ret_code_t ret = fds_record_delete(&record_desc_1);
-            if (ret != FDS_SUCCESS) {
-             printf("FDS Delete error \r\n");
-            }
-          }
+  uwb_radio_take();
+  dwt_forcetrxoff();
+  init_reconfig();
 
-          // Delete rate record
-          fds_record_desc_t   record_desc_2;
-          fds_find_token_t    ftok_2;
-          memset(&ftok_2, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_3, &record_desc_2, &ftok_2) == FDS_SUCCESS) {
-            ret_code_t ret2 = fds_record_delete(&record_desc_2);
-            if (ret2 != FDS_SUCCESS) {
-             printf("FDS Delete error \r\n");
-            }
-          }
-          
-          // Delete channel record
-          fds_record_desc_t   record_desc_3;
-          fds_find_token_t    ftok_3;
-          memset(&ftok_3, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_4, &record_desc_3, &ftok_3) == FDS_SUCCESS) { 
-            ret_code_t ret3 = fds_record_delete(&record_desc_3);
-            if (ret3 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
-          
-          // Delete timeout record
-          fds_record_desc_t   record_desc_4;
-          fds_find_token_t    ftok_4;
-          memset(&ftok_4, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_5, &record_desc_4, &ftok_4) == FDS_SUCCESS) {
-            ret_code_t ret4 = fds_record_delete(&record_desc_4);
-            if (ret4 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
-          
+  delay = uwb_calibrate(&turnaround);
 
-          // Delete Tx power record
-          fds_record_desc_t   record_desc_5;
-          fds_find_token_t    ftok_5;
-          memset(&ftok_5, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_6, &record_desc_5, &ftok_5) == FDS_SUCCESS) {
-            ret_code_t ret5 = fds_record_delete(&record_desc_5);
-            if (ret5 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
-          
+  resp_reconfig();
+  dwt_forcetrxoff();
+  uwb_radio_give();
 
-          // Delete stream mode record
-          fds_record_desc_t   record_desc_6;
-          fds_find_token_t    ftok_6;
-          memset(&ftok_6, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_7, &record_desc_6, &ftok_6) == FDS_SUCCESS) {
-            ret_code_t ret6 = fds_record_delete(&record_desc_6);
-            if (ret6 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
+  if (delay == 0) {
+    printf("Calibration error \r\n");
+  }
+  else {
+    writeFlashID(delay, 13);
+    printf("Turnaround: %d us, reply delay: %d us \r\n", turnaround, delay);
+    printf("OK \r\n");
+  }
+}
 
-          // Delete TWR mode record
-          fds_record_desc_t   record_desc_7;
-          fds_find_token_t    ftok_7;
-          memset(&ftok_7, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_8, &record_desc_7, &ftok_7) == FDS_SUCCESS) {
-            ret_code_t ret7 = fds_record_delete(&record_desc_7);
-            if (ret7 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
-          
-          // Delete LED mode record
-          fds_record_desc_t   record_desc_8;
-          fds_find_token_t    ftok_8;
-          memset(&ftok_8, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_9, &record_desc_8, &ftok_8) == FDS_SUCCESS) {
-            ret_code_t ret8 = fds_record_delete(&record_desc_8);
-            if (ret8 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          }
+static void at_channel(const at_args_t *args)
+{
+  int32_t channel = args->value;
 
-          // Delete BOOT mode record
-          fds_record_desc_t   record_desc_9;
-          fds_find_token_t    ftok_9;
-          memset(&ftok_9, 0x00, sizeof(fds_find_token_t));
-          if (fds_record_find(FILE_ID, RECORD_KEY_2, &record_desc_9, &ftok_9) == FDS_SUCCESS) {
-            ret_code_t ret9 = fds_record_delete(&record_desc_9);
-            if (ret9 != FDS_SUCCESS) {
-              printf("FDS Delete error \r\n");
-            }
-          };
-          
-          printf("Reset OK \r\n");
-        }
+  if (channel < 1 || channel > 7 || channel == 6) {
+    printf("Invalid Channel number \r\n");
+    return;
+  }
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+TIMEOUT", (size_t)10)) {
-            
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t timeout = atoi(uuid_char);
-            //printf("%d \r\n", timeout);
-            
-            if (timeout < 0) {
-              printf("Timeout cannot be negative \r\n");
-            }
-            else {
-              writeFlashID(timeout, 5);
-              time_out = timeout; 
+  writeFlashID(channel, 4);
+  switch (channel) {
+    case 1: uwb_pgdelay = ch1;
+            break;
+    case 2: uwb_pgdelay = ch2;
+            break;
+    case 3: uwb_pgdelay = ch3;
+            break;
+    case 4: uwb_pgdelay = ch4;
+            break;
+    case 5: uwb_pgdelay = ch5;
+            break;
+    case 7: uwb_pgdelay = ch7;
+            break;
+  }
+  config_tx.PGdly = uwb_pgdelay;
+  config.chan = channel;
+  uwb_radio_take();
+  dwt_configure(&config);
+  dwt_configuretxrf(&config_tx);
+  uwb_radio_give();
+  printf("OK \r\n");
+}
 
-              printf("OK \r\n");
-            }
-        }
+static void at_filter(const at_args_t *args)
+{
+  if (args->given) {
+    if (args->value < 0 || args->value >= RANGE_FILTER_MODES) {
+      printf("Filter parameter input error \r\n");
+      return;
+    }
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+TXPOWER", (size_t)10)) {
-            
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t tx_power = atoi(uuid_char);
-            //printf("%d \r\n", timeout);
-            
-            if (tx_power < 0 || tx_power > 1) {
-              printf("Tx Power parameter input error \r\n");
-            }
-            else {
-              writeFlashID(tx_power, 6);
-              if (tx_power == 0) {
-                config_tx.power = TX_POWER_MAN_DEFAULT;
-              }
-              if (tx_power == 1) {
-                config_tx.power = TX_POWER_MAX;
-              }
-              dwt_configuretxrf(&config_tx);
-              printf("OK \r\n");
-            }
-        }
+    writeFlashID(args->value, 16);
+    // Filters restart by themselves on their next range
+    filter_mode = args->value;
+  }
+  else {
+    range_filter_stats_t stats;
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+STREAMMODE", (size_t)13)) {
-            
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t stream_mode = atoi(uuid_char);
-            
-            if (stream_mode < 0 || stream_mode > 1) {
-              printf("Stream mode parameter input error \r\n");
-            }
-            else {
-              writeFlashID(stream_mode, 7);
-              streaming_mode = stream_mode;
-              printf("OK \r\n");
-            }
-        }
+    range_filter_stats_get(&stats);
+    printf("Filter: %d, accepted: %lu, rejected: %lu, restarts: %lu \r\n", filter_mode,
+           stats.accepted, stats.rejected, stats.resets);
+  }
+  printf("OK \r\n");
+}
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+TWRMODE", (size_t)10)) {
-            
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t ranging_mode = atoi(uuid_char);
-            
-            if (ranging_mode < 0 || ranging_mode > 1) {
-              printf("TWR mode parameter input error \r\n");
-            }
-            else {
-              writeFlashID(ranging_mode, 8);
-              twr_mode = ranging_mode;
-              printf("OK \r\n");
-            }
-        }
+static void at_format(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 1) {
+    printf("Format parameter input error \r\n");
+    return;
+  }
 
-        else if (0 == strncmp((const char *)incoming_message.data, (const char *)"AT+LEDMODE", (size_t)10)) {
-            
-            char buf[100];
-            strcpy(buf, incoming_message.data);
-            char *uuid_char = strtok(buf, " ");
-            uuid_char = strtok(NULL, " ");
-            uint32_t led_mode = atoi(uuid_char);
-            
-            if (led_mode < 0 || led_mode > 1) {
-              printf("LED mode parameter input error \r\n");
-            }
-            else {
-              writeFlashID(led_mode, 9);
-              leds_mode = led_mode;
-              // Turn off all LEDs
-              if (leds_mode == 1) {
-                bsp_board_leds_off();
-                dwt_setleds(DWT_LEDS_DISABLE);
-              }
-
-              // Turn on LEDs from flash records
-              if (leds_mode == 0) {
-                bsp_board_led_on(BSP_BOARD_LED_0);
-                dwt_setleds(DWT_LEDS_ENABLE);
-
-                uint32_t state = getFlashID(2); 
-                if( (state == 1) || (state == 2) ) {
-                  bsp_board_led_on(BSP_BOARD_LED_1);
-                }
-                if (state == 2) {
-                  bsp_board_led_on(BSP_BOARD_LED_2);
-                }  
-              }
-
-              printf("OK \r\n");
-            }
-        }
+  writeFlashID(args->value, 10);
+  output_format = args->value;
+  printf("OK \r\n");
+}
 
-        else printf("ERROR Invalid AT Command\r\n");
-      }
+static void at_id(const at_args_t *args)
+{
+  // 0 marks a free neighbor slot and 0xFFFF is the UWB broadcast address
+  if (args->value < 1 || args->value >= UWB_ADDR_BROADCAST) {
+    printf("ID parameter input error \r\n");
+    return;
+  }
 
-      else if(0 == strncmp((const char *)incoming_message.data, (const char *)"AT", (size_t)2))
-      {
-        printf("Only input AT without + command \r\n");
-      }
+  uint32_t rec_uuid = args->value;
 
-      else {
-        printf("Not an AT command\r\n");
-        
-      }  
+  NODE_UUID = rec_uuid;
+  m_adv_uuids[1].uuid = NODE_UUID;
+  uwb_radio_take();
+  uwb_frame_set_address(NODE_UUID);
+  uwb_radio_give();
+
+  // Setup UUID into BLE 
+  advertising_init();
+  writeFlashID(rec_uuid, 1);
+  printf("OK\r\n");
+}
+
+static void at_idlestat(const at_args_t *args)
+{
+  static uint32_t last_idle = 0;
+  static uint32_t last_total = 0;
+  TaskStatus_t tasks[IDLE_STAT_MAX_TASKS];
+  uint32_t total = 0;
+  uint32_t idle = 0;
+
+  UNUSED_PARAMETER(args);
+
+  UBaseType_t count = uxTaskGetSystemState(tasks, IDLE_STAT_MAX_TASKS, &total);
+  TaskHandle_t idle_task = xTaskGetIdleTaskHandle();
+  for (UBaseType_t i = 0; i < count; i++) {
+    if (tasks[i].xHandle == idle_task) idle = tasks[i].ulRunTimeCounter;
+  }
+
+  if (total == 0 || total == last_total) {
+    printf("ERROR No run time yet \r\n");
+    return;
+  }
+
+  // Per mille, since boot and since the previous query
+  uint32_t boot = (uint32_t)(((uint64_t)idle * 1000) / total);
+  uint32_t recent = (uint32_t)(((uint64_t)(idle - last_idle) * 1000) / (total - last_total));
+  last_idle = idle;
+  last_total = total;
+
+  printf("Idle since boot: %lu.%lu %%, since last query: %lu.%lu %% \r\n", boot / 10, boot % 10, recent / 10, recent % 10);
+  printf("OK \r\n");
+}
+
+static void at_ledmode(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 1) {
+    printf("LED mode parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 9);
+  leds_mode = args->value;
+  uwb_radio_take();
+  // Turn off all LEDs
+  if (leds_mode == 1) {
+    bsp_board_leds_off();
+    dwt_setleds(DWT_LEDS_DISABLE);
+  }
+
+  // Turn on LEDs from flash records
+  if (leds_mode == 0) {
+    bsp_board_led_on(BSP_BOARD_LED_0);
+    dwt_setleds(DWT_LEDS_ENABLE);
+
+    uint32_t state = getFlashID(2); 
+    if( (state == 1) || (state == 2) ) {
+      bsp_board_led_on(BSP_BOARD_LED_1);
+    }
+    if (state == 2) {
+      bsp_board_led_on(BSP_BOARD_LED_2);
+    }  
+  }
+
+  uwb_radio_give();
+  printf("OK \r\n");
+}
+
+static void at_pollmode(const at_args_t *args)
+{
+  if (args->given) {
+    if (args->value < 0 || args->value >= POLL_POLICIES) {
+      printf("Poll mode parameter input error \r\n");
+      return;
+    }
+
+    writeFlashID(args->value, 17);
+    poll_select_set_policy(args->value);
+  }
+
+  printf("Poll mode: %d (%s) \r\n", poll_select_policy(), poll_select_name(poll_select_policy()));
+  printf("OK \r\n");
+}
+
+static void at_priority(const at_args_t *args)
+{
+  uint16_t ids[POLL_PRIORITY_MAX];
+
+  if (args->given) {
+    if (args->value < 0 || args->value > UINT16_MAX) {
+      printf("Priority parameter input error \r\n");
+      return;
     }
+    if (args->value == 0) {
+      poll_priority_clear();
+    }
+    else if (!poll_priority_add(args->value)) {
+      printf("Priority set full \r\n");
+      return;
+    }
+  }
+
+  int n = poll_priority_get(ids);
+  printf("Priority:");
+  for (int i = 0; i < n; i++) {
+    printf(" %d", ids[i]);
+  }
+  printf(" \r\n");
+  printf("OK \r\n");
+}
+
+static void at_pwrmode(const at_args_t *args)
+{
+  if (!args->given) {
+    uwb_power_stats_t stats;
+
+    uwb_power_stats_get(&stats);
+    printf("Power mode: %d, wake ups: %lu, slow wake ups: %lu \r\n", pwr_mode, stats.wakes, stats.failures);
+    printf("Wake latency last: %lu us, average: %lu us, max: %lu us \r\n", stats.last_us, stats.avg_us, stats.max_us);
+    printf("OK \r\n");
+    return;
+  }
+
+  if (args->value < 0 || args->value > 1) {
+    printf("Power mode parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 14);
+  pwr_mode = args->value;
+  // Leave the radio awake when sleeping is turned off, uwb_radio_give() would put it back to sleep
+  uwb_radio_take();
+  if (pwr_mode == 0) radio_was_asleep = false;
+  uwb_radio_give();
+  printf("OK \r\n");
+}
+
+static void at_rangebench(const at_args_t *args)
+{
+  range_bench_t bench;
+
+  UNUSED_PARAMETER(args);
+  range_bench_run(&bench);
+
+  printf("DS-TWR cycles per range: double %lu, fixed %lu \r\n", bench.ds_double, bench.ds_fixed);
+  printf("SS-TWR cycles per range: float %lu, fixed %lu \r\n", bench.ss_float, bench.ss_fixed);
+  printf("OK \r\n");
+}
+
+static void at_rate(const at_args_t *args)
+{
+  int32_t rate = args->value;
+
+  if (rate < 0 || rate > 500) {
+    printf("Invalid rate parameter \r\n"); 
+    return;
+  }
+
+  writeFlashID(rate, 3);
+  initiator_freq = rate;
+
+  // reconfig BLE advertising data
+  advertising_reconfig(rate == 0 ? 0 : 1);
+
+  printf("Rate: %d OK \r\n", rate);
+}
+
+static void at_reset(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
+
+  flash_config_reset();
+  printf("Reset OK \r\n");
+}
+
+static void at_rngstats(const at_args_t *args)
+{
+  if (args->given) {
+    if (args->value != 0) {
+      printf("Ranging stats parameter input error \r\n");
+      return;
+    }
+    uwb_prof_reset();
+  }
+  else {
+    uwb_prof_print();
+  }
+  printf("OK \r\n");
+}
+
+static void at_rxmode(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 1) {
+    printf("RX mode parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 12);
+  rx_mode = args->value;
+  printf("OK \r\n");
+}
+
+static void at_rxstats(const at_args_t *args)
+{
+  uwb_rx_stats_t stats;
+
+  UNUSED_PARAMETER(args);
+  uwb_frame_stats_get(&stats);
+
+  printf("RX good: %lu, filtered: %lu, CRC error: %lu, PHR error: %lu \r\n",
+         stats.received, stats.filtered, stats.crc_err, stats.phr_err);
+  printf("RX overrun: %lu, polls answered: %lu \r\n", stats.overruns, stats.answered);
+  printf("OK \r\n");
+}
+
+static void at_sniff(const at_args_t *args)
+{
+  uwb_sniff_info_t info;
+
+  if (args->given) {
+    if (args->value < 0 || args->value > 99) {
+      printf("Sniff duty parameter input error \r\n");
+      return;
+    }
+
+    writeFlashID(args->value, 15);
+    uwb_radio_take();
+    uwb_sniff_set(args->value);
+    // Accept the longer preamble of polls
+    config.sfdTO = uwb_sniff_sfd_timeout(8);
+    dwt_configure(&config);
+    uwb_radio_give();
+  }
+
+  uwb_sniff_info_get(&info);
+  if (uwb_sniff_duty() == 0) {
+    printf("Sniff: off \r\n");
+  }
+  else {
+    printf("Sniff: on %lu us, off %lu us, duty %lu.%lu %% \r\n", info.on_us, info.off_us,
+           info.duty_permille / 10, info.duty_permille % 10);
+    printf("Poll preamble: %lu symbols, added latency: %lu us \r\n", info.poll_plen, info.latency_us);
+  }
+  printf("OK \r\n");
+}
+
+static void at_startble(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
+
+  ble_started = 1;
+  // Give print list semaphore
+  xSemaphoreGive(print_list_sem);
+  adv_scan_start();
+  if (leds_mode == 0) bsp_board_led_on(BSP_BOARD_LED_1);
+  printf("OK \r\n");
+}
+
+static void at_startuwb(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
+
+  // Giving the radio again would let two tasks use it
+  if (uwb_started == 1) {
+    printf("OK \r\n");
+    return;
+  }
+
+  uwb_started = 1;
+  // Give the suspension semaphore so UWB can continue
+  xSemaphoreGive(sus_resp);
+  xSemaphoreGive(sus_init);
+  if (leds_mode == 0) bsp_board_led_on(BSP_BOARD_LED_2);
+  printf("OK \r\n");
+}
+
+static void at_stats(const at_args_t *args)
+{
+  if (args->given) {
+    if (args->value < 0 || args->value > 1) {
+      printf("Stats clock parameter input error \r\n");
+      return;
+    }
+    // 1 counts run time with a hardware timer, 0 with the tick RTC
+    task_stats_profile(args->value == 1);
+  }
+  else {
+    task_stats_print();
+  }
+  printf("OK \r\n");
+}
+
+static void at_stopble(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
+
+  ble_started = 0;
+  sd_ble_gap_adv_stop();
+  sd_ble_gap_scan_stop();
+  // Take print list semaphore to stop printing
+  xSemaphoreTake(print_list_sem, portMAX_DELAY);
+  if (leds_mode == 0) bsp_board_led_off(BSP_BOARD_LED_1);
+  printf("OK \r\n");
+}
+
+static void at_stopuwb(const at_args_t *args)
+{
+  UNUSED_PARAMETER(args);
+
+  // The radio is already held by this task
+  if (uwb_started == 0) {
+    printf("OK \r\n");
+    return;
+  }
+
+  uwb_started = 0;
+  // Take UWB suspension semaphore, the ranging task may already hold it when no neighbor polls
+  xSemaphoreTake(sus_resp, 0);
+  uwb_cancel_wait(responder_task_handle);
+  xSemaphoreTake(sus_init, portMAX_DELAY);
+  if (leds_mode == 0) bsp_board_led_off(BSP_BOARD_LED_2);
+  printf("OK \r\n");
+}
+
+static void at_streammode(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 1) {
+    printf("Stream mode parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 7);
+  streaming_mode = args->value;
+  // The list task may be waiting for new ranges
+  xTaskNotifyGive(list_task_handle);
+  printf("OK \r\n");
+}
+
+static void at_tdma(const at_args_t *args)
+{
+  int32_t slot_ms = args->value;
+
+  if (slot_ms != 0 && (slot_ms < TDMA_SLOT_MIN_MS || slot_ms > TDMA_SLOT_MAX_MS)) {
+    printf("TDMA slot parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(slot_ms, 11);
+  tdma_set_slot_ms(slot_ms);
+  printf("OK \r\n");
+}
+
+static void at_timeout(const at_args_t *args)
+{
+  if (args->value < 0) {
+    printf("Timeout cannot be negative \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 5);
+  time_out = args->value; 
+  printf("OK \r\n");
+}
+
+static void at_twrmode(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 2) {
+    printf("TWR mode parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 8);
+  twr_mode = args->value;
+  printf("OK \r\n");
+}
+
+static void at_txpower(const at_args_t *args)
+{
+  if (args->value < 0 || args->value > 1) {
+    printf("Tx Power parameter input error \r\n");
+    return;
+  }
+
+  writeFlashID(args->value, 6);
+  config_tx.power = (args->value == 1) ? TX_POWER_MAX : TX_POWER_MAN_DEFAULT;
+  uwb_radio_take();
+  dwt_configuretxrf(&config_tx);
+  uwb_radio_give();
+  printf("OK \r\n");
+}
+
+static void at_uartstat(const at_args_t *args)
+{
+  uart_stats_t console, stream;
+
+  UNUSED_PARAMETER(args);
+  uart_get_stats(UART_CH_CONSOLE, &console);
+  uart_get_stats(UART_CH_STREAM, &stream);
+
+  printf("Console queued: %lu, dropped: %lu, pending: %lu \r\n", console.queued, console.dropped, console.pending);
+  printf("Stream queued: %lu, dropped: %lu, pending: %lu \r\n", stream.queued, stream.dropped, stream.pending);
+  printf("Input lines dropped: %lu \r\n", uart_rx_dropped());
+  printf("OK \r\n");
+}
+
+/* AT commands, sorted by name for the binary search in at_find() */
+static const at_command_t at_commands[] = {
+  { "AUTORATE",   AT_ARG_OPT,  at_autorate },
+  { "BAUD",       AT_ARG_INT,  at_baud },
+  { "BOOTMODE",   AT_ARG_INT,  at_bootmode },
+  { "BOOTTIME",   AT_ARG_NONE, at_boottime },
+  { "CALIBRATE",  AT_ARG_OPT,  at_calibrate },
+  { "CHANNEL",    AT_ARG_INT,  at_channel },
+  { "FILTER",     AT_ARG_OPT,  at_filter },
+  { "FORMAT",     AT_ARG_INT,  at_format },
+  { "ID",         AT_ARG_INT,  at_id },
+  { "IDLESTAT",   AT_ARG_NONE, at_idlestat },
+  { "LEDMODE",    AT_ARG_INT,  at_ledmode },
+  { "POLLMODE",   AT_ARG_OPT,  at_pollmode },
+  { "PRIORITY",   AT_ARG_OPT,  at_priority },
+  { "PWRMODE",    AT_ARG_OPT,  at_pwrmode },
+  { "RANGEBENCH", AT_ARG_NONE, at_rangebench },
+  { "RATE",       AT_ARG_INT,  at_rate },
+  { "RESET",      AT_ARG_NONE, at_reset },
+  { "RNGSTATS",   AT_ARG_OPT,  at_rngstats },
+  { "RXMODE",     AT_ARG_INT,  at_rxmode },
+  { "RXSTATS",    AT_ARG_NONE, at_rxstats },
+  { "SNIFF",      AT_ARG_OPT,  at_sniff },
+  { "STARTBLE",   AT_ARG_NONE, at_startble },
+  { "STARTUWB",   AT_ARG_NONE, at_startuwb },
+  { "STATS",      AT_ARG_OPT,  at_stats },
+  { "STOPBLE",    AT_ARG_NONE, at_stopble },
+  { "STOPUWB",    AT_ARG_NONE, at_stopuwb },
+  { "STREAMMODE", AT_ARG_INT,  at_streammode },
+  { "TDMA",       AT_ARG_INT,  at_tdma },
+  { "TIMEOUT",    AT_ARG_INT,  at_timeout },
+  { "TWRMODE",    AT_ARG_INT,  at_twrmode },
+  { "TXPOWER",    AT_ARG_INT,  at_txpower },
+  { "UARTSTAT",   AT_ARG_NONE, at_uartstat },
+};
+
+/**
+ * @brief Parse and run one input line
+ */
+static void at_execute(char *line)
+{
+  const at_command_t *cmd;
+  at_args_t args;
+
+  switch (at_parse_line(line, at_commands, sizeof(at_commands) / sizeof(at_commands[0]), &cmd, &args)) {
+    case AT_OK:
+      cmd->handler(&args);
+      break;
+    case AT_ERR_NO_PLUS:
+      printf("Only input AT without + command \r\n");
+      break;
+    case AT_ERR_NOT_AT:
+      printf("Not an AT command\r\n");
+      break;
+    case AT_ERR_UNKNOWN:
+      printf("ERROR Invalid AT Command\r\n");
+      break;
+    case AT_ERR_PARAM:
+      printf("ERROR Invalid parameter\r\n");
+      break;
+  }
+}
+
+/**
+ * @brief Task to receive AT commands over UART and run them
+ *
+ * The task blocks until the UART driver has assembled a complete line.
+ *
+ * @param[in] pvParameter   Pointer that will be used as the parameter for the task.
+ */
+void uart_task_function(void * pvParameter){
+
+  UNUSED_PARAMETER(pvParameter);
+
+  char line[UART_LINE_LEN];
+
+  while(1) {
+    if (!uart_read_line(line, sizeof(line), portMAX_DELAY)) continue;
+
+    if (debug_print == 1) printf("uart task in \r\n");
+    at_execute(line);
     if (debug_print == 1) printf("uart task out \r\n");
   }
 }
 
 
 
+/**
+ * @brief Store a new range of a neighbor
+ *
+ * Implausible ranges and outliers rejected by the range filter are dropped.
+ * Failed exchanges and the range change are recorded for the poll selection.
+ *
+ * @param[in] slot       Slot of the neighbor in seen list
+ * @param[in] id         ID of the neighbor when ranging started
+ * @param[in] range_mm   Measured range, UWB_RANGE_NONE if the exchange failed
+ */
+static void neighbor_range_update(int slot, uint16_t id, int32_t range_mm)
+{
+  bool ok = (range_mm != UWB_RANGE_NONE) && (range_mm >= RANGE_MIN_MM) && (range_mm <= RANGE_MAX_MM);
+  uint32_t now = timestamp_ms();
+  uint8_t nested = 0;
+
+  // BLE events evict from an interrupt masked here, and the monitor task evicts with
+  // it masked, so the slot cannot be reused between the ID check and the end of the write
+  app_util_critical_region_enter(&nested);
+
+  // The slot may have been evicted and reused while ranging
+  if (seen_list[slot].UUID != id) {
+    app_util_critical_region_exit(nested);
+    return;
+  }
+
+  neighbor_write_begin(slot);
+  range_mm = ok ? range_filter_update(&seen_list[slot].filter, filter_mode, range_mm, now) : UWB_RANGE_NONE;
+  poll_select_result(slot, ok, range_mm, now);
+  if (range_mm != UWB_RANGE_NONE) {
+    seen_list[slot].range = range_mm / 1000.0f;
+    seen_list[slot].time_stamp = now;
+  }
+  neighbor_write_end(slot);
+
+  app_util_critical_region_exit(nested);
+
+  if (range_mm == UWB_RANGE_NONE) {
+    return;
+  }
+
+  neighbor_flag_set(slot, NEIGHBOR_UPDATED);
+  boot_mark(BOOT_FIRST_RANGE);
+  xTaskNotifyGive(list_task_handle);
+}
+
 /**
  * @brief Task to perform UWB ranging task.
  * 
@@ -688,8 +1117,6 @@ void uart_task_function(void * pvParameter){
 void ranging_task_function(void *pvParameter)
 {
   int drop_flag = 0;
-  int break_flag = 0;
-  static int cur_index = 0;
 
   while(1){
       //printf("ranging task in \r\n\n");
@@ -698,13 +1125,22 @@ void ranging_task_function(void *pvParameter)
       if(initiator_freq != 0)
       {
         
-        vTaskDelay(initiator_freq);
+        // In TDMA mode wait for the own slot, otherwise poll at the set or adapted rate
+        TickType_t delay = rate_ctl_period(initiator_freq);
+        if (tdma_enabled()) {
+          delay = tdma_slot_delay();
+          drop_flag = 0;
+        }
+
+        // Start waking a sleeping DW1000 early enough to poll on time
+        TickType_t lead = uwb_asleep() ? uwb_wake_lead() : 0;
+        vTaskDelay(delay > lead ? delay - lead : 0);
 //        uint16_t rand = get_rand_num_exp_collision(initiator_freq);
 //        printf("%d \r\n", rand);
         
         // If previous polling drop, give a random exponential distribution delay
         if (drop_flag != 0) {
-          uint16_t rand_small = get_rand_num_exp_collision(initiator_freq);
+          uint16_t rand_small = get_rand_num_exp_collision(rate_ctl_period(initiator_freq));
           //printf("Small delay: %d \r\n", rand_small);
           vTaskDelay(rand_small);
           drop_flag = 0;
@@ -714,74 +1150,61 @@ void ranging_task_function(void *pvParameter)
         if (debug_print == 1) printf("ranging task in \r\n");
         
         xSemaphoreTake(sus_resp, 0); //Suspend Responder Task
+        uwb_cancel_wait(responder_task_handle);
         xSemaphoreTake(sus_init, portMAX_DELAY);
 
+        // A failed wake up shows as a timed out round
+        (void) uwb_wake();
 
         vTaskDelay(2);
 
         dwt_forcetrxoff();
         init_reconfig();
 
+        // The coordinator opens the superframe for the other initiators
+        if (tdma_enabled() && tdma_is_coordinator()) {
+          tdma_send_beacon();
+        }
+
 //------- separate ranging codes
 
-        int search_count = 0;
-        float range1;
+        // Neighbors to poll, chosen by the policy set with AT+POLLMODE
+        int slots[MTWR_MAX_RESPONDERS];
+        uint16_t ids[MTWR_MAX_RESPONDERS];
+        int n = poll_select_next(slots, (twr_mode == 2) ? MTWR_MAX_RESPONDERS : 1, timestamp_ms());
 
-//        for (int a = 0; a < MAX_ANCHOR_COUNT; a++) {
-//          printf("%d ", seen_list[a].UUID);
-//        }
-//        printf("\n");
+        for (int i = 0; i < n; i++) {
+          ids[i] = seen_list[slots[i]].UUID;
+        }
 
-        while (seen_list[cur_index].UUID == 0) {
-          cur_index += 1;
-          
-          // Back to the head of seen list
-          if (cur_index == MAX_ANCHOR_COUNT) {
-            cur_index = 0;
-          }
-          // Finish search for whole list, no found, then break
-          if (search_count == MAX_ANCHOR_COUNT - 1) {
-            break_flag = 1;
-            break;
+        if (n > 0 && twr_mode == 2) {
+
+          // Range with all of them in one broadcast poll exchange
+          int32_t ranges[MTWR_MAX_RESPONDERS];
+
+          if (ds_init_run_multi(ids, n, ranges) == 0) drop_flag = 1;
+
+          for (int i = 0; i < n; i++) {
+            neighbor_range_update(slots[i], ids[i], ranges[i]);
           }
-          search_count += 1;
         }
-
-        if (break_flag != 1) {
+        else if (n > 0) {
+          int32_t range_mm = UWB_RANGE_NONE;
 
           // UWB ranging measurment
           if (twr_mode == 1) {
-            range1 = ds_init_run(seen_list[cur_index].UUID);
+            range_mm = ds_init_run(ids[0]);
           }
           if (twr_mode == 0) {
-            range1 = ss_init_run(seen_list[cur_index].UUID);
-          }
-          
-          if (range1 == -1) drop_flag = 1;
-
-          int numThru = 1;
-          if (range1 == -1) {
-            range1 = 0;
-            numThru -= 1;
+            range_mm = ss_init_run(ids[0]);
           }
-
-          float range = (range1)/numThru;
           
-          if( (numThru != 0) && (range >= -5) && (range <= 100) ) {
-            seen_list[cur_index].update_flag = 1;
-            seen_list[cur_index].range = range;
-            seen_list[cur_index].time_stamp = time_keeper;
-            //printf("node: %d; range: %f; timestamp: %u \r\n",seen_list[cur_index].UUID, seen_list[cur_index].range, time_keeper);
-          }      
+          if (range_mm == UWB_RANGE_NONE) drop_flag = 1;
 
-
-          cur_index += 1;
-          // Back to the head of seen list
-          if (cur_index == MAX_ANCHOR_COUNT) {
-            cur_index = 0;
-          }
+          neighbor_range_update(slots[0], ids[0], range_mm);
         }
-        break_flag = 0;
+
+        if (n > 0) rate_ctl_result(drop_flag == 0);
         
         resp_reconfig();
         dwt_forcetrxoff();
@@ -797,21 +1220,26 @@ void ranging_task_function(void *pvParameter)
     // Check polling flag of each node
     int polling_count = 0;
     for (int x = 0; x < MAX_ANCHOR_COUNT; x++) {
-      //printf("node %d: flag = %d \r\n", x, seen_list[x].polling_flag);
-      if(seen_list[x].UUID != 0 && seen_list[x].polling_flag != 0) {
+      //printf("node %d: flag = %d \r\n", x, seen_list[x].flags);
+      if(seen_list[x].UUID != 0 && (seen_list[x].flags & NEIGHBOR_POLLING)) {
         polling_count += 1;
       }
     }
-    // If no polling nodes in the network, suspend UWB response (listening) 
-    if (polling_count == 0) {
+    // If no polling nodes in the network, or the DW1000 sleeps between polls, suspend UWB response (listening) 
+    if (polling_count == 0 || pwr_mode == 1) {
       //printf("resp take! \r\n\n");
 
       xSemaphoreTake(sus_resp, 0); //Suspend Responder Task
+      uwb_cancel_wait(responder_task_handle);
       xSemaphoreTake(sus_init, portMAX_DELAY);
       vTaskDelay(2);
-      dwt_forcetrxoff();
-      resp_reconfig();
-      dwt_forcetrxoff();
+      if (!uwb_asleep()) {
+        dwt_forcetrxoff();
+        resp_reconfig();
+        dwt_forcetrxoff();
+      }
+      // Sleep until the next poll, the configuration is kept in AON
+      if (pwr_mode == 1) uwb_sleep();
       xSemaphoreGive(sus_init);
       xSemaphoreGive(sus_resp);
 
@@ -822,8 +1250,11 @@ void ranging_task_function(void *pvParameter)
       //printf("resp give! \r\n\n");
 
       xSemaphoreTake(sus_resp, 0); //Suspend Responder Task
+      uwb_cancel_wait(responder_task_handle);
       xSemaphoreTake(sus_init, portMAX_DELAY);
       vTaskDelay(2);
+      // The DW1000 still sleeps when polling stopped or sleeping was just turned off
+      (void) uwb_wake();
       dwt_forcetrxoff();
       resp_reconfig();
       dwt_forcetrxoff();
@@ -840,75 +1271,107 @@ void ranging_task_function(void *pvParameter)
  }
 
 /**
- * @brief Task to check nodes eviction and re-sorting
+ * @brief Task to evict timed out nodes
+ *
+ * Sleeps until the next timer wheel bucket holding a neighbor is due, and
+ * indefinitely while the table is empty. The BLE event handler wakes it up
+ * for each new neighbor. The watchdog is fed by the responder task while
+ * this task sleeps.
  *
  * @param[in] pvParameter   Pointer that will be used as the parameter for the task.
  */
 void monitor_task_function(void *pvParameter)
 {
+  while(1) {
+    TickType_t wait = portMAX_DELAY;
+    uint32_t due;
 
-  uint32 count = 0;
+    if (neighbor_next_expiry(&due)) {
+      int32_t left = (int32_t)(due - timestamp_ms());
+      // One tick more, so the wake up is not before the bucket is due
+      wait = (left > 0) ? pdMS_TO_TICKS(left) + 1 : 0;
+    }
+    (void) ulTaskNotifyTake(pdTRUE, wait);
 
-  while(1) {
-    
-    vTaskDelay(1000);
     if (debug_print == 1) printf("monitor task in \r\n");
 
     // Feed the watchdog timer
     nrf_drv_wdt_channel_feed(m_channel_id);
 
-    count += 1;
-    
-    xSemaphoreTake(sus_init, portMAX_DELAY);
-    int removed = 0;
-
-    // Check for timeout eviction
-    for(int x = 0; x < MAX_ANCHOR_COUNT; x++) {
-      if(seen_list[x].UUID != 0) {
-        if( (time_keeper - seen_list[x].ble_time_stamp) >= time_out) {
-          removed = 1;
-          seen_list[x].UUID = 0;
-          seen_list[x].range = 0;
-          seen_list[x].time_stamp = 0;
-          seen_list[x].RSSI = 0;
-          seen_list[x].update_flag = 0;
-          seen_list[x].polling_flag = 0;
-          seen_list[x].ble_time_stamp = 0;
-        }
-      }
-    }
-    
-    // Re-sort seen list by RSSI value when a node is removed, added, or a period of time
-    if(removed || node_added || ((count % 5) == 0)  ) {
-        
-      (void) sd_ble_gap_scan_stop();
-
-      for (int j = 0; j < MAX_ANCHOR_COUNT; j++) {
-        for( int k = j+1; k < MAX_ANCHOR_COUNT; k++) {
-          if(seen_list[j].RSSI < seen_list[k].RSSI) {
-              node A = seen_list[j];
-              seen_list[j] = seen_list[k];
-              seen_list[k] = A;
-          }
-        }
-      }
-      
-      //Resume scanning/building up neighbor list
-      scan_start();
-      node_added = 0;
-      removed = 0;
-      count = 0;
-    }
-
-    
-      
-    xSemaphoreGive(sus_init);
+    // Evict timed out neighbors, ranging goes on and skips slots that were reused
+    (void) neighbor_expire(timestamp_ms(), time_out);
 
     if (debug_print == 1) printf("monitor task out \r\n");
   }
 }
 
 
+/**
+ * @brief Bring up the DW1000 once the scheduler runs
+ *
+ * main() releases the DW1000 reset before setting up the SoftDevice and FDS,
+ * so only the power-up of the DW1000 overlaps them. Its initialisation needs
+ * the settings loaded from flash and runs after the scheduler starts. The
+ * responder task runs this first: it waits for the DW1000 to leave reset
+ * instead of sleeping a fixed time, applies the settings, then creates the
+ * other tasks using the radio. The responder task is not deleted afterwards, as
+ * heap_1 cannot free its memory.
+ */
+static void uwb_bringup(void)
+{
+  nrf_gpio_cfg_input(DW1000_IRQ, NRF_GPIO_PIN_NOPULL); 	
+  
+  /* Wait for the DW1000 to leave reset */
+  if (port_wait_dw1000_reset(10) != 0) {
+    printf("DW1000 reset timeout \r\n");
+  }
+  boot_mark(BOOT_UWB_RESET);
+
+  /* Set SPI clock to 2MHz */
+  port_set_dw1000_slowrate();			
+  
+  /* Init the DW1000 */
+  if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+  {
+    //Init of DW1000 Failed
+    while (1) {};
+  }
+
+  // Set SPI to 8MHz clock  
+  port_set_dw1000_fastrate();
+
+  /* Configure DW1000. */
+  dwt_configure(&config);
+
+  /* Configure DW1000 TX power and pulse delay */
+  dwt_configuretxrf(&config_tx);
+
+  /* Apply default antenna delay value. See NOTE 2 below. */
+  dwt_setrxantennadelay(RX_ANT_DLY);
+  dwt_settxantennadelay(TX_ANT_DLY);
+        
+  /* Set expected response's timeout. (keep listening so timeout is 0) */
+  dwt_setrxtimeout(0);
+
+  /* Route DW1000 events to the IRQ line so ranging tasks block instead of polling */
+  uwb_irq_init();
+
+  /* Address frames with the node ID and let the DW1000 drop frames for other nodes */
+  uwb_frame_init(NODE_UUID);
+
+  /* Let the DW1000 sleep between polls in power mode 1 */
+  uwb_power_init();
+
+  if (leds_mode == 0) dwt_setleds(DWT_LEDS_ENABLE);
+  if (leds_mode == 1) dwt_setleds(DWT_LEDS_DISABLE);
+
+  boot_mark(BOOT_UWB_READY);
+
+  UNUSED_VARIABLE(xTaskCreate(ranging_task_function, "RNG", configMINIMAL_STACK_SIZE+200, NULL, 2, &ranging_task_handle));
+  UNUSED_VARIABLE(xTaskCreate(uart_task_function, "UART", configMINIMAL_STACK_SIZE+1200, NULL, 2, &uart_task_handle));
+}
+
+
 /**
  * @brief SS TWR Initiator task entry function.
  *
@@ -917,10 +1380,12 @@ void monitor_task_function(void *pvParameter)
 void responder_task_function (void * pvParameter)
 {
   UNUSED_PARAMETER(pvParameter);
-  
-  if (leds_mode == 0) dwt_setleds(DWT_LEDS_ENABLE);
-  if (leds_mode == 1) dwt_setleds(DWT_LEDS_DISABLE);
 
+  // The task starts at the priority of the other tasks to boot quickly, and responds at a lower one
+  uwb_bringup();
+  vTaskPrioritySet(NULL, 1);
+
+  TickType_t stats_time = xTaskGetTickCount();
 
   while(1) {
 
@@ -928,16 +1393,50 @@ void responder_task_function (void * pvParameter)
 
     // Feed the watchdog timer
     nrf_drv_wdt_channel_feed(m_channel_id);
+
+    // Extend the RTC time even while no other task reads it
+    (void) timestamp_ticks();
     
     
     //Check if responding is suspended, return 0 means suspended
     int suspend_start = uxQueueMessagesWaiting((QueueHandle_t) sus_resp); 
 
-    if(suspend_start != 0) 
+    if (suspend_start != 0)
     {
-      
-      if (twr_mode == 1) ds_resp_run();
-      if (twr_mode == 0) ss_resp_run();      
+      // Hold the radio while using the DW1000, the other tasks suspend responding and cancel the wait to get it
+      if (xSemaphoreTake(sus_init, RESP_SUSPEND_WAIT) == pdTRUE) {
+
+        // Responding may have been suspended while waiting for the radio
+        if (uxQueueMessagesWaiting((QueueHandle_t) sus_resp) != 0) {
+          // Responding is only resumed in power mode 0, wake a DW1000 left asleep by mode 1
+          if (!uwb_wake()) {
+            xSemaphoreGive(sus_init);
+            vTaskDelay(RESP_SUSPEND_WAIT);
+            continue;
+          }
+
+          // Apply the RX mode here as the responder owns the radio, it is reset by the ranging task
+          if ((rx_mode == 1) != uwb_rx_continuous_enabled()) {
+            uwb_rx_continuous(rx_mode == 1);
+          }
+
+          if (twr_mode == 1 || twr_mode == 2) ds_resp_run();
+          if (twr_mode == 0) ss_resp_run();
+
+          // Event counters are read here as the responder owns the radio while it is not suspended
+          if ((xTaskGetTickCount() - stats_time) >= RX_STATS_PERIOD) {
+            uwb_frame_stats_update();
+            stats_time = xTaskGetTickCount();
+          }
+        }
+        xSemaphoreGive(sus_init);
+      }
+    }
+    else
+    {
+      // Responding is suspended, sleep until it resumes without taking the semaphore.
+      // Wake up now and then to feed the watchdog while UWB is stopped.
+      (void) xQueuePeek((QueueHandle_t) sus_resp, NULL, RESP_SUSPEND_WAIT);
     }
 
     /* Delay a task for a given number of ticks */
@@ -947,6 +1446,8 @@ void responder_task_function (void * pvParameter)
 }
 
 
+
+
 /************************************************
  *            Program main function             *
  ***********************************************/
@@ -959,11 +1460,17 @@ int main(void)
 
     debug_print = 0;
     streaming_mode = 0;
+    output_format = 0;
     twr_mode = 1;
+    rx_mode = 0;
+    pwr_mode = 0;
     leds_mode = 0;
     uwb_pgdelay = ch5;
     bool erase_bonds;
 
+    boot_time_init();
+    boot_mark(BOOT_MAIN);
+
     // Setup WDT 
     uint32_t err_code = NRF_SUCCESS;
     nrf_drv_wdt_config_t wdt_config = NRF_DRV_WDT_DEAFULT_CONFIG;
@@ -975,16 +1482,10 @@ int main(void)
 
 
     // Init nodes in seen list
-    for(int i = 0; i < MAX_ANCHOR_COUNT; i++)
-    {
-      seen_list[i].UUID = 0;
-      seen_list[i].RSSI = 0;
-      seen_list[i].time_stamp = 0;
-      seen_list[i].range = 0;
-      seen_list[i].update_flag = 0;
-      seen_list[i].polling_flag = 0;
-      seen_list[i].ble_time_stamp = 0;
-    }
+    neighbor_init();
+
+    // Release the DW1000 reset now, it powers up while the SoftDevice and FDS are set up
+    reset_DW1000();
   
     uart_init();
     timer_init();  
@@ -995,6 +1496,7 @@ int main(void)
     conn_params_init();
     peer_manager_init();
     advertising_init();
+    boot_mark(BOOT_BLE_STACK);
 
     // Init flash data storage
     ret_code_t ret = fds_register(fds_evt_handler);
@@ -1007,47 +1509,14 @@ int main(void)
        printf("init error \r\n");
     }
 
+    // Load all settings in one flash access
+    flash_config_load();
+    boot_mark(BOOT_FLASH);
+
     // Logic Analyzer debug used
     nrf_gpio_cfg_output(12);
     nrf_gpio_cfg_output(27);
 
-
-    /*------------ UWB config part ------------- */
-    nrf_gpio_cfg_input(DW1000_IRQ, NRF_GPIO_PIN_NOPULL); 	
-    
-    /* Reset DW1000 */
-    reset_DW1000(); 
-
-    /* Set SPI clock to 2MHz */
-    port_set_dw1000_slowrate();			
-  
-    /* Init the DW1000 */
-    if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
-    {
-      //Init of DW1000 Failed
-      while (1) {};
-    }
-
-    // Set SPI to 8MHz clock  
-    port_set_dw1000_fastrate();
-
-    /* Configure DW1000. */
-    dwt_configure(&config);
-
-    /* Configure DW1000 TX power and pulse delay */
-    dwt_configuretxrf(&config_tx);
-
-    /* Apply default antenna delay value. See NOTE 2 below. */
-    dwt_setrxantennadelay(RX_ANT_DLY);
-    dwt_settxantennadelay(TX_ANT_DLY);
-          
-    /* Set expected response's timeout. (keep listening so timeout is 0) */
-    dwt_setrxtimeout(0);
-
-    // Init timekeeper from timer. unit: 1ms
-    ret_code_t create_timer = app_timer_create(&m_timestamp_keeper, APP_TIMER_MODE_REPEATED, timestamp_handler);
-    ret_code_t start_timer =  app_timer_start(m_timestamp_keeper, APP_TIMER_TICKS(1) , NULL);
-  
     printf("Node On: Firmware version %s\r\n", FIRMWARE_VERSION);
 
  
@@ -1072,11 +1541,8 @@ int main(void)
     print_list_sem = xSemaphoreCreateBinary();
     //xSemaphoreGive(sus_resp);
 
-    uart_queue = xQueueCreate(25, sizeof(struct message));
-
-    UNUSED_VARIABLE(xTaskCreate(responder_task_function, "TWR_RESP", configMINIMAL_STACK_SIZE+600, NULL,1, &responder_task_handle));
-    UNUSED_VARIABLE(xTaskCreate(ranging_task_function, "RNG", configMINIMAL_STACK_SIZE+200, NULL, 2, &ranging_task_handle));
-    UNUSED_VARIABLE(xTaskCreate(uart_task_function, "UART", configMINIMAL_STACK_SIZE+1200, NULL, 2, &uart_task_handle));
+    // The responder task brings the DW1000 up, then creates the ranging and AT command tasks
+    UNUSED_VARIABLE(xTaskCreate(responder_task_function, "TWR_RESP", configMINIMAL_STACK_SIZE+600, NULL, 2, &responder_task_handle));
     UNUSED_VARIABLE(xTaskCreate(list_task_function, "LIST", configMINIMAL_STACK_SIZE+600, NULL, 2, &list_task_handle));
     UNUSED_VARIABLE(xTaskCreate(monitor_task_function, "MONITOR", configMINIMAL_STACK_SIZE+800, NULL, 2, &monitor_task_handle));
     //UNUSED_VARIABLE(xTaskCreate(ble_task_fuction, "BLE", configMINIMAL_STACK_SIZE+1600, NULL, 0, &ble_task_handle));
@@ -1086,10 +1552,7 @@ int main(void)
 
     
     /* Fetch LED mode from flash */
-    fds_record_desc_t   record_desc_9;
-    fds_find_token_t    ftok_9;
-    memset(&ftok_9, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_9, &record_desc_9, &ftok_9) == FDS_SUCCESS)
+    if (flash_config_has(9))
     {
       uint32_t led_mode = getFlashID(9);
       leds_mode = led_mode;
@@ -1106,10 +1569,7 @@ int main(void)
 
 
     /* Fetch ID and bootmode record from flash */
-    fds_record_desc_t   record_desc_2;
-    fds_find_token_t    ftok_2;
-    memset(&ftok_2, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_1, &record_desc_2, &ftok_2) == FDS_SUCCESS) //If there is a stored ID
+    if (flash_config_has(1)) //If there is a stored ID
     {      
       uint32_t id = getFlashID(1); //Get ID
       NODE_UUID = id;
@@ -1124,10 +1584,7 @@ int main(void)
     }
 
     /* Fetch polling rate record from flash */
-    fds_record_desc_t   record_desc_1;
-    fds_find_token_t    ftok_1;
-    memset(&ftok_1, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_2, &record_desc_1, &ftok_1) == FDS_SUCCESS) 
+    if (flash_config_has(2)) 
     {
       uint32_t state = getFlashID(2); //Get State
       printf("  Boot Mode: %d \r\n", state);
@@ -1153,10 +1610,7 @@ int main(void)
     }
 
     /* Fetch polling rate record from flash */
-    fds_record_desc_t   record_desc_3;
-    fds_find_token_t    ftok_3;
-    memset(&ftok_3, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_3, &record_desc_3, &ftok_3) == FDS_SUCCESS) 
+    if (flash_config_has(3)) 
     {
       uint32_t rate = getFlashID(3);
       initiator_freq = rate;
@@ -1176,10 +1630,7 @@ int main(void)
     }
 
     /* Fetch channel record from flash */
-    fds_record_desc_t   record_desc_4;
-    fds_find_token_t    ftok_4;
-    memset(&ftok_4, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_4, &record_desc_4, &ftok_4) == FDS_SUCCESS)
+    if (flash_config_has(4))
     {
       uint32_t channel = getFlashID(4);
       switch (channel) {
@@ -1196,10 +1647,9 @@ int main(void)
         case 7: uwb_pgdelay = ch7;
                 break;
       }
+      // Applied by the UWB init task
       config_tx.PGdly = uwb_pgdelay;
       config.chan = channel;
-      dwt_configuretxrf(&config_tx);
-      dwt_configure(&config);
       printf("  UWB Channel: %d \r\n", channel);
     }
     else {
@@ -1207,10 +1657,7 @@ int main(void)
     }
 
     /* Fetch timeout record from flash */
-    fds_record_desc_t   record_desc_5;
-    fds_find_token_t    ftok_5;
-    memset(&ftok_5, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_5, &record_desc_5, &ftok_5) == FDS_SUCCESS) 
+    if (flash_config_has(5)) 
     {
       uint32_t timeout = getFlashID(5);
       time_out = timeout;
@@ -1221,10 +1668,7 @@ int main(void)
     }
 
     /* Fetch TX power record from flash */
-    fds_record_desc_t   record_desc_6;
-    fds_find_token_t    ftok_6;
-    memset(&ftok_6, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_6, &record_desc_6, &ftok_6) == FDS_SUCCESS)
+    if (flash_config_has(6))
     {
       uint32_t tx_power = getFlashID(6);
       if (tx_power == 1) {
@@ -1235,17 +1679,13 @@ int main(void)
         config_tx.power = TX_POWER_MAN_DEFAULT;
         printf("  TX Power: Default \r\n");
       }
-      dwt_configuretxrf(&config_tx);
     }
     else {
       printf("  TX Power: Default \r\n");
     }
 
     /* Fetch streaming mode from flash */
-    fds_record_desc_t   record_desc_7;
-    fds_find_token_t    ftok_7;
-    memset(&ftok_7, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_7, &record_desc_7, &ftok_7) == FDS_SUCCESS)
+    if (flash_config_has(7))
     {
       uint32_t stream_mode = getFlashID(7);
       streaming_mode = stream_mode;
@@ -1256,10 +1696,7 @@ int main(void)
     }
 
     /* Fetch TWR mode from flash */
-    fds_record_desc_t   record_desc_8;
-    fds_find_token_t    ftok_8;
-    memset(&ftok_8, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(FILE_ID, RECORD_KEY_8, &record_desc_8, &ftok_8) == FDS_SUCCESS)
+    if (flash_config_has(8))
     {
       uint32_t ranging_mode = getFlashID(8);
       twr_mode = ranging_mode;
@@ -1269,9 +1706,107 @@ int main(void)
       printf("  Ranging Mode: Default \r\n");
     }
 
+    /* Fetch output format from flash */
+    if (flash_config_has(10))
+    {
+      uint32_t format = getFlashID(10);
+      output_format = format;
+      printf("  Output Format: %d \r\n", format);
+    }
+    else {
+      printf("  Output Format: Default \r\n");
+    }
+
+    /* Fetch TDMA slot length from flash */
+    if (flash_config_has(11))
+    {
+      uint32_t slot_ms = getFlashID(11);
+      tdma_set_slot_ms(slot_ms);
+      printf("  TDMA Slot: %d \r\n", slot_ms);
+    }
+    else {
+      printf("  TDMA Slot: Default \r\n");
+    }
+
+    /* Fetch RX mode from flash */
+    if (flash_config_has(12))
+    {
+      uint32_t mode = getFlashID(12);
+      rx_mode = mode;
+      printf("  RX Mode: %d \r\n", mode);
+    }
+    else {
+      printf("  RX Mode: Default \r\n");
+    }
+
+    /* Fetch calibrated reply delay from flash */
+    if (flash_config_has(13))
+    {
+      uint32_t delay = getFlashID(13);
+      uwb_reply_delay_set(delay);
+      printf("  Reply Delay: %d \r\n", delay);
+    }
+    else {
+      printf("  Reply Delay: Default \r\n");
+    }
+
+    /* Fetch power mode from flash */
+    if (flash_config_has(14))
+    {
+      uint32_t mode = getFlashID(14);
+      pwr_mode = mode;
+      printf("  Power Mode: %d \r\n", mode);
+    }
+    else {
+      printf("  Power Mode: Default \r\n");
+    }
+
+    /* Fetch sniff duty cycle from flash, the DW1000 is configured by the UWB init task */
+    if (flash_config_has(15))
+    {
+      uint32_t duty = getFlashID(15);
+      uwb_sniff_set(duty);
+      config.sfdTO = uwb_sniff_sfd_timeout(8);
+      printf("  Sniff Duty: %d \r\n", duty);
+    }
+    else {
+      printf("  Sniff Duty: Default \r\n");
+    }
+
+    if (flash_config_has(16))
+    {
+      uint32_t mode = getFlashID(16);
+      filter_mode = mode;
+      printf("  Range Filter: %d \r\n", mode);
+    }
+    else {
+      printf("  Range Filter: Default \r\n");
+    }
+
+    if (flash_config_has(17))
+    {
+      uint32_t mode = getFlashID(17);
+      poll_select_set_policy(mode);
+      printf("  Poll Mode: %d \r\n", mode);
+    }
+    else {
+      printf("  Poll Mode: Default \r\n");
+    }
+
+    if (flash_config_has(18))
+    {
+      uint32_t min_ms = getFlashID(18);
+      rate_ctl_set_min(min_ms);
+      printf("  Autorate: %d \r\n", min_ms);
+    }
+    else {
+      printf("  Autorate: Default \r\n");
+    }
+
 
 
    
+    boot_mark(BOOT_SCHEDULER);
     vTaskStartScheduler();
     while(1) 
     {
@@ -0,0 +1,476 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   neighbor.c
+ *
+ *  @brief  Neighbor table with hashed ID lookup and RSSI ordered index
+ *
+ *          Entries live in fixed slots of seen_list so their index stays valid
+ *          while they are in the table. Node IDs map to slots through an open
+ *          addressing hash table with linear probing, and a separate index
+ *          array keeps the occupied slots ordered by RSSI. The order is
+ *          updated with every RSSI change by moving only that slot, so it
+ *          never needs a full sort and BLE scanning never stops for it.
+ *
+ *          Timed out neighbors are found with a hashed timer wheel. Each slot
+ *          is in the bucket of the time it expires, at NEIGHBOR_EXPIRY_MS
+ *          resolution, and only the bucket of the current time is checked.
+ *          Empty buckets are skipped without waking up for them.
+ *          Advertisements do not touch the wheel: a slot whose last
+ *          advertisement is newer than its bucket is moved to its new
+ *          expiry time when the bucket comes up.
+ *
+ *          Entries are written from the BLE event interrupt and from several
+ *          tasks, so each slot has a sequence count (seqlock). Writers make it
+ *          odd while they change the entry and never wait. Readers that need
+ *          a consistent entry copy it and retry if the count was odd or
+ *          changed during the copy, without disabling interrupts.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "neighbor.h"
+
+#define NEIGHBOR_EMPTY  0xFF
+#define NEIGHBOR_MASK   (NEIGHBOR_HASH_SIZE - 1)
+#define NEIGHBOR_READ_TRIES  4    /**< Copies tried by neighbor_read() before giving up */
+#define WHEEL_MASK      (NEIGHBOR_WHEEL_SIZE - 1)
+#define WHEEL_EXPIRING  NEIGHBOR_WHEEL_SIZE   /**< List of the bucket being expired */
+
+#if MAX_ANCHOR_COUNT >= NEIGHBOR_EMPTY
+#error "MAX_ANCHOR_COUNT must fit a slot index below NEIGHBOR_EMPTY"
+#endif
+#if NEIGHBOR_HASH_SIZE < (2 * MAX_ANCHOR_COUNT)
+#error "NEIGHBOR_HASH_SIZE must be at least twice MAX_ANCHOR_COUNT"
+#endif
+
+node seen_list[MAX_ANCHOR_COUNT];
+
+static uint8_t id_map[NEIGHBOR_HASH_SIZE];        /**< Slot of the ID hashed to each bucket */
+static uint8_t rssi_order[MAX_ANCHOR_COUNT];      /**< Occupied slots, strongest RSSI first */
+static uint8_t rank_of[MAX_ANCHOR_COUNT];         /**< Position of each occupied slot in rssi_order */
+static uint8_t free_slots[MAX_ANCHOR_COUNT];      /**< Stack of free slots */
+static volatile uint32_t seq[MAX_ANCHOR_COUNT];   /**< Sequence count of each slot, odd while written */
+static uint8_t wheel[NEIGHBOR_WHEEL_SIZE + 1];    /**< First slot of each bucket, and of the expiring list */
+static uint8_t wheel_next[MAX_ANCHOR_COUNT];      /**< Bucket lists, doubly linked */
+static uint8_t wheel_prev[MAX_ANCHOR_COUNT];
+static uint8_t wheel_of[MAX_ANCHOR_COUNT];        /**< List each occupied slot is in */
+static uint32_t wheel_tick;                       /**< Next tick to expire, in NEIGHBOR_EXPIRY_MS */
+static int free_top;
+static int count;
+
+
+/**
+ * @brief Home bucket of a node ID (Fibonacci hashing)
+ */
+static uint32_t hash_id(uint16_t id)
+{
+  return ((uint32_t)id * 2654435761U) >> (32 - NEIGHBOR_HASH_BITS);
+}
+
+/**
+ * @brief Bucket holding a node ID, -1 if the ID is not in the table
+ */
+static int find_bucket(uint16_t id)
+{
+  uint32_t b = hash_id(id);
+
+  for (int i = 0; i < NEIGHBOR_HASH_SIZE; i++) {
+    uint8_t slot = id_map[b];
+    if (slot == NEIGHBOR_EMPTY) {
+      return -1;
+    }
+    if (seen_list[slot].UUID == id) {
+      return b;
+    }
+    b = (b + 1) & NEIGHBOR_MASK;
+  }
+  return -1;
+}
+
+/**
+ * @brief Add a slot to the head of a timer wheel list
+ */
+static void wheel_link(uint8_t slot, int list)
+{
+  wheel_prev[slot] = NEIGHBOR_EMPTY;
+  wheel_next[slot] = wheel[list];
+  if (wheel[list] != NEIGHBOR_EMPTY) {
+    wheel_prev[wheel[list]] = slot;
+  }
+  wheel[list] = slot;
+  wheel_of[slot] = list;
+}
+
+/**
+ * @brief Take a slot out of its timer wheel list
+ */
+static void wheel_unlink(uint8_t slot)
+{
+  if (wheel_prev[slot] != NEIGHBOR_EMPTY) {
+    wheel_next[wheel_prev[slot]] = wheel_next[slot];
+  }
+  else {
+    wheel[wheel_of[slot]] = wheel_next[slot];
+  }
+  if (wheel_next[slot] != NEIGHBOR_EMPTY) {
+    wheel_prev[wheel_next[slot]] = wheel_prev[slot];
+  }
+}
+
+/**
+ * @brief Move the slot at one rank to its place in the RSSI order
+ *
+ * The rest of the order is sorted, so the slot moves one way only, past the
+ * neighbors whose RSSI it crossed. Equal RSSI keeps the current order.
+ */
+static void rank_settle(int r)
+{
+  uint8_t slot = rssi_order[r];
+  int8_t rssi = seen_list[slot].RSSI;
+
+  while (r > 0 && seen_list[rssi_order[r - 1]].RSSI < rssi) {
+    rssi_order[r] = rssi_order[r - 1];
+    rank_of[rssi_order[r]] = r;
+    r--;
+  }
+  while (r < count - 1 && seen_list[rssi_order[r + 1]].RSSI > rssi) {
+    rssi_order[r] = rssi_order[r + 1];
+    rank_of[rssi_order[r]] = r;
+    r++;
+  }
+  rssi_order[r] = slot;
+  rank_of[slot] = r;
+}
+
+/**
+ * @brief Empty the neighbor table
+ */
+void neighbor_init(void)
+{
+  memset(seen_list, 0, sizeof(seen_list));
+  memset(id_map, NEIGHBOR_EMPTY, sizeof(id_map));
+  memset(wheel, NEIGHBOR_EMPTY, sizeof(wheel));
+  wheel_tick = 0;
+
+  // Hand out low slots first
+  for (int i = 0; i < MAX_ANCHOR_COUNT; i++) {
+    free_slots[i] = MAX_ANCHOR_COUNT - 1 - i;
+  }
+  free_top = MAX_ANCHOR_COUNT;
+  count = 0;
+}
+
+/**
+ * @brief Look up the slot of a node
+ *
+ * @return slot index in seen_list, -1 if the node is unknown
+ */
+int neighbor_find(uint16_t id)
+{
+  int b = find_bucket(id);
+
+  if (b < 0) {
+    return -1;
+  }
+  return id_map[b];
+}
+
+/**
+ * @brief Add a node to the table
+ *
+ * When the table is full, the weakest neighbor is evicted if the new node
+ * is heard with a stronger RSSI.
+ *
+ * @return slot index of the node, -1 if it was not added
+ */
+int neighbor_insert(uint16_t id, int8_t rssi)
+{
+  int slot = neighbor_find(id);
+
+  if (slot >= 0 || id == 0) {
+    return slot;
+  }
+
+  if (free_top == 0) {
+    int weakest = rssi_order[count - 1];
+    if (rssi <= seen_list[weakest].RSSI) {
+      return -1;
+    }
+    neighbor_remove(weakest);
+  }
+
+  slot = free_slots[--free_top];
+  neighbor_write_begin(slot);
+  memset(&seen_list[slot], 0, sizeof(node));
+  seen_list[slot].UUID = id;
+  seen_list[slot].RSSI = rssi;
+  neighbor_write_end(slot);
+
+  uint32_t b = hash_id(id);
+  while (id_map[b] != NEIGHBOR_EMPTY) {
+    b = (b + 1) & NEIGHBOR_MASK;
+  }
+  id_map[b] = slot;
+
+  rssi_order[count] = slot;
+  rank_settle(count++);
+
+  // The next expiry check moves it to the bucket of its actual expiry time
+  wheel_link(slot, wheel_tick & WHEEL_MASK);
+
+  return slot;
+}
+
+/**
+ * @brief Remove the node in a slot from the table
+ *
+ * Uses backward shift deletion so lookups never need tombstones.
+ */
+void neighbor_remove(int slot)
+{
+  if (slot < 0 || slot >= MAX_ANCHOR_COUNT || seen_list[slot].UUID == 0) {
+    return;
+  }
+
+  int b = find_bucket(seen_list[slot].UUID);
+  if (b >= 0) {
+    uint32_t hole = b;
+    uint32_t j = b;
+
+    while (1) {
+      j = (j + 1) & NEIGHBOR_MASK;
+      uint8_t s = id_map[j];
+      if (s == NEIGHBOR_EMPTY) {
+        break;
+      }
+      // Shift back entries whose home bucket is not between the hole and their bucket
+      uint32_t home = hash_id(seen_list[s].UUID);
+      if (((j - home) & NEIGHBOR_MASK) >= ((j - hole) & NEIGHBOR_MASK)) {
+        id_map[hole] = s;
+        hole = j;
+      }
+    }
+    id_map[hole] = NEIGHBOR_EMPTY;
+  }
+
+  wheel_unlink(slot);
+
+  for (int r = rank_of[slot] + 1; r < count; r++) {
+    rssi_order[r - 1] = rssi_order[r];
+    rank_of[rssi_order[r - 1]] = r - 1;
+  }
+  count--;
+
+  neighbor_write_begin(slot);
+  memset(&seen_list[slot], 0, sizeof(node));
+  neighbor_write_end(slot);
+  free_slots[free_top++] = slot;
+}
+
+/**
+ * @brief Number of nodes in the table
+ */
+int neighbor_count(void)
+{
+  return count;
+}
+
+/**
+ * @brief Slot of the neighbor at a given RSSI rank, 0 being the strongest
+ *
+ * @return slot index, -1 if rank is out of range
+ */
+int neighbor_at_rank(int rank)
+{
+  if (rank < 0 || rank >= count) {
+    return -1;
+  }
+  return rssi_order[rank];
+}
+
+/**
+ * @brief Update the RSSI order after the RSSI of a slot changed
+ *
+ * Called from the BLE event interrupt like neighbor_insert(), while
+ * neighbor_remove() runs with that interrupt masked, so the order has a
+ * single writer at a time. Costs one move per neighbor the slot passes,
+ * usually none or a few.
+ */
+void neighbor_reorder(int slot)
+{
+  if (slot < 0 || slot >= MAX_ANCHOR_COUNT || seen_list[slot].UUID == 0) {
+    return;
+  }
+  rank_settle(rank_of[slot]);
+}
+
+/**
+ * @brief Remove the neighbors not heard from for a timeout
+ *
+ * Checks the buckets of the ticks up to now, one slot at a time with
+ * interrupts masked, as BLE events insert and evict from their interrupt.
+ * A change of timeout applies to each slot from its next check.
+ *
+ * @param[in] now       Current time, ms
+ * @param[in] timeout   Time after the last advertisement a neighbor is removed, ms
+ *
+ * @return Number of neighbors removed
+ */
+int neighbor_expire(uint32_t now, uint32_t timeout)
+{
+  uint32_t target = now / NEIGHBOR_EXPIRY_MS;
+  uint8_t nested = 0;
+  int removed = 0;
+
+  // After a stall, one turn of the wheel still checks every slot
+  if (target - wheel_tick >= NEIGHBOR_WHEEL_SIZE) {
+    wheel_tick = target - (NEIGHBOR_WHEEL_SIZE - 1);
+  }
+
+  while ((int32_t)(target - wheel_tick) >= 0) {
+    app_util_critical_region_enter(&nested);
+    int b = wheel_tick & WHEEL_MASK;
+    wheel_tick++;
+    // Slots inserted from now on go to the next bucket
+    for (uint8_t s = wheel[b]; s != NEIGHBOR_EMPTY; s = wheel_next[s]) {
+      wheel_of[s] = WHEEL_EXPIRING;
+    }
+    wheel[WHEEL_EXPIRING] = wheel[b];
+    wheel[b] = NEIGHBOR_EMPTY;
+    app_util_critical_region_exit(nested);
+
+    while (1) {
+      app_util_critical_region_enter(&nested);
+      uint8_t s = wheel[WHEEL_EXPIRING];
+      if (s == NEIGHBOR_EMPTY) {
+        app_util_critical_region_exit(nested);
+        break;
+      }
+
+      uint32_t expiry = seen_list[s].ble_time_stamp + timeout;
+      if ((int32_t)(now - expiry) >= 0) {
+        neighbor_remove(s);
+        removed++;
+      }
+      else {
+        uint32_t tick = expiry / NEIGHBOR_EXPIRY_MS;
+        if ((int32_t)(tick - wheel_tick) < 0) {
+          tick = wheel_tick;
+        }
+        wheel_unlink(s);
+        wheel_link(s, tick & WHEEL_MASK);
+      }
+      app_util_critical_region_exit(nested);
+    }
+  }
+  return removed;
+}
+
+/**
+ * @brief Time the next non-empty timer wheel bucket is due
+ *
+ * A bucket holds the slots of every tick mapping to it, so it is due at the
+ * first of these ticks. Slots expiring a turn later are moved on then.
+ *
+ * @param[out] due   Time to call neighbor_expire() at, ms
+ *
+ * @return false if the table is empty, no expiry check is needed
+ */
+bool neighbor_next_expiry(uint32_t *due)
+{
+  uint8_t nested = 0;
+  bool found = false;
+
+  app_util_critical_region_enter(&nested);
+  for (uint32_t k = 0; k < NEIGHBOR_WHEEL_SIZE; k++) {
+    if (wheel[(wheel_tick + k) & WHEEL_MASK] != NEIGHBOR_EMPTY) {
+      *due = (wheel_tick + k) * NEIGHBOR_EXPIRY_MS;
+      found = true;
+      break;
+    }
+  }
+  app_util_critical_region_exit(nested);
+
+  return found;
+}
+
+/**
+ * @brief Start changing the entry in a slot
+ *
+ * Writers never wait for readers. A writer may interrupt another one, e.g.
+ * a BLE event during a task's write, as the interrupting writer always
+ * completes before the other one resumes.
+ */
+void neighbor_write_begin(int slot)
+{
+  seq[slot]++;
+  __DMB();
+}
+
+/**
+ * @brief Publish the changes made since neighbor_write_begin()
+ */
+void neighbor_write_end(int slot)
+{
+  __DMB();
+  seq[slot]++;
+}
+
+/**
+ * @brief Copy the entry in a slot, consistent with itself
+ *
+ * Gives up instead of spinning when a writer keeps the slot busy, e.g. a
+ * lower priority task preempted during its write.
+ *
+ * @param[in]  slot   Slot index in seen_list
+ * @param[out] copy   Entry snapshot
+ *
+ * @return true if copy holds a consistent, occupied entry
+ */
+bool neighbor_read(int slot, node *copy)
+{
+  if (slot < 0 || slot >= MAX_ANCHOR_COUNT) {
+    return false;
+  }
+
+  for (int i = 0; i < NEIGHBOR_READ_TRIES; i++) {
+    uint32_t start = seq[slot];
+    if (start & 1) {
+      continue;
+    }
+
+    __DMB();
+    memcpy(copy, (const void *)&seen_list[slot], sizeof(node));
+    __DMB();
+
+    if (seq[slot] == start) {
+      return copy->UUID != 0;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Set flag bits of an entry
+ *
+ * Flags are changed by exclusive access so a BLE event changing another
+ * bit of the same entry is not lost.
+ */
+void neighbor_flag_set(int slot, uint8_t mask)
+{
+  (void) __atomic_fetch_or(&seen_list[slot].flags, mask, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Clear flag bits of an entry
+ */
+void neighbor_flag_clear(int slot, uint8_t mask)
+{
+  (void) __atomic_fetch_and(&seen_list[slot].flags, (uint8_t)~mask, __ATOMIC_RELAXED);
+}
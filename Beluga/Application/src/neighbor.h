@@ -0,0 +1,59 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   neighbor.h
+ *
+ *  @brief  Neighbor table with hashed ID lookup and RSSI ordered index --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _NEIGHBOR_H_
+#define _NEIGHBOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "range_filter.h"
+#include "poll_select.h"
+
+#define MAX_ANCHOR_COUNT    128   /**< Number of neighbor slots */
+#define NEIGHBOR_HASH_BITS  8     /**< ID hash buckets = 2^NEIGHBOR_HASH_BITS, at least 2x MAX_ANCHOR_COUNT */
+#define NEIGHBOR_HASH_SIZE  (1 << NEIGHBOR_HASH_BITS)
+#define NEIGHBOR_WHEEL_BITS 6     /**< Expiry timer wheel buckets = 2^NEIGHBOR_WHEEL_BITS */
+#define NEIGHBOR_WHEEL_SIZE (1 << NEIGHBOR_WHEEL_BITS)
+#define NEIGHBOR_EXPIRY_MS  64    /**< Timer wheel resolution */
+
+/* Bits of node.flags, changed with neighbor_flag_set() and neighbor_flag_clear() */
+#define NEIGHBOR_UPDATED    (1 << 0)  /**< New range not printed yet */
+#define NEIGHBOR_POLLING    (1 << 1)  /**< The node advertises that it polls */
+
+/* Neighbor entry, 52 bytes without padding. UUID 0 marks a free slot. */
+typedef struct node {
+    uint32_t time_stamp;        /**< Time of the last accepted range */
+    uint32_t ble_time_stamp;    /**< Time of the last BLE advertisement */
+    float range;
+    uint16_t UUID;
+    int8_t RSSI;
+    volatile uint8_t flags;     /**< NEIGHBOR_* bits */
+    range_filter_t filter;      /**< Range filter state, reset with the entry */
+    poll_state_t poll;          /**< Polling history, reset with the entry */
+} node;
+
+extern node seen_list[MAX_ANCHOR_COUNT];
+
+void neighbor_init(void);
+int neighbor_find(uint16_t id);
+int neighbor_insert(uint16_t id, int8_t rssi);
+void neighbor_remove(int slot);
+int neighbor_count(void);
+int neighbor_at_rank(int rank);
+void neighbor_reorder(int slot);
+int neighbor_expire(uint32_t now, uint32_t timeout);
+bool neighbor_next_expiry(uint32_t *due);
+void neighbor_write_begin(int slot);
+void neighbor_write_end(int slot);
+bool neighbor_read(int slot, node *copy);
+void neighbor_flag_set(int slot, uint8_t mask);
+void neighbor_flag_clear(int slot, uint8_t mask);
+
+#endif
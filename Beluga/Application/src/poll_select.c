@@ -0,0 +1,252 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   poll_select.c
+ *
+ *  @brief  Selection of the neighbors to poll
+ *
+ *          The ranging task asks the current policy which neighbors to poll
+ *          next, and reports the outcome of each exchange back. Policies are
+ *          entries of a table, so another one only needs a select function.
+ *
+ *          The weighted policy polls the neighbor whose last range is the
+ *          most out of date, where a range gets out of date faster when the
+ *          neighbor moves fast and when it is in the priority set chosen by
+ *          the host, and slower when exchanges with it often fail. A neighbor
+ *          never ranged is the most out of date, and as ages keep growing,
+ *          every neighbor is polled eventually.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "neighbor.h"
+#include "uwb_range.h"
+#include "uwb_frame.h"
+#include "poll_select.h"
+
+#define POLL_SPEED_REF      500     /**< Speed doubling the ageing rate, mm/s */
+#define POLL_SPEED_MAX      10000   /**< Speed bound, faster changes are ranging errors, mm/s */
+#define POLL_SPEED_SHIFT    2       /**< Speed average weight, 1 / 2^POLL_SPEED_SHIFT */
+#define POLL_FAIL_SHIFT     2       /**< Failure rate average weight, 1 / 2^POLL_FAIL_SHIFT */
+#define POLL_FAIL_REF       128     /**< Failure rate halving the ageing rate, a third of it at 255 */
+#define POLL_PRIORITY_GAIN  2.0f    /**< Ageing rate factor of the priority set */
+#define POLL_SELECT_MAX     MTWR_MAX_RESPONDERS
+
+typedef struct
+{
+  const char *name;
+  int (*select)(int *slots, int max, uint32_t now);
+} poll_policy_t;
+
+static int select_rr(int *slots, int max, uint32_t now);
+static int select_weighted(int *slots, int max, uint32_t now);
+
+static const poll_policy_t policies[POLL_POLICIES] =
+{
+  { "round robin", select_rr },
+  { "weighted",    select_weighted },
+};
+
+static int policy = POLL_POLICY_RR;
+static int cur_index = 0;                           /**< Next RSSI rank of round robin */
+static uint16_t priority[POLL_PRIORITY_MAX];        /**< Priority set, 0 marks a free entry */
+
+
+/**
+ * @brief Whether a node is in the priority set
+ */
+static bool is_priority(uint16_t id)
+{
+  for (int i = 0; i < POLL_PRIORITY_MAX; i++) {
+    if (priority[i] == id) return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Round robin: the next neighbors from strongest to weakest RSSI, back to the head at the end
+ */
+static int select_rr(int *slots, int max, uint32_t now)
+{
+  int n = 0;
+
+  (void) now;
+  if (cur_index >= neighbor_count()) {
+    cur_index = 0;
+  }
+  while (n < max && cur_index < neighbor_count()) {
+    int slot = neighbor_at_rank(cur_index++);
+    if (slot < 0) break;
+    slots[n++] = slot;
+  }
+  return n;
+}
+
+/**
+ * @brief Urgency of polling a neighbor, the age of its range in weighted ms
+ */
+static float poll_score(const node *nb, uint32_t now)
+{
+  float score = (float)(now - nb->time_stamp);
+
+  score *= (float)(POLL_SPEED_REF + nb->poll.speed) / POLL_SPEED_REF;
+  score *= (float)POLL_FAIL_REF / (POLL_FAIL_REF + nb->poll.fail);
+  if (is_priority(nb->UUID)) {
+    score *= POLL_PRIORITY_GAIN;
+  }
+  return score;
+}
+
+/**
+ * @brief Weighted: the neighbors with the highest score
+ *
+ * One pass keeping the best max slots in order, max being at most the
+ * responders of a broadcast poll.
+ */
+static int select_weighted(int *slots, int max, uint32_t now)
+{
+  float best[POLL_SELECT_MAX];
+  int n = 0;
+
+  if (max > POLL_SELECT_MAX) max = POLL_SELECT_MAX;
+
+  for (int i = 0; i < MAX_ANCHOR_COUNT; i++) {
+    if (seen_list[i].UUID == 0) continue;
+
+    float score = poll_score(&seen_list[i], now);
+    int j = (n < max) ? n++ : max;
+
+    while (j > 0 && best[j - 1] < score) {
+      if (j < max) {
+        best[j] = best[j - 1];
+        slots[j] = slots[j - 1];
+      }
+      j--;
+    }
+    if (j < max) {
+      best[j] = score;
+      slots[j] = i;
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Set the poll selection policy
+ *
+ * @param[in] mode   POLL_POLICY_*
+ */
+void poll_select_set_policy(int mode)
+{
+  if (mode >= 0 && mode < POLL_POLICIES) {
+    policy = mode;
+  }
+}
+
+/**
+ * @brief Current poll selection policy
+ */
+int poll_select_policy(void)
+{
+  return policy;
+}
+
+/**
+ * @brief Name of a poll selection policy
+ */
+const char *poll_select_name(int mode)
+{
+  if (mode < 0 || mode >= POLL_POLICIES) return "";
+  return policies[mode].name;
+}
+
+/**
+ * @brief Neighbors to poll next
+ *
+ * @param[out] slots   Slots in seen list, most urgent first
+ * @param[in]  max     Size of slots
+ * @param[in]  now     Current time, ms
+ *
+ * @return Number of slots set, 0 if there is no neighbor
+ */
+int poll_select_next(int *slots, int max, uint32_t now)
+{
+  return policies[policy].select(slots, max, now);
+}
+
+/**
+ * @brief Record the outcome of an exchange, before the new range is stored
+ *
+ * Called by the ranging task inside its write of the neighbor entry.
+ *
+ * @param[in] slot       Slot in seen list
+ * @param[in] ok         The exchange gave a range
+ * @param[in] range_mm   New range, UWB_RANGE_NONE if it is not stored (failure or outlier)
+ * @param[in] now        Current time, ms
+ */
+void poll_select_result(int slot, bool ok, int32_t range_mm, uint32_t now)
+{
+  node *nb = &seen_list[slot];
+  poll_state_t *p = &nb->poll;
+
+  p->fail = p->fail - (p->fail >> POLL_FAIL_SHIFT) + (ok ? 0 : (255 >> POLL_FAIL_SHIFT));
+
+  // Range change rate against the last stored range
+  if (range_mm != UWB_RANGE_NONE && nb->time_stamp != 0 && now != nb->time_stamp) {
+    int32_t change = range_mm - (int32_t)(nb->range * 1000.0f);
+    if (change < 0) change = -change;
+
+    uint32_t speed = (uint32_t)change * 1000 / (now - nb->time_stamp);
+    if (speed > POLL_SPEED_MAX) speed = POLL_SPEED_MAX;
+
+    p->speed += ((int32_t)speed - (int32_t)p->speed) >> POLL_SPEED_SHIFT;
+  }
+}
+
+/**
+ * @brief Add a node to the priority set
+ *
+ * @return false if the set is full
+ */
+bool poll_priority_add(uint16_t id)
+{
+  int free_idx = -1;
+
+  for (int i = 0; i < POLL_PRIORITY_MAX; i++) {
+    if (priority[i] == id) return true;
+    if (priority[i] == 0 && free_idx < 0) free_idx = i;
+  }
+  if (free_idx < 0) return false;
+
+  priority[free_idx] = id;
+  return true;
+}
+
+/**
+ * @brief Empty the priority set
+ */
+void poll_priority_clear(void)
+{
+  for (int i = 0; i < POLL_PRIORITY_MAX; i++) {
+    priority[i] = 0;
+  }
+}
+
+/**
+ * @brief Nodes in the priority set
+ *
+ * @param[out] ids   At least POLL_PRIORITY_MAX entries
+ *
+ * @return Number of nodes
+ */
+int poll_priority_get(uint16_t *ids)
+{
+  int n = 0;
+
+  for (int i = 0; i < POLL_PRIORITY_MAX; i++) {
+    if (priority[i] != 0) ids[n++] = priority[i];
+  }
+  return n;
+}
@@ -0,0 +1,41 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   poll_select.h
+ *
+ *  @brief  Selection of the neighbors to poll --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _POLL_SELECT_H_
+#define _POLL_SELECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Poll selection policies, set by AT+POLLMODE */
+#define POLL_POLICY_RR        0   /**< Round robin from strongest to weakest RSSI */
+#define POLL_POLICY_WEIGHTED  1   /**< Stalest range first, weighted by speed, failures and priority */
+#define POLL_POLICIES         2
+
+#define POLL_PRIORITY_MAX     8   /**< Size of the priority set */
+
+/* Polling history of one neighbor, 4 bytes. All zero for a new neighbor. */
+typedef struct
+{
+  uint16_t speed;       /**< Average range change rate, mm/s */
+  uint8_t fail;         /**< Average failure rate, 255 = all exchanges fail */
+  uint8_t reserved;
+} poll_state_t;
+
+void poll_select_set_policy(int mode);
+int poll_select_policy(void);
+const char *poll_select_name(int mode);
+int poll_select_next(int *slots, int max, uint32_t now);
+void poll_select_result(int slot, bool ok, int32_t range_mm, uint32_t now);
+bool poll_priority_add(uint16_t id);
+void poll_priority_clear(void);
+int poll_priority_get(uint16_t *ids);
+
+#endif
@@ -18,12 +18,14 @@ uint16_t get_rand_num_exp_collision(uint32_t freq) {
 
       int lower = 10;
       
-      double lambda  = 5.0 / (double)freq;
+      // Single precision, the FPU has no double support
+      float lambda  = 5.0f / (float)freq;
       
-      double u;
+      float u;
       
-      u = rand() / (RAND_MAX + 1.0);
+      // 24 random bits, exact in a float so u stays below 1
+      u = (rand() & 0xFFFFFF) / 16777216.0f;
 
       
-      return (-log(1- u) / lambda)+lower; 
+      return (-logf(1.0f - u) / lambda)+lower; 
 }
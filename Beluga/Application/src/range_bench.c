@@ -0,0 +1,147 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   range_bench.c
+ *
+ *  @brief  On-target cycle counts of the ranging math
+ *
+ *          Times the double formulas the ranging code used before
+ *          uwb_range.c against the fixed-point ones, with the DWT cycle
+ *          counter started by boot_time_init(). On the Cortex-M4F every
+ *          double operation is a library call, and the 64-bit divisions of
+ *          the fixed-point code are __aeabi_uldivmod and __aeabi_ldivmod
+ *          calls, so only a count on the target compares them. Each count
+ *          is the best of several passes, so passes cut by an interrupt
+ *          drop out.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include "nrf.h"
+#include "deca_device_api.h"
+#include "uwb_range.h"
+#include "range_bench.h"
+
+#define BENCH_EXCHANGES   8
+#define BENCH_PASSES      32
+
+#define SPEED_OF_LIGHT    299702547
+#define UUS_TO_DWT_TIME   65536
+
+typedef struct {
+  uint32_t round_a, reply_a, round_b, reply_b;
+  int32_t rtd_init, rtd_resp, carrier_int;
+} bench_exchange_t;
+
+/* Not const, so the compiler cannot fold the computations */
+static bench_exchange_t m_ex[BENCH_EXCHANGES];
+static volatile double m_sink_d;
+static volatile int32_t m_sink_i;
+
+
+/**
+ * @brief Exchanges from 0 to 70 m, with clock offsets up to +-16 ppm
+ */
+static void bench_exchanges(void)
+{
+  for (int i = 0; i < BENCH_EXCHANGES; i++) {
+    double tof = i * 10000.0 * 63897600.0 / SPEED_OF_LIGHT;
+    double drift_a = 1 + (i - 4) * 4e-6;
+    double drift_b = 1 - (i - 4) * 2e-6;
+    double ra = 2000.0 * UUS_TO_DWT_TIME;
+    double rb = 1100.0 * UUS_TO_DWT_TIME;
+
+    m_ex[i].round_a = (2 * tof + rb) * drift_a;
+    m_ex[i].reply_a = ra * drift_a;
+    m_ex[i].round_b = (2 * tof + ra) * drift_b;
+    m_ex[i].reply_b = rb * drift_b;
+    m_ex[i].rtd_init = m_ex[i].round_a;
+    m_ex[i].rtd_resp = m_ex[i].reply_b;
+    m_ex[i].carrier_int = (drift_a - drift_b) / drift_b * 1744830464.0;
+  }
+}
+
+/**
+ * @brief DS-TWR distance of the original ds_resp_run() and ds_init_run()
+ */
+static double bench_ds_double(const bench_exchange_t *e)
+{
+  double roundA = e->round_a, replyA = e->reply_a, roundB = e->round_b, replyB = e->reply_b;
+
+  if ((roundA * roundB - replyA * replyB) <= 0) return -1;
+  uint64_t tof_dtu = (uint64_t)((roundA * roundB - replyA * replyB) / (roundA + roundB + replyA + replyB));
+  return tof_dtu * DWT_TIME_UNITS * SPEED_OF_LIGHT;
+}
+
+static int32_t bench_ds_fixed(const bench_exchange_t *e)
+{
+  int64_t tof_dtu = uwb_range_ds_tof(e->round_a, e->reply_a, e->round_b, e->reply_b);
+
+  return (tof_dtu < 0) ? UWB_RANGE_NONE : uwb_range_mm(tof_dtu);
+}
+
+/**
+ * @brief SS-TWR distance of the original ss_init_run()
+ */
+static double bench_ss_float(const bench_exchange_t *e)
+{
+  float clockOffsetRatio = e->carrier_int * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_5 / 1.0e6);
+  double tof = ((e->rtd_init - e->rtd_resp * (1.0f - clockOffsetRatio)) / 2.0f) * DWT_TIME_UNITS;
+
+  return tof * SPEED_OF_LIGHT;
+}
+
+static int32_t bench_ss_fixed(const bench_exchange_t *e)
+{
+  return uwb_range_ss_mm(e->rtd_init, e->rtd_resp, e->carrier_int);
+}
+
+/**
+ * @brief Best pass over the exchanges, in cycles per range
+ */
+static uint32_t bench_double(double (*fn)(const bench_exchange_t *))
+{
+  uint32_t best = UINT32_MAX;
+
+  for (int p = 0; p < BENCH_PASSES; p++) {
+    uint32_t start = DWT->CYCCNT;
+    for (int i = 0; i < BENCH_EXCHANGES; i++) {
+      m_sink_d = fn(&m_ex[i]);
+    }
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles < best) best = cycles;
+  }
+  return best / BENCH_EXCHANGES;
+}
+
+static uint32_t bench_fixed(int32_t (*fn)(const bench_exchange_t *))
+{
+  uint32_t best = UINT32_MAX;
+
+  for (int p = 0; p < BENCH_PASSES; p++) {
+    uint32_t start = DWT->CYCCNT;
+    for (int i = 0; i < BENCH_EXCHANGES; i++) {
+      m_sink_i = fn(&m_ex[i]);
+    }
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles < best) best = cycles;
+  }
+  return best / BENCH_EXCHANGES;
+}
+
+/**
+ * @brief Count the cycles per range of the double and fixed-point ranging math
+ *
+ * Runs for a few milliseconds on the calling task. The counts include the
+ * call through a function pointer and the store of the result.
+ */
+void range_bench_run(range_bench_t *result)
+{
+  bench_exchanges();
+
+  result->ds_double = bench_double(bench_ds_double);
+  result->ds_fixed = bench_fixed(bench_ds_fixed);
+  result->ss_float = bench_double(bench_ss_float);
+  result->ss_fixed = bench_fixed(bench_ss_fixed);
+}
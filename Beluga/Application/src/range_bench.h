@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   range_bench.h
+ *
+ *  @brief  On-target cycle counts of the ranging math --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _RANGE_BENCH_H_
+#define _RANGE_BENCH_H_
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t ds_double;   /**< DS-TWR, double computation of the original responder */
+  uint32_t ds_fixed;    /**< DS-TWR, uwb_range_ds_tof() and uwb_range_mm() */
+  uint32_t ss_float;    /**< SS-TWR, float and double computation of the original initiator */
+  uint32_t ss_fixed;    /**< SS-TWR, uwb_range_ss_mm() */
+} range_bench_t;
+
+void range_bench_run(range_bench_t *result);
+
+#endif
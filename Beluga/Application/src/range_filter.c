@@ -0,0 +1,250 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   range_filter.c
+ *
+ *  @brief  Per-neighbor range filtering with outlier rejection
+ *
+ *          Each neighbor entry embeds a fixed size filter state, updated by the
+ *          ranging task with every new range. Three filters are available:
+ *          a median of the last ranges, an alpha-beta tracker and a constant
+ *          velocity Kalman filter. Each range is first compared with the
+ *          filter's prediction, and rejected as an outlier when the innovation
+ *          is too large. After a few rejections in a row, or a long gap, the
+ *          filter restarts from the new range so a moving node is not locked
+ *          out.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "range_filter.h"
+#include "uwb_range.h"
+
+#define FILTER_GATE_MM        1000      /**< Median and alpha-beta gate at dt = 0, mm */
+#define FILTER_MAX_SPEED      5000      /**< Speed added to that gate, mm/s */
+#define FILTER_GATE_SIGMA2    9.0f      /**< Kalman gate, innovations beyond 3 sigma are rejected */
+#define FILTER_MAX_REJECTS    3         /**< Rejections in a row before restarting */
+#define FILTER_STALE_MS       5000      /**< Gap after which the filter restarts */
+#define FILTER_MIN_DT_MS      1         /**< Lower bound of the time step */
+
+#define FILTER_AB_ALPHA       0.4f      /**< Alpha-beta range gain */
+#define FILTER_AB_BETA        0.05f     /**< Alpha-beta speed gain */
+
+#define FILTER_KF_R           1.0e4f    /**< Range noise variance, (100 mm)^2 */
+#define FILTER_KF_Q           1.0e6f    /**< Acceleration noise density, (1 m/s^2)^2 */
+#define FILTER_KF_P11         4.0e6f    /**< Initial speed variance, (2 m/s)^2 */
+
+#define FILTER_ERR_REF        100       /**< Average innovation giving 50 % quality, mm */
+#define FILTER_ERR_SHIFT      3         /**< Innovation average weight, 1 / 2^FILTER_ERR_SHIFT */
+
+static range_filter_stats_t m_stats;
+
+
+/**
+ * @brief Round a float range to mm
+ */
+static int32_t filter_round(float x)
+{
+  return (int32_t)(x + (x >= 0 ? 0.5f : -0.5f));
+}
+
+/**
+ * @brief Median of the ranges in the window
+ */
+static int32_t filter_median(const range_filter_t *f)
+{
+  int n = (f->count < RANGE_FILTER_WINDOW) ? f->count : RANGE_FILTER_WINDOW;
+  int32_t sorted[RANGE_FILTER_WINDOW];
+
+  // The newest n ranges end just before head
+  for (int i = 0; i < n; i++) {
+    int32_t v = f->s.window[(f->head + RANGE_FILTER_WINDOW - 1 - i) % RANGE_FILTER_WINDOW];
+    int j = i - 1;
+
+    while (j >= 0 && sorted[j] > v) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+
+  if (n % 2) return sorted[n / 2];
+  return (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/**
+ * @brief Restart a filter from one range
+ */
+static int32_t filter_reset(range_filter_t *f, int mode, int32_t range_mm, uint32_t now_ms)
+{
+  memset(f, 0, sizeof(range_filter_t));
+  f->mode = mode;
+  f->last_ms = now_ms;
+  f->count = 1;
+
+  switch (mode) {
+    case RANGE_FILTER_MEDIAN:
+      f->s.window[0] = range_mm;
+      f->head = 1;
+      break;
+
+    case RANGE_FILTER_AB:
+      f->s.ab.x = range_mm;
+      break;
+
+    case RANGE_FILTER_KALMAN:
+      f->s.kf.x = range_mm;
+      f->s.kf.p00 = FILTER_KF_R;
+      f->s.kf.p11 = FILTER_KF_P11;
+      break;
+  }
+  return range_mm;
+}
+
+/**
+ * @brief Filter a new range of a neighbor
+ *
+ * The state is restarted when the mode changed since the last range, so
+ * changing AT+FILTER needs no access to the ranging task's entries.
+ *
+ * @param[in,out] f          Filter state of the neighbor
+ * @param[in]     mode       RANGE_FILTER_* mode
+ * @param[in]     range_mm   Measured range
+ * @param[in]     now_ms     Time of the range
+ *
+ * @return Filtered range in mm, UWB_RANGE_NONE if the range is rejected
+ */
+int32_t range_filter_update(range_filter_t *f, int mode, int32_t range_mm, uint32_t now_ms)
+{
+  if (mode == RANGE_FILTER_OFF) {
+    f->mode = mode;
+    return range_mm;
+  }
+
+  uint32_t dt_ms = now_ms - f->last_ms;
+
+  if (f->count == 0 || f->mode != mode || dt_ms > FILTER_STALE_MS) {
+    if (f->count != 0) m_stats.resets++;
+    m_stats.accepted++;
+    return filter_reset(f, mode, range_mm, now_ms);
+  }
+
+  if (dt_ms < FILTER_MIN_DT_MS) dt_ms = FILTER_MIN_DT_MS;
+  float dt = dt_ms / 1000.0f;
+  float predicted;
+  bool reject;
+
+  // Predict, and gate the innovation
+  if (mode == RANGE_FILTER_KALMAN) {
+    float p01 = f->s.kf.p01;
+    float p11 = f->s.kf.p11;
+
+    f->s.kf.x += f->s.kf.v * dt;
+    f->s.kf.p00 += dt * (2.0f * p01 + dt * p11) + FILTER_KF_Q * dt * dt * dt * dt / 4.0f;
+    f->s.kf.p01 += dt * p11 + FILTER_KF_Q * dt * dt * dt / 2.0f;
+    f->s.kf.p11 += FILTER_KF_Q * dt * dt;
+
+    predicted = f->s.kf.x;
+    float r = range_mm - predicted;
+    reject = (r * r > FILTER_GATE_SIGMA2 * (f->s.kf.p00 + FILTER_KF_R));
+  }
+  else {
+    if (mode == RANGE_FILTER_AB) {
+      f->s.ab.x += f->s.ab.v * dt;
+      predicted = f->s.ab.x;
+    }
+    else {
+      predicted = filter_median(f);
+    }
+    float r = range_mm - predicted;
+    float gate = FILTER_GATE_MM + FILTER_MAX_SPEED * dt;
+    reject = (r > gate || r < -gate);
+  }
+
+  f->last_ms = now_ms;
+
+  if (reject) {
+    if (++f->rejects < FILTER_MAX_REJECTS) {
+      m_stats.rejected++;
+      return UWB_RANGE_NONE;
+    }
+    // The node really moved, or the filter locked on an outlier
+    m_stats.resets++;
+    m_stats.accepted++;
+    return filter_reset(f, mode, range_mm, now_ms);
+  }
+
+  float r = range_mm - predicted;
+  int32_t out;
+
+  // Correct
+  switch (mode) {
+    case RANGE_FILTER_MEDIAN:
+      f->s.window[f->head] = range_mm;
+      f->head = (f->head + 1) % RANGE_FILTER_WINDOW;
+      if (f->count < UINT8_MAX) f->count++;
+      out = filter_median(f);
+      break;
+
+    case RANGE_FILTER_AB:
+      f->s.ab.x += FILTER_AB_ALPHA * r;
+      f->s.ab.v += FILTER_AB_BETA * r / dt;
+      out = filter_round(f->s.ab.x);
+      break;
+
+    default: {
+      float s = f->s.kf.p00 + FILTER_KF_R;
+      float k0 = f->s.kf.p00 / s;
+      float k1 = f->s.kf.p01 / s;
+
+      f->s.kf.x += k0 * r;
+      f->s.kf.v += k1 * r;
+      f->s.kf.p11 -= k1 * f->s.kf.p01;
+      f->s.kf.p01 *= 1.0f - k0;
+      f->s.kf.p00 *= 1.0f - k0;
+      out = filter_round(f->s.kf.x);
+      break;
+    }
+  }
+
+  if (mode != RANGE_FILTER_MEDIAN && f->count < UINT8_MAX) f->count++;
+  f->rejects = 0;
+
+  // Running average of the innovation size, for the quality figure
+  float a = (r >= 0) ? r : -r;
+  int32_t err = (a > UINT16_MAX) ? UINT16_MAX : (int32_t)a;
+  f->err_mm += (err - (int32_t)f->err_mm) >> FILTER_ERR_SHIFT;
+
+  m_stats.accepted++;
+  return out;
+}
+
+/**
+ * @brief Quality of a neighbor's filtered range
+ *
+ * 100 for a settled filter whose innovations are much smaller than
+ * FILTER_ERR_REF, lower while warming up, with noisy ranges, and halved by
+ * each of the last ranges that was rejected.
+ *
+ * @return Quality from 0 to 100
+ */
+uint8_t range_filter_quality(const range_filter_t *f)
+{
+  uint32_t q = 100 * FILTER_ERR_REF / (FILTER_ERR_REF + f->err_mm);
+
+  if (f->count < RANGE_FILTER_WINDOW) {
+    q = q * f->count / RANGE_FILTER_WINDOW;
+  }
+  return q >> f->rejects;
+}
+
+/**
+ * @brief Counters of all filters since boot
+ */
+void range_filter_stats_get(range_filter_stats_t *stats)
+{
+  *stats = m_stats;
+}
@@ -0,0 +1,52 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   range_filter.h
+ *
+ *  @brief  Per-neighbor range filtering with outlier rejection --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _RANGE_FILTER_H_
+#define _RANGE_FILTER_H_
+
+#include <stdint.h>
+
+/* Filter modes, set by AT+FILTER */
+#define RANGE_FILTER_OFF      0   /**< Raw ranges */
+#define RANGE_FILTER_MEDIAN   1   /**< Median of the last RANGE_FILTER_WINDOW ranges */
+#define RANGE_FILTER_AB       2   /**< Alpha-beta tracker */
+#define RANGE_FILTER_KALMAN   3   /**< Constant velocity Kalman filter */
+#define RANGE_FILTER_MODES    4
+
+#define RANGE_FILTER_WINDOW   5   /**< Median window, also the warm up length of all filters */
+
+/* Filter state of one neighbor, 32 bytes. All zero is a reset state. */
+typedef struct
+{
+  union {
+    int32_t window[RANGE_FILTER_WINDOW];              /**< Median: last ranges, mm */
+    struct { float x, v; } ab;                        /**< Alpha-beta: range mm, speed mm/s */
+    struct { float x, v, p00, p01, p11; } kf;         /**< Kalman: state and covariance */
+  } s;
+  uint32_t last_ms;     /**< Time of the last range */
+  uint16_t err_mm;      /**< Average size of the accepted innovations */
+  uint8_t count;        /**< Ranges accepted since the reset, saturating */
+  uint8_t head;         /**< Median: next window slot */
+  uint8_t rejects;      /**< Consecutive rejected ranges */
+  uint8_t mode;         /**< Mode the state was built with */
+} range_filter_t;
+
+typedef struct
+{
+  uint32_t accepted;    /**< Ranges passed through a filter */
+  uint32_t rejected;    /**< Ranges rejected as outliers */
+  uint32_t resets;      /**< Filters restarted after repeated rejections or a gap */
+} range_filter_stats_t;
+
+int32_t range_filter_update(range_filter_t *f, int mode, int32_t range_mm, uint32_t now_ms);
+uint8_t range_filter_quality(const range_filter_t *f);
+void range_filter_stats_get(range_filter_stats_t *stats);
+
+#endif
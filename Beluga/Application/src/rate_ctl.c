@@ -0,0 +1,128 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   rate_ctl.c
+ *
+ *  @brief  Adaptive poll rate control
+ *
+ *          With AT+AUTORATE set, the poll period moves between the shortest
+ *          period set there and the AT+RATE period by additive increase,
+ *          multiplicative decrease (AIMD) of the poll rate. The rate goes up
+ *          a little after each successful exchange while few exchanges fail
+ *          and the receiver heard no corrupted frame, and is halved after
+ *          every failed exchange. This avoids the collapse of a short fixed
+ *          period as nodes are added, but test/sim_rate.c shows it does not
+ *          beat a fixed AT+RATE period long enough for the number of nodes.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "uwb_frame.h"
+#include "rate_ctl.h"
+
+#define RATE_AI_STEP      2.0f    /**< Rate increase per successful exchange, polls/s */
+#define RATE_MD_FACTOR    0.5f    /**< Rate factor after a failure */
+#define RATE_SUCCESS_HI   0.9f    /**< Success rate above which the rate may go up */
+#define RATE_SUCCESS_W    0.125f  /**< Success rate average weight */
+
+static uint32_t m_min_ms = 0;
+static float m_rate = 0;          /**< Polls/s, 0 until the first period is asked */
+static float m_success = 1.0f;
+static uint32_t m_rx_err = 0;     /**< Corrupted frames seen at the last exchange */
+static uint32_t m_increases = 0;
+static uint32_t m_backoffs = 0;
+
+
+/**
+ * @brief Bound the rate to the periods set by the host
+ */
+static void rate_clamp(uint32_t max_ms)
+{
+  float lo = 1000.0f / max_ms;
+  float hi = 1000.0f / m_min_ms;
+
+  if (m_rate < lo) m_rate = lo;
+  if (m_rate > hi) m_rate = hi;
+}
+
+/**
+ * @brief Set the shortest poll period, 0 to poll at the fixed AT+RATE period
+ *
+ * The rate restarts from the longest period.
+ */
+void rate_ctl_set_min(uint32_t min_ms)
+{
+  m_min_ms = min_ms;
+  m_rate = 0;
+  m_success = 1.0f;
+}
+
+/**
+ * @brief Current poll period
+ *
+ * @param[in] max_ms   Longest poll period, the AT+RATE setting, not 0
+ *
+ * @return Period in ms, max_ms when the rate is fixed
+ */
+uint32_t rate_ctl_period(uint32_t max_ms)
+{
+  if (m_min_ms == 0 || m_min_ms >= max_ms) {
+    return max_ms;
+  }
+
+  rate_clamp(max_ms);
+  return (uint32_t)(1000.0f / m_rate + 0.5f);
+}
+
+/**
+ * @brief Adjust the rate after an exchange
+ *
+ * Called by the ranging task while it owns the radio, as the DW1000 event
+ * counters are read for corrupted frames.
+ *
+ * @param[in] ok   The exchange gave at least one range
+ */
+void rate_ctl_result(bool ok)
+{
+  uwb_rx_stats_t stats;
+
+  uwb_frame_stats_update();
+  uwb_frame_stats_get(&stats);
+
+  // Frames with a bad header or CRC are mostly collisions
+  uint32_t rx_err = stats.crc_err + stats.phr_err;
+  bool busy = (rx_err != m_rx_err);
+  m_rx_err = rx_err;
+
+  m_success += ((ok ? 1.0f : 0.0f) - m_success) * RATE_SUCCESS_W;
+
+  if (m_min_ms == 0 || m_rate == 0) {
+    return;
+  }
+
+  if (ok && !busy && m_success >= RATE_SUCCESS_HI) {
+    m_rate += RATE_AI_STEP;
+    m_increases++;
+  }
+  else if (!ok) {
+    m_rate *= RATE_MD_FACTOR;
+    m_backoffs++;
+  }
+}
+
+/**
+ * @brief Rate control state
+ *
+ * @param[in]  max_ms   Longest poll period, the AT+RATE setting
+ * @param[out] stats    Current period, success rate and counters
+ */
+void rate_ctl_stats_get(uint32_t max_ms, rate_ctl_stats_t *stats)
+{
+  stats->min_ms = m_min_ms;
+  stats->period_ms = (max_ms != 0) ? rate_ctl_period(max_ms) : 0;
+  stats->success = (uint32_t)(m_success * 100.0f + 0.5f);
+  stats->increases = m_increases;
+  stats->backoffs = m_backoffs;
+}
@@ -0,0 +1,31 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   rate_ctl.h
+ *
+ *  @brief  Adaptive poll rate control --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _RATE_CTL_H_
+#define _RATE_CTL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+  uint32_t min_ms;      /**< Shortest poll period, 0 when the rate is fixed */
+  uint32_t period_ms;   /**< Current poll period */
+  uint32_t success;     /**< Average exchange success rate, percent */
+  uint32_t increases;   /**< Rate increases since boot */
+  uint32_t backoffs;    /**< Rate decreases since boot */
+} rate_ctl_stats_t;
+
+void rate_ctl_set_min(uint32_t min_ms);
+uint32_t rate_ctl_period(uint32_t max_ms);
+void rate_ctl_result(bool ok);
+void rate_ctl_stats_get(uint32_t max_ms, rate_ctl_stats_t *stats);
+
+#endif
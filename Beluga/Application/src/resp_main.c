@@ -25,6 +25,12 @@
 #include "semphr.h"
 #include "random.h"
 #include "nrf_drv_wdt.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "tdma.h"
+#include "uwb_calib.h"
+#include "uwb_power.h"
+#include "uwb_range.h"
 
 /* Inter-ranging delay period, in milliseconds. */
 #define RNG_DELAY_MS 250
@@ -32,33 +38,20 @@
 /* Frames used in the ranging process. See NOTE 1,2 below. */
 
 /* Frames used in the ranging process. See NOTE 2,3 below. */
-static uint8 rx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x61, 0, 0};
-static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static uint8 rx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x69, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static uint8 tx_report_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0xE3, 0, 0, 0, 0, 0, 0};
+static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, FRAME_FUNC_RESP, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8 tx_report_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, FRAME_FUNC_REPORT, 0, 0, 0, 0, 0, 0};
 
-/* Length of the common part of the message (up to and including the function code, see NOTE 1 below). */
-/* Length of the common part of the message (up to and including the function code, see NOTE 3 below). */
-#define ALL_MSG_COMMON_LEN 10
-
-/* Index to access some of the fields in the frames involved in the process. */
-#define ALL_MSG_SN_IDX 2
+/* Index to access some of the fields in the frames involved in the process. Header fields are in uwb_frame.h. */
 #define RESP_MSG_POLL_RX_TS_IDX 10
 #define RESP_MSG_RESP_TX_TS_IDX 14
 #define FINAL_MSG_FINAL_TX_TS_IDX 18
 #define RESP_MSG_TS_LEN 4	
 
-/* Frame sequence number, incremented after each transmission. */
-static uint8 frame_seq_nb = 0;
-
 /* Buffer to store received response message.
 * Its size is adjusted to longest frame that this example code is supposed to handle. */
-#define RX_BUF_LEN 24
+#define RX_BUF_LEN MFINAL_LEN(MTWR_MAX_RESPONDERS)
 static uint8 rx_buffer[RX_BUF_LEN];
 
-/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
-static uint32 status_reg = 0;
-
 /* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
 * 1 uus = 512 / 499.2 ?s and 1 ?s = 499.2 * 128 dtu. */
 #define UUS_TO_DWT_TIME 65536
@@ -67,6 +60,11 @@ static uint32 status_reg = 0;
 // Might be able to get away with 800 uSec but would have to test
 // See note 6 at the end of this file
 #define POLL_RX_TO_RESP_TX_DLY_UUS  1100
+/* Default DS-TWR poll RX to response TX delay. Both are replaced by the calibrated delay once AT+CALIBRATE is run. */
+#define DS_POLL_RX_TO_RESP_TX_DLY_UUS  1500
+
+/* The response is prebuilt at this TX buffer offset, see NOTE 8 of init_main.c. */
+#define RESP_TX_BUF_OFFSET 128
 
 
 /* Timestamps of frames transmission/reception.
@@ -82,6 +80,11 @@ static uint64 get_tx_timestamp_u64(void);
 static void resp_msg_set_ts(uint8 *ts_field, const uint64 ts);
 static void resp_msg_get_ts(uint8 *ts_field, uint32 *ts);
 //static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts);
+static void ds_resp_multi(uint16 initiator, int idx);
+static void resp_rx_start(void);
+static uint32 resp_rx_wait(TickType_t timeout);
+static uint32 resp_rx_read(uint64 *rx_ts);
+static void resp_tx_prepare(void);
 
 /* Timestamps of frames transmission/reception.
 * As they are 40-bit wide, we need to define a 64-bit int type to handle them. */
@@ -94,17 +97,21 @@ static uint64 final_rx_ts;
 static volatile int tx_count = 0 ; // Successful transmit counter
 static volatile int rx_count = 0 ; // Successful receive counter 
 
-/* Hold copies of computed time of flight and distance here for reference so that it can be examined at a debug breakpoint. */
-static double tof;
-static double distance;
-/* Speed of light in air, in metres per second. */
-#define SPEED_OF_LIGHT 299702547
+/* Hold a copy of the computed time of flight here for reference so that it can be examined at a debug breakpoint. */
+static int64 tof;
 
 /* This is the delay from the end of the frame transmission to the enable of the receiver, as programmed for the DW1000's wait for response feature. */
 #define RESP_TX_TO_FINAL_RX_DLY_UUS 500
 /* Receive final timeout. See NOTE 5 below. */
 #define FINAL_RX_TIMEOUT_UUS 4500
 
+/* Time to listen for a poll before returning to the responder task, in ticks. */
+#define RESP_POLL_WAIT_TICKS 1000
+/* Safety bound on waiting for a DW1000 event within an exchange, in ticks. */
+#define UWB_EVT_TIMEOUT_TICKS 10
+/* Same bound for the longer windows of a broadcast poll exchange. */
+#define MTWR_WAIT_TICKS 20
+
 nrf_drv_wdt_channel_id m_channel_id;
 
 
@@ -125,35 +132,29 @@ int ds_resp_run(void)
   int suspend_start = uxQueueMessagesWaiting((QueueHandle_t) sus_resp); //Check if responding is suspended
   if(suspend_start == 0) return 1;
 
+  /* Prebuild the response, the header from the sequence number to the source is written once the poll arrives. */
+  dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, RESP_TX_BUF_OFFSET);
+
   /* Activate reception immediately. */
-  dwt_rxenable(DWT_START_RX_IMMEDIATE);
+  resp_rx_start();
 
-  /* Poll for reception of a frame or error/timeout. See NOTE 5 below. */
-  while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-  {
-    nrf_gpio_pin_set(27);
-    int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-    if(suspend == 0) 
-    {
-      //if (debug_print) printf("stopped from loop \r\n");
-      dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
-    
-      /* Reset RX to properly reinitialise LDE operation. */
-      dwt_rxreset();
-      nrf_gpio_pin_clear(27);
-      return 1;
-    }
-  }
+  /* Block until a frame or error/timeout is reported, or the ranging task suspends responding. See NOTE 5 below. */
+  nrf_gpio_pin_set(27);
+  uint32 event = resp_rx_wait(RESP_POLL_WAIT_TICKS);
   nrf_gpio_pin_clear(27);
+  uwb_sniff_rx(false);
+  if (!(event & UWB_EVT_RX_ANY) || uxQueueMessagesWaiting((QueueHandle_t) sus_resp) == 0)
+  {
+    //if (debug_print) printf("stopped from loop \r\n");
+    /* In continuous RX mode the receiver keeps listening until responding is suspended. */
+    if (event == 0 && uwb_rx_continuous_enabled() && uxQueueMessagesWaiting((QueueHandle_t) sus_resp) != 0) return 1;
 
-    #if 0	  // Include to determine the type of timeout if required.
-    int temp = 0;
-    // (frame wait timeout and preamble detect timeout)
-    if(status_reg & SYS_STATUS_RXRFTO )
-    temp =1;
-    else if(status_reg & SYS_STATUS_RXPTO )
-    temp =2;
-    #endif
+    uwb_rx_stop();
+
+    /* Reset RX to properly reinitialise LDE operation. */
+    dwt_rxreset();
+    return 1;
+  }
 //  if (debug_print) printf("RXFCG:%d \r\n", dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_RXFCG);
 //  if (debug_print) printf("RXRFTO:%d \r\n", dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_RXRFTO);
 //  if (debug_print) printf("RXPTO:%d \r\n", dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_RXPTO);
@@ -164,36 +165,31 @@ int ds_resp_run(void)
 //  if (debug_print) printf("AFFREJ:%d \r\n", dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_AFFREJ);
 //  if (debug_print) printf("LDEERR:%d \r\n", dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_LDEERR);
 
-  if (status_reg & SYS_STATUS_RXFCG)
+  if (event & UWB_EVT_RX_OK)
   {
     uint32 frame_len;
-
-    /* Clear good RX frame event in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+    uint64 rx_ts;
 
     /* A frame has been received, read it into the local buffer. */
-    frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-    if (frame_len <= RX_BUFFER_LEN)
-    {
-      dwt_readrxdata(rx_buffer, frame_len, 0);
-    }
+    frame_len = resp_rx_read(&rx_ts);
 
-    /*  Check that the frame is the expected response from the companion frame and extract ID from sender' message */
-    int id = rx_buffer[ALL_MSG_SN_IDX];
-    rx_buffer[ALL_MSG_SN_IDX] = 0;  
-    if ((memcmp(rx_buffer, rx_poll_msg, ALL_MSG_COMMON_LEN) == 0) && (id == NODE_UUID))
+    /* Check that the frame is a poll. Polls for other nodes are dropped by the DW1000 frame filter. */
+    if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_POLL, UWB_ADDR_BROADCAST))
     {
+      uint16 initiator = uwb_frame_src(rx_buffer);
+
+
       if (debug_print) printf("Poll msg received \r\n");
 
       uint32 resp_tx_time;
       int ret;
 
       /* Retrieve poll reception timestamp. */
-      poll_rx_ts = get_rx_timestamp_u64();
+      poll_rx_ts = rx_ts;
 
       /* Compute final message transmission time. See NOTE 7 below. */
       //resp_tx_time = (poll_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
-      resp_tx_time = (poll_rx_ts + (1500 * UUS_TO_DWT_TIME)) >> 8;
+      resp_tx_time = (poll_rx_ts + ((uint64)uwb_reply_delay(DS_POLL_RX_TO_RESP_TX_DLY_UUS) * UUS_TO_DWT_TIME)) >> 8;
       dwt_setdelayedtrxtime(resp_tx_time);
 
 //--  /* Set expected delay and timeout for final message reception. See NOTE 4 and 5 below. */
@@ -202,9 +198,10 @@ int ds_resp_run(void)
 //--
 
       /* Write and send the response message. See NOTE 9 below. */
-      tx_resp_msg[ALL_MSG_SN_IDX] = NODE_UUID;
-      dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0); /* Zero offset in TX buffer. See Note 5 below.*/
-      dwt_writetxfctrl(sizeof(tx_resp_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+      resp_tx_prepare();
+      uwb_frame_header(tx_resp_msg, initiator);
+      dwt_writetxdata(FRAME_SRC_IDX + 2 - FRAME_SN_IDX + 2, &tx_resp_msg[FRAME_SN_IDX], RESP_TX_BUF_OFFSET + FRAME_SN_IDX);
+      dwt_writetxfctrl(sizeof(tx_resp_msg), RESP_TX_BUF_OFFSET, 1); /* Ranging. */
 
       /* Send Response message */
       ret = dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
@@ -215,23 +212,16 @@ int ds_resp_run(void)
       {
         if (debug_print) printf("Second msg sent \r\n");
       
-        /* Poll DW1000 until TX frame sent event set. See NOTE 5 below. */
-        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+        /* Block until the DW1000 reports TX frame sent. See NOTE 5 below. */
+        if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) != UWB_EVT_TX_DONE)
         {
-//          int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-//          if(suspend == 0) 
-//          {
-//            //if (debug_print) printf("Left while waiting\r\n");
-//            nrf_gpio_pin_clear(12);
-//            dwt_forcetrxoff();
-//            return 1;
-//           }
+          nrf_gpio_pin_clear(12);
+          dwt_forcetrxoff();
+          dwt_rxreset();
+          return 1;
         }
         nrf_gpio_pin_clear(12);
-
-        /* Clear TXFRS event. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
-      
+        uwb_frame_stats_answered();
       }
       else
       {
@@ -253,65 +243,33 @@ int ds_resp_run(void)
       }
 
       
-      /* Poll for reception of a frame or error/timeout. See NOTE 5 below. */
-      while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-      {
-        nrf_gpio_pin_set(27);
-        int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-        if(suspend == 0) 
-        {
-          //if (debug_print) printf("stopped from loop \r\n");
-          dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
-    
-          /* Reset RX to properly reinitialise LDE operation. */
-          dwt_rxreset();
-          nrf_gpio_pin_clear(27);
-          return 1;
-        }
-      };
+      /* Wait for reception of a frame or error/timeout. See NOTE 5 below. */
+      nrf_gpio_pin_set(27);
+      event = resp_rx_wait(UWB_EVT_TIMEOUT_TICKS);
       nrf_gpio_pin_clear(27);
 
-        #if 0	  // Include to determine the type of timeout if required.
-        int temp = 0;
-        // (frame wait timeout and preamble detect timeout)
-        if(status_reg & SYS_STATUS_RXRFTO )
-        temp =1;
-        else if(status_reg & SYS_STATUS_RXPTO )
-        temp =2;
-        #endif
-
-      if (status_reg & SYS_STATUS_RXFCG)
+      if (event & UWB_EVT_RX_OK)
       {
         uint32 frame_len;
-
-        /* Clear good RX frame event in the DW1000 status register. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+        uint64 rx_ts;
 
         /* A frame has been received, read it into the local buffer. */
-        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-        if (frame_len <= RX_BUFFER_LEN)
-        {
-          dwt_readrxdata(rx_buffer, frame_len, 0);
-        }
+        frame_len = resp_rx_read(&rx_ts);
 
-        /* Check that the frame is a poll sent by "SS TWR initiator" example.
-        * As the sequence number field of the frame is not relevant, it is cleared to simplify the validation of the frame. */
-        int id = rx_buffer[ALL_MSG_SN_IDX];
-        rx_buffer[ALL_MSG_SN_IDX] = 0;
+        /* Check that the frame is the final of the initiator that polled us. */
 
 //----- Receive third(final) message -----
 
-        if (memcmp(rx_buffer, rx_final_msg, ALL_MSG_COMMON_LEN) == 0  && (id == NODE_UUID))
+        if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_FINAL, initiator))
         {
           if (debug_print) printf("Final msg received \r\n");
-          int ret;
           uint32 resp_rx_ts, poll_tx_ts, final_tx_ts;
           uint32 poll_rx_ts_32, resp_tx_ts_32, final_rx_ts_32;
-          double roundA, replyA, roundB, replyB;
+          uint32 roundA, replyA, roundB, replyB;
           int64 tof_dtu;
 
           /* Retrieve final reception timestamp. */
-          final_rx_ts = get_rx_timestamp_u64();
+          final_rx_ts = rx_ts;
           resp_tx_ts = get_tx_timestamp_u64();
 
           /* Get timestamps embedded in response message. */
@@ -323,19 +281,16 @@ int ds_resp_run(void)
           poll_rx_ts_32 = (uint32)poll_rx_ts;
           resp_tx_ts_32 = (uint32)resp_tx_ts;
           final_rx_ts_32 = (uint32)final_rx_ts;
-          roundB = (double) (final_rx_ts_32 - resp_tx_ts_32);
-          replyB = (double) (resp_tx_ts_32 - poll_rx_ts_32);
-          roundA = (double) (resp_rx_ts - poll_tx_ts);
-          replyA = (double) (final_tx_ts - resp_rx_ts);
-
-          if ((roundA * roundB - replyA * replyB) <= 0) return 1;
-
-          /* Compute time of flight and distance, using clock offset ratio to correct for differing local and remote clock rates */
-          tof_dtu = (uint64) ((roundA * roundB - replyA * replyB) / (roundA + roundB + replyA + replyB));
-          tof = tof_dtu * DWT_TIME_UNITS;
-          distance = tof * SPEED_OF_LIGHT;
+          roundB = final_rx_ts_32 - resp_tx_ts_32;
+          replyB = resp_tx_ts_32 - poll_rx_ts_32;
+          roundA = resp_rx_ts - poll_tx_ts;
+          replyA = final_tx_ts - resp_rx_ts;
+
+          /* Compute time of flight in integer math, the initiator turns it into a distance. See NOTE 13 below. */
+          tof_dtu = uwb_range_ds_tof(roundA, replyA, roundB, replyB);
+          if (tof_dtu <= 0) return 1;
+          tof = tof_dtu;
           //if (tof_dtu== 0) printf("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$ \r\n");
-          //printf("SDS-TWR Distance : %f\r\n",distance);
 
 
 //----- Send report message
@@ -344,7 +299,8 @@ int ds_resp_run(void)
           resp_msg_set_ts(&tx_report_msg[RESP_MSG_POLL_RX_TS_IDX], tof_dtu);
 
           /* Write and send the report message. */
-          tx_report_msg[ALL_MSG_SN_IDX] = NODE_UUID;
+          resp_tx_prepare();
+          uwb_frame_header(tx_report_msg, initiator);
           dwt_writetxdata(sizeof(tx_report_msg), tx_report_msg, 0); /* Zero offset in TX buffer. See Note 5 below.*/
           dwt_writetxfctrl(sizeof(tx_report_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
           int ret_report = dwt_starttx(DWT_START_TX_IMMEDIATE);
@@ -353,21 +309,12 @@ int ds_resp_run(void)
           if (ret_report == DWT_SUCCESS)
           {
             if (debug_print) printf("Report message sent! \r\n");
-            /* Poll DW1000 until TX frame sent event set. See NOTE 5 below. */
-            while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+            /* Block until the DW1000 reports TX frame sent. See NOTE 5 below. */
+            if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) != UWB_EVT_TX_DONE)
             {
-//              int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-//              if(suspend == 0) 
-//              {
-//                //if (debug_print) printf("Left while waiting\r\n");
-//                dwt_forcetrxoff();
-//                nrf_gpio_pin_clear(12);
-//                return 1;
-//               }
-            };
+              dwt_forcetrxoff();
+            }
             nrf_gpio_pin_clear(12);
-            /* Clear TXFRS event. */
-            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
           }
 
           else
@@ -393,34 +340,149 @@ int ds_resp_run(void)
 //          dwt_rxreset();
 //          return -1;
         }
-      } //status_reg
-      else
+      } //event
+      else if (!(event & UWB_EVT_RX_ANY))
       {
-        /* Clear RX error/timeout events in the DW1000 status register. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+        /* Timed out or cancelled, the RX error/timeout events are handled by dwt_isr(). */
+        dwt_forcetrxoff();
 
         /* Reset RX to properly reinitialise LDE operation. */
         dwt_rxreset();
       } 
     } //memcpy
+    else if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_MPOLL, UWB_ADDR_BROADCAST))
+    {
+      /* Broadcast poll, answer in our slot if we are listed. */
+      int n = rx_buffer[MPOLL_N_IDX];
+      if (n <= MTWR_MAX_RESPONDERS && frame_len >= MPOLL_LEN(n))
+      {
+        for (int i = 0; i < n; i++)
+        {
+          uint16 id = rx_buffer[MPOLL_ID_IDX + 2 * i] | (rx_buffer[MPOLL_ID_IDX + 2 * i + 1] << 8);
+          if (id == NODE_UUID)
+          {
+            poll_rx_ts = rx_ts;
+            ds_resp_multi(uwb_frame_src(rx_buffer), i);
+            break;
+          }
+        }
+      }
+    }
+    else if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_BEACON, UWB_ADDR_BROADCAST))
+    {
+      /* TDMA superframe beacon from the coordinator. */
+      tdma_beacon_rx(rx_buffer, frame_len);
+    }
     else
     {
       /* Reset RX to properly reinitialise LDE operation. */
 //      dwt_rxreset();
 //      return -1;
     }
-  } //status_reg
-  else
+  } //event
+
+  return(1);	
+
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn ds_resp_multi()
+*
+* @brief Answer a broadcast poll in our slot, then compute and report the time of flight from the broadcast final.
+*        See NOTE 7 of init_main.c.
+*
+* @param  initiator  node ID of the initiator
+*         idx        our position in the responder list of the poll
+*
+* @return none
+*/
+static void ds_resp_multi(uint16 initiator, int idx)
+{
+  uint32 resp_tx_time, report_tx_time;
+
+  /* Send the response in our slot, poll_rx_ts was set by ds_resp_run(). */
+  resp_tx_time = (poll_rx_ts + ((MTWR_RESP_DLY_UUS + idx * MTWR_SLOT_UUS) * UUS_TO_DWT_TIME)) >> 8;
+  dwt_setdelayedtrxtime(resp_tx_time);
+
+  resp_tx_prepare();
+  uwb_frame_header(tx_resp_msg, initiator);
+  dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0); /* Zero offset in TX buffer. */
+  dwt_writetxfctrl(sizeof(tx_resp_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+
+  if (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS)
   {
-    /* Clear RX error events in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+    dwt_rxreset();
+    return;
+  }
 
-    /* Reset RX to properly reinitialise LDE operation. */
+  if (uwb_wait_event(UWB_EVT_TX_DONE, MTWR_WAIT_TICKS) != UWB_EVT_TX_DONE)
+  {
+    dwt_forcetrxoff();
     dwt_rxreset();
+    return;
   }
+  resp_tx_ts = get_tx_timestamp_u64();
+  uwb_frame_stats_answered();
 
-  return(1);	
+  /* Wait for the broadcast final, the responses of the other nodes are dropped by the frame filter. */
+  uint32 event = resp_rx_wait(MTWR_WAIT_TICKS);
+  if (!(event & UWB_EVT_RX_OK))
+  {
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    return;
+  }
 
+  uint64 rx_ts;
+  uint32 frame_len = resp_rx_read(&rx_ts);
+
+  if (!uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_MFINAL, initiator) ||
+      rx_buffer[MFINAL_N_IDX] <= idx || frame_len < MFINAL_LEN(rx_buffer[MFINAL_N_IDX]))
+  {
+    return;
+  }
+
+  uint32 poll_tx_ts, final_tx_ts, resp_rx_ts;
+  uint32 roundA, replyA, roundB, replyB;
+  int64 tof_dtu;
+
+  final_rx_ts = rx_ts;
+  resp_msg_get_ts(&rx_buffer[MFINAL_POLL_TX_IDX], &poll_tx_ts);
+  resp_msg_get_ts(&rx_buffer[MFINAL_FINAL_TX_IDX], &final_tx_ts);
+  resp_msg_get_ts(&rx_buffer[MFINAL_RESP_RX_IDX + 4 * idx], &resp_rx_ts);
+
+  /* The initiator missed our response. */
+  if (resp_rx_ts == 0) return;
+
+  roundB = (uint32)final_rx_ts - (uint32)resp_tx_ts;
+  replyB = (uint32)resp_tx_ts - (uint32)poll_rx_ts;
+  roundA = resp_rx_ts - poll_tx_ts;
+  replyA = final_tx_ts - resp_rx_ts;
+
+  tof_dtu = uwb_range_ds_tof(roundA, replyA, roundB, replyB);
+  if (tof_dtu <= 0) return;
+
+  /* Send the report in our slot. */
+  report_tx_time = (final_rx_ts + ((MTWR_RESP_DLY_UUS + idx * MTWR_SLOT_UUS) * UUS_TO_DWT_TIME)) >> 8;
+  dwt_setdelayedtrxtime(report_tx_time);
+
+  resp_msg_set_ts(&tx_report_msg[RESP_MSG_POLL_RX_TS_IDX], tof_dtu);
+  resp_tx_prepare();
+  uwb_frame_header(tx_report_msg, initiator);
+  dwt_writetxdata(sizeof(tx_report_msg), tx_report_msg, 0); /* Zero offset in TX buffer. */
+  dwt_writetxfctrl(sizeof(tx_report_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+
+  if (dwt_starttx(DWT_START_TX_DELAYED) != DWT_SUCCESS)
+  {
+    dwt_rxreset();
+    return;
+  }
+
+  if (uwb_wait_event(UWB_EVT_TX_DONE, MTWR_WAIT_TICKS) != UWB_EVT_TX_DONE)
+  {
+    dwt_forcetrxoff();
+  }
 }
 
 
@@ -439,72 +501,53 @@ int ss_resp_run(void)
   int suspend_start = uxQueueMessagesWaiting((QueueHandle_t) sus_resp); //Check if responding is suspended
   if(suspend_start == 0) return 1;
 
+  /* Prebuild the response, only the header and timestamps are written once the poll arrives. */
+  dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, RESP_TX_BUF_OFFSET);
+
   /* Activate reception immediately. */
-  dwt_rxenable(DWT_START_RX_IMMEDIATE);
+  resp_rx_start();
 
-  while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+  uint32 event = resp_rx_wait(RESP_POLL_WAIT_TICKS);
+  uwb_sniff_rx(false);
+  if (!(event & UWB_EVT_RX_ANY) || uxQueueMessagesWaiting((QueueHandle_t) sus_resp) == 0)
   {
-    int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-    if(suspend == 0) 
-    {
-      if (debug_print) printf("stopped from loop \r\n");
-      dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
-    
-      /* Reset RX to properly reinitialise LDE operation. */
-      dwt_rxreset();
-      return 1;
-    }
+    if (debug_print) printf("stopped from loop \r\n");
+    /* In continuous RX mode the receiver keeps listening until responding is suspended. */
+    if (event == 0 && uwb_rx_continuous_enabled() && uxQueueMessagesWaiting((QueueHandle_t) sus_resp) != 0) return 1;
+
+    uwb_rx_stop();
+
+    /* Reset RX to properly reinitialise LDE operation. */
+    dwt_rxreset();
+    return 1;
   }
 
    if (debug_print) printf("gotrx sem\r\n");
 
-    #if 0	  // Include to determine the type of timeout if required.
-    int temp = 0;
-    // (frame wait timeout and preamble detect timeout)
-    if(status_reg & SYS_STATUS_RXRFTO )
-    temp =1;
-    else if(status_reg & SYS_STATUS_RXPTO )
-    temp =2;
-    #endif
-
-  if (status_reg & SYS_STATUS_RXFCG)
-  //if(rx_int_flag)
+  if (event & UWB_EVT_RX_OK)
   {
     if(debug_print) printf("rx good \r\n");
     //printf("good\r\n");
     uint32 frame_len;
-
-    /* Clear good RX frame event in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
-    //rx_int_flag = 0;
-
-
+    uint64 rx_ts;
 
     /* A frame has been received, read it into the local buffer. */
-    frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-    if (frame_len <= RX_BUFFER_LEN)
-    {
-      dwt_readrxdata(rx_buffer, frame_len, 0);
-    }
+    frame_len = resp_rx_read(&rx_ts);
 
-    /* Check that the frame is a poll sent by "SS TWR initiator" example.
-    * As the sequence number field of the frame is not relevant, it is cleared to simplify the validation of the frame. */
-    int id = rx_buffer[ALL_MSG_SN_IDX];
-    rx_buffer[ALL_MSG_SN_IDX] = 0;
-    
-   
-    if ((memcmp(rx_buffer, rx_poll_msg, ALL_MSG_COMMON_LEN) == 0) && (id == NODE_UUID))
+    /* Check that the frame is a poll. Polls for other nodes are dropped by the DW1000 frame filter. */
+    if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_POLL, UWB_ADDR_BROADCAST))
     {
+      uint16 initiator = uwb_frame_src(rx_buffer);
 
       if(debug_print) printf("match\r\n");
       uint32 resp_tx_time;
       int ret;
 
       /* Retrieve poll reception timestamp. */
-      poll_rx_ts = get_rx_timestamp_u64();
+      poll_rx_ts = rx_ts;
 
       /* Compute final message transmission time. See NOTE 7 below. */
-      resp_tx_time = (poll_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+      resp_tx_time = (poll_rx_ts + ((uint64)uwb_reply_delay(POLL_RX_TO_RESP_TX_DLY_UUS) * UUS_TO_DWT_TIME)) >> 8;
       dwt_setdelayedtrxtime(resp_tx_time);
 
       /* Response TX timestamp is the transmission time we programmed plus the antenna delay. */
@@ -515,9 +558,10 @@ int ss_resp_run(void)
       resp_msg_set_ts(&tx_resp_msg[RESP_MSG_RESP_TX_TS_IDX], resp_tx_ts);
 
       /* Write and send the response message. See NOTE 9 below. */
-      tx_resp_msg[ALL_MSG_SN_IDX] = NODE_UUID;
-      dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0); /* Zero offset in TX buffer. See Note 5 below.*/
-      dwt_writetxfctrl(sizeof(tx_resp_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+      resp_tx_prepare();
+      uwb_frame_header(tx_resp_msg, initiator);
+      dwt_writetxdata(RESP_MSG_RESP_TX_TS_IDX + RESP_MSG_TS_LEN - FRAME_SN_IDX + 2, &tx_resp_msg[FRAME_SN_IDX], RESP_TX_BUF_OFFSET + FRAME_SN_IDX);
+      dwt_writetxfctrl(sizeof(tx_resp_msg), RESP_TX_BUF_OFFSET, 1); /* Ranging. */
 
       ret = dwt_starttx(DWT_START_TX_DELAYED);
       //
@@ -528,23 +572,14 @@ int ss_resp_run(void)
       {
        if (debug_print) printf("succ\r\n");
 
-      while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+      if (uwb_wait_event(UWB_EVT_TX_DONE, UWB_EVT_TIMEOUT_TICKS) != UWB_EVT_TX_DONE)
       {
-        int suspend = uxQueueMessagesWaiting((QueueHandle_t) sus_resp);
-        if(suspend == 0) 
-        {
-          if (debug_print) printf("Left while waiting\r\n");
-          dwt_forcetrxoff();
-          return 1;
-         }
+        if (debug_print) printf("Left while waiting\r\n");
+        dwt_forcetrxoff();
+        return 1;
       }
 
-      /* Clear TXFRS event. */
-      dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
-
-      /* Increment frame sequence number after transmission of the poll message (modulo 256). */
-      frame_seq_nb++;
-
+      uwb_frame_stats_answered();
       if (debug_print) printf("sent tx \r\n");
       }
       else
@@ -555,22 +590,22 @@ int ss_resp_run(void)
       dwt_rxreset();
       }
     }
+    else if ((frame_len <= RX_BUF_LEN) && uwb_frame_check(rx_buffer, frame_len, FRAME_FUNC_BEACON, UWB_ADDR_BROADCAST))
+    {
+      /* TDMA superframe beacon from the coordinator. */
+      tdma_beacon_rx(rx_buffer, frame_len);
+    }
     else
     {
       if(debug_print) printf("no match\r\n");
-      dwt_rxreset();
+      if (!uwb_rx_continuous_enabled()) dwt_rxreset();
     }
     
   }
   else
   {
+    /* RX error/timeout events are cleared and the receiver reset by dwt_isr(). */
     if(debug_print) printf("rx err/to \r\n");
-    /* Clear RX error events in the DW1000 status register. */
-    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
-    
-    /* Reset RX to properly reinitialise LDE operation. */
-    dwt_rxreset();
-
   }
  
   return(1);	
@@ -580,6 +615,105 @@ int ss_resp_run(void)
 
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn resp_rx_start()
+*
+* @brief Activate reception. In continuous RX mode the receiver is only enabled if it stopped, see NOTE 11 below.
+*
+* @param  none
+*
+* @return none
+*/
+static void resp_rx_start(void)
+{
+  if (uwb_rx_continuous_enabled())
+  {
+    uwb_rx_listen();
+  }
+  else
+  {
+    uwb_clear_events();
+    /* Cycle the receiver while waiting for a poll if a sniff duty cycle is set. See NOTE 12 below. */
+    uwb_sniff_rx(true);
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+  }
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn resp_rx_wait()
+*
+* @brief Block until a frame is received, or an RX error/timeout occurs
+*
+* @param  timeout  maximum number of ticks to block
+*
+* @return UWB_EVT_* events, 0 on timeout
+*/
+static uint32 resp_rx_wait(TickType_t timeout)
+{
+  if (uwb_rx_continuous_enabled())
+  {
+    return uwb_rx_wait(timeout);
+  }
+  return uwb_wait_event(UWB_EVT_RX_ANY, timeout);
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn resp_rx_read()
+*
+* @brief Read the received frame into rx_buffer, from the DW1000 or from the continuous RX queue
+*
+* @param  rx_ts  RX timestamp of the frame
+*
+* @return frame length, 0 if the frame does not fit in rx_buffer
+*/
+static uint32 resp_rx_read(uint64 *rx_ts)
+{
+  uint8 ts_tab[5];
+  uint32 frame_len;
+  int i;
+
+  if (uwb_rx_continuous_enabled())
+  {
+    frame_len = uwb_rx_pop(rx_buffer, RX_BUF_LEN, ts_tab);
+    *rx_ts = 0;
+    for (i = 4; i >= 0; i--)
+    {
+      *rx_ts <<= 8;
+      *rx_ts |= ts_tab[i];
+    }
+    return frame_len;
+  }
+
+  frame_len = uwb_rx_length();
+  if (frame_len > RX_BUF_LEN) return 0;
+
+  dwt_readrxdata(rx_buffer, frame_len, 0);
+  *rx_ts = get_rx_timestamp_u64();
+  return frame_len;
+}
+
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn resp_tx_prepare()
+*
+* @brief In continuous RX mode the receiver is still listening after a frame, stop it before transmitting. Frames
+*        queued meanwhile are too old to be answered and are dropped.
+*
+* @param  none
+*
+* @return none
+*/
+static void resp_tx_prepare(void)
+{
+  if (uwb_rx_continuous_enabled())
+  {
+    uwb_rx_stop();
+  }
+}
+
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
  *
@@ -695,16 +829,14 @@ static void resp_msg_get_ts(uint8 *ts_field, uint32 *ts)
 *     - byte 10 -> 13: poll message reception timestamp.
 *     - byte 14 -> 17: response message transmission timestamp.
 *    All messages end with a 2-byte checksum automatically set by DW1000.
-* 3. Source and destination addresses are hard coded constants in this example to keep it simple but for a real product every device should have a
-*    unique ID. Here, 16-bit addressing is used to keep the messages as short as possible but, in an actual application, this should be done only
-*    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange.
+* 3. Source and destination addresses are the 16-bit node IDs set with AT+ID. The same ID is programmed as the DW1000 short address and frame
+*    filtering is enabled (see uwb_frame.c), so polls addressed to other nodes are rejected by the DW1000 without waking up the responder task.
 * 4. dwt_writetxdata() takes the full size of the message as a parameter but only copies (size - 2) bytes as the check-sum at the end of the frame is
 *    automatically appended by the DW1000. This means that our variable could be two bytes shorter without losing any data (but the sizeof would not
 *    work anymore then as we would still have to indicate the full length of the frame to dwt_writetxdata()).
-* 5. We use polled mode of operation here to keep the example as simple as possible but all status events can be used to generate interrupts. Please
-*    refer to DW1000 User Manual for more details on "interrupts". It is also to be noted that STATUS register is 5 bytes long but, as the event we
-*    use are all in the first bytes of the register, we can use the simple dwt_read32bitreg() API call to access it instead of reading the whole 5
-*    bytes.
+* 5. The status events used here are routed to the DW1000 IRQ line (see uwb_irq.c). The waiting task blocks on a FreeRTOS task notification
+*    and runs dwt_isr() itself when woken, so the STATUS register is only read over SPI once an event is actually pending instead of being polled
+*    in a loop. Please refer to DW1000 User Manual for more details on "interrupts".
 * 6. POLL_RX_TO_RESP_TX_DLY_UUS is a critical value for porting to different processors. For slower platforms where the SPI is at a slower speed 
 *    or the processor is operating at a lower frequency (Comparing to STM32F, SPI of 18MHz and Processor internal 72MHz)this value needs to be increased.
 *    Knowing the exact time when the responder is going to send its response is vital for time of flight calculation. The specification of the time of 
@@ -723,6 +855,16 @@ static void resp_msg_get_ts(uint8 *ts_field, uint32 *ts)
 *    work anymore then as we would still have to indicate the full length of the frame to dwt_writetxdata()).
 *10. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
 *    DW1000 API Guide for more details on the DW1000 driver functions.
+*11. In continuous RX mode (AT+RXMODE 1) the DW1000 uses both of its RX buffers and re-enables the receiver by itself, so frames arriving while
+*    the previous one is processed are not lost. Frames and their RX timestamps are copied to a queue by dwt_isr() (see uwb_irq.c) and read from
+*    there. The receiver is only stopped to transmit, on RX errors and timeouts, and when the ranging task suspends responding.
+*12. With a sniff duty cycle set (AT+SNIFF), the receiver is switched on and off while waiting for a poll, and initiators send polls with a preamble
+*    longer than one on/off period. SNIFF mode is turned off as soon as the wait ends, since the other frames of the exchange keep the configured
+*    preamble. It is only used in single frame RX mode, as the receiver is not stopped between frames in continuous RX mode.
+*13. The DS-TWR time of flight is computed with 64-bit integers (see uwb_range.c) instead of software emulated doubles, which keeps the report
+*    close behind the final. Products of two 32-bit intervals are exact in 64 bits, so the result is the exact quotient, truncated. The double
+*    computation rounded the products to 53 bits and is one time unit (4.69 mm) off now and then, see test/test_uwb_range.c. AT+RANGEBENCH
+*    counts the cycles of both on the target.
 *
 ****************************************************************************************************************************************************/
  
\ No newline at end of file
@@ -0,0 +1,140 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   stream.c
+ *
+ *  @brief  Binary framed output of range reports
+ *
+ *          Used instead of the text neighbor list when AT+FORMAT 1 is set.
+ *          Range records are batched into one frame:
+ *
+ *            type (1) | count (1) | records (count x 11 or 12) | CRC16 (2)
+ *
+ *          A record is ID (u16), range in mm (i32), RSSI (i8) and timestamp
+ *          in ms (u32), all little endian. While range filtering is on, the
+ *          frame type is STREAM_TYPE_RANGE_Q and each record ends with the
+ *          range quality (u8), so records are 12 bytes. The CRC is the SDK CRC16-CCITT over
+ *          type, count and records. The frame is COBS encoded and terminated
+ *          by a zero byte, so a host can resynchronize on any 0x00.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "crc16.h"
+#include "uart.h"
+#include "stream.h"
+
+#define STREAM_HDR_LEN      2
+#define STREAM_CRC_LEN      2
+#define STREAM_RAW_MAX      (STREAM_HDR_LEN + STREAM_MAX_RECORDS * STREAM_RECORD_Q_LEN + STREAM_CRC_LEN)
+
+/* COBS adds one byte per 254 bytes of data plus one, and the frame delimiter */
+#define STREAM_COBS_MAX     (STREAM_RAW_MAX + STREAM_RAW_MAX / 254 + 2)
+
+static uint8_t raw[STREAM_RAW_MAX];
+static uint8_t cobs[STREAM_COBS_MAX];
+static uint8_t count = 0;
+static uint8_t type = STREAM_TYPE_RANGE;   /**< Type of the current batch */
+
+
+/**
+ * @brief COBS encode a buffer and append the zero frame delimiter
+ *
+ * @return encoded length, including the delimiter
+ */
+static uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+  uint32_t code_idx = 0;
+  uint32_t out = 1;
+  uint8_t code = 1;
+
+  for (uint32_t i = 0; i < len; i++) {
+    if (src[i] == 0) {
+      dst[code_idx] = code;
+      code_idx = out++;
+      code = 1;
+    }
+    else {
+      dst[out++] = src[i];
+      code++;
+      // A full block carries no zero. At the end of the data it is the last
+      // block, opening another one would add a needless 0x01
+      if (code == 0xFF && i + 1 < len) {
+        dst[code_idx] = code;
+        code_idx = out++;
+        code = 1;
+      }
+    }
+  }
+  dst[code_idx] = code;
+  dst[out++] = 0;
+
+  return out;
+}
+
+/**
+ * @brief Append a range record to the current batch, sending it when full
+ *
+ * @param[in] id          Neighbor node ID
+ * @param[in] range       Range in metres
+ * @param[in] rssi        BLE RSSI of the neighbor
+ * @param[in] time_stamp  Time of the range, in ms
+ * @param[in] quality     Range quality 0 to 100, negative without range filtering
+ */
+void stream_add_range(uint16_t id, float range, int8_t rssi, uint32_t time_stamp, int quality)
+{
+  int32_t range_mm = (int32_t)(range * 1000.0f + (range >= 0 ? 0.5f : -0.5f));
+  uint8_t rec_type = (quality < 0) ? STREAM_TYPE_RANGE : STREAM_TYPE_RANGE_Q;
+
+  // A batch holds records of one type only
+  if (rec_type != type) {
+    stream_flush();
+    type = rec_type;
+  }
+
+  uint32_t rec_len = (type == STREAM_TYPE_RANGE) ? STREAM_RECORD_LEN : STREAM_RECORD_Q_LEN;
+  uint8_t *rec = &raw[STREAM_HDR_LEN + count * rec_len];
+
+  rec[0] = id & 0xFF;
+  rec[1] = id >> 8;
+  rec[2] = range_mm & 0xFF;
+  rec[3] = (range_mm >> 8) & 0xFF;
+  rec[4] = (range_mm >> 16) & 0xFF;
+  rec[5] = (range_mm >> 24) & 0xFF;
+  rec[6] = (uint8_t)rssi;
+  rec[7] = time_stamp & 0xFF;
+  rec[8] = (time_stamp >> 8) & 0xFF;
+  rec[9] = (time_stamp >> 16) & 0xFF;
+  rec[10] = (time_stamp >> 24) & 0xFF;
+  if (type == STREAM_TYPE_RANGE_Q) rec[11] = quality;
+
+  count++;
+  if (count == STREAM_MAX_RECORDS) {
+    stream_flush();
+  }
+}
+
+/**
+ * @brief Send the current batch, if any
+ */
+void stream_flush(void)
+{
+  if (count == 0) {
+    return;
+  }
+
+  uint32_t rec_len = (type == STREAM_TYPE_RANGE) ? STREAM_RECORD_LEN : STREAM_RECORD_Q_LEN;
+  uint32_t len = STREAM_HDR_LEN + count * rec_len;
+  raw[0] = type;
+  raw[1] = count;
+
+  uint16_t crc = crc16_compute(raw, len, NULL);
+  raw[len++] = crc & 0xFF;
+  raw[len++] = crc >> 8;
+
+  // A frame that does not fit in the stream ring is dropped whole and counted there
+  (void) uart_write(UART_CH_STREAM, cobs, cobs_encode(raw, len, cobs));
+  count = 0;
+}
@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   stream.h
+ *
+ *  @brief  Binary framed output of range reports --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdint.h>
+
+#define STREAM_TYPE_RANGE     0x01  /**< Batch of range records */
+#define STREAM_TYPE_RANGE_Q   0x02  /**< Batch of range records with a quality byte */
+#define STREAM_RECORD_LEN     11    /**< Packed size of one range record */
+#define STREAM_RECORD_Q_LEN   12    /**< Packed size of one range record with quality */
+#define STREAM_MAX_RECORDS    16    /**< Records per batch */
+
+void stream_add_range(uint16_t id, float range, int8_t rssi, uint32_t time_stamp, int quality);
+void stream_flush(void);
+
+#endif
@@ -0,0 +1,180 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   task_stats.c
+ *
+ *  @brief  Run time, stack and heap statistics of the FreeRTOS tasks
+ *
+ *          The FreeRTOS run time stats count in units of 16 us. By default
+ *          the count is derived from the tick RTC, which keeps running in
+ *          tickless idle but only resolves one tick. In profiling mode a
+ *          free-running TIMER counts instead, resolving the short runs of
+ *          the radio tasks. The TIMER keeps the high frequency clock on,
+ *          so profiling mode is only meant for measurements.
+ *          The 32-bit count wraps after 19 hours, shares are therefore
+ *          reported since the previous query.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "app_error.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timestamp.h"
+#include "task_stats.h"
+
+#define STATS_TIMER            NRF_TIMER3
+#define STATS_TIMER_PRESCALER  8         /**< 16 MHz / 2^8 = TASK_STATS_COUNTER_HZ */
+#define STATS_MAX_TASKS        12
+
+static bool m_profiling = false;
+static uint32_t m_base = 0;        /**< Count when the source was last switched */
+static uint32_t m_start = 0;       /**< Source reading when the source was last switched */
+
+/* Run time of each task at the previous query, by task number */
+static uint32_t m_last_run[STATS_MAX_TASKS];
+static UBaseType_t m_last_num[STATS_MAX_TASKS];
+static uint32_t m_last_total = 0;
+
+
+/**
+ * @brief Tick RTC time in counter units
+ */
+static uint32_t stats_rtc_units(void)
+{
+  return (uint32_t)(((uint64_t) timestamp_ticks() * TASK_STATS_COUNTER_HZ) / configTICK_RATE_HZ);
+}
+
+/**
+ * @brief Current TIMER count
+ */
+static uint32_t stats_timer_units(void)
+{
+  STATS_TIMER->TASKS_CAPTURE[0] = 1;
+  return STATS_TIMER->CC[0];
+}
+
+/**
+ * @brief Run time stats clock, see portGET_RUN_TIME_COUNTER_VALUE()
+ *
+ * Safe from any task and from interrupts.
+ */
+uint32_t task_stats_counter(void)
+{
+  uint8_t nested = 0;
+  uint32_t now;
+
+  app_util_critical_region_enter(&nested);
+  now = m_base + ((m_profiling ? stats_timer_units() : stats_rtc_units()) - m_start);
+  app_util_critical_region_exit(nested);
+
+  return now;
+}
+
+/**
+ * @brief Switch the run time stats clock between the tick RTC and the TIMER
+ *
+ * The count continues from its current value, so the task run times stay
+ * consistent across the switch.
+ *
+ * @param[in] enable   true to count with the TIMER
+ */
+void task_stats_profile(bool enable)
+{
+  uint8_t nested = 0;
+
+  app_util_critical_region_enter(&nested);
+
+  if (enable != m_profiling) {
+    m_base = task_stats_counter();
+
+    if (enable) {
+      STATS_TIMER->MODE = TIMER_MODE_MODE_Timer;
+      STATS_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+      STATS_TIMER->PRESCALER = STATS_TIMER_PRESCALER;
+      STATS_TIMER->TASKS_CLEAR = 1;
+      STATS_TIMER->TASKS_START = 1;
+      m_start = 0;
+    }
+    else {
+      STATS_TIMER->TASKS_STOP = 1;
+      STATS_TIMER->TASKS_SHUTDOWN = 1;
+      m_start = stats_rtc_units();
+    }
+    m_profiling = enable;
+  }
+
+  app_util_critical_region_exit(nested);
+}
+
+/**
+ * @brief Whether the TIMER counts the run time
+ */
+bool task_stats_profiling(void)
+{
+  return m_profiling;
+}
+
+/**
+ * @brief Run time of a task at the previous query
+ */
+static uint32_t stats_last_run(UBaseType_t num)
+{
+  for (int i = 0; i < STATS_MAX_TASKS; i++) {
+    if (m_last_num[i] == num) return m_last_run[i];
+  }
+  return 0;
+}
+
+/**
+ * @brief Print one line per task and the heap usage
+ *
+ * Each line holds the share of CPU time since the previous call, the
+ * stack space never used, in words, and the priority.
+ */
+void task_stats_print(void)
+{
+  TaskStatus_t tasks[STATS_MAX_TASKS];
+  uint32_t total = 0;
+
+  UBaseType_t count = uxTaskGetSystemState(tasks, STATS_MAX_TASKS, &total);
+  uint32_t elapsed = total - m_last_total;
+
+  printf("Task      CPU %%   Stack  Prio \r\n");
+  for (UBaseType_t i = 0; i < count; i++) {
+    uint32_t run = tasks[i].ulRunTimeCounter - stats_last_run(tasks[i].xTaskNumber);
+    uint32_t share = elapsed == 0 ? 0 : (uint32_t)(((uint64_t) run * 1000) / elapsed);
+
+    printf("%-9s %3lu.%lu  %5u  %u \r\n", tasks[i].pcTaskName, share / 10, share % 10,
+           tasks[i].usStackHighWaterMark, (unsigned) tasks[i].uxCurrentPriority);
+  }
+
+  // heap_1 never frees, so the free size is also the lowest it has been
+  printf("Heap free: %u of %u bytes \r\n", (unsigned) xPortGetFreeHeapSize(), (unsigned) configTOTAL_HEAP_SIZE);
+  printf("Clock: %s, %lu ms since last query \r\n", m_profiling ? "timer" : "rtc",
+         (uint32_t)(((uint64_t) elapsed * 1000) / TASK_STATS_COUNTER_HZ));
+
+  for (UBaseType_t i = 0; i < STATS_MAX_TASKS; i++) {
+    m_last_num[i] = i < count ? tasks[i].xTaskNumber : 0;
+    m_last_run[i] = i < count ? tasks[i].ulRunTimeCounter : 0;
+  }
+  m_last_total = total;
+}
+
+/**
+ * @brief Called by FreeRTOS when a task overflowed its stack
+ *
+ * Runs during the context switch, so the fault is left to the error handler.
+ */
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
+{
+  UNUSED_PARAMETER(xTask);
+  UNUSED_PARAMETER(pcTaskName);
+
+  APP_ERROR_HANDLER(NRF_ERROR_NO_MEM);
+}
@@ -0,0 +1,24 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   task_stats.h
+ *
+ *  @brief  Run time, stack and heap statistics of the FreeRTOS tasks --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _TASK_STATS_H_
+#define _TASK_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TASK_STATS_COUNTER_HZ  62500   /**< Run time counter rate, 16 us resolution */
+
+uint32_t task_stats_counter(void);
+void task_stats_profile(bool enable);
+bool task_stats_profiling(void);
+void task_stats_print(void);
+
+#endif
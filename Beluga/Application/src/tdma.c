@@ -0,0 +1,219 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   tdma.c
+ *
+ *  @brief  TDMA slot scheduling of the UWB initiators
+ *
+ *          The initiators heard in the neighbor table (polling flag set) and
+ *          this node share a superframe of one slot each, ordered by node ID.
+ *          The lowest ID is the coordinator: it opens every superframe with a
+ *          broadcast UWB beacon giving the slot count, slot length and its
+ *          offset from the superframe start. The other nodes align their
+ *          superframe on the last beacon heard, and fall back to their own
+ *          clock when no beacon was heard for a few superframes. Each node
+ *          initiates only at the start of its own slot. Unaligned nodes pick
+ *          a random slot phase each superframe until they hear a beacon, see
+ *          test/sim_tdma.c.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "deca_device_api.h"
+#include "neighbor.h"
+#include "init_main.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "tdma.h"
+
+/* Beacon payload, after the common header */
+#define BEACON_N_SLOTS_IDX    (FRAME_HDR_LEN)
+#define BEACON_SLOT_MS_IDX    (FRAME_HDR_LEN + 1)
+#define BEACON_OFFSET_IDX     (FRAME_HDR_LEN + 3)
+#define BEACON_LEN            (FRAME_HDR_LEN + 4 + 2)
+
+/* Superframes without beacon before a node stops following the coordinator */
+#define BEACON_LOSS_SUPERFRAMES  3
+
+#define BEACON_TX_TIMEOUT_TICKS  10
+
+static uint8_t tx_beacon_msg[BEACON_LEN] = {0x41, 0x88, 0, 0xCA, 0xDE, 0xFF, 0xFF, 0, 0, FRAME_FUNC_BEACON};
+
+static uint32_t slot_ms = 0;          /**< Slot length, 0 when TDMA is off */
+static TickType_t sf_start;           /**< Start of a past superframe */
+static TickType_t slot_start;         /**< Start of the slot last handed out */
+static bool coordinator = false;      /**< This node opens the superframes */
+
+/* Last beacon heard */
+static volatile bool beacon_valid = false;
+static volatile TickType_t beacon_sf_start;
+static volatile TickType_t beacon_time;
+static volatile uint8_t beacon_n_slots;
+static volatile uint16_t beacon_slot_ms;
+
+
+/**
+ * @brief Slot count, own slot and coordinator from the neighbor table
+ */
+static void tdma_layout(uint8_t *n_slots, uint8_t *own_slot, uint16_t *coord)
+{
+  uint8_t n = 1;
+  uint8_t rank = 0;
+  uint16_t lowest = NODE_UUID;
+
+  for (int i = 0; i < MAX_ANCHOR_COUNT; i++) {
+    // Single loads, a slot reused in between only skews the layout until the next beacon
+    uint16_t id = seen_list[i].UUID;
+
+    if (id != 0 && (seen_list[i].flags & NEIGHBOR_POLLING)) {
+      n++;
+      if (id < NODE_UUID) rank++;
+      if (id < lowest) lowest = id;
+    }
+  }
+
+  *n_slots = n;
+  *own_slot = rank;
+  *coord = lowest;
+}
+
+/**
+ * @brief Enable TDMA with a given slot length, or disable it with 0
+ */
+void tdma_set_slot_ms(uint32_t ms)
+{
+  slot_ms = ms;
+  sf_start = xTaskGetTickCount();
+  slot_start = sf_start - 1;
+  beacon_valid = false;
+}
+
+/**
+ * @brief Whether initiators are scheduled by TDMA instead of random backoff
+ */
+bool tdma_enabled(void)
+{
+  return slot_ms != 0;
+}
+
+/**
+ * @brief Ticks to wait until the start of the next own slot
+ *
+ * Also decides whether this node is the coordinator of that superframe.
+ */
+TickType_t tdma_slot_delay(void)
+{
+  uint8_t n_slots, own_slot;
+  uint16_t coord;
+  uint32_t ms = slot_ms;
+  TickType_t now = xTaskGetTickCount();
+
+  tdma_layout(&n_slots, &own_slot, &coord);
+  coordinator = (coord == NODE_UUID);
+
+  // Follow the coordinator's superframe while its beacons are heard
+  if (!coordinator && beacon_valid) {
+    if (beacon_n_slots > n_slots) n_slots = beacon_n_slots;
+    ms = beacon_slot_ms;
+
+    TickType_t beacon_sf_len = pdMS_TO_TICKS(n_slots * ms);
+    if ((now - beacon_time) > BEACON_LOSS_SUPERFRAMES * beacon_sf_len) {
+      beacon_valid = false;
+      ms = slot_ms;
+    }
+    else {
+      sf_start = beacon_sf_start;
+    }
+  }
+
+  TickType_t slot_len = pdMS_TO_TICKS(ms);
+  TickType_t sf_len = n_slots * slot_len;
+
+  // The responder is off during the own round, so a slot on the own clock
+  // that covers the beacon would hide it for good. Until a beacon is heard,
+  // move the superframe by a random number of slots each time.
+  if (!coordinator && !beacon_valid) {
+    sf_start += (rand() % n_slots) * slot_len;
+  }
+  TickType_t offset = own_slot * slot_len;
+  TickType_t elapsed = now - sf_start;
+  TickType_t start;
+
+  if (elapsed <= offset) {
+    start = sf_start + offset;
+  }
+  else {
+    start = sf_start + offset + ((elapsed - offset + sf_len - 1) / sf_len) * sf_len;
+  }
+
+  // Never hand out the same slot twice
+  if (start == slot_start) start += sf_len;
+
+  slot_start = start;
+  sf_start = start - offset;
+
+  return start - now;
+}
+
+/**
+ * @brief Whether this node opens the superframe of the slot last handed out
+ */
+bool tdma_is_coordinator(void)
+{
+  return coordinator;
+}
+
+/**
+ * @brief Broadcast the superframe beacon, called by the coordinator from its slot
+ */
+void tdma_send_beacon(void)
+{
+  uint8_t n_slots, own_slot;
+  uint16_t coord;
+  uint32_t offset_ms = (xTaskGetTickCount() - sf_start) * 1000 / configTICK_RATE_HZ;
+
+  tdma_layout(&n_slots, &own_slot, &coord);
+
+  uwb_frame_header(tx_beacon_msg, UWB_ADDR_BROADCAST);
+  tx_beacon_msg[BEACON_N_SLOTS_IDX] = n_slots;
+  tx_beacon_msg[BEACON_SLOT_MS_IDX] = slot_ms & 0xFF;
+  tx_beacon_msg[BEACON_SLOT_MS_IDX + 1] = (slot_ms >> 8) & 0xFF;
+  tx_beacon_msg[BEACON_OFFSET_IDX] = (offset_ms > 0xFF) ? 0xFF : offset_ms;
+
+  uwb_clear_events();
+  dwt_writetxdata(sizeof(tx_beacon_msg), tx_beacon_msg, 0);
+  dwt_writetxfctrl(sizeof(tx_beacon_msg), 0, 0);
+
+  if (dwt_starttx(DWT_START_TX_IMMEDIATE) == DWT_SUCCESS) {
+    if (uwb_wait_event(UWB_EVT_TX_DONE, BEACON_TX_TIMEOUT_TICKS) == 0) {
+      dwt_forcetrxoff();
+    }
+  }
+}
+
+/**
+ * @brief Handle a beacon received by the responder
+ *
+ * @param[in] frame  Received frame, already checked to be a beacon
+ * @param[in] len    Frame length
+ */
+void tdma_beacon_rx(const uint8_t *frame, uint32_t len)
+{
+  if (len < BEACON_LEN) return;
+
+  uint16_t ms = frame[BEACON_SLOT_MS_IDX] | (frame[BEACON_SLOT_MS_IDX + 1] << 8);
+  if (ms < TDMA_SLOT_MIN_MS || ms > TDMA_SLOT_MAX_MS || frame[BEACON_N_SLOTS_IDX] == 0) return;
+
+  TickType_t now = xTaskGetTickCount();
+
+  beacon_n_slots = frame[BEACON_N_SLOTS_IDX];
+  beacon_slot_ms = ms;
+  beacon_sf_start = now - pdMS_TO_TICKS(frame[BEACON_OFFSET_IDX]);
+  beacon_time = now;
+  beacon_valid = true;
+}
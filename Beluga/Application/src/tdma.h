@@ -0,0 +1,28 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   tdma.h
+ *
+ *  @brief  TDMA slot scheduling of the UWB initiators --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _TDMA_H_
+#define _TDMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+#define TDMA_SLOT_MIN_MS    5     /**< Shortest slot, one DS-TWR exchange with margin */
+#define TDMA_SLOT_MAX_MS    1000
+
+void tdma_set_slot_ms(uint32_t slot_ms);
+bool tdma_enabled(void);
+TickType_t tdma_slot_delay(void);
+bool tdma_is_coordinator(void);
+void tdma_send_beacon(void);
+void tdma_beacon_rx(const uint8_t *frame, uint32_t len);
+
+#endif
@@ -0,0 +1,77 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   timestamp.c
+ *
+ *  @brief  Time since boot derived from the RTOS tick RTC
+ *
+ *          The time is read on demand from the counter of the RTC driving
+ *          the FreeRTOS tick, which keeps running through tickless idle, so
+ *          no periodic interrupt is needed to keep it. The 24-bit counter is
+ *          extended in software, which only requires a call at least every
+ *          4.5 hours; the responder task calls it at least every second,
+ *          when it feeds the watchdog.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include "nrf_rtc.h"
+#include "app_util_platform.h"
+#include "FreeRTOS.h"
+#include "portmacro_cmsis.h"
+#include "timestamp.h"
+
+#define TIMESTAMP_RTC_BITS   24
+
+static uint32_t m_last = 0;    /**< Counter value at the previous call */
+static uint32_t m_high = 0;    /**< Counter overflows, shifted in above the counter bits */
+
+
+/**
+ * @brief RTC ticks since the scheduler started, at configTICK_RATE_HZ
+ *
+ * Safe from any task and from interrupts. Also the default source of the run time stats clock.
+ */
+uint32_t timestamp_ticks(void)
+{
+  uint8_t nested = 0;
+  uint32_t ticks;
+
+  app_util_critical_region_enter(&nested);
+
+  uint32_t now = nrf_rtc_counter_get(portNRF_RTC_REG);
+  if (now < m_last) {
+    m_high += 1UL << TIMESTAMP_RTC_BITS;
+  }
+  m_last = now;
+  ticks = m_high | now;
+
+  app_util_critical_region_exit(nested);
+
+  return ticks;
+}
+
+/**
+ * @brief Milliseconds since the scheduler started
+ *
+ * Replaces the 1 ms time keeper timer. Wraps like it after 49 days.
+ */
+uint32_t timestamp_ms(void)
+{
+  static uint32_t wraps = 0;
+  static uint32_t last = 0;
+  uint8_t nested = 0;
+
+  app_util_critical_region_enter(&nested);
+
+  // Carry the tick counter wrap into the millisecond conversion
+  uint32_t ticks = timestamp_ticks();
+  if (ticks < last) wraps++;
+  last = ticks;
+  uint64_t total = ((uint64_t)wraps << 32) | ticks;
+
+  app_util_critical_region_exit(nested);
+
+  return (uint32_t)((total * 1000) / configTICK_RATE_HZ);
+}
@@ -0,0 +1,19 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   timestamp.h
+ *
+ *  @brief  Time since boot derived from the RTOS tick RTC --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _TIMESTAMP_H_
+#define _TIMESTAMP_H_
+
+#include <stdint.h>
+
+uint32_t timestamp_ticks(void);
+uint32_t timestamp_ms(void);
+
+#endif
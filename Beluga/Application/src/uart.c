@@ -3,56 +3,288 @@
  *
  *  @brief  An implementation of uart init and uart event handler
  *
+ *          UARTE0 is driven directly through the HAL. Output is queued in one
+ *          ring buffer per producer (console and stream) and sent by EasyDMA
+ *          straight from the rings, so writers never wait on the serial line.
+ *          When a ring is full the write is dropped and counted instead.
+ *
+ *          Input is received by EasyDMA into two alternating chunk buffers.
+ *          TIMER2 measures the idle time since the last byte through PPI and
+ *          stops the receiver once the line has been quiet for a few
+ *          characters, so a command costs one interrupt instead of one per
+ *          byte. Complete lines are assembled in place in a small line ring
+ *          and the reading task is woken by a task notification.
+ *
  *  @date   2020/06
  *
- *  @author WiseLab-CMU 
+ *  @author WiseLab-CMU
  */
 
 #include <stdint.h>
-#include "app_uart.h"
-#include "ble_nus.h"
+#include <stdio.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_uarte.h"
+#include "nrf_timer.h"
+#include "nrf_ppi.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_common.h"
+#include "app_util_platform.h"
 #include "dw1001_dev.h"
-#include "nrf_uart.h"
 #include "uart.h"
 #include "FreeRTOS.h"
 #include "portmacro_cmsis.h"
-#include <string.h>
-#include "queue.h"
+#include "task.h"
+
+#define UART_CONSOLE_BUF_SIZE  1024   /**< Console ring size, power of two */
+#define UART_STREAM_BUF_SIZE   1024   /**< Stream ring size, power of two */
+#define UART_DMA_MAX_LEN       255    /**< UARTE TXD.MAXCNT is 8 bits on nRF52832 */
+
+#define UART_RX_CHUNK          64     /**< Size of each RX DMA buffer */
+#define UART_RX_LINES          4      /**< Complete lines waiting for the reader, power of two */
+#define UART_IDLE_CHARS        3      /**< Quiet characters ending a burst of input */
+
+#define UART_IDLE_TIMER        NRF_TIMER2
+#define UART_PPI_CH_RXDRDY     NRF_PPI_CHANNEL0   /**< RXDRDY -> idle timer CLEAR, fork START */
+#define UART_PPI_CH_IDLE       NRF_PPI_CHANNEL1   /**< Idle timer COMPARE0 -> STOPRX */
+
+typedef struct
+{
+    uint8_t * buf;
+    uint32_t size;                /**< Power of two */
+    volatile uint32_t head;       /**< Free running write index, producer side */
+    volatile uint32_t tail;       /**< Free running read index, DMA side */
+    volatile uint32_t queued;     /**< Bytes accepted */
+    volatile uint32_t dropped;    /**< Bytes dropped because the ring was full */
+} uart_ring_t;
+
+static uint8_t console_buf[UART_CONSOLE_BUF_SIZE];
+static uint8_t stream_buf[UART_STREAM_BUF_SIZE];
+
+static uart_ring_t rings[UART_CH_COUNT] =
+{
+    [UART_CH_CONSOLE] = { .buf = console_buf, .size = sizeof(console_buf) },
+    [UART_CH_STREAM]  = { .buf = stream_buf,  .size = sizeof(stream_buf) },
+};
+
+static volatile uint32_t tx_busy = 0;   /**< Set while a DMA transfer is in flight */
+static uart_ring_t * tx_ring;           /**< Ring the transfer in flight reads from */
+static uint32_t tx_len;                 /**< Length of the transfer in flight */
+static uint32_t tx_next = 0;            /**< Next ring to serve, round robin */
+
+static uint8_t rx_buf[2][UART_RX_CHUNK]; /**< Alternating RX DMA buffers */
+static uint8_t rx_idx = 0;               /**< Buffer the receiver is writing to */
+
+static char rx_lines[UART_RX_LINES][UART_LINE_LEN];   /**< Line ring, the head slot is being assembled */
+static volatile uint32_t rx_head = 0;    /**< Free running index of the line being assembled */
+static volatile uint32_t rx_tail = 0;    /**< Free running index of the oldest complete line */
+static uint32_t rx_pos = 0;              /**< Length of the line being assembled */
+static volatile uint32_t rx_dropped = 0; /**< Lines dropped because the ring was full */
+static volatile TaskHandle_t rx_reader = NULL;
 
-static uint16_t   m_ble_nus_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - 3; 
-extern QueueHandle_t uart_queue;
 
 /**
- * @brief Handling the data received over UART
+ * @brief Whether any ring has bytes waiting to be sent
  */
-static void uart_event_handle(app_uart_evt_t * p_event)
+static bool tx_pending(void)
 {
-    static uint8_t data_array[BLE_NUS_MAX_DATA_LEN];
-    static uint8_t index = 0;
-    uint32_t       err_code;
+    for (int i = 0; i < UART_CH_COUNT; i++)
+    {
+        if (rings[i].head != rings[i].tail) return true;
+    }
+    return false;
+}
 
-    switch (p_event->evt_type)
+/**
+ * @brief Start a DMA transfer of the next contiguous chunk, caller owns tx_busy
+ *
+ * @return true if a transfer was started
+ */
+static bool tx_start(void)
+{
+    for (int i = 0; i < UART_CH_COUNT; i++)
     {
-        case APP_UART_DATA_READY:
-            UNUSED_VARIABLE(app_uart_get(&data_array[index]));
-            index++;
-            if ((data_array[index - 1] == '\n') || (data_array[index - 1] == '\r') ||  (index >= (m_ble_nus_max_data_len)))
-            {         
-                send_AT_command(data_array);
-                index = 0;
-            }
-            break;
-
-        case APP_UART_COMMUNICATION_ERROR:
-            // If uart error occur, keep moving on
-            break;
-
-        case APP_UART_FIFO_ERROR:
-            // If uart error occur, keep moving on
-            break;
-
-        default:
-            break;
+        uint32_t ch = (tx_next + i) % UART_CH_COUNT;
+        uart_ring_t * r = &rings[ch];
+        uint32_t tail = r->tail;
+        uint32_t pending = r->head - tail;
+
+        if (pending == 0) continue;
+
+        uint32_t offset = tail & (r->size - 1);
+        uint32_t len = r->size - offset;
+        if (len > pending) len = pending;
+        if (len > UART_DMA_MAX_LEN) len = UART_DMA_MAX_LEN;
+
+        tx_ring = r;
+        tx_len = len;
+        tx_next = (ch + 1) % UART_CH_COUNT;
+
+        nrf_uarte_tx_buffer_set(NRF_UARTE0, &r->buf[offset], len);
+        nrf_uarte_task_trigger(NRF_UARTE0, NRF_UARTE_TASK_STARTTX);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Start sending if the transmitter is idle
+ *
+ * Safe from any task and from the UARTE interrupt. Whoever wins tx_busy
+ * starts the transfer, the others leave their bytes to the ENDTX interrupt.
+ */
+static void tx_kick(void)
+{
+    while (tx_pending())
+    {
+        if (!__sync_bool_compare_and_swap(&tx_busy, 0, 1)) return;
+        if (tx_start()) return;
+
+        // Nothing found after all, release and check again for bytes queued meanwhile
+        tx_busy = 0;
+    }
+}
+
+/**
+ * @brief Add received bytes to the line being assembled
+ *
+ * A line ends at CR or LF, empty lines are skipped. Overlong lines are cut
+ * at UART_LINE_LEN - 1 characters. When the ring is full the line is
+ * assembled but not published, and counted as dropped.
+ *
+ * @return true if at least one line was completed
+ */
+static bool uart_rx_bytes(const uint8_t *data, uint32_t len)
+{
+    bool done = false;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        char * line = rx_lines[rx_head & (UART_RX_LINES - 1)];
+        bool eol = (data[i] == '\r') || (data[i] == '\n');
+
+        if (!eol) line[rx_pos++] = (char)data[i];
+        if (!eol && rx_pos < UART_LINE_LEN - 1) continue;
+        if (rx_pos == 0) continue;
+
+        line[rx_pos] = '\0';
+        rx_pos = 0;
+
+        if (rx_head - rx_tail < UART_RX_LINES - 1)
+        {
+            rx_head++;
+            done = true;
+        }
+        else
+        {
+            rx_dropped++;
+        }
+    }
+    return done;
+}
+
+/**
+ * @brief Consume the RX buffer the receiver just ended and wake the reader
+ */
+static void uart_rx_end(void)
+{
+    uint32_t amount = nrf_uarte_rx_amount_get(NRF_UARTE0);
+    uint8_t idx = rx_idx;
+
+    rx_idx ^= 1;
+
+    if (uart_rx_bytes(rx_buf[idx], amount) && rx_reader != NULL)
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(rx_reader, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+/**
+ * @brief Set the idle time ending a burst of input for a baud rate
+ */
+static void uart_idle_set(uint32_t baud)
+{
+    // 10 bits per character, timer runs at 1 MHz
+    nrf_timer_cc_write(UART_IDLE_TIMER, NRF_TIMER_CC_CHANNEL0, (UART_IDLE_CHARS * 10 * 1000000UL) / baud + 1);
+}
+
+/**
+ * @brief Setup the idle timer and the PPI channels stopping the receiver on an idle line
+ *
+ * TIMER0 belongs to the SoftDevice, which also reserves the upper PPI channels.
+ */
+static void uart_idle_init(void)
+{
+    nrf_timer_task_trigger(UART_IDLE_TIMER, NRF_TIMER_TASK_STOP);
+    nrf_timer_mode_set(UART_IDLE_TIMER, NRF_TIMER_MODE_TIMER);
+    nrf_timer_bit_width_set(UART_IDLE_TIMER, NRF_TIMER_BIT_WIDTH_16);
+    nrf_timer_frequency_set(UART_IDLE_TIMER, NRF_TIMER_FREQ_1MHz);
+    nrf_timer_shorts_enable(UART_IDLE_TIMER, NRF_TIMER_SHORT_COMPARE0_STOP_MASK | NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK);
+    nrf_timer_event_clear(UART_IDLE_TIMER, NRF_TIMER_EVENT_COMPARE0);
+    uart_idle_set(115200);
+
+    // Every received byte restarts the idle time
+    nrf_ppi_channel_and_fork_endpoint_setup(UART_PPI_CH_RXDRDY,
+        (uint32_t)&NRF_UARTE0->EVENTS_RXDRDY,
+        (uint32_t)nrf_timer_task_address_get(UART_IDLE_TIMER, NRF_TIMER_TASK_CLEAR),
+        (uint32_t)nrf_timer_task_address_get(UART_IDLE_TIMER, NRF_TIMER_TASK_START));
+
+    // A quiet line ends the DMA transfer early
+    nrf_ppi_channel_endpoint_setup(UART_PPI_CH_IDLE,
+        (uint32_t)nrf_timer_event_address_get(UART_IDLE_TIMER, NRF_TIMER_EVENT_COMPARE0),
+        nrf_uarte_task_address_get(NRF_UARTE0, NRF_UARTE_TASK_STOPRX));
+
+    nrf_ppi_channel_enable(UART_PPI_CH_RXDRDY);
+    nrf_ppi_channel_enable(UART_PPI_CH_IDLE);
+}
+
+/**
+ * @brief UARTE0 interrupt handler
+ */
+void UARTE0_UART0_IRQHandler(void)
+{
+    if (nrf_uarte_event_check(NRF_UARTE0, NRF_UARTE_EVENT_ERROR))
+    {
+        nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ERROR);
+        // If uart error occur, keep moving on
+        (void) nrf_uarte_errorsrc_get_and_clear(NRF_UARTE0);
+    }
+
+    // ENDRX is handled before RXSTARTED so the next buffer is not the one just filled
+    if (nrf_uarte_event_check(NRF_UARTE0, NRF_UARTE_EVENT_ENDRX))
+    {
+        nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ENDRX);
+        uart_rx_end();
+
+        // A full buffer continues at once, an idle stop continues on RXTO
+        if (!nrf_timer_event_check(UART_IDLE_TIMER, NRF_TIMER_EVENT_COMPARE0))
+        {
+            nrf_uarte_task_trigger(NRF_UARTE0, NRF_UARTE_TASK_STARTRX);
+        }
+    }
+
+    if (nrf_uarte_event_check(NRF_UARTE0, NRF_UARTE_EVENT_RXTO))
+    {
+        nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_RXTO);
+        nrf_timer_event_clear(UART_IDLE_TIMER, NRF_TIMER_EVENT_COMPARE0);
+        nrf_uarte_task_trigger(NRF_UARTE0, NRF_UARTE_TASK_STARTRX);
+    }
+
+    if (nrf_uarte_event_check(NRF_UARTE0, NRF_UARTE_EVENT_RXSTARTED))
+    {
+        nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_RXSTARTED);
+        // The next transfer goes to the other buffer
+        nrf_uarte_rx_buffer_set(NRF_UARTE0, rx_buf[rx_idx ^ 1], UART_RX_CHUNK);
+    }
+
+    if (nrf_uarte_event_check(NRF_UARTE0, NRF_UARTE_EVENT_ENDTX))
+    {
+        nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ENDTX);
+        tx_ring->tail += tx_len;
+        tx_busy = 0;
+        tx_kick();
     }
 }
 
@@ -62,41 +294,192 @@ static void uart_event_handle(app_uart_evt_t * p_event)
  */
 void uart_init(void)
 {
-  
-    uint32_t  err_code;
-    app_uart_comm_params_t const comm_params =
+    nrf_gpio_pin_set(TX_PIN_NUMBER);
+    nrf_gpio_cfg_output(TX_PIN_NUMBER);
+    nrf_gpio_cfg_input(RX_PIN_NUMBER, NRF_GPIO_PIN_NOPULL);
+
+    nrf_uarte_baudrate_set(NRF_UARTE0, NRF_UARTE_BAUDRATE_115200);
+    nrf_uarte_configure(NRF_UARTE0, NRF_UARTE_PARITY_EXCLUDED, NRF_UARTE_HWFC_DISABLED);
+    nrf_uarte_txrx_pins_set(NRF_UARTE0, TX_PIN_NUMBER, RX_PIN_NUMBER);
+
+    nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ENDTX);
+    nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ENDRX);
+    nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_RXSTARTED);
+    nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_RXTO);
+    nrf_uarte_event_clear(NRF_UARTE0, NRF_UARTE_EVENT_ERROR);
+
+    uart_idle_init();
+
+    // Reception is restarted by the interrupt, see UARTE0_UART0_IRQHandler
+    nrf_uarte_int_enable(NRF_UARTE0, NRF_UARTE_INT_ENDTX_MASK | NRF_UARTE_INT_ENDRX_MASK |
+                                     NRF_UARTE_INT_RXSTARTED_MASK | NRF_UARTE_INT_RXTO_MASK |
+                                     NRF_UARTE_INT_ERROR_MASK);
+    nrf_drv_common_irq_enable(UARTE0_UART0_IRQn, APP_IRQ_PRIORITY_LOWEST);
+
+    nrf_uarte_enable(NRF_UARTE0);
+
+    rx_idx = 0;
+    nrf_uarte_rx_buffer_set(NRF_UARTE0, rx_buf[0], UART_RX_CHUNK);
+    nrf_uarte_task_trigger(NRF_UARTE0, NRF_UARTE_TASK_STARTRX);
+}
+
+/**
+ * @brief Queue bytes for transmission without blocking
+ *
+ * The stream channel has a single producer and is lock free. The console
+ * is written by printf from every task, so its producer side is serialized
+ * by a short critical region. The DMA side never takes a lock.
+ *
+ * @param[in] ch     Producer channel
+ * @param[in] data   Bytes to send
+ * @param[in] len    Number of bytes
+ *
+ * @return true if queued, false if the ring was full and the bytes were dropped
+ */
+bool uart_write(uart_channel_t ch, const uint8_t *data, uint32_t len)
+{
+    uart_ring_t * r = &rings[ch];
+    bool queued = false;
+    uint8_t nested = 0;
+
+    if (ch == UART_CH_CONSOLE) app_util_critical_region_enter(&nested);
+
+    uint32_t head = r->head;
+    if (len <= r->size - (head - r->tail))
+    {
+        uint32_t offset = head & (r->size - 1);
+        uint32_t first = r->size - offset;
+        if (first > len) first = len;
+
+        memcpy(&r->buf[offset], data, first);
+        memcpy(&r->buf[0], data + first, len - first);
+
+        // Publish the bytes before the new head
+        __DMB();
+        r->head = head + len;
+        r->queued += len;
+        queued = true;
+    }
+    else
+    {
+        r->dropped += len;
+    }
+
+    if (ch == UART_CH_CONSOLE) app_util_critical_region_exit(nested);
+
+    tx_kick();
+
+    return queued;
+}
+
+/**
+ * @brief Wait until all queued bytes are sent
+ *
+ * @param[in] timeout   Maximum ticks to wait
+ *
+ * @return true if the rings are empty
+ */
+bool uart_flush(TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (tx_pending() || tx_busy)
     {
-        .rx_pin_no    = RX_PIN_NUMBER,
-        .tx_pin_no    = TX_PIN_NUMBER, 
-        .rts_pin_no   = RTS_PIN_NUMBER,
-        .cts_pin_no   = CTS_PIN_NUMBER,
-        .flow_control = APP_UART_FLOW_CONTROL_DISABLED,
-        .use_parity   = false, 
-        .baud_rate    = NRF_UART_BAUDRATE_115200
-    };
+        if ((xTaskGetTickCount() - start) >= timeout) return false;
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+/**
+ * @brief Change the baud rate
+ *
+ * @param[in] baud   Baud rate, 9600 up to 1000000
+ *
+ * @return false if the rate is not supported
+ */
+bool uart_set_baudrate(uint32_t baud)
+{
+    nrf_uarte_baudrate_t rate;
 
-    APP_UART_FIFO_INIT(&comm_params,
-                       UART_RX_BUF_SIZE,
-                       UART_TX_BUF_SIZE,
-                       uart_event_handle,
-                       APP_IRQ_PRIORITY_LOWEST,
-                       err_code);
+    switch (baud)
+    {
+        case 9600:    rate = NRF_UARTE_BAUDRATE_9600;    break;
+        case 19200:   rate = NRF_UARTE_BAUDRATE_19200;   break;
+        case 38400:   rate = NRF_UARTE_BAUDRATE_38400;   break;
+        case 57600:   rate = NRF_UARTE_BAUDRATE_57600;   break;
+        case 115200:  rate = NRF_UARTE_BAUDRATE_115200;  break;
+        case 230400:  rate = NRF_UARTE_BAUDRATE_230400;  break;
+        case 460800:  rate = NRF_UARTE_BAUDRATE_460800;  break;
+        case 921600:  rate = NRF_UARTE_BAUDRATE_921600;  break;
+        case 1000000: rate = NRF_UARTE_BAUDRATE_1000000; break;
+        default:      return false;
+    }
 
-    APP_ERROR_CHECK(err_code);
-    
+    nrf_uarte_baudrate_set(NRF_UARTE0, rate);
+    uart_idle_set(baud);
+    return true;
 }
 
 /**
- * @brief Send AT command
+ * @brief Byte counters of a producer channel
  */
-void send_AT_command(char *command){
+void uart_get_stats(uart_channel_t ch, uart_stats_t *stats)
+{
+    uart_ring_t * r = &rings[ch];
 
-    BaseType_t xHigherPriorityTaskWoken;
-    message new_message = {0};
+    stats->queued = r->queued;
+    stats->dropped = r->dropped;
+    stats->pending = r->head - r->tail;
+}
 
-    strcpy(new_message.data, command);
+/**
+ * @brief Block until a complete input line is received
+ *
+ * Only one task may read lines.
+ *
+ * @param[out] buf       Line without the CR/LF terminator, NUL terminated
+ * @param[in]  size      Size of buf
+ * @param[in]  timeout   Maximum ticks to wait
+ *
+ * @return true if a line was copied to buf
+ */
+bool uart_read_line(char *buf, size_t size, TickType_t timeout)
+{
+    rx_reader = xTaskGetCurrentTaskHandle();
+
+    while (rx_tail == rx_head)
+    {
+        if (ulTaskNotifyTake(pdTRUE, timeout) == 0 && rx_tail == rx_head) return false;
+    }
 
-    xQueueSendFromISR(uart_queue,(void *)&new_message, xHigherPriorityTaskWoken);
+    strncpy(buf, rx_lines[rx_tail & (UART_RX_LINES - 1)], size - 1);
+    buf[size - 1] = '\0';
 
-    return;
-}
\ No newline at end of file
+    // Release the slot only after the copy
+    __DMB();
+    rx_tail++;
+    return true;
+}
+
+/**
+ * @brief Number of input lines dropped because the reader fell behind
+ */
+uint32_t uart_rx_dropped(void)
+{
+    return rx_dropped;
+}
+
+#if defined(__SES_ARM)
+/**
+ * @brief printf output of the SEGGER runtime library, goes to the console ring
+ */
+int __putchar(int ch, __printf_tag_ptr p_file)
+{
+    uint8_t c = (uint8_t)ch;
+
+    UNUSED_PARAMETER(p_file);
+    UNUSED_VARIABLE(uart_write(UART_CH_CONSOLE, &c, 1));
+    return ch;
+}
+#endif
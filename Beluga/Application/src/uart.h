@@ -5,21 +5,40 @@
  *
  *  @date   2020/06
  *
- *  @author WiseLab-CMU 
+ *  @author WiseLab-CMU
  */
 
 #ifndef _UART_H_
 #define _UART_H_
 
-#define UART_TX_BUF_SIZE 256  /**< UART TX buffer size. */
-#define UART_RX_BUF_SIZE 256  /**< UART RX buffer size. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FreeRTOS.h"
 
-typedef struct message
+#define UART_LINE_LEN  64   /**< Longest input line including the terminating NUL */
+
+/* Output producers, each with its own TX ring */
+typedef enum
+{
+    UART_CH_CONSOLE,    /**< printf, AT command replies */
+    UART_CH_STREAM,     /**< Neighbor list output */
+    UART_CH_COUNT
+} uart_channel_t;
+
+typedef struct
 {
-   char data[50];
-} message;
+    uint32_t queued;    /**< Bytes accepted since boot */
+    uint32_t dropped;   /**< Bytes dropped since boot */
+    uint32_t pending;   /**< Bytes waiting in the ring */
+} uart_stats_t;
 
 void uart_init(void);
-void send_AT_command(char *command);
+bool uart_write(uart_channel_t ch, const uint8_t *data, uint32_t len);
+bool uart_flush(TickType_t timeout);
+bool uart_set_baudrate(uint32_t baud);
+void uart_get_stats(uart_channel_t ch, uart_stats_t *stats);
+bool uart_read_line(char *buf, size_t size, TickType_t timeout);
+uint32_t uart_rx_dropped(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,167 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_calib.c
+ *
+ *  @brief  Calibration of the ranging reply delays
+ *
+ *          Responses and finals are sent at a fixed delay after the frame
+ *          they answer, which has to cover the firmware turnaround: IRQ to
+ *          task wake up, frame and timestamp reads, programming the delayed
+ *          transmission and writing the timestamps into it. The calibration
+ *          sends a reference frame and replays that path after its TX done
+ *          event, up to the return of dwt_starttx(), measured against the
+ *          reference TX timestamp. The DW1000 does not receive its own
+ *          frames, so the RX buffer read only stands for the SPI traffic of
+ *          a real answer. The reply delay is the worst turnaround seen plus a
+ *          margin, kept only if a second set of rounds answers with it without
+ *          a late transmission.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "deca_device_api.h"
+#include "init_main.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "uwb_calib.h"
+
+/* Timestamp bytes written per reply, at their place in a final */
+#define CALIB_MSG_TS_IDX    (FRAME_HDR_LEN)
+#define CALIB_MSG_TS_LEN    12
+
+/* DW1000 system time high 32 bits per UWB microsecond */
+#define SYS_TIME_HI_PER_UUS 256
+
+#define CALIB_TX_TIMEOUT_TICKS 10
+
+/* Sent as a poll to this node */
+static uint8_t tx_calib_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, FRAME_FUNC_POLL, 0, 0};
+static uint8_t calib_ts[CALIB_MSG_TS_LEN];
+static uint8_t calib_rx[CALIB_MSG_TS_LEN + FRAME_HDR_LEN];
+
+static uint16_t m_reply_dly = 0;      /**< Calibrated reply delay, 0 for the defaults */
+
+
+/**
+ * @brief Reply delay to program, in UWB microseconds
+ *
+ * @param[in] default_uus   Delay used when the node was not calibrated
+ */
+uint16_t uwb_reply_delay(uint16_t default_uus)
+{
+  return (m_reply_dly != 0) ? m_reply_dly : default_uus;
+}
+
+/**
+ * @brief Set the calibrated reply delay, 0 returns to the defaults
+ */
+void uwb_reply_delay_set(uint16_t uus)
+{
+  if (uus != 0 && uus < REPLY_DLY_MIN_UUS) uus = REPLY_DLY_MIN_UUS;
+  if (uus > REPLY_DLY_MAX_UUS) uus = REPLY_DLY_MAX_UUS;
+  m_reply_dly = uus;
+}
+
+/**
+ * @brief Send the reference frame
+ *
+ * @param[out] ref_hi   High 32 bits of its TX timestamp
+ *
+ * @return false if it could not be sent
+ */
+static bool calib_send_ref(uint32_t *ref_hi)
+{
+  uwb_frame_header(tx_calib_msg, NODE_UUID);
+  uwb_clear_events();
+  dwt_writetxdata(sizeof(tx_calib_msg), tx_calib_msg, 0);
+  dwt_writetxfctrl(sizeof(tx_calib_msg), 0, 1);
+
+  if (dwt_starttx(DWT_START_TX_IMMEDIATE) != DWT_SUCCESS) {
+    return false;
+  }
+  if (uwb_wait_event(UWB_EVT_TX_DONE, CALIB_TX_TIMEOUT_TICKS) != UWB_EVT_TX_DONE) {
+    dwt_forcetrxoff();
+    return false;
+  }
+
+  *ref_hi = dwt_readtxtimestamphi32();
+  return true;
+}
+
+/**
+ * @brief Answer the reference frame like a responder, with a delayed transmission
+ *
+ * @param[in]  ref_hi    High 32 bits of the reference TX timestamp
+ * @param[in]  dly_uus   Reply delay to program
+ * @param[out] elapsed   Time from the reference to the return of dwt_starttx(), UWB microseconds
+ *
+ * @return false if the reply was late (HPDWARN) or not sent
+ */
+static bool calib_reply(uint32_t ref_hi, uint32_t dly_uus, uint32_t *elapsed)
+{
+  uint32_t reply_hi = ref_hi + dly_uus * SYS_TIME_HI_PER_UUS;
+
+  // Same SPI traffic as answering a frame: read it and its timestamp, program the reply
+  dwt_readrxdata(calib_rx, sizeof(calib_rx), 0);
+  dwt_readtxtimestamp(calib_ts);
+  dwt_setdelayedtrxtime(reply_hi);
+  dwt_writetxdata(sizeof(calib_ts) + 2, calib_ts, CALIB_MSG_TS_IDX);
+  dwt_writetxfctrl(sizeof(tx_calib_msg), 0, 1);
+
+  int ret = dwt_starttx(DWT_START_TX_DELAYED);
+  *elapsed = (dwt_readsystimestamphi32() - ref_hi) / SYS_TIME_HI_PER_UUS;
+
+  if (ret != DWT_SUCCESS) {
+    // Too late for the programmed time, the transmitter did not start
+    dwt_forcetrxoff();
+    return false;
+  }
+  if (uwb_wait_event(UWB_EVT_TX_DONE, CALIB_TX_TIMEOUT_TICKS) != UWB_EVT_TX_DONE) {
+    dwt_forcetrxoff();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Measure the firmware turnaround and derive the reply delay
+ *
+ * The caller must own the radio. Frames are addressed to this node, so the
+ * other nodes drop them in their frame filter. Turnarounds are measured with
+ * replies at the longest delay, then the derived delay is checked on as many
+ * rounds. The current delay is kept if any of them is late.
+ *
+ * @param[out] turnaround   Worst turnaround measured, in UWB microseconds
+ *
+ * @return Reply delay, or 0 if a frame could not be sent or a reply was late
+ */
+uint16_t uwb_calibrate(uint16_t *turnaround)
+{
+  uint32_t worst = 0;
+  uint32_t ref_hi, elapsed;
+
+  for (int i = 0; i < CALIB_ROUNDS; i++) {
+    if (!calib_send_ref(&ref_hi) || !calib_reply(ref_hi, REPLY_DLY_MAX_UUS, &elapsed)) {
+      return 0;
+    }
+    if (elapsed > worst) worst = elapsed;
+  }
+
+  *turnaround = (worst > UINT16_MAX) ? UINT16_MAX : worst;
+  uint32_t delay = (worst + CALIB_MARGIN_UUS > REPLY_DLY_MAX_UUS) ? REPLY_DLY_MAX_UUS : worst + CALIB_MARGIN_UUS;
+  if (delay < REPLY_DLY_MIN_UUS) delay = REPLY_DLY_MIN_UUS;
+
+  // Every reply at the new delay must leave in time
+  for (int i = 0; i < CALIB_ROUNDS; i++) {
+    if (!calib_send_ref(&ref_hi) || !calib_reply(ref_hi, delay, &elapsed)) {
+      return 0;
+    }
+  }
+
+  uwb_reply_delay_set(delay);
+  return m_reply_dly;
+}
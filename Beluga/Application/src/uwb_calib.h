@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_calib.h
+ *
+ *  @brief  Calibration of the ranging reply delays --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_CALIB_H_
+#define _UWB_CALIB_H_
+
+#include <stdint.h>
+
+#define REPLY_DLY_MIN_UUS   400     /**< Initiator RX is enabled 300 uus after the poll */
+#define REPLY_DLY_MAX_UUS   2000
+#define CALIB_ROUNDS        64
+#define CALIB_MARGIN_UUS    300     /**< Preamble time plus interrupt latency jitter */
+
+uint16_t uwb_reply_delay(uint16_t default_uus);
+void uwb_reply_delay_set(uint16_t uus);
+uint16_t uwb_calibrate(uint16_t *turnaround);
+
+#endif
@@ -0,0 +1,169 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_frame.c
+ *
+ *  @brief  IEEE 802.15.4 addressing of the UWB ranging frames
+ *
+ *          Ranging frames carry the real 16-bit destination and source node
+ *          IDs. The DW1000 is given the node's short address and PAN ID and
+ *          its frame filter is enabled, so frames addressed to other nodes are
+ *          dropped by the radio and never raise an interrupt or get read over
+ *          SPI. The number of such frames is kept from the DW1000 event
+ *          counters.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "deca_device_api.h"
+#include "uwb_frame.h"
+
+/* Frame control of a data frame with PAN ID compression and 16-bit addresses */
+#define FRAME_FCTRL_LO      0x41
+#define FRAME_FCTRL_HI      0x88
+
+/* DW1000 event counters are 12 bits wide */
+#define EVC_MASK            0xFFF
+
+static uint16_t m_addr = 0;
+static uint8_t m_seq = 0;
+
+static uwb_rx_stats_t m_stats;
+static dwt_deviceentcnts_t m_evc_last;
+
+
+/**
+ * @brief Setup PAN ID, short address, frame filtering and event counters
+ *
+ * @param[in] addr   Node ID used as 16-bit short address
+ */
+void uwb_frame_init(uint16_t addr)
+{
+  dwt_setpanid(UWB_PAN_ID);
+  uwb_frame_set_address(addr);
+
+  /* Accept data frames addressed to this node or to the broadcast address only */
+  dwt_enableframefilter(DWT_FF_DATA_EN);
+
+  dwt_configeventcounters(1);
+  memset(&m_stats, 0, sizeof(m_stats));
+  memset(&m_evc_last, 0, sizeof(m_evc_last));
+}
+
+/**
+ * @brief Restore the frame filter and event counters after DEEPSLEEP
+ *
+ * The event counters restart from zero on wake up, so the counts folded in
+ * by the last uwb_frame_stats_update() before sleeping are kept.
+ */
+void uwb_frame_resume(void)
+{
+  dwt_setaddress16(m_addr);
+  dwt_enableframefilter(DWT_FF_DATA_EN);
+  dwt_configeventcounters(1);
+  memset(&m_evc_last, 0, sizeof(m_evc_last));
+}
+
+/**
+ * @brief Change the 16-bit short address of the node
+ */
+void uwb_frame_set_address(uint16_t addr)
+{
+  m_addr = addr;
+  dwt_setaddress16(addr);
+}
+
+/**
+ * @brief Fill sequence number, PAN ID and addresses of a frame to send
+ *
+ * @param[in] frame  Frame starting with the frame control field
+ * @param[in] dst    Destination node ID
+ */
+void uwb_frame_header(uint8_t *frame, uint16_t dst)
+{
+  frame[FRAME_FCTRL_IDX] = FRAME_FCTRL_LO;
+  frame[FRAME_FCTRL_IDX + 1] = FRAME_FCTRL_HI;
+  frame[FRAME_SN_IDX] = m_seq++;
+  frame[FRAME_PAN_IDX] = UWB_PAN_ID & 0xFF;
+  frame[FRAME_PAN_IDX + 1] = UWB_PAN_ID >> 8;
+  frame[FRAME_DST_IDX] = dst & 0xFF;
+  frame[FRAME_DST_IDX + 1] = dst >> 8;
+  frame[FRAME_SRC_IDX] = m_addr & 0xFF;
+  frame[FRAME_SRC_IDX + 1] = m_addr >> 8;
+}
+
+/**
+ * @brief Check a received frame is a given ranging frame from a given node
+ *
+ * @param[in] frame  Received frame
+ * @param[in] len    Received frame length, including the CRC
+ * @param[in] func   Expected function code
+ * @param[in] src    Expected source node ID, UWB_ADDR_BROADCAST for any
+ *
+ * @return 1 if the frame matches, 0 otherwise
+ */
+int uwb_frame_check(const uint8_t *frame, uint32_t len, uint8_t func, uint16_t src)
+{
+  uint16_t dst = frame[FRAME_DST_IDX] | (frame[FRAME_DST_IDX + 1] << 8);
+
+  if (len < FRAME_HDR_LEN ||
+      frame[FRAME_FCTRL_IDX] != FRAME_FCTRL_LO || frame[FRAME_FCTRL_IDX + 1] != FRAME_FCTRL_HI ||
+      frame[FRAME_PAN_IDX] != (UWB_PAN_ID & 0xFF) || frame[FRAME_PAN_IDX + 1] != (UWB_PAN_ID >> 8) ||
+      frame[FRAME_FUNC_IDX] != func) {
+    return 0;
+  }
+  if (dst != m_addr && dst != UWB_ADDR_BROADCAST) {
+    return 0;
+  }
+  if (src != UWB_ADDR_BROADCAST && uwb_frame_src(frame) != src) {
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Source node ID of a received frame
+ */
+uint16_t uwb_frame_src(const uint8_t *frame)
+{
+  return frame[FRAME_SRC_IDX] | (frame[FRAME_SRC_IDX + 1] << 8);
+}
+
+/**
+ * @brief Fold the DW1000 event counters into the receive statistics
+ *
+ * Must run from the task owning the radio, often enough that no 12-bit
+ * counter wraps twice between two calls.
+ */
+void uwb_frame_stats_update(void)
+{
+  dwt_deviceentcnts_t evc;
+
+  dwt_readeventcounters(&evc);
+
+  m_stats.received += (evc.CRCG - m_evc_last.CRCG) & EVC_MASK;
+  m_stats.filtered += (evc.ARFE - m_evc_last.ARFE) & EVC_MASK;
+  m_stats.crc_err += (evc.CRCB - m_evc_last.CRCB) & EVC_MASK;
+  m_stats.phr_err += (evc.PHE - m_evc_last.PHE) & EVC_MASK;
+  m_stats.overruns += (evc.OVER - m_evc_last.OVER) & EVC_MASK;
+
+  m_evc_last = evc;
+}
+
+/**
+ * @brief Count a poll answered by the responder
+ */
+void uwb_frame_stats_answered(void)
+{
+  m_stats.answered++;
+}
+
+/**
+ * @brief Copy of the receive statistics as of the last update
+ */
+void uwb_frame_stats_get(uwb_rx_stats_t *stats)
+{
+  *stats = m_stats;
+}
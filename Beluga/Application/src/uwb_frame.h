@@ -0,0 +1,75 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_frame.h
+ *
+ *  @brief  IEEE 802.15.4 addressing of the UWB ranging frames --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_FRAME_H_
+#define _UWB_FRAME_H_
+
+#include <stdint.h>
+
+#define UWB_PAN_ID          0xDECA
+#define UWB_ADDR_BROADCAST  0xFFFF
+
+/* Header layout shared by all ranging frames, see NOTE 1 of init_main.c */
+#define FRAME_FCTRL_IDX     0
+#define FRAME_SN_IDX        2
+#define FRAME_PAN_IDX       3
+#define FRAME_DST_IDX       5
+#define FRAME_SRC_IDX       7
+#define FRAME_FUNC_IDX      9
+#define FRAME_HDR_LEN       10
+
+/* Function codes of the ranging frames */
+#define FRAME_FUNC_POLL     0x61
+#define FRAME_FUNC_RESP     0x50
+#define FRAME_FUNC_FINAL    0x69
+#define FRAME_FUNC_REPORT   0xE3
+#define FRAME_FUNC_BEACON   0xB5
+#define FRAME_FUNC_MPOLL    0x62
+#define FRAME_FUNC_MFINAL   0x6A
+
+/* Broadcast poll DS-TWR (AT+TWRMODE 2). The poll lists the responders, response i
+ * is sent MTWR_RESP_DLY_UUS + i * MTWR_SLOT_UUS after the poll and report i the
+ * same delay after the final. */
+#define MTWR_MAX_RESPONDERS 8
+#define MTWR_RESP_DLY_UUS   1500
+#define MTWR_SLOT_UUS       800
+#define MTWR_FINAL_DLY_UUS  1000    /**< Final TX after the end of the response window */
+
+#define MPOLL_N_IDX         (FRAME_HDR_LEN)
+#define MPOLL_ID_IDX        (FRAME_HDR_LEN + 1)
+#define MPOLL_LEN(n)        (MPOLL_ID_IDX + 2 * (n) + 2)
+
+#define MFINAL_POLL_TX_IDX  (FRAME_HDR_LEN)
+#define MFINAL_FINAL_TX_IDX (FRAME_HDR_LEN + 4)
+#define MFINAL_N_IDX        (FRAME_HDR_LEN + 8)
+#define MFINAL_RESP_RX_IDX  (FRAME_HDR_LEN + 9)
+#define MFINAL_LEN(n)       (MFINAL_RESP_RX_IDX + 4 * (n) + 2)
+
+/* Receive counters, accumulated from the DW1000 12-bit event counters */
+typedef struct {
+  uint32_t received;    /**< Frames received with good CRC */
+  uint32_t filtered;    /**< Frames rejected by the address filter, never read over SPI */
+  uint32_t crc_err;     /**< Frames received with bad CRC */
+  uint32_t phr_err;     /**< PHY header errors */
+  uint32_t overruns;    /**< Frames lost with both RX buffers full, continuous RX mode only */
+  uint32_t answered;    /**< Polls answered by the responder */
+} uwb_rx_stats_t;
+
+void uwb_frame_init(uint16_t addr);
+void uwb_frame_set_address(uint16_t addr);
+void uwb_frame_resume(void);
+void uwb_frame_header(uint8_t *frame, uint16_t dst);
+int uwb_frame_check(const uint8_t *frame, uint32_t len, uint8_t func, uint16_t src);
+uint16_t uwb_frame_src(const uint8_t *frame);
+void uwb_frame_stats_update(void);
+void uwb_frame_stats_answered(void);
+void uwb_frame_stats_get(uwb_rx_stats_t *stats);
+
+#endif
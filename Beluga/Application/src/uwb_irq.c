@@ -0,0 +1,376 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_irq.c
+ *
+ *  @brief  Interrupt driven DW1000 event handling for the ranging tasks
+ *
+ *          The DW1000 IRQ line is routed through GPIOTE. The GPIOTE handler only
+ *          notifies the task that is waiting on the radio; dwt_isr() and the
+ *          callbacks registered with dwt_setcallbacks() then run in that task's
+ *          context, so SPI is never accessed from interrupt context and the
+ *          ranging tasks block instead of polling SYS_STATUS.
+ *
+ *  @date   2020/06
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_gpiote.h"
+#include "app_error.h"
+#include "dw1001_dev.h"
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "uwb_irq.h"
+
+/* Task notification bits used to wake the waiting task */
+#define UWB_NOTIFY_IRQ     (1UL << 0)
+#define UWB_NOTIFY_CANCEL  (1UL << 1)
+
+/* Upper bound of dwt_isr() calls per wake up, in case the IRQ line gets stuck */
+#define UWB_ISR_MAX_LOOPS  4
+
+/* DW1000 events enabled on the IRQ line */
+#define UWB_IRQ_MASK (DWT_INT_TFRS | DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | \
+                      DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT)
+
+static volatile TaskHandle_t m_waiter = NULL;
+static uint32_t m_events = 0;
+static uint16_t m_rx_len = 0;
+
+/* Frames captured in continuous RX mode. Only touched from dwt_isr() and the
+ * task owning the radio, so no locking is needed. */
+static bool m_capture = false;
+static bool m_listening = false;
+static uwb_rx_frame_t m_rxq[UWB_RX_QUEUE_LEN];
+static uint8_t m_rxq_head = 0;
+static uint8_t m_rxq_tail = 0;
+
+
+/**
+ * @brief DW1000 frame sent callback, called from dwt_isr()
+ */
+static void tx_done_cb(const dwt_cb_data_t *cb_data)
+{
+  m_events |= UWB_EVT_TX_DONE;
+}
+
+/**
+ * @brief DW1000 good frame callback, called from dwt_isr()
+ */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data)
+{
+  m_rx_len = cb_data->datalength;
+
+  /* With double buffering dwt_isr() hands the buffer back to the DW1000 right
+   * after this callback, so the frame has to be copied out here. */
+  if (m_capture) {
+    uint8_t next = (m_rxq_head + 1) % UWB_RX_QUEUE_LEN;
+
+    if (next != m_rxq_tail && m_rx_len <= UWB_RX_FRAME_MAX) {
+      dwt_readrxdata(m_rxq[m_rxq_head].data, m_rx_len, 0);
+      dwt_readrxtimestamp(m_rxq[m_rxq_head].ts);
+      m_rxq[m_rxq_head].len = m_rx_len;
+      m_rxq_head = next;
+    }
+  }
+
+  m_events |= UWB_EVT_RX_OK;
+}
+
+/**
+ * @brief DW1000 RX timeout callback, called from dwt_isr()
+ *
+ * dwt_isr() only acknowledges the frame wait timeout, so the preamble detect
+ * timeout is cleared here to release the IRQ line.
+ */
+static void rx_to_cb(const dwt_cb_data_t *cb_data)
+{
+  dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO);
+  m_events |= UWB_EVT_RX_TO;
+}
+
+/**
+ * @brief DW1000 RX error callback, called from dwt_isr()
+ */
+static void rx_err_cb(const dwt_cb_data_t *cb_data)
+{
+  m_events |= UWB_EVT_RX_ERR;
+}
+
+/**
+ * @brief GPIOTE handler of the DW1000 IRQ line
+ */
+static void uwb_irq_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+  BaseType_t woken = pdFALSE;
+  TaskHandle_t waiter = m_waiter;
+
+  if (waiter != NULL) {
+    xTaskNotifyFromISR(waiter, UWB_NOTIFY_IRQ, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+/**
+ * @brief Run dwt_isr() while the DW1000 IRQ line is asserted
+ */
+static void uwb_service(void)
+{
+  for (int i = 0; i < UWB_ISR_MAX_LOOPS && nrf_gpio_pin_read(DW1000_IRQ); i++) {
+    dwt_isr();
+  }
+}
+
+/**
+ * @brief Setup DW1000 interrupts, callbacks and the GPIOTE IRQ line
+ */
+void uwb_irq_init(void)
+{
+  ret_code_t err_code;
+
+  if (!nrf_drv_gpiote_is_init()) {
+    err_code = nrf_drv_gpiote_init();
+    APP_ERROR_CHECK(err_code);
+  }
+
+  nrf_drv_gpiote_in_config_t in_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
+  in_config.pull = NRF_GPIO_PIN_NOPULL;
+
+  err_code = nrf_drv_gpiote_in_init(DW1000_IRQ, &in_config, uwb_irq_handler);
+  APP_ERROR_CHECK(err_code);
+
+  dwt_setcallbacks(&tx_done_cb, &rx_ok_cb, &rx_to_cb, &rx_err_cb);
+  dwt_setinterrupt(UWB_IRQ_MASK, 1);
+
+  nrf_drv_gpiote_in_event_enable(DW1000_IRQ, true);
+}
+
+/**
+ * @brief Enable the DW1000 interrupts again after DEEPSLEEP
+ */
+void uwb_irq_resume(void)
+{
+  dwt_setinterrupt(UWB_IRQ_MASK, 1);
+  m_listening = false;
+  uwb_rx_flush();
+}
+
+/**
+ * @brief Drop events left over from a previous exchange
+ */
+void uwb_clear_events(void)
+{
+  uwb_service();
+  m_events = 0;
+}
+
+/**
+ * @brief Block the calling task until one of the requested DW1000 events occurs
+ *
+ * @param[in] mask      UWB_EVT_* events to wait for
+ * @param[in] timeout   Maximum number of ticks to block
+ *
+ * @return Events that occurred out of mask, UWB_EVT_CANCEL if the wait was
+ *         aborted by uwb_cancel_wait(), or 0 on timeout
+ */
+uint32_t uwb_wait_event(uint32_t mask, TickType_t timeout)
+{
+  TickType_t start = xTaskGetTickCount();
+  uint32_t notify = 0;
+  uint32_t ev = 0;
+
+  m_waiter = xTaskGetCurrentTaskHandle();
+
+  while (1) {
+    uwb_service();
+
+    ev = m_events & mask;
+    if (ev != 0) {
+      m_events &= ~ev;
+      break;
+    }
+
+    if (notify & UWB_NOTIFY_CANCEL) {
+      ev = UWB_EVT_CANCEL;
+      break;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+      break;
+    }
+
+    xTaskNotifyWait(0, UWB_NOTIFY_IRQ | UWB_NOTIFY_CANCEL, &notify, timeout - elapsed);
+  }
+
+  if (m_waiter == xTaskGetCurrentTaskHandle()) {
+    m_waiter = NULL;
+  }
+  return ev;
+}
+
+/**
+ * @brief Abort the current or next uwb_wait_event() of a task
+ *
+ * @param[in] task   Task blocked on the radio, e.g. the responder
+ */
+void uwb_cancel_wait(TaskHandle_t task)
+{
+  if (task != NULL) {
+    xTaskNotify(task, UWB_NOTIFY_CANCEL, eSetBits);
+  }
+}
+
+/**
+ * @brief Length of the last frame received with good CRC
+ */
+uint16_t uwb_rx_length(void)
+{
+  return m_rx_len;
+}
+
+/**
+ * @brief Switch continuous RX on or off
+ *
+ * In continuous mode the DW1000 receives into its two RX buffers and
+ * re-enables the receiver by itself after each frame, while frames are
+ * copied to a queue in dwt_isr(). The radio must be idle. Functions writing
+ * the driver's cached SYS_CFG, like dwt_setdblrxbuffmode(), clear the
+ * auto re-enable bit, so this must be called again after them.
+ *
+ * @param[in] enable   true for continuous RX, false for single frame RX
+ */
+void uwb_rx_continuous(bool enable)
+{
+  dwt_forcetrxoff();
+  dwt_setdblrxbuffmode(enable);
+
+  uint32_t cfg = dwt_read32bitreg(SYS_CFG_ID);
+  if (enable) {
+    cfg |= SYS_CFG_RXAUTR;
+  }
+  else {
+    cfg &= ~SYS_CFG_RXAUTR;
+  }
+  dwt_write32bitreg(SYS_CFG_ID, cfg);
+
+  m_capture = enable;
+  m_listening = false;
+  uwb_rx_flush();
+}
+
+/**
+ * @brief Whether continuous RX is on
+ */
+bool uwb_rx_continuous_enabled(void)
+{
+  return m_capture;
+}
+
+/**
+ * @brief Start receiving, unless the receiver is still listening in continuous RX mode
+ */
+void uwb_rx_listen(void)
+{
+  if (m_capture && m_listening) {
+    return;
+  }
+
+  uwb_clear_events();
+  dwt_rxenable(DWT_START_RX_IMMEDIATE);
+  m_listening = m_capture;
+}
+
+/**
+ * @brief Stop receiving and drop the queued frames, e.g. before a transmission
+ */
+void uwb_rx_stop(void)
+{
+  dwt_forcetrxoff();
+  m_listening = false;
+  uwb_rx_flush();
+}
+
+/**
+ * @brief Block until a frame is queued in continuous RX mode
+ *
+ * A receiver overrun is recovered here and reported as UWB_EVT_RX_ERR.
+ *
+ * @param[in] timeout   Maximum number of ticks to block
+ *
+ * @return UWB_EVT_RX_OK if a frame is queued, possibly with UWB_EVT_RX_TO or
+ *         UWB_EVT_RX_ERR if the receiver was stopped, UWB_EVT_CANCEL, or 0 on timeout
+ */
+uint32_t uwb_rx_wait(TickType_t timeout)
+{
+  TickType_t start = xTaskGetTickCount();
+  uint32_t ev = 0;
+
+  if (dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_RXOVRR) {
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXOVRR);
+    m_listening = false;
+    ev = UWB_EVT_RX_ERR;
+  }
+
+  while (1) {
+    if (m_rxq_head != m_rxq_tail) {
+      return ev | UWB_EVT_RX_OK;
+    }
+    if (ev & (UWB_EVT_RX_TO | UWB_EVT_RX_ERR | UWB_EVT_CANCEL)) {
+      return ev;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+      return 0;
+    }
+
+    ev = uwb_wait_event(UWB_EVT_RX_ANY, timeout - elapsed) & ~UWB_EVT_RX_OK;
+
+    /* dwt_isr() turns the receiver off on timeouts and errors */
+    if (ev & (UWB_EVT_RX_TO | UWB_EVT_RX_ERR)) {
+      m_listening = false;
+    }
+  }
+}
+
+/**
+ * @brief Take the oldest frame queued in continuous RX mode
+ *
+ * @param[out] buf    Frame data
+ * @param[in]  size   Size of buf
+ * @param[out] ts     40-bit RX timestamp, little endian
+ *
+ * @return Frame length, or 0 if no frame is queued or it does not fit in buf
+ */
+uint16_t uwb_rx_pop(uint8_t *buf, uint16_t size, uint8_t *ts)
+{
+  uint16_t len = 0;
+
+  if (m_rxq_head != m_rxq_tail) {
+    uwb_rx_frame_t *frame = &m_rxq[m_rxq_tail];
+
+    if (frame->len <= size) {
+      len = frame->len;
+      memcpy(buf, frame->data, len);
+      memcpy(ts, frame->ts, sizeof(frame->ts));
+    }
+    m_rxq_tail = (m_rxq_tail + 1) % UWB_RX_QUEUE_LEN;
+  }
+  return len;
+}
+
+/**
+ * @brief Drop the frames queued in continuous RX mode
+ */
+void uwb_rx_flush(void)
+{
+  m_rxq_tail = m_rxq_head;
+}
@@ -0,0 +1,52 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_irq.h
+ *
+ *  @brief  Interrupt driven DW1000 event handling for the ranging tasks --Header file
+ *
+ *  @date   2020/06
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_IRQ_H_
+#define _UWB_IRQ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Events reported by uwb_wait_event() */
+#define UWB_EVT_TX_DONE   (1UL << 0)  /**< Frame sent */
+#define UWB_EVT_RX_OK     (1UL << 1)  /**< Frame received with good CRC */
+#define UWB_EVT_RX_TO     (1UL << 2)  /**< Frame wait or preamble detect timeout */
+#define UWB_EVT_RX_ERR    (1UL << 3)  /**< PHY header, CRC, sync loss or SFD timeout error */
+#define UWB_EVT_CANCEL    (1UL << 4)  /**< Wait aborted by uwb_cancel_wait() */
+
+#define UWB_EVT_RX_ANY    (UWB_EVT_RX_OK | UWB_EVT_RX_TO | UWB_EVT_RX_ERR)
+
+/* Frame queue of the continuous RX mode */
+#define UWB_RX_FRAME_MAX  64
+#define UWB_RX_QUEUE_LEN  4     /**< Holds UWB_RX_QUEUE_LEN - 1 frames */
+
+typedef struct {
+  uint16_t len;
+  uint8_t ts[5];                      /**< RX timestamp, 40-bit little endian */
+  uint8_t data[UWB_RX_FRAME_MAX];
+} uwb_rx_frame_t;
+
+void uwb_irq_init(void);
+void uwb_irq_resume(void);
+void uwb_clear_events(void);
+uint32_t uwb_wait_event(uint32_t mask, TickType_t timeout);
+void uwb_cancel_wait(TaskHandle_t task);
+uint16_t uwb_rx_length(void);
+void uwb_rx_continuous(bool enable);
+bool uwb_rx_continuous_enabled(void);
+void uwb_rx_listen(void);
+void uwb_rx_stop(void);
+uint32_t uwb_rx_wait(TickType_t timeout);
+uint16_t uwb_rx_pop(uint8_t *buf, uint16_t size, uint8_t *ts);
+void uwb_rx_flush(void);
+
+#endif
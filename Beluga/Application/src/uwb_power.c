@@ -0,0 +1,295 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_power.c
+ *
+ *  @brief  DW1000 power saving, deep sleep between ranging rounds and sniff listening
+ *
+ *          In DEEPSLEEP only the AON block of the DW1000 stays powered. The
+ *          configuration is uploaded to AON when entering sleep and restored
+ *          on wake up, while the LDE microcode is reloaded. Wake up is done
+ *          with DW_CS, watching DW_RESET to know when the crystal is running.
+ *          The latency of each wake up is measured, so the ranging task can
+ *          start it early enough for the next poll.
+ *
+ *          Responders can listen in SNIFF mode instead, where the receiver
+ *          is switched on and off while waiting for a poll. Initiators then
+ *          send polls with a preamble longer than one sniff period, so a
+ *          sniffing responder is sure to catch it.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "port_platform.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "uwb_power.h"
+
+#define UWB_CYCLES_PER_US    (SystemCoreClock / 1000000)
+#define UWB_WAKE_BUF_LEN     600     /**< SPI read length of the slow wake up, ~600 us at 8 MHz */
+#define UWB_WAKE_ID_TRIES    10      /**< Device ID reads while the DW1000 moves from INIT to IDLE */
+#define UWB_WAKE_AVG_SHIFT   3       /**< Weight 1/8 of a new sample in the average */
+
+#define SNIFF_ON_PACS        2       /**< Receiver on time, in PACs beyond the one added by the DW1000 */
+#define SNIFF_PAC_NS         8141    /**< PAC8 at 64 MHz PRF, 8 symbols of 1017.6 ns */
+#define SNIFF_OFF_UNIT_NS    1024    /**< Unit of the receiver off time, 128/125 us */
+#define SNIFF_OFF_MAX        255
+#define SNIFF_SYMBOL_NS      1018    /**< Preamble symbol at 64 MHz PRF */
+#define SNIFF_PLEN_DEFAULT   128     /**< Preamble length set in dwt_config_t */
+
+static bool m_configured = false;
+static bool m_asleep = false;
+static uwb_power_stats_t m_stats;
+static uint8_t m_wake_buf[UWB_WAKE_BUF_LEN];
+
+static int m_sniff_duty = 0;
+static uint8_t m_sniff_off = 0;
+static uint8_t m_poll_plen = 0;         /**< DWT_PLEN_* of polls, 0 for the configured preamble */
+static bool m_sniff_on = false;
+static uwb_sniff_info_t m_sniff_info = { .poll_plen = SNIFF_PLEN_DEFAULT };
+
+
+/**
+ * @brief Whether the DW1000 answers SPI reads
+ */
+static bool uwb_awake_check(void)
+{
+  for (int i = 0; i < UWB_WAKE_ID_TRIES; i++) {
+    if (dwt_readdevid() == DWT_DEVICE_ID) {
+      return true;
+    }
+    nrf_delay_us(10);
+  }
+  return false;
+}
+
+/**
+ * @brief Record the latency of a wake up
+ */
+static void uwb_wake_record(uint32_t us)
+{
+  m_stats.wakes++;
+  m_stats.last_us = us;
+  if (us > m_stats.max_us) {
+    m_stats.max_us = us;
+  }
+  if (m_stats.avg_us == 0) {
+    m_stats.avg_us = us;
+  }
+  else {
+    m_stats.avg_us += ((int32_t) us - (int32_t) m_stats.avg_us) >> UWB_WAKE_AVG_SHIFT;
+  }
+}
+
+/**
+ * @brief Configure DEEPSLEEP with wake up on DW_CS, after dwt_initialise()
+ *
+ * The configuration is restored from AON on wake up and the DW1000 returns
+ * to IDLE. The DWT CYCCNT counter must be running, see boot_time_init().
+ */
+void uwb_power_init(void)
+{
+  dwt_configuresleep(DWT_PRESRV_SLEEP | DWT_CONFIG, DWT_WAKE_CS | DWT_SLP_EN);
+  m_configured = true;
+}
+
+/**
+ * @brief Put the DW1000 into DEEPSLEEP, the caller must own the radio
+ */
+void uwb_sleep(void)
+{
+  if (!m_configured || m_asleep) return;
+
+  dwt_forcetrxoff();
+  uwb_clear_events();
+  uwb_frame_stats_update();
+  dwt_entersleep();
+  m_asleep = true;
+}
+
+/**
+ * @brief Wake the DW1000 up if it sleeps, the caller must own the radio
+ *
+ * Settings held outside of AON, like the antenna delays, the interrupt
+ * mask and the frame filter, are written again.
+ *
+ * @return true once the DW1000 is in IDLE
+ */
+bool uwb_wake(void)
+{
+  if (!m_asleep) return true;
+
+  uint32_t start = DWT->CYCCNT;
+  bool ok;
+
+  port_wakeup_dw1000_fast();
+  ok = uwb_awake_check();
+  if (!ok) {
+    m_stats.failures++;
+    ok = dwt_spicswakeup(m_wake_buf, sizeof(m_wake_buf)) == DWT_SUCCESS;
+  }
+  if (!ok) {
+    return false;
+  }
+
+  dwt_setrxantennadelay(RX_ANT_DLY);
+  dwt_settxantennadelay(TX_ANT_DLY);
+  dwt_setrxtimeout(0);
+  if (m_sniff_on) {
+    dwt_setsniffmode(0, 0, 0);
+    m_sniff_on = false;
+  }
+  uwb_irq_resume();
+  uwb_frame_resume();
+  m_asleep = false;
+
+  uwb_wake_record((DWT->CYCCNT - start) / UWB_CYCLES_PER_US);
+  return true;
+}
+
+/**
+ * @brief Whether the DW1000 is in DEEPSLEEP
+ */
+bool uwb_asleep(void)
+{
+  return m_asleep;
+}
+
+/**
+ * @brief Ticks to start a wake up ahead of the radio being needed
+ *
+ * Based on the longest wake up seen so far, rounded up, or the crystal
+ * startup time given by DecaWave before the first wake up.
+ */
+TickType_t uwb_wake_lead(void)
+{
+  uint32_t us = m_stats.max_us != 0 ? m_stats.max_us : 2200;
+
+  return (us * configTICK_RATE_HZ + 999999) / 1000000;
+}
+
+/**
+ * @brief Copy of the wake up statistics
+ */
+void uwb_power_stats_get(uwb_power_stats_t *stats)
+{
+  *stats = m_stats;
+}
+
+/**
+ * @brief Set the receiver duty cycle of responders listening for polls
+ *
+ * The receiver is on for SNIFF_ON_PACS + 1 PACs, the off time follows from
+ * the duty cycle, limited by the 8-bit off time of the DW1000. Polls are
+ * sent with the shortest preamble covering a full sniff period plus one on
+ * time. All nodes of a deployment should use the same setting.
+ * The caller must own the radio.
+ *
+ * @param[in] duty   Receiver on time in percent, 1 to 99, 0 to listen continuously
+ *
+ * @return false if duty is out of range
+ */
+bool uwb_sniff_set(int duty)
+{
+  if (duty < 0 || duty > 99) return false;
+
+  uwb_sniff_rx(false);
+
+  memset(&m_sniff_info, 0, sizeof(m_sniff_info));
+  m_sniff_info.poll_plen = SNIFF_PLEN_DEFAULT;
+  m_sniff_duty = duty;
+  m_sniff_off = 0;
+  m_poll_plen = 0;
+
+  if (duty == 0) return true;
+
+  uint32_t on_ns = (SNIFF_ON_PACS + 1) * SNIFF_PAC_NS;
+  uint32_t off = (on_ns * (100 - duty)) / (duty * SNIFF_OFF_UNIT_NS);
+
+  if (off < 1) off = 1;
+  if (off > SNIFF_OFF_MAX) off = SNIFF_OFF_MAX;
+  m_sniff_off = off;
+
+  uint32_t off_ns = off * SNIFF_OFF_UNIT_NS;
+  uint32_t need_ns = on_ns + off_ns + on_ns;
+
+  if (need_ns <= 256 * SNIFF_SYMBOL_NS) {
+    m_poll_plen = DWT_PLEN_256;
+    m_sniff_info.poll_plen = 256;
+  }
+  else {
+    m_poll_plen = DWT_PLEN_512;
+    m_sniff_info.poll_plen = 512;
+  }
+
+  m_sniff_info.on_us = on_ns / 1000;
+  m_sniff_info.off_us = off_ns / 1000;
+  m_sniff_info.duty_permille = (on_ns * 1000) / (on_ns + off_ns);
+  m_sniff_info.latency_us = ((m_sniff_info.poll_plen - SNIFF_PLEN_DEFAULT) * SNIFF_SYMBOL_NS) / 1000;
+  return true;
+}
+
+/**
+ * @brief Receiver duty cycle set by uwb_sniff_set()
+ */
+int uwb_sniff_duty(void)
+{
+  return m_sniff_duty;
+}
+
+/**
+ * @brief SFD timeout for dwt_config_t, covering the preamble of polls
+ *
+ * @param[in] pac   PAC size in symbols
+ */
+uint16_t uwb_sniff_sfd_timeout(uint16_t pac)
+{
+  return m_sniff_info.poll_plen + 1 + 8 - pac;
+}
+
+/**
+ * @brief Switch SNIFF mode of the receiver, which must be off
+ *
+ * Does nothing when no duty cycle is set or the mode is already as requested.
+ *
+ * @param[in] on   true before listening for polls, false before any other reception
+ */
+void uwb_sniff_rx(bool on)
+{
+  on = on && m_sniff_duty != 0;
+  if (on == m_sniff_on) return;
+
+  dwt_setsniffmode(on, SNIFF_ON_PACS, m_sniff_off);
+  m_sniff_on = on;
+}
+
+/**
+ * @brief Lengthen the preamble of the poll whose frame control was just written
+ *
+ * The next dwt_writetxfctrl() restores the configured preamble.
+ */
+void uwb_sniff_poll_preamble(void)
+{
+  if (m_poll_plen == 0) return;
+
+  uint32_t fctrl = dwt_read32bitreg(TX_FCTRL_ID);
+  fctrl &= ~TX_FCTRL_TXPSR_PE_MASK;
+  fctrl |= (uint32_t) m_poll_plen << TX_FCTRL_TXPRF_SHFT;
+  dwt_write32bitreg(TX_FCTRL_ID, fctrl);
+}
+
+/**
+ * @brief Timing of the SNIFF mode set by uwb_sniff_set()
+ */
+void uwb_sniff_info_get(uwb_sniff_info_t *info)
+{
+  *info = m_sniff_info;
+}
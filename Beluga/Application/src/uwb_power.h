@@ -0,0 +1,48 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_power.h
+ *
+ *  @brief  DW1000 power saving, deep sleep between ranging rounds and sniff listening --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_POWER_H_
+#define _UWB_POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+typedef struct {
+  uint32_t wakes;       /**< Wake ups since boot */
+  uint32_t failures;    /**< Wake ups that needed the slow fallback */
+  uint32_t last_us;     /**< Latency of the last wake up */
+  uint32_t max_us;      /**< Longest wake up */
+  uint32_t avg_us;      /**< Moving average of the wake latency */
+} uwb_power_stats_t;
+
+typedef struct {
+  uint32_t on_us;         /**< Receiver on time of a sniff period */
+  uint32_t off_us;        /**< Receiver off time of a sniff period */
+  uint32_t duty_permille; /**< Actual receiver on share */
+  uint32_t poll_plen;     /**< Preamble length of polls, in symbols */
+  uint32_t latency_us;    /**< Time added to each poll by the longer preamble */
+} uwb_sniff_info_t;
+
+void uwb_power_init(void);
+void uwb_sleep(void);
+bool uwb_wake(void);
+bool uwb_asleep(void);
+TickType_t uwb_wake_lead(void);
+void uwb_power_stats_get(uwb_power_stats_t *stats);
+
+bool uwb_sniff_set(int duty);
+int uwb_sniff_duty(void);
+uint16_t uwb_sniff_sfd_timeout(uint16_t pac);
+void uwb_sniff_rx(bool on);
+void uwb_sniff_poll_preamble(void);
+void uwb_sniff_info_get(uwb_sniff_info_t *info);
+
+#endif
@@ -0,0 +1,135 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_prof.c
+ *
+ *  @brief  Latency histograms of the initiator ranging phases
+ *
+ *          Each phase of an exchange is stamped with the DW1000 system time,
+ *          relative to the start of the poll transmission, and counted in a
+ *          histogram with power of two buckets. The system time is read
+ *          with a 4 byte SPI read, so the stamps are cheap enough to stay in
+ *          the ranging path. dwt_readsystimestamphi32() wraps after 17 s,
+ *          far longer than an exchange.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "deca_device_api.h"
+#include "uwb_prof.h"
+
+/* dwt_readsystimestamphi32() counts 499.2 MHz * 128 / 256 = 249.6 per us */
+#define PROF_TIME_TO_US(t)   (((uint64_t)(t) * 10) / 2496)
+
+typedef struct {
+  uint32_t exchanges;     /**< Polls sent or attempted */
+  uint32_t success;       /**< Exchanges ending with a range */
+  uint32_t hist[UWB_PHASE_COUNT][UWB_PROF_BUCKETS];
+} uwb_prof_t;
+
+static uwb_prof_t m_prof;
+static uint32_t m_start;          /**< System time at the start of the exchange */
+static uint8_t m_ended;           /**< The exchange was already counted as ended */
+
+static const char *const phase_names[UWB_PHASE_COUNT] = {
+  "Poll TX", "Resp RX", "Final TX", "Report RX", "Timeout", "Fail"
+};
+
+
+/**
+ * @brief Histogram bucket of a latency
+ */
+static int prof_bucket(uint32_t us)
+{
+  int b = 0;
+  uint32_t bound = UWB_PROF_BUCKET_US;
+
+  while (b < UWB_PROF_BUCKETS - 1 && us >= bound) {
+    bound <<= 1;
+    b++;
+  }
+  return b;
+}
+
+/**
+ * @brief Stamp the start of an exchange, right before the poll is sent
+ */
+void uwb_prof_start(void)
+{
+  m_start = dwt_readsystimestamphi32();
+  m_ended = 0;
+  m_prof.exchanges++;
+}
+
+/**
+ * @brief Stamp a phase of the current exchange
+ *
+ * UWB_PHASE_TIMEOUT and UWB_PHASE_FAIL end the exchange, later marks of
+ * these two are ignored.
+ *
+ * @param[in] phase   Phase reached
+ */
+void uwb_prof_mark(uwb_phase_t phase)
+{
+  if (phase >= UWB_PHASE_TIMEOUT) {
+    if (m_ended) return;
+    m_ended = 1;
+  }
+
+  uint32_t us = PROF_TIME_TO_US(dwt_readsystimestamphi32() - m_start);
+  m_prof.hist[phase][prof_bucket(us)]++;
+}
+
+/**
+ * @brief Count the current exchange as successful
+ */
+void uwb_prof_done(void)
+{
+  m_ended = 1;
+  m_prof.success++;
+}
+
+/**
+ * @brief Clear the counters and histograms
+ */
+void uwb_prof_reset(void)
+{
+  memset(&m_prof, 0, sizeof(m_prof));
+}
+
+/**
+ * @brief Print the counters and one histogram per phase
+ *
+ * The ranging task may update the counters while they are printed, so
+ * lines can be one exchange apart.
+ */
+void uwb_prof_print(void)
+{
+  uint32_t timeouts = 0;
+  uint32_t fails = 0;
+
+  for (int b = 0; b < UWB_PROF_BUCKETS; b++) {
+    timeouts += m_prof.hist[UWB_PHASE_TIMEOUT][b];
+    fails += m_prof.hist[UWB_PHASE_FAIL][b];
+  }
+
+  printf("Exchanges: %lu, success: %lu, timeout: %lu, fail: %lu \r\n",
+         m_prof.exchanges, m_prof.success, timeouts, fails);
+
+  printf("Bucket us ");
+  for (int b = 0; b < UWB_PROF_BUCKETS - 1; b++) {
+    printf(" <%lu", (uint32_t) UWB_PROF_BUCKET_US << b);
+  }
+  printf(" more \r\n");
+
+  for (int p = 0; p < UWB_PHASE_COUNT; p++) {
+    printf("%-9s:", phase_names[p]);
+    for (int b = 0; b < UWB_PROF_BUCKETS; b++) {
+      printf(" %lu", m_prof.hist[p][b]);
+    }
+    printf(" \r\n");
+  }
+}
@@ -0,0 +1,36 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_prof.h
+ *
+ *  @brief  Latency histograms of the initiator ranging phases --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_PROF_H_
+#define _UWB_PROF_H_
+
+#include <stdint.h>
+
+#define UWB_PROF_BUCKETS      10   /**< Buckets of UWB_PROF_BUCKET_US, doubling up to the last, open ended one */
+#define UWB_PROF_BUCKET_US    64   /**< Upper bound of the first bucket */
+
+/* Ranging phases, each measured from the start of the poll transmission */
+typedef enum {
+  UWB_PHASE_POLL_TX,      /**< Poll sent */
+  UWB_PHASE_RESP_RX,      /**< Response received */
+  UWB_PHASE_FINAL_TX,     /**< Final sent */
+  UWB_PHASE_REPORT_RX,    /**< Report received */
+  UWB_PHASE_TIMEOUT,      /**< Exchange ended by a timeout */
+  UWB_PHASE_FAIL,         /**< Exchange ended by an error */
+  UWB_PHASE_COUNT
+} uwb_phase_t;
+
+void uwb_prof_start(void);
+void uwb_prof_mark(uwb_phase_t phase);
+void uwb_prof_done(void);
+void uwb_prof_reset(void);
+void uwb_prof_print(void);
+
+#endif
@@ -0,0 +1,94 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_range.c
+ *
+ *  @brief  Fixed-point time of flight and range computation
+ *
+ *          The Cortex-M4F only has a single precision FPU, so the double
+ *          precision time of flight math of the DecaWave examples runs in
+ *          software. Here it is done with 64-bit integers instead, with
+ *          ranges in millimetres. The DW1000 time unit is 1 / (499.2 MHz
+ *          * 128), so one unit of time of flight is 299702547 / 63897600
+ *          mm, about 4.69 mm.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include "uwb_range.h"
+
+#define RANGE_C_AIR          299702547LL   /**< Speed of light in air, m/s */
+#define RANGE_DTU_PER_MS     63897600LL    /**< DW1000 time units per ms, 499.2 MHz * 128 / 1000 */
+
+/* The SS-TWR clock offset ratio is -carrier_int / RANGE_CFO_DIV on channel 5,
+ * see FREQ_OFFSET_MULTIPLIER and HERTZ_TO_PPM_MULTIPLIER_CHAN_5 */
+#define RANGE_CFO_DIV        1744830464LL
+#define RANGE_SS_FRAC        16            /**< Fractions of a time unit kept by the SS-TWR division */
+#define RANGE_SS_MAX_DIFF    (1L << 26)    /**< Round trip difference bound, about 1 ms, keeps the math in 64 bits */
+
+
+/**
+ * @brief Divide rounding to nearest, halves away from zero
+ */
+static int64_t range_div_round(int64_t num, int64_t den)
+{
+  return (num >= 0) ? (num + den / 2) / den : (num - den / 2) / den;
+}
+
+/**
+ * @brief Double-sided two way ranging time of flight
+ *
+ * (round_a * round_b - reply_a * reply_b) / (round_a + round_b + reply_a + reply_b),
+ * truncated like the double computation it replaces. The products of two
+ * 32-bit intervals are exact in 64 bits, where doubles round them, so the
+ * two differ by one time unit now and then.
+ *
+ * @return Time of flight in DW1000 time units, or -1 if it is not positive
+ */
+int64_t uwb_range_ds_tof(uint32_t round_a, uint32_t reply_a, uint32_t round_b, uint32_t reply_b)
+{
+  uint64_t rounds = (uint64_t) round_a * round_b;
+  uint64_t replies = (uint64_t) reply_a * reply_b;
+  uint64_t sum = (uint64_t) round_a + round_b + reply_a + reply_b;
+
+  if (rounds <= replies || sum == 0) return -1;
+
+  return (int64_t)((rounds - replies) / sum);
+}
+
+/**
+ * @brief Range of a time of flight
+ *
+ * @param[in] tof_dtu   Time of flight in DW1000 time units, below 2^28 so the range fits in 32 bits
+ *
+ * @return Range in mm, rounded to nearest
+ */
+int32_t uwb_range_mm(int64_t tof_dtu)
+{
+  return (int32_t) range_div_round(tof_dtu * RANGE_C_AIR, RANGE_DTU_PER_MS);
+}
+
+/**
+ * @brief Single-sided two way ranging range with clock offset correction
+ *
+ * tof = (rtd_init - rtd_resp * (1 - ratio)) / 2 with ratio = -carrier_int / RANGE_CFO_DIV,
+ * scaled by 2 * RANGE_CFO_DIV so all terms are integers.
+ *
+ * @param[in] rtd_init      Initiator round trip, response RX - poll TX
+ * @param[in] rtd_resp      Responder reply time, response TX - poll RX
+ * @param[in] carrier_int   dwt_readcarrierintegrator() of the response
+ *
+ * @return Range in mm, or UWB_RANGE_NONE if the round trips are inconsistent
+ */
+int32_t uwb_range_ss_mm(int32_t rtd_init, int32_t rtd_resp, int32_t carrier_int)
+{
+  int64_t diff = (int64_t) rtd_init - rtd_resp;
+
+  if (diff >= RANGE_SS_MAX_DIFF || diff <= -RANGE_SS_MAX_DIFF) return UWB_RANGE_NONE;
+
+  int64_t num = diff * RANGE_CFO_DIV - (int64_t) rtd_resp * carrier_int;
+  int64_t tof_frac = range_div_round(num * (RANGE_SS_FRAC / 2), RANGE_CFO_DIV);
+
+  return (int32_t) range_div_round(tof_frac * RANGE_C_AIR, RANGE_DTU_PER_MS * RANGE_SS_FRAC);
+}
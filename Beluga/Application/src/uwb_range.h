@@ -0,0 +1,22 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   uwb_range.h
+ *
+ *  @brief  Fixed-point time of flight and range computation --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _UWB_RANGE_H_
+#define _UWB_RANGE_H_
+
+#include <stdint.h>
+
+#define UWB_RANGE_NONE   INT32_MIN   /**< No range, the exchange failed */
+
+int64_t uwb_range_ds_tof(uint32_t round_a, uint32_t reply_a, uint32_t round_b, uint32_t reply_b);
+int32_t uwb_range_mm(int64_t tof_dtu);
+int32_t uwb_range_ss_mm(int32_t rtd_init, int32_t rtd_resp, int32_t carrier_int);
+
+#endif
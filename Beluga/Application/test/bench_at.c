@@ -0,0 +1,200 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   bench_at.c
+ *
+ *  @brief  Host benchmark of the AT command round trip
+ *
+ *          Sends a configuration script through uart.c and fake_uarte.c one
+ *          command at a time, waiting for each reply like a host script. The
+ *          round trip is the command on the line, the idle time that ends the
+ *          DMA transfer, and the "OK" reply on the line. The original input
+ *          path took one interrupt per byte and the UART task polled its queue
+ *          every 100 ticks, adding 50 ticks on average.
+ *
+ *          Also times the lookup of at_cmd.c against a chain of strncmp()
+ *          with strcpy()/strtok()/atoi() like the original uart task.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uart.h"
+#include "at_cmd.h"
+#include "nrf.h"
+#include "fake_rtos.h"
+#include "fake_uarte.h"
+#include "test.h"
+
+#define OLD_POLL_TICKS   100
+#define LOOKUP_ROUNDS    200000
+
+static void reply_ok(const at_args_t *args)
+{
+  static const char ok[] = "OK \r\n";
+
+  (void) uart_write(UART_CH_CONSOLE, (const uint8_t *) ok, sizeof(ok) - 1);
+}
+
+/* The commands of main.c, sorted */
+static const at_command_t m_table[] = {
+  { "AUTORATE",   AT_ARG_OPT,  reply_ok }, { "BAUD",       AT_ARG_INT,  reply_ok },
+  { "BOOTMODE",   AT_ARG_INT,  reply_ok }, { "BOOTTIME",   AT_ARG_NONE, reply_ok },
+  { "CALIBRATE",  AT_ARG_OPT,  reply_ok }, { "CHANNEL",    AT_ARG_INT,  reply_ok },
+  { "FILTER",     AT_ARG_OPT,  reply_ok }, { "FORMAT",     AT_ARG_INT,  reply_ok },
+  { "ID",         AT_ARG_INT,  reply_ok }, { "IDLESTAT",   AT_ARG_NONE, reply_ok },
+  { "LEDMODE",    AT_ARG_INT,  reply_ok }, { "POLLMODE",   AT_ARG_OPT,  reply_ok },
+  { "PRIORITY",   AT_ARG_OPT,  reply_ok }, { "PWRMODE",    AT_ARG_OPT,  reply_ok },
+  { "RATE",       AT_ARG_INT,  reply_ok }, { "RESET",      AT_ARG_NONE, reply_ok },
+  { "RNGSTATS",   AT_ARG_OPT,  reply_ok }, { "RXMODE",     AT_ARG_INT,  reply_ok },
+  { "RXSTATS",    AT_ARG_NONE, reply_ok }, { "SNIFF",      AT_ARG_OPT,  reply_ok },
+  { "STARTBLE",   AT_ARG_NONE, reply_ok }, { "STARTUWB",   AT_ARG_NONE, reply_ok },
+  { "STATS",      AT_ARG_OPT,  reply_ok }, { "STOPBLE",    AT_ARG_NONE, reply_ok },
+  { "STOPUWB",    AT_ARG_NONE, reply_ok }, { "STREAMMODE", AT_ARG_INT,  reply_ok },
+  { "TDMA",       AT_ARG_INT,  reply_ok }, { "TIMEOUT",    AT_ARG_INT,  reply_ok },
+  { "TWRMODE",    AT_ARG_INT,  reply_ok }, { "TXPOWER",    AT_ARG_INT,  reply_ok },
+  { "UARTSTAT",   AT_ARG_NONE, reply_ok },
+};
+
+#define TABLE_LEN  (sizeof(m_table) / sizeof(m_table[0]))
+
+/* Setup of a node by a host script */
+static const char *const m_script[] = {
+  "AT+STOPUWB", "AT+STOPBLE", "AT+ID 12", "AT+BOOTMODE 2", "AT+CHANNEL 5", "AT+TXPOWER 1",
+  "AT+TWRMODE 1", "AT+RATE 100", "AT+AUTORATE 20", "AT+TIMEOUT 9000", "AT+FILTER 1", "AT+POLLMODE 1",
+  "AT+PRIORITY 7", "AT+FORMAT 1", "AT+STREAMMODE 1", "AT+TDMA 10", "AT+RXMODE 1", "AT+PWRMODE 1",
+  "AT+LEDMODE 0", "AT+STARTBLE", "AT+STARTUWB",
+};
+
+#define SCRIPT_LEN  (sizeof(m_script) / sizeof(m_script[0]))
+
+/* The original chain tested the names in the order they were added */
+static const char *const m_chain[] = {
+  "AT+STARTUWB", "AT+STOPUWB", "AT+STARTBLE", "AT+STOPBLE", "AT+ID", "AT+BOOTMODE", "AT+RATE",
+  "AT+CHANNEL", "AT+RESET", "AT+TIMEOUT", "AT+TXPOWER", "AT+STREAMMODE", "AT+TWRMODE", "AT+LEDMODE",
+  "AT+FORMAT", "AT+BAUD", "AT+UARTSTAT", "AT+TDMA", "AT+RXMODE", "AT+CALIBRATE", "AT+RXSTATS",
+  "AT+BOOTTIME", "AT+PWRMODE", "AT+SNIFF", "AT+STATS", "AT+RNGSTATS", "AT+FILTER", "AT+POLLMODE",
+  "AT+PRIORITY", "AT+AUTORATE", "AT+IDLESTAT",
+};
+
+#define CHAIN_LEN  (sizeof(m_chain) / sizeof(m_chain[0]))
+
+
+/**
+ * @brief Lookup of the original uart task
+ */
+static int chain_lookup(const char *line)
+{
+  char message[50];
+  char *token;
+
+  strcpy(message, line);
+  for (unsigned i = 0; i < CHAIN_LEN; i++) {
+    size_t len = strlen(m_chain[i]);
+
+    if (strncmp(message, m_chain[i], len) == 0 && (message[len] == ' ' || message[len] == '\0')) {
+      token = strtok(message, " ");
+      token = strtok(NULL, " ");
+      return (token != NULL) ? atoi(token) : 0;
+    }
+  }
+  return -1;
+}
+
+static int table_lookup(const char *line)
+{
+  const at_command_t *cmd;
+  at_args_t args;
+  char message[UART_LINE_LEN];
+
+  strcpy(message, line);
+  return (at_parse_line(message, m_table, TABLE_LEN, &cmd, &args) == AT_OK) ? args.value : -1;
+}
+
+/**
+ * @brief Run the script at one baud rate
+ */
+static void bench_baud(uint32_t baud)
+{
+  fake_uarte_stats_t before, after;
+  char line[UART_LINE_LEN];
+  double char_us = 10e6 / baud;
+  double new_ms = 0, old_ms = 0;
+  uint32_t irqs = 0, bytes = 0;
+
+  CHECK(uart_set_baudrate(baud));
+  double idle_us = NRF_TIMER2->CC[0];
+
+  for (unsigned i = 0; i < SCRIPT_LEN; i++) {
+    const at_command_t *cmd;
+    at_args_t args;
+    char text[UART_LINE_LEN + 2];
+    uint32_t reply;
+
+    snprintf(text, sizeof(text), "%s\r\n", m_script[i]);
+    fake_uarte_stats(&before);
+    fake_uarte_receive((const uint8_t *) text, strlen(text), true);
+    fake_uarte_stats(&after);
+
+    CHECK(uart_read_line(line, sizeof(line), 0));
+    CHECK_EQ(at_parse_line(line, m_table, TABLE_LEN, &cmd, &args), AT_OK);
+    fake_uarte_wire_clear();
+    cmd->handler(&args);
+    while (fake_uarte_tx_end() > 0)
+      ;
+    fake_uarte_wire(&reply);
+
+    double line_us = strlen(text) * char_us + reply * char_us;
+    new_ms += (line_us + idle_us) / 1000;
+    old_ms += (line_us + OLD_POLL_TICKS / 2 * 1e6 / configTICK_RATE_HZ) / 1000;
+    irqs += after.irqs - before.irqs;
+    bytes += strlen(text);
+  }
+
+  printf("%8u | %5.1f %5.1f | %7.2f %7.2f | %7.1f %7.1f\n", baud, (double) bytes / SCRIPT_LEN,
+         (double) irqs / SCRIPT_LEN, old_ms / SCRIPT_LEN, new_ms / SCRIPT_LEN, old_ms, new_ms);
+
+  CHECK(irqs <= 2 * SCRIPT_LEN);
+  CHECK(new_ms < old_ms);
+}
+
+int main(void)
+{
+  fake_uarte_reset();
+  fake_rtos_reset();
+  uart_init();
+
+  printf("round trip of %u commands, each sent after the reply to the previous one\n", (unsigned) SCRIPT_LEN);
+  printf("%8s | %5s %5s | %-15s | %-15s\n", "", "bytes", "irqs", "ms per command", "ms script");
+  printf("%8s | %5s %5s | %7s %7s | %7s %7s\n", "baud", "", "", "polled", "idle", "polled", "idle");
+  bench_baud(9600);
+  bench_baud(115200);
+  bench_baud(1000000);
+  CHECK(uart_set_baudrate(115200));
+  printf("the polled path took one interrupt per byte\n");
+
+  /* Lookup cost, the same answers from both */
+  volatile int sink = 0;
+  for (unsigned i = 0; i < SCRIPT_LEN; i++) {
+    CHECK_EQ(chain_lookup(m_script[i]), table_lookup(m_script[i]));
+  }
+
+  double start = test_now_ns();
+  for (int r = 0; r < LOOKUP_ROUNDS; r++) {
+    sink += chain_lookup(m_script[r % SCRIPT_LEN]);
+  }
+  double t_chain = (test_now_ns() - start) / LOOKUP_ROUNDS;
+
+  start = test_now_ns();
+  for (int r = 0; r < LOOKUP_ROUNDS; r++) {
+    sink += table_lookup(m_script[r % SCRIPT_LEN]);
+  }
+  double t_table = (test_now_ns() - start) / LOOKUP_ROUNDS;
+
+  printf("lookup of %u commands: strncmp chain %.1f ns, sorted table %.1f ns\n", (unsigned) TABLE_LEN, t_chain, t_table);
+  return TEST_RESULT();
+}
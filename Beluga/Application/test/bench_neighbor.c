@@ -0,0 +1,163 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   bench_neighbor.c
+ *
+ *  @brief  Host benchmark of the neighbor table against the original linear scan
+ *
+ *          Replays advertisements of n nodes in random order. The original
+ *          handler scanned seen_list with in_seen_list() and then again with
+ *          get_seen_list_idx() for every advertisement. The hashed table looks
+ *          the node up once and moves it in the RSSI order.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "neighbor.h"
+#include "test.h"
+
+#define BENCH_ADVS  2000000
+
+/* Entry of the original table */
+typedef struct {
+  uint16_t UUID;
+  int8_t RSSI;
+  int time_stamp;
+  float range;
+  int update_flag;
+  int polling_flag;
+  int ble_time_stamp;
+} linear_node;
+
+static linear_node m_linear[MAX_ANCHOR_COUNT];
+static int m_linear_size;
+static int m_last_seen_idx;
+
+static uint16_t m_ids[BENCH_ADVS];
+static int8_t m_rssi[BENCH_ADVS];
+
+
+static bool in_seen_list(uint16_t id)
+{
+  for (int i = 0; i < m_linear_size; i++) {
+    if (m_linear[i].UUID == id) return true;
+  }
+  return false;
+}
+
+static int get_seen_list_idx(uint16_t id)
+{
+  for (int i = 0; i < m_linear_size; i++) {
+    if (m_linear[i].UUID == id) return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Advertisement handling of the original ble_app.c
+ */
+static void linear_adv(uint16_t id, int8_t rssi, int now)
+{
+  if (!in_seen_list(id)) {
+    (void) get_seen_list_idx(0);
+    m_linear[m_last_seen_idx].UUID = id;
+    m_linear[m_last_seen_idx].RSSI = rssi;
+    m_linear[m_last_seen_idx].ble_time_stamp = now;
+    m_last_seen_idx = (m_last_seen_idx + 1) % m_linear_size;
+  }
+  else {
+    int index = get_seen_list_idx(id);
+    m_linear[index].RSSI = rssi;
+    m_linear[index].ble_time_stamp = now;
+  }
+}
+
+/**
+ * @brief Advertisement handling with the hashed table
+ */
+static void hashed_adv(uint16_t id, int8_t rssi, int now)
+{
+  int slot = neighbor_find(id);
+
+  if (slot < 0) {
+    slot = neighbor_insert(id, rssi);
+    if (slot < 0) return;
+  }
+  else {
+    seen_list[slot].RSSI = rssi;
+    neighbor_reorder(slot);
+  }
+  seen_list[slot].ble_time_stamp = now;
+}
+
+static void bench(int n)
+{
+  /* IDs are spread like the ones given with AT+ID, RSSI moves a few dB per advertisement */
+  uint16_t nodes[MAX_ANCHOR_COUNT];
+  int8_t level[MAX_ANCHOR_COUNT];
+
+  srand(n);
+  for (int i = 0; i < n; i++) {
+    bool dup;
+    do {
+      nodes[i] = 1 + rand() % 0xFFFE;
+      dup = false;
+      for (int j = 0; j < i; j++) dup |= nodes[j] == nodes[i];
+    } while (dup);
+    level[i] = -40 - rand() % 50;
+  }
+  for (int i = 0; i < BENCH_ADVS; i++) {
+    int k = rand() % n;
+    m_ids[i] = nodes[k];
+    m_rssi[i] = level[k] + rand() % 7 - 3;
+  }
+
+  memset(m_linear, 0, sizeof(m_linear));
+  m_linear_size = n;
+  m_last_seen_idx = 0;
+  double start = test_now_ns();
+  for (int i = 0; i < BENCH_ADVS; i++) {
+    linear_adv(m_ids[i], m_rssi[i], i);
+  }
+  double t_linear = (test_now_ns() - start) / BENCH_ADVS;
+
+  neighbor_init();
+  start = test_now_ns();
+  for (int i = 0; i < BENCH_ADVS; i++) {
+    hashed_adv(m_ids[i], m_rssi[i], i);
+  }
+  double t_hashed = (test_now_ns() - start) / BENCH_ADVS;
+
+  /* Lookups of unknown nodes, e.g. advertisements of other networks */
+  start = test_now_ns();
+  volatile int found = 0;
+  for (int i = 0; i < BENCH_ADVS; i++) {
+    found += in_seen_list(m_ids[i] ^ 0x8000);
+  }
+  double t_linear_miss = (test_now_ns() - start) / BENCH_ADVS;
+
+  start = test_now_ns();
+  for (int i = 0; i < BENCH_ADVS; i++) {
+    found += neighbor_find(m_ids[i] ^ 0x8000) >= 0;
+  }
+  double t_hashed_miss = (test_now_ns() - start) / BENCH_ADVS;
+
+  printf("%5d | %8.1f %8.1f | %8.1f %8.1f\n", n, t_linear, t_hashed, t_linear_miss, t_hashed_miss);
+  CHECK_EQ(neighbor_count(), n);
+}
+
+int main(void)
+{
+  printf("ns per advertisement, %d advertisements, entry %u bytes (was %u), table %u bytes\n",
+         BENCH_ADVS, (unsigned) sizeof(node), (unsigned) sizeof(linear_node), (unsigned) sizeof(seen_list));
+  printf("nodes | linear   hashed   | miss: linear hashed\n");
+  bench(12);
+  bench(40);
+  bench(100);
+  bench(MAX_ANCHOR_COUNT);
+  return TEST_RESULT();
+}
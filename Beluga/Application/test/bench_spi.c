@@ -0,0 +1,238 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   bench_spi.c
+ *
+ *  @brief  Host benchmark of the DW1000 SPI transfer layer
+ *
+ *          Runs dwt_readrxdata() and dwt_writetxdata() of the Decawave driver
+ *          over the original readfromspi()/writetospi() with staging VLAs and
+ *          over port_platform.c, and counts SPI driver calls, bytes clocked
+ *          and bytes copied or cleared by memcpy()/memset() per call.
+ *          port_platform.c is built with its SPI functions, memcpy() and
+ *          memset() renamed, see the Makefile.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "deca_device_api.h"
+#include "nrf_drv_spi.h"
+#include "nrf_drv_common.h"
+#include "fake_rtos.h"
+#include "test.h"
+
+#define BENCH_ROUNDS  200000
+
+typedef struct {
+  uint32_t spi_calls;   /**< nrf_drv_spi_transfer() calls */
+  uint32_t spi_bytes;   /**< Bytes clocked on the bus */
+  uint32_t copied;      /**< Bytes moved by memcpy() */
+  uint32_t cleared;     /**< Bytes set by memset() */
+} bench_count_t;
+
+int port_readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer);
+int port_writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer);
+void port_set_dw1000_slowrate(void);
+
+static bench_count_t m_count;
+static bool m_baseline = false;
+static nrf_drv_spi_evt_handler_t m_spi_handler = NULL;
+static volatile bool m_spi_done;
+static const uint8_t *m_flash_start = NULL;
+static size_t m_flash_len = 0;
+static volatile uint32_t m_dma_sum;   /**< Sum of the bytes read, keeps the reads */
+
+
+void *bench_memcpy(void *dst, const void *src, size_t n)
+{
+  m_count.copied += n;
+  return memcpy(dst, src, n);
+}
+
+void *bench_memset(void *dst, int c, size_t n)
+{
+  m_count.cleared += n;
+  return memset(dst, c, n);
+}
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const *p_instance, nrf_drv_spi_config_t const *p_config,
+                            nrf_drv_spi_evt_handler_t handler, void *p_context)
+{
+  m_spi_handler = handler;
+  return NRF_SUCCESS;
+}
+
+void nrf_drv_spi_uninit(nrf_drv_spi_t const *p_instance)
+{
+}
+
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const *p_instance, uint8_t const *p_tx_buffer, uint8_t tx_buffer_length,
+                                uint8_t *p_rx_buffer, uint8_t rx_buffer_length)
+{
+  static const nrf_drv_spi_evt_t done = { 0 };
+  m_count.spi_calls++;
+  m_count.spi_bytes += (tx_buffer_length > rx_buffer_length) ? tx_buffer_length : rx_buffer_length;
+
+  /* EasyDMA reads and writes the buffers */
+  for (int i = 0; i < tx_buffer_length; i++) {
+    m_dma_sum += p_tx_buffer[i];
+  }
+  for (int i = 0; i < rx_buffer_length; i++) {
+    p_rx_buffer[i] = 0xA5;
+  }
+
+  m_spi_done = true;
+  if (m_spi_handler != NULL) {
+    m_spi_handler(&done, NULL);
+  }
+  return NRF_SUCCESS;
+}
+
+void fake_flash_range(const void *start, size_t len)
+{
+  m_flash_start = start;
+  m_flash_len = len;
+}
+
+bool nrf_drv_is_in_RAM(void const *ptr)
+{
+  const uint8_t *p = ptr;
+
+  return !(m_flash_start != NULL && p >= m_flash_start && p < m_flash_start + m_flash_len);
+}
+
+uint32_t nrf_gpio_pin_read(uint32_t pin)
+{
+  return 1;
+}
+
+/**
+ * @brief readfromspi() of the original port, staging header and body in two VLAs
+ */
+static int baseline_readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
+{
+  uint32 idatalength = headerLength + readlength;
+  uint8 idatabuf[idatalength];
+  uint8 itempbuf[idatalength];
+
+  bench_memset(idatabuf, 0, idatalength);
+  bench_memset(itempbuf, 0, idatalength);
+  bench_memcpy(idatabuf, headerBuffer, headerLength);
+  bench_memset(idatabuf + headerLength, 0x00, readlength);
+
+  m_spi_done = false;
+  nrf_drv_spi_transfer(NULL, idatabuf, idatalength, itempbuf, idatalength);
+  while (!m_spi_done)
+    ;
+
+  bench_memcpy(readBuffer, itempbuf + headerLength, readlength);
+  return 0;
+}
+
+/**
+ * @brief writetospi() of the original port
+ */
+static int baseline_writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+{
+  uint32 idatalength = headerLength + bodylength;
+  uint8 idatabuf[idatalength];
+  uint8 itempbuf[idatalength];
+
+  bench_memset(idatabuf, 0, idatalength);
+  bench_memset(itempbuf, 0, idatalength);
+  bench_memcpy(idatabuf, headerBuffer, headerLength);
+  bench_memcpy(idatabuf + headerLength, bodyBuffer, bodylength);
+
+  m_spi_done = false;
+  nrf_drv_spi_transfer(NULL, idatabuf, idatalength, itempbuf, idatalength);
+  while (!m_spi_done)
+    ;
+  return 0;
+}
+
+int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
+{
+  if (m_baseline) {
+    return baseline_readfromspi(headerLength, headerBuffer, readlength, readBuffer);
+  }
+  return port_readfromspi(headerLength, headerBuffer, readlength, readBuffer);
+}
+
+int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+{
+  if (m_baseline) {
+    return baseline_writetospi(headerLength, headerBuffer, bodylength, bodyBuffer);
+  }
+  return port_writetospi(headerLength, headerBuffer, bodylength, bodyBuffer);
+}
+
+
+static uint8_t m_frame[127];
+static const uint8_t m_const_frame[24] = { 0x41, 0x88 };
+
+/**
+ * @brief Count one call of op and time BENCH_ROUNDS of them
+ */
+static double bench_op(bool baseline, int op, uint16_t len, bench_count_t *count)
+{
+  m_baseline = baseline;
+
+  memset(&m_count, 0, sizeof(m_count));
+  switch (op) {
+  case 0: dwt_readrxdata(m_frame, len, 0); break;
+  case 1: dwt_writetxdata(len, m_frame, 0); break;
+  case 2: dwt_writetxdata(len, (uint8 *) m_const_frame, 0); break;
+  }
+  *count = m_count;
+
+  double start = test_now_ns();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    switch (op) {
+    case 0: dwt_readrxdata(m_frame, len, 0); break;
+    case 1: dwt_writetxdata(len, m_frame, 0); break;
+    case 2: dwt_writetxdata(len, (uint8 *) m_const_frame, 0); break;
+    }
+  }
+  return (test_now_ns() - start) / BENCH_ROUNDS;
+}
+
+static void bench_report(const char *name, int op, uint16_t len)
+{
+  bench_count_t before, after;
+  double t_before = bench_op(true, op, len, &before);
+  double t_after = bench_op(false, op, len, &after);
+
+  printf("%-26s %5u | %5u %5u %5u %5u %6.1f | %5u %5u %5u %5u %6.1f\n", name, len,
+         before.spi_calls, before.spi_bytes, before.copied, before.cleared, t_before,
+         after.spi_calls, after.spi_bytes, after.copied, after.cleared, t_after);
+
+  /* Same bytes on the bus, no staging except for constants out of EasyDMA reach */
+  CHECK(after.spi_bytes <= before.spi_bytes);
+  CHECK_EQ(after.cleared, 0);
+  if (op != 2) {
+    CHECK_EQ(after.copied, 0);
+  }
+}
+
+int main(void)
+{
+  fake_rtos_reset();
+  fake_flash_range(m_const_frame, sizeof(m_const_frame));
+  port_set_dw1000_slowrate();
+
+  printf("%-26s %5s | %-34s | %-34s\n", "", "", "before (VLA staging)", "after (EasyDMA list)");
+  printf("%-26s %5s | %5s %5s %5s %5s %6s | %5s %5s %5s %5s %6s\n", "call", "len",
+         "xfers", "bus", "copy", "clear", "ns", "xfers", "bus", "copy", "clear", "ns");
+
+  bench_report("dwt_readrxdata", 0, 12);
+  bench_report("dwt_readrxdata", 0, 24);
+  bench_report("dwt_readrxdata", 0, 127);
+  bench_report("dwt_writetxdata", 1, 12);
+  bench_report("dwt_writetxdata", 1, 24);
+  bench_report("dwt_writetxdata", 1, 127);
+  bench_report("dwt_writetxdata (flash)", 2, 24);
+  return TEST_RESULT();
+}
@@ -0,0 +1,122 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   bench_stream.c
+ *
+ *  @brief  Host benchmark of the text and binary neighbor list output
+ *
+ *          Formats the same range reports as the text lines of print_node()
+ *          and as stream.c frames, and reports the bytes per record, the
+ *          records per second a UART carries at 115200 and 1000000 baud
+ *          (10 bits per byte), and the host time to format one record.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "uart.h"
+#include "stream.h"
+#include "test.h"
+
+#define BENCH_RECORDS  1000000
+#define BENCH_NODES    40
+
+static uint64_t m_bytes;
+static uint32_t m_writes;
+
+static uint16_t m_id[BENCH_NODES];
+static float m_range[BENCH_NODES];
+static int8_t m_rssi[BENCH_NODES];
+static volatile uint32_t m_dma_sum;   /**< Sum of the bytes read, keeps the reads */
+
+
+bool uart_write(uart_channel_t ch, const uint8_t *data, uint32_t len)
+{
+  /* The DMA reads each byte once */
+  for (uint32_t i = 0; i < len; i++) {
+    m_dma_sum += data[i];
+  }
+  m_bytes += len;
+  m_writes++;
+  return true;
+}
+
+/**
+ * @brief One neighbor as print_node() writes it in AT+FORMAT 0
+ */
+static void text_record(uint16_t id, float range, int8_t rssi, uint32_t time_stamp, int quality)
+{
+  char line[56];
+  int len;
+
+  if (quality < 0) {
+    len = snprintf(line, sizeof(line), "%d, %f, %d, %d \r\n", id, range, rssi, time_stamp);
+  }
+  else {
+    len = snprintf(line, sizeof(line), "%d, %f, %d, %d, %d \r\n", id, range, rssi, time_stamp, quality);
+  }
+  if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+  if (len > 0) (void) uart_write(UART_CH_STREAM, (const uint8_t *)line, len);
+}
+
+/**
+ * @brief Output BENCH_RECORDS records in one format
+ *
+ * @return bytes per record on the UART
+ */
+static double bench(const char *name, bool binary, bool with_quality)
+{
+  m_bytes = 0;
+  m_writes = 0;
+
+  /* Time stamps of a node up for a day, in ms */
+  uint32_t time_stamp = 86400000;
+  double start = test_now_ns();
+  for (int i = 0; i < BENCH_RECORDS; i++) {
+    int k = i % BENCH_NODES;
+    int quality = with_quality ? (i * 7) % 101 : -1;
+
+    if (k == 0) time_stamp += 100;
+    if (binary) {
+      stream_add_range(m_id[k], m_range[k], m_rssi[k], time_stamp + k, quality);
+      if (k == BENCH_NODES - 1) stream_flush();
+    }
+    else {
+      text_record(m_id[k], m_range[k], m_rssi[k], time_stamp + k, quality);
+    }
+  }
+  double ns = (test_now_ns() - start) / BENCH_RECORDS;
+  double per_record = (double) m_bytes / BENCH_RECORDS;
+
+  printf("%-18s | %6.2f %8.0f %8.0f | %6.1f %5.2f\n", name, per_record,
+         115200 / 10 / per_record, 1000000 / 10 / per_record, ns, (double) m_writes / BENCH_RECORDS);
+  return per_record;
+}
+
+int main(void)
+{
+  srand(5);
+  for (int k = 0; k < BENCH_NODES; k++) {
+    m_id[k] = 1 + rand() % 999;
+    m_range[k] = 0.3f + (rand() % 30000) / 1000.0f;
+    m_rssi[k] = -40 - rand() % 50;
+  }
+
+  printf("%d records of %d neighbors, a list flushed after each round\n", BENCH_RECORDS, BENCH_NODES);
+  printf("%-18s | %6s %8s %8s | %6s %5s\n", "format", "B/rec", "rec/s", "rec/s", "ns", "wr/rec");
+  printf("%-18s | %6s %8s %8s | %6s %5s\n", "", "", "115200", "1M", "host", "");
+  double text = bench("text", false, false);
+  double binary = bench("binary", true, false);
+  double text_q = bench("text, quality", false, true);
+  double binary_q = bench("binary, quality", true, true);
+
+  /* A record is 11 or 12 bytes, plus its share of the frame overhead */
+  CHECK(binary < STREAM_RECORD_LEN + 1);
+  CHECK(binary_q < STREAM_RECORD_Q_LEN + 1);
+  CHECK(binary * 2 < text);
+  CHECK(binary_q * 2 < text_q);
+  return TEST_RESULT();
+}
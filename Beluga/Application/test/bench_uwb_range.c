@@ -0,0 +1,164 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   bench_uwb_range.c
+ *
+ *  @brief  Host cycle benchmark of the fixed-point ranging math
+ *
+ *          Times uwb_range.c against the double formulas of the original
+ *          ds_resp_run(), ds_init_run() and ss_init_run() on the same
+ *          exchanges, in time stamp counter cycles where the host has one.
+ *          The host runs doubles and 64-bit divisions in hardware, so
+ *          neither column estimates the firmware: on the Cortex-M4F each
+ *          double operation of the original is a library call, and so are
+ *          the 64-bit divisions of uwb_range.c (__aeabi_uldivmod and
+ *          __aeabi_ldivmod). AT+RANGEBENCH counts both paths on the node
+ *          with the DWT cycle counter.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include "deca_device_api.h"
+#include "uwb_range.h"
+#include "test.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES()  ((double) __rdtsc())
+#define BENCH_UNIT      "cycles"
+#else
+#define BENCH_CYCLES()  test_now_ns()
+#define BENCH_UNIT      "ns"
+#endif
+
+#define SPEED_OF_LIGHT   299702547
+#define UUS_TO_DWT_TIME  65536
+#define BENCH_EXCHANGES  4096
+#define BENCH_ROUNDS     500
+
+typedef struct {
+  uint32_t round_a, reply_a, round_b, reply_b;
+  int32_t rtd_init, rtd_resp, carrier_int;
+} exchange_t;
+
+static exchange_t m_ex[BENCH_EXCHANGES];
+static volatile double m_sink_d;
+static volatile int64_t m_sink_i;
+
+
+static double uniform(double lo, double hi)
+{
+  return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static void make_exchanges(void)
+{
+  srand(19);
+  for (int i = 0; i < BENCH_EXCHANGES; i++) {
+    double tof = uniform(0, 100000) * 63897600.0 / SPEED_OF_LIGHT;
+    double drift_a = 1 + uniform(-20e-6, 20e-6);
+    double drift_b = 1 + uniform(-20e-6, 20e-6);
+    double ra = 2000.0 * UUS_TO_DWT_TIME;
+    double rb = 1100.0 * UUS_TO_DWT_TIME;
+
+    m_ex[i].round_a = (2 * tof + rb) * drift_a;
+    m_ex[i].reply_a = ra * drift_a;
+    m_ex[i].round_b = (2 * tof + ra) * drift_b;
+    m_ex[i].reply_b = rb * drift_b;
+    m_ex[i].rtd_init = m_ex[i].round_a;
+    m_ex[i].rtd_resp = m_ex[i].reply_b;
+    m_ex[i].carrier_int = (drift_a - drift_b) / drift_b * 1744830464.0;
+  }
+}
+
+/**
+ * @brief DS-TWR time of flight and distance of the original responder and initiator
+ */
+static double double_ds(const exchange_t *e)
+{
+  double roundA = e->round_a, replyA = e->reply_a, roundB = e->round_b, replyB = e->reply_b;
+
+  if ((roundA * roundB - replyA * replyB) <= 0) return -1;
+  uint64_t tof_dtu = (uint64_t)((roundA * roundB - replyA * replyB) / (roundA + roundB + replyA + replyB));
+  return tof_dtu * DWT_TIME_UNITS * SPEED_OF_LIGHT;
+}
+
+static int64_t fixed_ds(const exchange_t *e)
+{
+  int64_t tof_dtu = uwb_range_ds_tof(e->round_a, e->reply_a, e->round_b, e->reply_b);
+
+  return (tof_dtu < 0) ? UWB_RANGE_NONE : uwb_range_mm(tof_dtu);
+}
+
+/**
+ * @brief SS-TWR distance of the original initiator
+ */
+static double float_ss(const exchange_t *e)
+{
+  float clockOffsetRatio = e->carrier_int * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_5 / 1.0e6);
+  double tof = ((e->rtd_init - e->rtd_resp * (1.0f - clockOffsetRatio)) / 2.0f) * DWT_TIME_UNITS;
+
+  return tof * SPEED_OF_LIGHT;
+}
+
+static int64_t fixed_ss(const exchange_t *e)
+{
+  return uwb_range_ss_mm(e->rtd_init, e->rtd_resp, e->carrier_int);
+}
+
+/**
+ * @brief Best of BENCH_ROUNDS passes over the exchanges, per exchange
+ */
+static double bench_double(double (*fn)(const exchange_t *))
+{
+  double best = 1e300;
+
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    double start = BENCH_CYCLES();
+    for (int i = 0; i < BENCH_EXCHANGES; i++) {
+      m_sink_d = fn(&m_ex[i]);
+    }
+    double t = (BENCH_CYCLES() - start) / BENCH_EXCHANGES;
+    if (t < best) best = t;
+  }
+  return best;
+}
+
+static double bench_fixed(int64_t (*fn)(const exchange_t *))
+{
+  double best = 1e300;
+
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    double start = BENCH_CYCLES();
+    for (int i = 0; i < BENCH_EXCHANGES; i++) {
+      m_sink_i = fn(&m_ex[i]);
+    }
+    double t = (BENCH_CYCLES() - start) / BENCH_EXCHANGES;
+    if (t < best) best = t;
+  }
+  return best;
+}
+
+int main(void)
+{
+  make_exchanges();
+
+  double ds_double = bench_double(double_ds);
+  double ds_fixed = bench_fixed(fixed_ds);
+  double ss_float = bench_double(float_ss);
+  double ss_fixed = bench_fixed(fixed_ss);
+
+  printf("%s per range, best of %d passes over %d exchanges\n", BENCH_UNIT, BENCH_ROUNDS, BENCH_EXCHANGES);
+  printf("DS-TWR  double %6.1f  fixed %6.1f\n", ds_double, ds_fixed);
+  printf("SS-TWR  float  %6.1f  fixed %6.1f\n", ss_float, ss_fixed);
+
+  /* Both compute the same ranges */
+  for (int i = 0; i < BENCH_EXCHANGES; i++) {
+    CHECK(llabs(fixed_ds(&m_ex[i]) - llround(double_ds(&m_ex[i]) * 1000)) <= 5);
+  }
+  return TEST_RESULT();
+}
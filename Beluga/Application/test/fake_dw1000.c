@@ -0,0 +1,314 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_dw1000.c
+ *
+ *  @brief  Scripted DW1000 behind readfromspi()/writetospi()
+ *
+ *          The DW1000 is a register file decoded from the SPI headers of the
+ *          Decawave driver. SYS_STATUS is write one to clear and SYS_CTRL
+ *          commands are counted but not kept. The test scripts radio events:
+ *          each one is delivered when the task has been blocked for its delay
+ *          since the previous one, sets status bits, loads a received frame or
+ *          a timestamp, and raises the IRQ line through the GPIOTE handler.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "port_platform.h"
+#include "task.h"
+#include "nrf_drv_gpiote.h"
+#include "dw1001_dev.h"
+#include "fake_rtos.h"
+#include "fake_dw1000.h"
+
+#define FAKE_DW_REG_IDS   0x40
+#define FAKE_DW_REG_SIZE  1024
+
+typedef struct {
+  TickType_t delay;
+  uint32_t status;
+  uint8_t frame[FAKE_DW_FRAME_MAX];
+  uint16_t len;
+  uint64_t ts;
+} fake_dw_event_t;
+
+static uint8_t m_regs[FAKE_DW_REG_IDS][FAKE_DW_REG_SIZE];
+static fake_dw_event_t m_events[FAKE_DW_EVENT_MAX];
+static int m_event_head = 0;
+static int m_event_cnt = 0;
+static TickType_t m_event_since = 0;
+static fake_dw_stats_t m_stats;
+
+static nrf_drv_gpiote_evt_handler_t m_irq_handler = NULL;
+static bool m_irq_enabled = false;
+static bool m_gpiote_init = false;
+
+
+static uint32_t reg32(uint8_t id)
+{
+  uint32_t v;
+
+  memcpy(&v, m_regs[id], sizeof(v));
+  return v;
+}
+
+static void put40(uint8_t id, uint64_t ts)
+{
+  for (int i = 0; i < 5; i++) {
+    m_regs[id][i] = (uint8_t) (ts >> (8 * i));
+  }
+}
+
+/**
+ * @brief Split an SPI header of the Decawave driver into register file and offset
+ */
+static void decode_header(uint16 len, const uint8 *header, uint8_t *id, uint16_t *index, bool *write)
+{
+  *id = header[0] & 0x3F;
+  *write = (header[0] & 0x80) != 0;
+  *index = 0;
+
+  if (header[0] & 0x40) {
+    assert(len >= 2);
+    *index = header[1] & 0x7F;
+    if (header[1] & 0x80) {
+      assert(len >= 3);
+      *index |= header[2] << 7;
+    }
+  }
+}
+
+/**
+ * @brief Apply the side effects of a SYS_CTRL command
+ */
+static void sys_ctrl(uint16_t index, const uint8_t *body, uint32_t len)
+{
+  if (index == 0 && len > 0) {
+    if (body[0] & SYS_CTRL_TXSTRT) m_stats.tx_starts++;
+    if (body[0] & SYS_CTRL_TRXOFF) m_stats.trx_offs++;
+  }
+  if (index <= 1 && index + len > 1) {
+    if (body[1 - index] & (SYS_CTRL_RXENAB >> 8)) m_stats.rx_enables++;
+  }
+}
+
+int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
+{
+  uint8_t id;
+  uint16_t index;
+  bool write;
+
+  decode_header(headerLength, headerBuffer, &id, &index, &write);
+  assert(!write && index + readlength <= FAKE_DW_REG_SIZE);
+
+  m_stats.xfers++;
+  m_stats.bytes += headerLength + readlength;
+  if (id == SYS_STATUS_ID) m_stats.status_reads++;
+
+  memcpy(readBuffer, &m_regs[id][index], readlength);
+  return 0;
+}
+
+int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+{
+  uint8_t id;
+  uint16_t index;
+  bool write;
+
+  decode_header(headerLength, headerBuffer, &id, &index, &write);
+  assert(write && index + bodylength <= FAKE_DW_REG_SIZE);
+
+  m_stats.xfers++;
+  m_stats.bytes += headerLength + bodylength;
+
+  if (id == SYS_STATUS_ID) {
+    for (uint32_t i = 0; i < bodylength; i++) {
+      m_regs[id][index + i] &= ~bodyBuffer[i];
+    }
+  }
+  else if (id == SYS_CTRL_ID) {
+    sys_ctrl(index, bodyBuffer, bodylength);
+  }
+  else {
+    memcpy(&m_regs[id][index], bodyBuffer, bodylength);
+  }
+  return 0;
+}
+
+void deca_sleep(unsigned int time_ms)
+{
+  (void) time_ms;
+}
+
+decaIrqStatus_t decamutexon(void)
+{
+  return 0;
+}
+
+void decamutexoff(decaIrqStatus_t s)
+{
+  (void) s;
+}
+
+void port_wakeup_dw1000_fast(void)
+{
+}
+
+/**
+ * @brief Deliver the next scripted event if it is due before until
+ */
+static void fake_dw_block(TickType_t until)
+{
+  if (m_event_cnt == 0) {
+    return;
+  }
+
+  fake_dw_event_t *ev = &m_events[m_event_head];
+  TickType_t due = m_event_since + ev->delay;
+  if (due > until) {
+    return;
+  }
+
+  bool irq_before = fake_dw_irq();
+
+  fake_rtos_set_tick(due);
+  if (ev->status & SYS_STATUS_RXFCG) {
+    memcpy(m_regs[RX_BUFFER_ID], ev->frame, ev->len);
+    m_regs[RX_FINFO_ID][0] = ev->len & 0xFF;
+    m_regs[RX_FINFO_ID][1] = (ev->len >> 8) & 0x03;
+    put40(RX_TIME_ID, ev->ts);
+  }
+  if (ev->status & SYS_STATUS_TXFRS) {
+    put40(TX_TIME_ID, ev->ts);
+  }
+  uint32_t status = reg32(SYS_STATUS_ID) | ev->status;
+  memcpy(m_regs[SYS_STATUS_ID], &status, sizeof(status));
+
+  m_event_head = (m_event_head + 1) % FAKE_DW_EVENT_MAX;
+  m_event_cnt--;
+  m_event_since = xTaskGetTickCount();
+
+  /* GPIOTE senses the rising edge only */
+  if (!irq_before && fake_dw_irq() && m_irq_enabled && m_irq_handler != NULL) {
+    m_irq_handler(DW1000_IRQ, NRF_GPIOTE_POLARITY_LOTOHI);
+  }
+}
+
+/**
+ * @brief Clear the registers, the script and the counters, and hook into the fake kernel
+ */
+void fake_dw_reset(void)
+{
+  memset(m_regs, 0, sizeof(m_regs));
+  m_event_head = 0;
+  m_event_cnt = 0;
+  m_event_since = xTaskGetTickCount();
+  fake_dw_stats_clear();
+  fake_rtos_set_block_hook(fake_dw_block);
+}
+
+/**
+ * @brief Script a radio event
+ *
+ * @param[in] delay    Ticks the task must block after the previous event
+ * @param[in] status   SYS_STATUS bits to set
+ * @param[in] frame    Received frame including the CRC, with SYS_STATUS_RXFCG
+ * @param[in] len      Length of frame
+ * @param[in] ts       RX timestamp with SYS_STATUS_RXFCG, TX timestamp with SYS_STATUS_TXFRS
+ */
+void fake_dw_event(TickType_t delay, uint32_t status, const uint8_t *frame, uint16_t len, uint64_t ts)
+{
+  assert(m_event_cnt < FAKE_DW_EVENT_MAX && len <= FAKE_DW_FRAME_MAX);
+
+  if (m_event_cnt == 0) {
+    m_event_since = xTaskGetTickCount();
+  }
+
+  fake_dw_event_t *ev = &m_events[(m_event_head + m_event_cnt) % FAKE_DW_EVENT_MAX];
+  ev->delay = delay;
+  ev->status = status;
+  ev->len = len;
+  ev->ts = ts;
+  if (frame != NULL) {
+    memcpy(ev->frame, frame, len);
+  }
+  m_event_cnt++;
+}
+
+/**
+ * @brief Number of scripted events not delivered yet
+ */
+int fake_dw_pending(void)
+{
+  return m_event_cnt;
+}
+
+/**
+ * @brief Level of the IRQ line, any enabled SYS_STATUS event
+ */
+bool fake_dw_irq(void)
+{
+  return (reg32(SYS_STATUS_ID) & reg32(SYS_MASK_ID)) != 0;
+}
+
+uint32_t fake_dw_status(void)
+{
+  return reg32(SYS_STATUS_ID);
+}
+
+/**
+ * @brief Direct access to a register file, e.g. to check the TX buffer
+ */
+uint8_t *fake_dw_reg(uint8_t id, uint16_t index)
+{
+  return &m_regs[id][index];
+}
+
+void fake_dw_stats_clear(void)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+const fake_dw_stats_t *fake_dw_stats(void)
+{
+  return &m_stats;
+}
+
+uint32_t nrf_gpio_pin_read(uint32_t pin)
+{
+  if (pin == DW1000_IRQ) {
+    return fake_dw_irq();
+  }
+  return 1;
+}
+
+bool nrf_drv_gpiote_is_init(void)
+{
+  return m_gpiote_init;
+}
+
+ret_code_t nrf_drv_gpiote_init(void)
+{
+  m_gpiote_init = true;
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t const *config,
+                                  nrf_drv_gpiote_evt_handler_t handler)
+{
+  assert(pin == DW1000_IRQ && config->sense == NRF_GPIOTE_POLARITY_LOTOHI);
+  m_irq_handler = handler;
+  return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable)
+{
+  m_irq_enabled = int_enable;
+}
@@ -0,0 +1,40 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_dw1000.h
+ *
+ *  @brief  Scripted DW1000 behind readfromspi()/writetospi() --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _FAKE_DW1000_H_
+#define _FAKE_DW1000_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+#define FAKE_DW_FRAME_MAX  128
+#define FAKE_DW_EVENT_MAX  16
+
+/* SPI traffic since the last fake_dw_stats_clear() */
+typedef struct {
+  uint32_t xfers;         /**< readfromspi() and writetospi() calls */
+  uint32_t bytes;         /**< Header and body bytes */
+  uint32_t status_reads;  /**< Reads of SYS_STATUS */
+  uint32_t tx_starts;     /**< SYS_CTRL writes starting a transmission */
+  uint32_t rx_enables;    /**< SYS_CTRL writes enabling the receiver */
+  uint32_t trx_offs;      /**< SYS_CTRL writes turning the transceiver off */
+} fake_dw_stats_t;
+
+void fake_dw_reset(void);
+void fake_dw_event(TickType_t delay, uint32_t status, const uint8_t *frame, uint16_t len, uint64_t ts);
+int fake_dw_pending(void);
+bool fake_dw_irq(void);
+uint32_t fake_dw_status(void);
+uint8_t *fake_dw_reg(uint8_t id, uint16_t index);
+void fake_dw_stats_clear(void);
+const fake_dw_stats_t *fake_dw_stats(void);
+
+#endif
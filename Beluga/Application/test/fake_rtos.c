@@ -0,0 +1,272 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_rtos.c
+ *
+ *  @brief  Single task FreeRTOS stand-in with a simulated tick
+ *
+ *          The code under test runs as the one task. Blocking calls hand the
+ *          time until their timeout to the block hook, which plays the
+ *          interrupts due meanwhile, and the tick then jumps to the wake up
+ *          time. Nothing runs in real time, so timeouts are exact.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "fake_rtos.h"
+
+#define FAKE_QUEUE_MAX  8
+
+struct fake_task {
+  uint32_t notify;
+  bool pending;
+};
+
+struct fake_queue {
+  UBaseType_t count;
+};
+
+fake_dwt_t fake_dwt;
+uint32_t SystemCoreClock = 64000000;
+
+static struct fake_task m_task;
+static struct fake_queue m_queues[FAKE_QUEUE_MAX];
+static int m_queue_cnt = 0;
+static TickType_t m_tick = 0;
+static uint32_t m_blocks = 0;
+static fake_rtos_block_hook_t m_block_hook = NULL;
+static pthread_mutex_t m_critical = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * @brief Forget notifications and semaphores and restart the tick from 0
+ */
+void fake_rtos_reset(void)
+{
+  m_task.notify = 0;
+  m_task.pending = false;
+  m_queue_cnt = 0;
+  m_tick = 0;
+  m_blocks = 0;
+}
+
+/**
+ * @brief Set the function playing the interrupts while the task blocks
+ */
+void fake_rtos_set_block_hook(fake_rtos_block_hook_t hook)
+{
+  m_block_hook = hook;
+}
+
+/**
+ * @brief Move the tick forward, used by the block hook
+ */
+void fake_rtos_set_tick(TickType_t tick)
+{
+  if (tick > m_tick) {
+    m_tick = tick;
+  }
+}
+
+/**
+ * @brief Number of times the task blocked
+ */
+uint32_t fake_rtos_blocks(void)
+{
+  return m_blocks;
+}
+
+/**
+ * @brief Block the task until woken up or until ticks have passed
+ *
+ * @param[in] woken   Condition ending the wait early, checked after the hook ran
+ */
+static void fake_block(TickType_t ticks, bool (*woken)(void *), void *arg)
+{
+  TickType_t until = (ticks == portMAX_DELAY) ? portMAX_DELAY : m_tick + ticks;
+
+  m_blocks++;
+  if (m_block_hook != NULL) {
+    m_block_hook(until);
+  }
+
+  if (!woken(arg)) {
+    if (until == portMAX_DELAY) {
+      printf("fake_rtos: task blocked forever\n");
+      abort();
+    }
+    m_tick = until;
+  }
+}
+
+static bool task_notified(void *arg)
+{
+  return ((struct fake_task *) arg)->pending;
+}
+
+static bool queue_nonempty(void *arg)
+{
+  return ((struct fake_queue *) arg)->count > 0;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  return m_tick;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return &m_task;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+  return taskSCHEDULER_RUNNING;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  m_blocks++;
+  if (m_block_hook != NULL) {
+    m_block_hook(m_tick + ticks);
+  }
+  m_tick += ticks;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+  if (!m_task.pending) {
+    m_task.notify &= ~clear_on_entry;
+    if (ticks > 0) {
+      fake_block(ticks, task_notified, &m_task);
+    }
+  }
+
+  if (value != NULL) {
+    *value = m_task.notify;
+  }
+  if (!m_task.pending) {
+    return pdFALSE;
+  }
+
+  m_task.pending = false;
+  m_task.notify &= ~clear_on_exit;
+  return pdTRUE;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+  switch (action) {
+  case eSetBits:
+    task->notify |= value;
+    break;
+  case eIncrement:
+    task->notify++;
+    break;
+  case eSetValueWithOverwrite:
+  case eSetValueWithoutOverwrite:
+    task->notify = value;
+    break;
+  default:
+    break;
+  }
+  task->pending = true;
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+  if (woken != NULL) {
+    *woken = pdTRUE;
+  }
+  return xTaskNotify(task, value, action);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+  if (m_task.notify == 0 && ticks > 0) {
+    fake_block(ticks, task_notified, &m_task);
+  }
+
+  uint32_t value = m_task.notify;
+  if (value != 0) {
+    m_task.notify = clear ? 0 : value - 1;
+  }
+  m_task.pending = false;
+  return value;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+  xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  if (m_queue_cnt >= FAKE_QUEUE_MAX) {
+    return NULL;
+  }
+  m_queues[m_queue_cnt].count = 0;
+  return &m_queues[m_queue_cnt++];
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  if (sem->count == 0 && ticks > 0) {
+    fake_block(ticks, queue_nonempty, sem);
+  }
+  if (sem->count == 0) {
+    return pdFALSE;
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  if (sem->count != 0) {
+    return pdFALSE;
+  }
+  sem->count = 1;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+  if (woken != NULL) {
+    *woken = pdTRUE;
+  }
+  return xSemaphoreGive(sem);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  return queue->count;
+}
+
+/**
+ * @brief Critical regions exclude each other across host threads
+ */
+void app_util_critical_region_enter(uint8_t *p_nested)
+{
+  pthread_mutex_lock(&m_critical);
+  if (p_nested != NULL) {
+    *p_nested = 0;
+  }
+}
+
+void app_util_critical_region_exit(uint8_t nested)
+{
+  (void) nested;
+  pthread_mutex_unlock(&m_critical);
+}
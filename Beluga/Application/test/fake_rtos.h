@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_rtos.h
+ *
+ *  @brief  Single task FreeRTOS stand-in with a simulated tick --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _FAKE_RTOS_H_
+#define _FAKE_RTOS_H_
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+/* Called when the task blocks, may advance the tick up to until and raise interrupts */
+typedef void (*fake_rtos_block_hook_t)(TickType_t until);
+
+void fake_rtos_reset(void);
+void fake_rtos_set_block_hook(fake_rtos_block_hook_t hook);
+void fake_rtos_set_tick(TickType_t tick);
+uint32_t fake_rtos_blocks(void);
+
+#endif
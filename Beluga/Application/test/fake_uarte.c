@@ -0,0 +1,273 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_uarte.c
+ *
+ *  @brief  UARTE0 and idle timer stand-in for the host tests of uart.c
+ *
+ *          STARTTX latches the buffer set by nrf_uarte_tx_buffer_set(), the
+ *          transfer stays in flight until the test ends it with
+ *          fake_uarte_tx_end(), which logs the bytes on the wire and runs the
+ *          interrupt handler of uart.c with ENDTX. Transfers may be ended
+ *          from another thread than the one writing, like the interrupt
+ *          preempting a task. STARTRX latches the RX buffer and raises
+ *          RXSTARTED. fake_uarte_receive() fills the RX buffer, ending it
+ *          with ENDRX when full, and plays the idle timer stopping the
+ *          receiver through PPI when the line goes quiet.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_uarte.h"
+#include "nrf_timer.h"
+#include "fake_uarte.h"
+
+#define FAKE_WIRE_LEN  (8 * 1024 * 1024)
+
+void UARTE0_UART0_IRQHandler(void);
+
+NRF_UARTE_Type fake_uarte0;
+NRF_TIMER_Type fake_timer2;
+
+static volatile bool m_events[NRF_UARTE_EVENT_COUNT];
+static uint32_t m_int_mask;
+static nrf_uarte_baudrate_t m_baudrate;
+
+static const uint8_t *m_tx_ptr;
+static uint32_t m_tx_maxcnt;
+static const uint8_t *m_tx_cur;           /**< Transfer in flight, latched by STARTTX */
+static uint32_t m_tx_len;
+static volatile uint32_t m_tx_busy;
+
+static uint8_t *m_rx_ptr;
+static uint32_t m_rx_maxcnt;
+static uint8_t *m_rx_cur;                 /**< Buffer of the running receiver, latched by STARTRX */
+static uint32_t m_rx_len;
+static uint32_t m_rx_amount;
+static bool m_rx_busy;
+
+static bool m_idle_event;                 /**< COMPARE0 of the idle timer */
+static bool m_idle_running;               /**< Idle timer started by RXDRDY */
+
+static uint8_t m_wire[FAKE_WIRE_LEN];
+static uint32_t m_wire_len;
+static fake_uarte_stats_t m_stats;
+
+
+/**
+ * @brief Clear the peripheral state, the wire log and the counters
+ */
+void fake_uarte_reset(void)
+{
+  memset((void *) m_events, 0, sizeof(m_events));
+  m_int_mask = 0;
+  m_tx_busy = 0;
+  m_rx_busy = false;
+  m_idle_event = false;
+  m_idle_running = false;
+  m_wire_len = 0;
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/**
+ * @brief Run the interrupt handler until no enabled event is left
+ */
+static void fake_uarte_irq(void)
+{
+  for (;;) {
+    bool pending = false;
+
+    for (int e = 0; e < NRF_UARTE_EVENT_COUNT; e++) {
+      pending |= m_events[e] && (m_int_mask & (1UL << e));
+    }
+    if (!pending) return;
+
+    m_stats.irqs++;
+    UARTE0_UART0_IRQHandler();
+  }
+}
+
+/**
+ * @brief Whether a TX transfer is in flight
+ */
+bool fake_uarte_tx_busy(void)
+{
+  return __sync_fetch_and_add(&m_tx_busy, 0) != 0;
+}
+
+/**
+ * @brief End the TX transfer in flight and run the ENDTX interrupt
+ *
+ * @return bytes sent, 0 if the transmitter was idle
+ */
+uint32_t fake_uarte_tx_end(void)
+{
+  if (!fake_uarte_tx_busy()) return 0;
+
+  uint32_t len = m_tx_len;
+  if (m_wire_len + len <= FAKE_WIRE_LEN) {
+    memcpy(&m_wire[m_wire_len], m_tx_cur, len);
+    m_wire_len += len;
+  }
+
+  __sync_lock_release(&m_tx_busy);
+  m_events[NRF_UARTE_EVENT_ENDTX] = true;
+  fake_uarte_irq();
+  return len;
+}
+
+/**
+ * @brief Receive bytes on the line
+ *
+ * @param[in] data   Bytes received back to back
+ * @param[in] len    Number of bytes
+ * @param[in] idle   The line goes quiet after the last byte
+ */
+void fake_uarte_receive(const uint8_t *data, uint32_t len, bool idle)
+{
+  // Events raised since the last interrupt, e.g. RXSTARTED of uart_init(), are served first
+  fake_uarte_irq();
+
+  for (uint32_t i = 0; i < len; i++) {
+    if (!m_rx_busy) {
+      m_stats.rx_lost++;
+      continue;
+    }
+
+    // RXDRDY restarts the idle timer through PPI
+    m_rx_cur[m_rx_amount++] = data[i];
+    m_idle_running = true;
+
+    if (m_rx_amount == m_rx_len) {
+      m_rx_busy = false;
+      m_events[NRF_UARTE_EVENT_ENDRX] = true;
+      fake_uarte_irq();
+    }
+  }
+
+  // COMPARE0 stops the timer and triggers STOPRX through PPI
+  if (idle && m_idle_running) {
+    m_idle_running = false;
+    m_idle_event = true;
+    nrf_uarte_task_trigger(NRF_UARTE0, NRF_UARTE_TASK_STOPRX);
+    fake_uarte_irq();
+  }
+}
+
+/**
+ * @brief Bytes sent since the last reset or clear
+ */
+const uint8_t *fake_uarte_wire(uint32_t *len)
+{
+  *len = m_wire_len;
+  return m_wire;
+}
+
+void fake_uarte_wire_clear(void)
+{
+  m_wire_len = 0;
+}
+
+nrf_uarte_baudrate_t fake_uarte_baudrate(void)
+{
+  return m_baudrate;
+}
+
+void fake_uarte_stats(fake_uarte_stats_t *stats)
+{
+  *stats = m_stats;
+}
+
+
+void nrf_uarte_task_trigger(NRF_UARTE_Type *p_reg, nrf_uarte_task_t task)
+{
+  switch (task) {
+  case NRF_UARTE_TASK_STARTTX:
+    m_tx_cur = m_tx_ptr;
+    m_tx_len = m_tx_maxcnt;
+    m_stats.tx_starts++;
+    if (m_tx_len > m_stats.tx_max_len) m_stats.tx_max_len = m_tx_len;
+    if (!__sync_bool_compare_and_swap(&m_tx_busy, 0, 1)) m_stats.tx_overlaps++;
+    break;
+
+  case NRF_UARTE_TASK_STARTRX:
+    m_rx_cur = m_rx_ptr;
+    m_rx_len = m_rx_maxcnt;
+    m_rx_amount = 0;
+    m_rx_busy = true;
+    m_events[NRF_UARTE_EVENT_RXSTARTED] = true;
+    break;
+
+  case NRF_UARTE_TASK_STOPRX:
+    if (m_rx_busy) {
+      m_rx_busy = false;
+      m_events[NRF_UARTE_EVENT_ENDRX] = true;
+    }
+    m_events[NRF_UARTE_EVENT_RXTO] = true;
+    break;
+
+  default:
+    break;
+  }
+}
+
+bool nrf_uarte_event_check(NRF_UARTE_Type *p_reg, nrf_uarte_event_t event)
+{
+  return m_events[event];
+}
+
+void nrf_uarte_event_clear(NRF_UARTE_Type *p_reg, nrf_uarte_event_t event)
+{
+  m_events[event] = false;
+}
+
+void nrf_uarte_tx_buffer_set(NRF_UARTE_Type *p_reg, uint8_t const *p_buffer, uint32_t length)
+{
+  m_tx_ptr = p_buffer;
+  m_tx_maxcnt = length;
+}
+
+void nrf_uarte_rx_buffer_set(NRF_UARTE_Type *p_reg, uint8_t *p_buffer, uint32_t length)
+{
+  m_rx_ptr = p_buffer;
+  m_rx_maxcnt = length;
+}
+
+uint32_t nrf_uarte_rx_amount_get(NRF_UARTE_Type *p_reg)
+{
+  return m_rx_amount;
+}
+
+uint32_t nrf_uarte_errorsrc_get_and_clear(NRF_UARTE_Type *p_reg)
+{
+  return 0;
+}
+
+void nrf_uarte_baudrate_set(NRF_UARTE_Type *p_reg, nrf_uarte_baudrate_t baudrate)
+{
+  m_baudrate = baudrate;
+}
+
+void nrf_uarte_int_enable(NRF_UARTE_Type *p_reg, uint32_t mask)
+{
+  m_int_mask |= mask;
+}
+
+
+void nrf_timer_task_trigger(NRF_TIMER_Type *p_reg, nrf_timer_task_t task)
+{
+}
+
+bool nrf_timer_event_check(NRF_TIMER_Type *p_reg, nrf_timer_event_t event)
+{
+  return m_idle_event;
+}
+
+void nrf_timer_event_clear(NRF_TIMER_Type *p_reg, nrf_timer_event_t event)
+{
+  m_idle_event = false;
+}
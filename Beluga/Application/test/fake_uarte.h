@@ -0,0 +1,35 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   fake_uarte.h
+ *
+ *  @brief  UARTE0 and idle timer stand-in for the host tests of uart.c --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _FAKE_UARTE_H_
+#define _FAKE_UARTE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf_uarte.h"
+
+typedef struct {
+  uint32_t tx_starts;     /**< STARTTX tasks */
+  uint32_t tx_overlaps;   /**< STARTTX while a transfer was in flight */
+  uint32_t tx_max_len;    /**< Longest transfer */
+  uint32_t irqs;          /**< Interrupt handler runs */
+  uint32_t rx_lost;       /**< Bytes received while the receiver was stopped */
+} fake_uarte_stats_t;
+
+void fake_uarte_reset(void);
+bool fake_uarte_tx_busy(void);
+uint32_t fake_uarte_tx_end(void);
+const uint8_t *fake_uarte_wire(uint32_t *len);
+void fake_uarte_receive(const uint8_t *data, uint32_t len, bool idle);
+void fake_uarte_wire_clear(void);
+nrf_uarte_baudrate_t fake_uarte_baudrate(void);
+void fake_uarte_stats(fake_uarte_stats_t *stats);
+
+#endif
@@ -0,0 +1,154 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sim_poll.c
+ *
+ *  @brief  Simulation of the poll selection policies, age of information
+ *
+ *          One initiator with 30 neighbors polls one of them every 10 ms, a
+ *          TDMA slot, with the neighbor table and the policy of poll_select.c.
+ *          A few neighbors walk back and forth, some fail most exchanges and
+ *          two are in the priority set, the others stand still. Every 100 ms
+ *          the age of each neighbor's last range and the error of that range
+ *          against the true distance are sampled.
+ *
+ *          Both policies get the same airtime. The weighted one should give
+ *          fresher ranges of the nodes that move or matter to the host,
+ *          without a worse mean age over all nodes.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "neighbor.h"
+#include "poll_select.h"
+#include "uwb_range.h"
+#include "test.h"
+
+#define SIM_NODES         30
+#define SIM_MOVING        3         /* Nodes 0 to 2 walk */
+#define SIM_FAILING       9         /* Nodes 3 to 8 fail most exchanges */
+#define SIM_PRIORITY      11        /* Nodes 9 and 10 are in the priority set */
+#define SIM_SPEED         1500.0    /* Walking speed, mm/s */
+#define SIM_FAIL_RATE     0.6
+#define SIM_BASE_FAIL     0.05
+#define SIM_NOISE_MM      100
+#define SIM_POLL_MS       10
+#define SIM_SAMPLE_MS     100
+#define SIM_WARMUP_MS     10000
+#define SIM_RUN_MS        600000
+
+enum { GROUP_MOVING, GROUP_FAILING, GROUP_PRIORITY, GROUP_STATIC, GROUP_COUNT };
+
+typedef struct {
+  double age[GROUP_COUNT];      /**< Mean age of the last range, ms */
+  double err[GROUP_COUNT];      /**< Mean error of the last range, mm */
+  double age_all;
+} sim_result_t;
+
+static const char *const m_groups[GROUP_COUNT] = { "moving", "failing", "priority", "static" };
+
+
+static int group_of(int i)
+{
+  if (i < SIM_MOVING) return GROUP_MOVING;
+  if (i < SIM_FAILING) return GROUP_FAILING;
+  if (i < SIM_PRIORITY) return GROUP_PRIORITY;
+  return GROUP_STATIC;
+}
+
+static double uniform(void)
+{
+  return rand() / (double) RAND_MAX;
+}
+
+static sim_result_t simulate(int policy)
+{
+  int slot[SIM_NODES];
+  double pos[SIM_NODES], vel[SIM_NODES];
+  double age[GROUP_COUNT] = { 0 }, err[GROUP_COUNT] = { 0 };
+  long samples[GROUP_COUNT] = { 0 };
+  sim_result_t res;
+
+  neighbor_init();
+  poll_priority_clear();
+  poll_select_set_policy(policy);
+  srand(7);
+
+  for (int i = 0; i < SIM_NODES; i++) {
+    slot[i] = neighbor_insert(100 + i, -40 - i);
+    pos[i] = 3000 + i * 500;
+    vel[i] = (group_of(i) == GROUP_MOVING) ? SIM_SPEED : 0;
+    if (group_of(i) == GROUP_PRIORITY) {
+      poll_priority_add(100 + i);
+    }
+  }
+
+  for (uint32_t now = 1; now < SIM_RUN_MS; now++) {
+    for (int i = 0; i < SIM_NODES; i++) {
+      pos[i] += vel[i] / 1000;
+      if (pos[i] > 20000 || pos[i] < 1000) vel[i] = -vel[i];
+    }
+
+    /* One exchange per slot, stored like neighbor_range_update() does without filtering */
+    int s;
+    if (now % SIM_POLL_MS == 0 && poll_select_next(&s, 1, now) == 1) {
+      int i = 0;
+      while (slot[i] != s) i++;
+
+      double fail = (group_of(i) == GROUP_FAILING) ? SIM_FAIL_RATE : SIM_BASE_FAIL;
+      bool ok = uniform() >= fail;
+      int32_t range_mm = ok ? (int32_t)(pos[i] + rand() % (2 * SIM_NOISE_MM + 1) - SIM_NOISE_MM) : UWB_RANGE_NONE;
+
+      poll_select_result(s, ok, range_mm, now);
+      if (ok) {
+        seen_list[s].range = range_mm / 1000.0f;
+        seen_list[s].time_stamp = now;
+      }
+    }
+
+    if (now % SIM_SAMPLE_MS == 0 && now > SIM_WARMUP_MS) {
+      for (int i = 0; i < SIM_NODES; i++) {
+        int g = group_of(i);
+        age[g] += now - seen_list[slot[i]].time_stamp;
+        err[g] += fabs(pos[i] - seen_list[slot[i]].range * 1000);
+        samples[g]++;
+      }
+    }
+  }
+
+  double age_sum = 0;
+  long n = 0;
+  for (int g = 0; g < GROUP_COUNT; g++) {
+    res.age[g] = age[g] / samples[g];
+    res.err[g] = err[g] / samples[g];
+    age_sum += age[g];
+    n += samples[g];
+  }
+  res.age_all = age_sum / n;
+  return res;
+}
+
+int main(void)
+{
+  sim_result_t rr = simulate(POLL_POLICY_RR);
+  sim_result_t weighted = simulate(POLL_POLICY_WEIGHTED);
+
+  printf("%d neighbors, one poll every %d ms, %d s\n", SIM_NODES, SIM_POLL_MS, (SIM_RUN_MS - SIM_WARMUP_MS) / 1000);
+  printf("%-9s | %-21s | %-21s\n", "", "round robin", "weighted");
+  printf("%-9s | %8s %12s | %8s %12s\n", "nodes", "age ms", "error mm", "age ms", "error mm");
+  for (int g = 0; g < GROUP_COUNT; g++) {
+    printf("%-9s | %8.0f %12.0f | %8.0f %12.0f\n", m_groups[g], rr.age[g], rr.err[g], weighted.age[g], weighted.err[g]);
+  }
+  printf("%-9s | %8.0f %12s | %8.0f\n", "all", rr.age_all, "", weighted.age_all);
+
+  /* Fresher where it matters, at no cost to the mean */
+  CHECK(weighted.err[GROUP_MOVING] < 0.6 * rr.err[GROUP_MOVING]);
+  CHECK(weighted.age[GROUP_PRIORITY] < 0.6 * rr.age[GROUP_PRIORITY]);
+  CHECK(weighted.age_all < 1.05 * rr.age_all);
+  return TEST_RESULT();
+}
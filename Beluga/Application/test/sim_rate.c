@@ -0,0 +1,207 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sim_rate.c
+ *
+ *  @brief  Simulation of N random access initiators, fixed poll rate against AIMD
+ *
+ *          Every node runs the poll loop of ranging_task_function(): wait for
+ *          rate_ctl_period(), back off with get_rand_num_exp_collision() after
+ *          a failed round, hand the radio over for 2 ticks and range in DS-TWR.
+ *          Overlapping exchanges both fail, and every node hears the collision
+ *          as corrupted frames, the busy signal of rate_ctl_result().
+ *
+ *          A short fixed period collapses as nodes are added. AIMD follows the
+ *          long period in a crowded channel but does not beat it: nodes at
+ *          one fixed period keep their phases, so those that did not collide
+ *          keep clear of each other, while AIMD keeps changing the period
+ *          and probing for a faster rate, and its collisions stay random.
+ *
+ *          rate_ctl.c is included here, and its statics are swapped in and
+ *          out around each call so every node has its own controller.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "rate_ctl.c"
+#include "random.h"
+#include "test.h"
+
+#define SIM_NODES_MAX       40
+#define SIM_EXCHANGE_TICKS  4       /* DS-TWR poll, response and final with the reply delays */
+#define SIM_HANDOVER_TICKS  2       /* vTaskDelay(2) before the exchange */
+#define SIM_WARMUP_TICKS    20000
+#define SIM_RUN_TICKS       200000
+#define SIM_MIN_MS          20
+#define SIM_MAX_MS          100
+#define SIM_JITTER_TICKS    3       /* Delay of the ranging task by other tasks, up to */
+
+/* Statics of rate_ctl.c for one node */
+typedef struct {
+  uint32_t min_ms;
+  float rate;
+  float success;
+  uint32_t rx_err;
+} sim_ctl_t;
+
+typedef struct {
+  sim_ctl_t ctl;
+  uint32_t next;            /**< Tick of the next exchange */
+  uint32_t busy_until;      /**< End of the exchange in progress */
+  bool collided;            /**< The exchange in progress overlapped another one */
+  uint32_t ranges;          /**< Good ranges after the warm up */
+} sim_node_t;
+
+typedef struct {
+  double ranges;            /**< Good ranges per second, all nodes */
+  double failed;            /**< Failed exchanges */
+  double fairness;          /**< Jain's index of the ranges of each node */
+} sim_result_t;
+
+static sim_node_t m_nodes[SIM_NODES_MAX];
+static uint32_t m_heard;    /**< Corrupted frames heard, the same for all nodes */
+
+
+void uwb_frame_stats_update(void)
+{
+}
+
+void uwb_frame_stats_get(uwb_rx_stats_t *stats)
+{
+  stats->crc_err = m_heard;
+  stats->phr_err = 0;
+}
+
+/**
+ * @brief Run rate_ctl_result() and rate_ctl_period() with the controller of a node
+ */
+static uint32_t ctl_step(sim_ctl_t *c, bool ok, uint32_t max_ms)
+{
+  m_min_ms = c->min_ms;
+  m_rate = c->rate;
+  m_success = c->success;
+  m_rx_err = c->rx_err;
+
+  rate_ctl_result(ok);
+  uint32_t period = rate_ctl_period(max_ms);
+
+  c->rate = m_rate;
+  c->success = m_success;
+  c->rx_err = m_rx_err;
+  return period;
+}
+
+static uint32_t ctl_start(sim_ctl_t *c, uint32_t min_ms, uint32_t max_ms)
+{
+  rate_ctl_set_min(min_ms);
+  uint32_t period = rate_ctl_period(max_ms);
+
+  c->min_ms = m_min_ms;
+  c->rate = m_rate;
+  c->success = m_success;
+  c->rx_err = m_heard;
+  return period;
+}
+
+/**
+ * @brief Simulate n nodes polling with periods from min_ms (0 for fixed) to max_ms
+ */
+static sim_result_t simulate(int n, uint32_t min_ms, uint32_t max_ms)
+{
+  uint32_t exchanges = 0, failures = 0;
+  sim_result_t res;
+
+  srand(n);
+  m_heard = 0;
+  for (int i = 0; i < n; i++) {
+    sim_node_t *nd = &m_nodes[i];
+    nd->next = ctl_start(&nd->ctl, min_ms, max_ms) * (rand() % 1000) / 1000;
+    nd->busy_until = 0;
+    nd->collided = false;
+    nd->ranges = 0;
+  }
+
+  for (uint32_t t = 0; t < SIM_RUN_TICKS; t++) {
+    /* Exchanges starting now */
+    for (int i = 0; i < n; i++) {
+      sim_node_t *nd = &m_nodes[i];
+      if (nd->next != t) continue;
+
+      nd->busy_until = t + SIM_HANDOVER_TICKS + SIM_EXCHANGE_TICKS;
+      for (int j = 0; j < n; j++) {
+        if (j != i && m_nodes[j].busy_until > t + SIM_HANDOVER_TICKS) {
+          if (!nd->collided || !m_nodes[j].collided) m_heard++;
+          nd->collided = true;
+          m_nodes[j].collided = true;
+        }
+      }
+    }
+
+    /* Exchanges ending now */
+    for (int i = 0; i < n; i++) {
+      sim_node_t *nd = &m_nodes[i];
+      if (nd->busy_until != t || t == 0) continue;
+
+      bool ok = !nd->collided;
+      uint32_t period = ctl_step(&nd->ctl, ok, max_ms);
+      uint32_t wait = period;     /* vTaskDelay() of the period, ticks taken as ms like the firmware */
+
+      if (!ok) {
+        wait += get_rand_num_exp_collision(period);
+      }
+      nd->next = t + 1 + wait + rand() % SIM_JITTER_TICKS;
+      nd->collided = false;
+
+      if (t >= SIM_WARMUP_TICKS) {
+        exchanges++;
+        failures += !ok;
+        nd->ranges += ok;
+      }
+    }
+  }
+
+  double sum = 0, sum2 = 0;
+  for (int i = 0; i < n; i++) {
+    sum += m_nodes[i].ranges;
+    sum2 += (double) m_nodes[i].ranges * m_nodes[i].ranges;
+  }
+  res.ranges = sum * configTICK_RATE_HZ / (SIM_RUN_TICKS - SIM_WARMUP_TICKS);
+  res.failed = (double) failures / exchanges;
+  res.fairness = (sum2 > 0) ? sum * sum / (n * sum2) : 0;
+  return res;
+}
+
+int main(void)
+{
+  const int sizes[] = { 2, 5, 10, 20, 40 };
+
+  printf("%d s of DS-TWR rounds, %d ticks each, AIMD between %d and %d ms\n",
+         (SIM_RUN_TICKS - SIM_WARMUP_TICKS) / configTICK_RATE_HZ, SIM_EXCHANGE_TICKS, SIM_MIN_MS, SIM_MAX_MS);
+  printf("nodes | fixed %3d ms           | fixed %3d ms           | AIMD                       \n", SIM_MIN_MS, SIM_MAX_MS);
+  printf("      | rng/s   failed   fair  | rng/s   failed   fair  | rng/s   failed   fair \n");
+
+  for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+    int n = sizes[k];
+    sim_result_t fast = simulate(n, 0, SIM_MIN_MS);
+    sim_result_t slow = simulate(n, 0, SIM_MAX_MS);
+    sim_result_t aimd = simulate(n, SIM_MIN_MS, SIM_MAX_MS);
+
+    printf("%5d | %6.1f %6.1f %%  %5.2f  | %6.1f %6.1f %%  %5.2f  | %6.1f %6.1f %%  %5.2f\n", n,
+           fast.ranges, fast.failed * 100, fast.fairness, slow.ranges, slow.failed * 100, slow.fairness,
+           aimd.ranges, aimd.failed * 100, aimd.fairness);
+
+    /* No collapse like the short period once the channel is crowded, close to the
+     * long period, which suits a crowded channel best, and fair among nodes */
+    if (n >= 10) {
+      CHECK(aimd.ranges > 1.5 * fast.ranges);
+    }
+    CHECK(aimd.ranges >= 0.8 * slow.ranges);
+    CHECK(aimd.fairness > 0.9);
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,381 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sim_tdma.c
+ *
+ *  @brief  Discrete event simulation of N initiators, random access against TDMA
+ *
+ *          Every node runs the loop of ranging_task_function(): wait for the
+ *          poll period or, in TDMA mode, for tdma_slot_delay() of its own copy
+ *          of tdma.c, back off with get_rand_num_exp_collision() after a failed
+ *          round, suspend its responder, wait 2 ticks, send the beacon if it is
+ *          the coordinator and range with the next neighbor in DS-TWR.
+ *
+ *          All nodes hear each other. Any two transmissions overlapping in time
+ *          are both lost, and an exchange also fails when its responder is busy
+ *          with its own round. Each node has its own tick with a random phase
+ *          and a crystal error of up to 20 ppm, and learns the other nodes over
+ *          BLE at random times during the first two seconds.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "FreeRTOS.h"
+#include "deca_device_api.h"
+#include "neighbor.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "random.h"
+#include "sim_tdma.h"
+#include "test.h"
+
+#define SIM_EXCHANGE_US   4000      /* DS-TWR poll, response and final with the reply delays */
+#define SIM_BEACON_US     200       /* Beacon air time */
+#define SIM_TASK_US       100       /* Reconfiguration before the first frame */
+#define SIM_JOIN_US       2e6       /* Neighbors are discovered within this time */
+#define SIM_WARMUP_US     5e6
+#define SIM_RUN_US        65e6
+#define SIM_PPM           20
+#define SIM_INTERVALS     1024
+
+enum { ST_PLAN, ST_WAKE, ST_SUSPEND, ST_RANGE, ST_EXCHANGE, ST_END };
+
+typedef struct {
+  const sim_tdma_node_t *tdma;
+  double rate;              /**< Local ticks per us */
+  double phase_us;          /**< Global time of local tick 0 */
+  double join_us[SIM_TDMA_NODES];
+  int state;
+  double next_us;
+  bool drop;
+  int rr;                   /**< Last neighbor ranged with */
+  int target;
+  int deaf;                 /**< Interval of the round in progress, responder suspended */
+  double beacon_us;         /**< Start of the beacon sent this round, < 0 if none */
+  double exchange_us;
+  uint32_t attempts;
+  uint32_t successes;
+} sim_node_t;
+
+typedef struct {
+  double start;
+  double end;
+  int node;
+  bool air;                 /**< A transmission, otherwise a deaf responder */
+} sim_interval_t;
+
+typedef struct {
+  double ranges;            /**< Successful ranges per second, all nodes */
+  double collisions;        /**< Failed rounds over all rounds */
+  double beacons;           /**< Beacons received over beacons expected */
+} sim_result_t;
+
+extern const sim_tdma_node_t sim_tdma_node_0, sim_tdma_node_1, sim_tdma_node_2, sim_tdma_node_3,
+                             sim_tdma_node_4, sim_tdma_node_5, sim_tdma_node_6, sim_tdma_node_7,
+                             sim_tdma_node_8, sim_tdma_node_9, sim_tdma_node_10, sim_tdma_node_11,
+                             sim_tdma_node_12, sim_tdma_node_13, sim_tdma_node_14, sim_tdma_node_15;
+
+static const sim_tdma_node_t *const m_tdma[SIM_TDMA_NODES] = {
+  &sim_tdma_node_0, &sim_tdma_node_1, &sim_tdma_node_2, &sim_tdma_node_3,
+  &sim_tdma_node_4, &sim_tdma_node_5, &sim_tdma_node_6, &sim_tdma_node_7,
+  &sim_tdma_node_8, &sim_tdma_node_9, &sim_tdma_node_10, &sim_tdma_node_11,
+  &sim_tdma_node_12, &sim_tdma_node_13, &sim_tdma_node_14, &sim_tdma_node_15,
+};
+
+static sim_node_t m_nodes[SIM_TDMA_NODES];
+static int m_n;
+static int m_cur;               /* Node whose code is running */
+static double m_now;
+static sim_interval_t m_iv[SIM_INTERVALS];
+static int m_iv_cnt;
+static uint8_t m_beacon[64];
+static uint32_t m_beacon_len;
+static uint32_t m_beacons_sent, m_beacons_heard;
+
+
+/**
+ * @brief Tick count of the node whose code runs, on its own clock
+ */
+TickType_t xTaskGetTickCount(void)
+{
+  sim_node_t *nd = &m_nodes[m_cur];
+
+  return (TickType_t) floor((m_now - nd->phase_us) * nd->rate);
+}
+
+/**
+ * @brief Global time at which a node's tick count reaches a value
+ */
+static double tick_time(const sim_node_t *nd, TickType_t tick)
+{
+  return nd->phase_us + tick / nd->rate;
+}
+
+/* The radio of the beacon sender */
+void uwb_frame_header(uint8_t *frame, uint16_t dst) { }
+void uwb_clear_events(void) { }
+uint32_t uwb_wait_event(uint32_t mask, TickType_t timeout) { return UWB_EVT_TX_DONE; }
+void dwt_writetxfctrl(uint16 txFrameLength, uint16 txBufferOffset, int ranging) { }
+void dwt_forcetrxoff(void) { }
+
+int dwt_writetxdata(uint16 txFrameLength, uint8 *txFrameBytes, uint16 txBufferOffset)
+{
+  m_beacon_len = txFrameLength;
+  memcpy(m_beacon, txFrameBytes, txFrameLength);
+  return DWT_SUCCESS;
+}
+
+int dwt_starttx(uint8 mode)
+{
+  m_nodes[m_cur].beacon_us = m_now;
+  return DWT_SUCCESS;
+}
+
+
+static int interval_open(double start, double end, int node, bool air)
+{
+  /* Drop intervals that ended long ago */
+  if (m_iv_cnt == SIM_INTERVALS) {
+    int keep = 0;
+    for (int i = 0; i < m_iv_cnt; i++) {
+      if (m_iv[i].end > m_now - 1e5) m_iv[keep++] = m_iv[i];
+    }
+    for (int k = 0; k < m_n; k++) m_nodes[k].deaf = -1;
+    for (int i = 0; i < keep; i++) {
+      if (!m_iv[i].air && m_iv[i].end == INFINITY) m_nodes[m_iv[i].node].deaf = i;
+    }
+    m_iv_cnt = keep;
+  }
+  m_iv[m_iv_cnt] = (sim_interval_t) { start, end, node, air };
+  return m_iv_cnt++;
+}
+
+/**
+ * @brief Whether a node hears a transmission of another node from start to end
+ */
+static bool clear_at(int rx, int tx, double start, double end)
+{
+  for (int i = 0; i < m_iv_cnt; i++) {
+    const sim_interval_t *iv = &m_iv[i];
+    bool overlap = iv->start < end && iv->end > start;
+
+    if (!overlap) continue;
+    if (iv->air && iv->node != tx) return false;
+    if (!iv->air && iv->node == rx) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief BLE discovery: add the neighbors heard by now to the node's table
+ */
+static void discover(int k)
+{
+  sim_node_t *nd = &m_nodes[k];
+
+  for (int j = 0; j < m_n; j++) {
+    node *e = &nd->tdma->seen_list[j];
+    if (j != k && e->UUID == 0 && nd->join_us[j] <= m_now) {
+      e->UUID = *m_tdma[j]->uuid;
+      e->flags = NEIGHBOR_POLLING;
+    }
+  }
+}
+
+/**
+ * @brief Run one step of ranging_task_function() on a node
+ */
+static void step(int k, bool tdma, int period)
+{
+  sim_node_t *nd = &m_nodes[k];
+  TickType_t delay;
+
+  m_cur = k;
+  discover(k);
+
+  switch (nd->state) {
+  case ST_PLAN:
+    delay = period;
+    if (tdma) {
+      delay = nd->tdma->slot_delay();
+      nd->drop = false;
+    }
+    nd->next_us = tick_time(nd, xTaskGetTickCount() + delay);
+    nd->state = ST_WAKE;
+    break;
+
+  case ST_WAKE:
+    nd->state = ST_SUSPEND;
+    if (nd->drop) {
+      nd->next_us = tick_time(nd, xTaskGetTickCount() + get_rand_num_exp_collision(period));
+      nd->drop = false;
+      break;
+    }
+    /* fall through */
+
+  case ST_SUSPEND:
+    nd->deaf = interval_open(m_now, INFINITY, k, false);
+    nd->next_us = tick_time(nd, xTaskGetTickCount() + 2);
+    nd->state = ST_RANGE;
+    break;
+
+  case ST_RANGE:
+    m_now += SIM_TASK_US;
+    nd->beacon_us = -1;
+    if (tdma && nd->tdma->is_coordinator()) {
+      nd->tdma->send_beacon();
+      interval_open(nd->beacon_us, nd->beacon_us + SIM_BEACON_US, k, true);
+      m_now += SIM_BEACON_US;
+    }
+    nd->next_us = m_now;
+    nd->state = ST_EXCHANGE;
+    break;
+
+  case ST_EXCHANGE:
+    /* Every transmission overlapping the beacon has started by now */
+    if (nd->beacon_us >= 0) {
+      for (int r = 0; r < m_n; r++) {
+        if (r == k) continue;
+        m_beacons_sent += (m_now > SIM_WARMUP_US);
+        if (clear_at(r, k, nd->beacon_us, m_now)) {
+          m_beacons_heard += (m_now > SIM_WARMUP_US);
+          m_cur = r;
+          m_nodes[r].tdma->beacon_rx(m_beacon, m_beacon_len);
+          m_cur = k;
+        }
+      }
+    }
+
+    nd->target = -1;
+    for (int i = 1; i <= m_n; i++) {
+      int j = (nd->rr + i) % m_n;
+      if (j != k && nd->tdma->seen_list[j].UUID != 0) {
+        nd->target = nd->rr = j;
+        break;
+      }
+    }
+    if (nd->target < 0) {
+      m_iv[nd->deaf].end = m_now;
+      nd->state = ST_PLAN;
+      break;
+    }
+    nd->exchange_us = m_now;
+    interval_open(m_now, m_now + SIM_EXCHANGE_US, k, true);
+    nd->next_us = m_now + SIM_EXCHANGE_US;
+    nd->state = ST_END;
+    break;
+
+  case ST_END: {
+    bool ok = clear_at(nd->target, k, nd->exchange_us, m_now);
+
+    if (m_now > SIM_WARMUP_US) {
+      nd->attempts++;
+      nd->successes += ok;
+    }
+    nd->drop = !ok;
+    m_iv[nd->deaf].end = m_now;
+    nd->state = ST_PLAN;
+    break;
+  }
+  }
+}
+
+/**
+ * @brief Run n nodes for SIM_RUN_US
+ *
+ * @param[in] slot_ms   TDMA slot, 0 for random access
+ * @param[in] period    Poll period in ticks of random access, AT+RATE
+ */
+static sim_result_t simulate(int n, uint32_t slot_ms, int period, unsigned seed)
+{
+  sim_result_t res;
+
+  srand(seed);
+  memset(m_nodes, 0, sizeof(m_nodes));
+  m_n = n;
+  m_iv_cnt = 0;
+  m_now = 0;
+  m_beacons_sent = m_beacons_heard = 0;
+
+  for (int k = 0; k < n; k++) {
+    sim_node_t *nd = &m_nodes[k];
+    uint16_t id;
+    bool dup;
+
+    do {
+      id = 1 + rand() % 999;
+      dup = false;
+      for (int j = 0; j < k; j++) dup |= *m_tdma[j]->uuid == id;
+    } while (dup);
+
+    nd->tdma = m_tdma[k];
+    memset(nd->tdma->seen_list, 0, sizeof(node) * MAX_ANCHOR_COUNT);
+    *nd->tdma->uuid = id;
+    nd->rate = configTICK_RATE_HZ / 1e6 * (1 + ((rand() % (2 * SIM_PPM + 1)) - SIM_PPM) * 1e-6);
+    nd->phase_us = -(rand() % 100000) * 1e3;
+    nd->deaf = -1;
+    nd->state = ST_PLAN;
+    nd->next_us = (rand() % 1000) * 1e3;
+    for (int j = 0; j < n; j++) {
+      nd->join_us[j] = (rand() % 1000) * SIM_JOIN_US / 1000;
+    }
+  }
+  for (int k = 0; k < n; k++) {
+    m_cur = k;
+    m_now = m_nodes[k].next_us;
+    m_nodes[k].tdma->set_slot_ms(slot_ms);
+  }
+
+  for (;;) {
+    int k = 0;
+    for (int j = 1; j < n; j++) {
+      if (m_nodes[j].next_us < m_nodes[k].next_us) k = j;
+    }
+    if (m_nodes[k].next_us > SIM_RUN_US) break;
+    m_now = m_nodes[k].next_us;
+    step(k, slot_ms != 0, period);
+  }
+
+  uint32_t attempts = 0, successes = 0;
+  for (int k = 0; k < n; k++) {
+    attempts += m_nodes[k].attempts;
+    successes += m_nodes[k].successes;
+  }
+  res.ranges = successes / ((SIM_RUN_US - SIM_WARMUP_US) / 1e6);
+  res.collisions = attempts ? 1.0 - (double) successes / attempts : 0;
+  res.beacons = m_beacons_sent ? (double) m_beacons_heard / m_beacons_sent : 0;
+  return res;
+}
+
+int main(void)
+{
+  const uint32_t slot_ms = 10;
+  const int sizes[] = { 2, 4, 8, 12, 16 };
+
+  printf("%d s of DS-TWR rounds, %d us each, slot %u ms\n", (int)((SIM_RUN_US - SIM_WARMUP_US) / 1e6), SIM_EXCHANGE_US, slot_ms);
+  printf("nodes | random, 100 ticks | random, same load | TDMA                      \n");
+  printf("      | rng/s    failed   | rng/s    failed   | rng/s    failed   beacons \n");
+
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int n = sizes[i];
+    sim_result_t aloha = simulate(n, 0, 100, n);
+    sim_result_t aloha_load = simulate(n, 0, pdMS_TO_TICKS(n * slot_ms), n);
+    sim_result_t tdma = simulate(n, slot_ms, 100, n);
+
+    printf("%5d | %6.1f  %6.1f %%  | %6.1f  %6.1f %%  | %6.1f  %6.1f %%  %6.1f %%\n", n,
+           aloha.ranges, aloha.collisions * 100, aloha_load.ranges, aloha_load.collisions * 100,
+           tdma.ranges, tdma.collisions * 100, tdma.beacons * 100);
+
+    /* Slots never overlap once aligned, and every slot is used */
+    CHECK(tdma.collisions < 0.01);
+    CHECK(tdma.ranges > 0.95 * 1000 / slot_ms);
+    CHECK(tdma.ranges >= aloha_load.ranges);
+  }
+  return TEST_RESULT();
+}
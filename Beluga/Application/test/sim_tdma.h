@@ -0,0 +1,33 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sim_tdma.h
+ *
+ *  @brief  One simulated node running its own copy of tdma.c --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _SIM_TDMA_H_
+#define _SIM_TDMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "neighbor.h"
+
+#define SIM_TDMA_NODES  16
+
+/* Entry points and globals of one node's tdma.c, see sim_tdma_node.c */
+typedef struct {
+  node *seen_list;
+  uint16_t *uuid;
+  void (*set_slot_ms)(uint32_t slot_ms);
+  bool (*enabled)(void);
+  TickType_t (*slot_delay)(void);
+  bool (*is_coordinator)(void);
+  void (*send_beacon)(void);
+  void (*beacon_rx)(const uint8_t *frame, uint32_t len);
+} sim_tdma_node_t;
+
+#endif
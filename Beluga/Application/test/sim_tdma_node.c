@@ -0,0 +1,44 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sim_tdma_node.c
+ *
+ *  @brief  One simulated node running its own copy of tdma.c
+ *
+ *          Built once per node with -DSIM_NODE=<n>. The names of tdma.c and
+ *          the neighbor table and node ID it reads are prefixed with the node,
+ *          so every node keeps its own state in its own copy of the statics.
+ *          The radio and the tick are shared and provided by sim_tdma.c.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#define SIM_CAT2(a, b)  a##b
+#define SIM_CAT(a, b)   SIM_CAT2(a, b)
+#define SIM_NAME(x)     SIM_CAT(x, SIM_NODE)
+
+#define seen_list             SIM_NAME(sim_seen_list_)
+#define NODE_UUID             SIM_NAME(sim_uuid_)
+#define tdma_set_slot_ms      SIM_NAME(sim_tdma_set_slot_ms_)
+#define tdma_enabled          SIM_NAME(sim_tdma_enabled_)
+#define tdma_slot_delay       SIM_NAME(sim_tdma_slot_delay_)
+#define tdma_is_coordinator   SIM_NAME(sim_tdma_is_coordinator_)
+#define tdma_send_beacon      SIM_NAME(sim_tdma_send_beacon_)
+#define tdma_beacon_rx        SIM_NAME(sim_tdma_beacon_rx_)
+
+#include "tdma.c"
+#include "sim_tdma.h"
+
+node seen_list[MAX_ANCHOR_COUNT];
+uint16_t NODE_UUID;
+
+const sim_tdma_node_t SIM_NAME(sim_tdma_node_) = {
+  .seen_list = seen_list,
+  .uuid = &NODE_UUID,
+  .set_slot_ms = tdma_set_slot_ms,
+  .enabled = tdma_enabled,
+  .slot_delay = tdma_slot_delay,
+  .is_coordinator = tdma_is_coordinator,
+  .send_beacon = tdma_send_beacon,
+  .beacon_rx = tdma_beacon_rx,
+};
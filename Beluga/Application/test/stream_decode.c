@@ -0,0 +1,140 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   stream_decode.c
+ *
+ *  @brief  Host decoder of the binary range stream of stream.c
+ *
+ *          Used by test_stream.c. Built with STREAM_DECODE_MAIN (make
+ *          stream_decode), it reads the raw serial stream of a node in
+ *          AT+FORMAT 1 from stdin and prints the records in the text format:
+ *
+ *            stty -F /dev/ttyACM0 115200 raw && ./stream_decode < /dev/ttyACM0
+ *
+ *          Bytes up to the first zero are skipped, as the host may connect in
+ *          the middle of a frame. Broken frames are reported on stderr.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "crc16.h"
+#include "stream_decode.h"
+
+
+/**
+ * @brief COBS decode one frame
+ *
+ * @param[in]  src   Encoded frame, without the zero delimiter
+ * @param[in]  len   Length of src
+ * @param[out] dst   Decoded bytes, at least len bytes
+ *
+ * @return decoded length, STREAM_ERR_COBS on a zero or a block past the end
+ */
+int stream_cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+  uint32_t i = 0;
+  int out = 0;
+
+  while (i < len) {
+    uint8_t code = src[i++];
+
+    if (code == 0) return STREAM_ERR_COBS;
+    for (int j = 1; j < code; j++) {
+      if (i >= len || src[i] == 0) return STREAM_ERR_COBS;
+      dst[out++] = src[i++];
+    }
+    // A full block carries no zero, the last block has no zero after it
+    if (code != 0xFF && i < len) {
+      dst[out++] = 0;
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Decode one frame of the stream into range records
+ *
+ * @param[in]  frame  Encoded frame, without the zero delimiter
+ * @param[in]  len    Length of frame
+ * @param[out] recs   At least STREAM_MAX_RECORDS records
+ *
+ * @return number of records, or a negative STREAM_ERR_ code
+ */
+int stream_decode_frame(const uint8_t *frame, uint32_t len, stream_record_t *recs)
+{
+  uint8_t raw[len > 0 ? len : 1];
+  int raw_len = stream_cobs_decode(frame, len, raw);
+
+  if (raw_len < 0) return raw_len;
+  if (raw_len < 4) return STREAM_ERR_FORMAT;
+
+  uint16_t crc = raw[raw_len - 2] | (raw[raw_len - 1] << 8);
+  if (crc16_compute(raw, raw_len - 2, NULL) != crc) return STREAM_ERR_CRC;
+
+  uint32_t rec_len;
+  switch (raw[0]) {
+    case STREAM_TYPE_RANGE:   rec_len = STREAM_RECORD_LEN;   break;
+    case STREAM_TYPE_RANGE_Q: rec_len = STREAM_RECORD_Q_LEN; break;
+    default: return STREAM_ERR_FORMAT;
+  }
+  int count = raw[1];
+  if (count > STREAM_MAX_RECORDS || (uint32_t)raw_len != 4 + count * rec_len) return STREAM_ERR_FORMAT;
+
+  for (int r = 0; r < count; r++) {
+    const uint8_t *rec = &raw[2 + r * rec_len];
+
+    recs[r].id = rec[0] | (rec[1] << 8);
+    recs[r].range_mm = (int32_t)((uint32_t)rec[2] | ((uint32_t)rec[3] << 8) | ((uint32_t)rec[4] << 16) | ((uint32_t)rec[5] << 24));
+    recs[r].rssi = (int8_t)rec[6];
+    recs[r].time_stamp = (uint32_t)rec[7] | ((uint32_t)rec[8] << 8) | ((uint32_t)rec[9] << 16) | ((uint32_t)rec[10] << 24);
+    recs[r].quality = (raw[0] == STREAM_TYPE_RANGE_Q) ? rec[11] : -1;
+  }
+  return count;
+}
+
+
+#ifdef STREAM_DECODE_MAIN
+
+#include <stdio.h>
+
+int main(void)
+{
+  static uint8_t frame[1024];
+  stream_record_t recs[STREAM_MAX_RECORDS];
+  uint32_t len = 0;
+  int synced = 0;
+  int c;
+
+  while ((c = getchar()) != EOF) {
+    if (c != 0) {
+      if (len < sizeof(frame)) frame[len] = c;
+      len++;
+      continue;
+    }
+
+    if (synced && len > 0) {
+      int n = (len <= sizeof(frame)) ? stream_decode_frame(frame, len, recs) : STREAM_ERR_FORMAT;
+
+      if (n < 0) {
+        fprintf(stderr, "bad frame of %u bytes: %d\n", len, n);
+      }
+      for (int r = 0; r < n; r++) {
+        if (recs[r].quality < 0) {
+          printf("%d, %f, %d, %u \r\n", recs[r].id, recs[r].range_mm / 1000.0, recs[r].rssi, recs[r].time_stamp);
+        }
+        else {
+          printf("%d, %f, %d, %u, %d \r\n", recs[r].id, recs[r].range_mm / 1000.0, recs[r].rssi,
+                 recs[r].time_stamp, recs[r].quality);
+        }
+      }
+      fflush(stdout);
+    }
+    synced = 1;
+    len = 0;
+  }
+  return 0;
+}
+
+#endif
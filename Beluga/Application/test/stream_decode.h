@@ -0,0 +1,33 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   stream_decode.h
+ *
+ *  @brief  Host decoder of the binary range stream of stream.c --Header file
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STREAM_DECODE_H_
+#define _STREAM_DECODE_H_
+
+#include <stdint.h>
+#include "stream.h"
+
+#define STREAM_ERR_COBS    -1   /**< Not a valid COBS encoding */
+#define STREAM_ERR_CRC     -2   /**< CRC mismatch */
+#define STREAM_ERR_FORMAT  -3   /**< Unknown type or length not matching the count */
+
+typedef struct
+{
+    uint16_t id;            /**< Neighbor node ID */
+    int32_t range_mm;       /**< Range in mm */
+    int8_t rssi;            /**< BLE RSSI */
+    uint32_t time_stamp;    /**< Time of the range, in ms */
+    int quality;            /**< Range quality, -1 in STREAM_TYPE_RANGE frames */
+} stream_record_t;
+
+int stream_cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst);
+int stream_decode_frame(const uint8_t *frame, uint32_t len, stream_record_t *recs);
+
+#endif
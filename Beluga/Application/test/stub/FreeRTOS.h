@@ -0,0 +1,35 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   FreeRTOS.h
+ *
+ *  @brief  Host stand-in for the FreeRTOS kernel configuration and types
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_FREERTOS_H_
+#define _STUB_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE   ((BaseType_t) 0)
+#define pdTRUE    ((BaseType_t) 1)
+#define pdPASS    pdTRUE
+#define pdFAIL    pdFALSE
+
+#define portMAX_DELAY             ((TickType_t) 0xFFFFFFFFUL)
+#define portYIELD_FROM_ISR(x)     ((void) (x))
+#define configTICK_RATE_HZ        1024
+#define configMINIMAL_STACK_SIZE  60
+#define configASSERT(x)           assert(x)
+
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000))
+
+#endif
@@ -0,0 +1,22 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   app_error.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK error checks
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_APP_ERROR_H_
+#define _STUB_APP_ERROR_H_
+
+#include <stdint.h>
+#include <assert.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS          0
+#define APP_ERROR_CHECK(x)   assert((x) == NRF_SUCCESS)
+
+#endif
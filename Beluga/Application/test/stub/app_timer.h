@@ -0,0 +1,20 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   app_timer.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK application timer
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_APP_TIMER_H_
+#define _STUB_APP_TIMER_H_
+
+#include <stdint.h>
+
+typedef void *app_timer_id_t;
+
+#define APP_TIMER_DEF(id)  static app_timer_id_t id __attribute__((unused))
+
+#endif
@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   app_util_platform.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK critical regions, implemented by fake_rtos.c
+ *
+ *          Critical regions take one process wide mutex, so code shared with
+ *          interrupt handlers can be run from several host threads.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_APP_UTIL_PLATFORM_H_
+#define _STUB_APP_UTIL_PLATFORM_H_
+
+#include <stdint.h>
+#include "nrf.h"
+
+#define APP_IRQ_PRIORITY_LOWEST  7
+
+void app_util_critical_region_enter(uint8_t *p_nested);
+void app_util_critical_region_exit(uint8_t nested);
+
+#endif
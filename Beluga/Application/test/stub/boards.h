@@ -0,0 +1,16 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   boards.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK board selection
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_BOARDS_H_
+#define _STUB_BOARDS_H_
+
+#include "dw1001_dev.h"
+
+#endif
@@ -0,0 +1,43 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf.h
+ *
+ *  @brief  Host stand-in for the nRF52 device header: the cycle counter, barriers
+ *          and the peripherals of uart.c, which fake_uarte.c implements
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_H_
+#define _STUB_NRF_H_
+
+#include <stdint.h>
+
+typedef struct {
+  volatile uint32_t CYCCNT;
+} fake_dwt_t;
+
+typedef struct {
+  volatile uint32_t EVENTS_RXDRDY;
+} NRF_UARTE_Type;
+
+typedef struct {
+  volatile uint32_t CC[4];
+} NRF_TIMER_Type;
+
+typedef enum {
+  UARTE0_UART0_IRQn = 2
+} IRQn_Type;
+
+extern fake_dwt_t fake_dwt;
+extern uint32_t SystemCoreClock;
+extern NRF_UARTE_Type fake_uarte0;
+extern NRF_TIMER_Type fake_timer2;
+
+#define DWT         (&fake_dwt)
+#define NRF_UARTE0  (&fake_uarte0)
+#define NRF_TIMER2  (&fake_timer2)
+#define __DMB()   __sync_synchronize()
+
+#endif
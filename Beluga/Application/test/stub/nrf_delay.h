@@ -0,0 +1,19 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_delay.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK busy wait delays
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_DELAY_H_
+#define _STUB_NRF_DELAY_H_
+
+#include <stdint.h>
+
+static inline void nrf_delay_us(uint32_t us) { (void) us; }
+static inline void nrf_delay_ms(uint32_t ms) { (void) ms; }
+
+#endif
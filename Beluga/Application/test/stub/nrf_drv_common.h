@@ -0,0 +1,27 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_drv_common.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK common driver helpers
+ *
+ *          Every host buffer is reachable by EasyDMA except the ones the test
+ *          marks as flash with fake_flash_range().
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_DRV_COMMON_H_
+#define _STUB_NRF_DRV_COMMON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "nrf.h"
+
+void fake_flash_range(const void *start, size_t len);
+bool nrf_drv_is_in_RAM(void const *ptr);
+
+static inline void nrf_drv_common_irq_enable(IRQn_Type irq, uint8_t priority) { (void) irq; (void) priority; }
+
+#endif
@@ -0,0 +1,45 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_drv_gpiote.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK GPIOTE driver, implemented by fake_dw1000.c
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_DRV_GPIOTE_H_
+#define _STUB_NRF_DRV_GPIOTE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_error.h"
+#include "nrf_gpio.h"
+
+typedef uint32_t nrf_drv_gpiote_pin_t;
+
+typedef enum {
+  NRF_GPIOTE_POLARITY_LOTOHI = 1,
+  NRF_GPIOTE_POLARITY_HITOLO,
+  NRF_GPIOTE_POLARITY_TOGGLE
+} nrf_gpiote_polarity_t;
+
+typedef struct {
+  nrf_gpiote_polarity_t sense;
+  nrf_gpio_pin_pull_t pull;
+  bool is_watcher;
+  bool hi_accuracy;
+} nrf_drv_gpiote_in_config_t;
+
+typedef void (*nrf_drv_gpiote_evt_handler_t)(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
+
+#define GPIOTE_CONFIG_IN_SENSE_LOTOHI(hi_accu) \
+  { .sense = NRF_GPIOTE_POLARITY_LOTOHI, .pull = NRF_GPIO_PIN_NOPULL, .is_watcher = false, .hi_accuracy = (hi_accu) }
+
+bool nrf_drv_gpiote_is_init(void);
+ret_code_t nrf_drv_gpiote_init(void);
+ret_code_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t const *config,
+                                  nrf_drv_gpiote_evt_handler_t handler);
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable);
+
+#endif
@@ -0,0 +1,58 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_drv_spi.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK SPI master driver
+ *
+ *          Transfers complete at once and call the event handler before
+ *          nrf_drv_spi_transfer() returns. The benchmark supplies the functions.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_DRV_SPI_H_
+#define _STUB_NRF_DRV_SPI_H_
+
+#include <stdint.h>
+#include "app_error.h"
+
+#define CONCAT_3(p1, p2, p3)      p1##p2##p3
+#define APP_IRQ_PRIORITY_LOW      6
+#define NRF_DRV_SPI_PIN_NOT_USED  0xFF
+
+typedef struct {
+  uint8_t inst_idx;
+} nrf_drv_spi_t;
+
+#define NRF_DRV_SPI_INSTANCE(id)  { .inst_idx = (id) }
+
+typedef enum { NRF_DRV_SPI_FREQ_2M, NRF_DRV_SPI_FREQ_8M } nrf_drv_spi_frequency_t;
+typedef enum { NRF_DRV_SPI_MODE_0 } nrf_drv_spi_mode_t;
+typedef enum { NRF_DRV_SPI_BIT_ORDER_MSB_FIRST } nrf_drv_spi_bit_order_t;
+
+typedef struct {
+  uint8_t sck_pin;
+  uint8_t mosi_pin;
+  uint8_t miso_pin;
+  uint8_t ss_pin;
+  uint8_t irq_priority;
+  uint8_t orc;
+  nrf_drv_spi_frequency_t frequency;
+  nrf_drv_spi_mode_t mode;
+  nrf_drv_spi_bit_order_t bit_order;
+} nrf_drv_spi_config_t;
+
+typedef struct {
+  int type;
+} nrf_drv_spi_evt_t;
+
+typedef void (*nrf_drv_spi_evt_handler_t)(nrf_drv_spi_evt_t const *p_event, void *p_context);
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const *p_instance, nrf_drv_spi_config_t const *p_config,
+                            nrf_drv_spi_evt_handler_t handler, void *p_context);
+void nrf_drv_spi_uninit(nrf_drv_spi_t const *p_instance);
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const *p_instance, uint8_t const *p_tx_buffer, uint8_t tx_buffer_length,
+                                uint8_t *p_rx_buffer, uint8_t rx_buffer_length);
+
+#endif
@@ -0,0 +1,18 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_drv_wdt.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK watchdog driver
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_DRV_WDT_H_
+#define _STUB_NRF_DRV_WDT_H_
+
+typedef int nrf_drv_wdt_channel_id;
+
+static inline void nrf_drv_wdt_channel_feed(nrf_drv_wdt_channel_id id) { (void) id; }
+
+#endif
@@ -0,0 +1,32 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_gpio.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK GPIO HAL
+ *
+ *          Outputs are ignored. Inputs read the pins driven by the fakes, e.g. the
+ *          DW1000 IRQ line of fake_dw1000.c.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_GPIO_H_
+#define _STUB_NRF_GPIO_H_
+
+#include <stdint.h>
+
+typedef enum {
+  NRF_GPIO_PIN_NOPULL = 0,
+  NRF_GPIO_PIN_PULLDOWN = 1,
+  NRF_GPIO_PIN_PULLUP = 3
+} nrf_gpio_pin_pull_t;
+
+uint32_t nrf_gpio_pin_read(uint32_t pin);
+
+static inline void nrf_gpio_pin_set(uint32_t pin) { (void) pin; }
+static inline void nrf_gpio_pin_clear(uint32_t pin) { (void) pin; }
+static inline void nrf_gpio_cfg_output(uint32_t pin) { (void) pin; }
+static inline void nrf_gpio_cfg_input(uint32_t pin, nrf_gpio_pin_pull_t pull) { (void) pin; (void) pull; }
+
+#endif
@@ -0,0 +1,17 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_log.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK logger
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_LOG_H_
+#define _STUB_NRF_LOG_H_
+
+#define NRF_LOG_INFO(...)
+#define NRF_LOG_FLUSH()
+
+#endif
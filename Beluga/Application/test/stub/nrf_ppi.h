@@ -0,0 +1,36 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_ppi.h
+ *
+ *  @brief  Host stand-in for the nRF52 PPI HAL
+ *
+ *          Channels are not modeled, fake_uarte.c applies the connections
+ *          uart.c sets up.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_PPI_H_
+#define _STUB_NRF_PPI_H_
+
+#include <stdint.h>
+
+typedef enum {
+  NRF_PPI_CHANNEL0 = 0,
+  NRF_PPI_CHANNEL1 = 1
+} nrf_ppi_channel_t;
+
+static inline void nrf_ppi_channel_endpoint_setup(nrf_ppi_channel_t ch, uint32_t eep, uint32_t tep)
+{
+  (void) ch; (void) eep; (void) tep;
+}
+
+static inline void nrf_ppi_channel_and_fork_endpoint_setup(nrf_ppi_channel_t ch, uint32_t eep, uint32_t tep, uint32_t fork)
+{
+  (void) ch; (void) eep; (void) tep; (void) fork;
+}
+
+static inline void nrf_ppi_channel_enable(nrf_ppi_channel_t ch) { (void) ch; }
+
+#endif
@@ -0,0 +1,65 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_timer.h
+ *
+ *  @brief  Host stand-in for the nRF52 TIMER HAL, the parts used by uart.c
+ *
+ *          The compare registers and events are implemented by fake_uarte.c,
+ *          the configuration is ignored.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_TIMER_H_
+#define _STUB_NRF_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+
+typedef enum {
+  NRF_TIMER_TASK_START,
+  NRF_TIMER_TASK_STOP,
+  NRF_TIMER_TASK_CLEAR
+} nrf_timer_task_t;
+
+typedef enum {
+  NRF_TIMER_EVENT_COMPARE0
+} nrf_timer_event_t;
+
+typedef enum { NRF_TIMER_CC_CHANNEL0 } nrf_timer_cc_channel_t;
+typedef enum { NRF_TIMER_MODE_TIMER } nrf_timer_mode_t;
+typedef enum { NRF_TIMER_BIT_WIDTH_16 } nrf_timer_bit_width_t;
+typedef enum { NRF_TIMER_FREQ_1MHz } nrf_timer_frequency_t;
+
+#define NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK  (1UL << 0)
+#define NRF_TIMER_SHORT_COMPARE0_STOP_MASK   (1UL << 8)
+
+void nrf_timer_task_trigger(NRF_TIMER_Type *p_reg, nrf_timer_task_t task);
+bool nrf_timer_event_check(NRF_TIMER_Type *p_reg, nrf_timer_event_t event);
+void nrf_timer_event_clear(NRF_TIMER_Type *p_reg, nrf_timer_event_t event);
+
+static inline void nrf_timer_cc_write(NRF_TIMER_Type *p_reg, nrf_timer_cc_channel_t ch, uint32_t value)
+{
+  p_reg->CC[ch] = value;
+}
+
+static inline void nrf_timer_mode_set(NRF_TIMER_Type *p_reg, nrf_timer_mode_t mode) { (void) p_reg; (void) mode; }
+static inline void nrf_timer_bit_width_set(NRF_TIMER_Type *p_reg, nrf_timer_bit_width_t width) { (void) p_reg; (void) width; }
+static inline void nrf_timer_frequency_set(NRF_TIMER_Type *p_reg, nrf_timer_frequency_t freq) { (void) p_reg; (void) freq; }
+static inline void nrf_timer_shorts_enable(NRF_TIMER_Type *p_reg, uint32_t mask) { (void) p_reg; (void) mask; }
+
+static inline uint32_t nrf_timer_task_address_get(NRF_TIMER_Type *p_reg, nrf_timer_task_t task)
+{
+  (void) task;
+  return (uint32_t) (uintptr_t) p_reg;
+}
+
+static inline uint32_t nrf_timer_event_address_get(NRF_TIMER_Type *p_reg, nrf_timer_event_t event)
+{
+  (void) event;
+  return (uint32_t) (uintptr_t) p_reg;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   nrf_uarte.h
+ *
+ *  @brief  Host stand-in for the nRF52 UARTE HAL, implemented by fake_uarte.c
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_NRF_UARTE_H_
+#define _STUB_NRF_UARTE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+
+typedef enum {
+  NRF_UARTE_TASK_STARTRX,
+  NRF_UARTE_TASK_STOPRX,
+  NRF_UARTE_TASK_STARTTX,
+  NRF_UARTE_TASK_STOPTX
+} nrf_uarte_task_t;
+
+typedef enum {
+  NRF_UARTE_EVENT_ENDRX,
+  NRF_UARTE_EVENT_ENDTX,
+  NRF_UARTE_EVENT_ERROR,
+  NRF_UARTE_EVENT_RXTO,
+  NRF_UARTE_EVENT_RXSTARTED,
+  NRF_UARTE_EVENT_COUNT
+} nrf_uarte_event_t;
+
+#define NRF_UARTE_INT_ENDRX_MASK      (1UL << NRF_UARTE_EVENT_ENDRX)
+#define NRF_UARTE_INT_ENDTX_MASK      (1UL << NRF_UARTE_EVENT_ENDTX)
+#define NRF_UARTE_INT_ERROR_MASK      (1UL << NRF_UARTE_EVENT_ERROR)
+#define NRF_UARTE_INT_RXTO_MASK       (1UL << NRF_UARTE_EVENT_RXTO)
+#define NRF_UARTE_INT_RXSTARTED_MASK  (1UL << NRF_UARTE_EVENT_RXSTARTED)
+
+typedef enum {
+  NRF_UARTE_BAUDRATE_9600,
+  NRF_UARTE_BAUDRATE_19200,
+  NRF_UARTE_BAUDRATE_38400,
+  NRF_UARTE_BAUDRATE_57600,
+  NRF_UARTE_BAUDRATE_115200,
+  NRF_UARTE_BAUDRATE_230400,
+  NRF_UARTE_BAUDRATE_460800,
+  NRF_UARTE_BAUDRATE_921600,
+  NRF_UARTE_BAUDRATE_1000000
+} nrf_uarte_baudrate_t;
+
+typedef enum { NRF_UARTE_PARITY_EXCLUDED } nrf_uarte_parity_t;
+typedef enum { NRF_UARTE_HWFC_DISABLED } nrf_uarte_hwfc_t;
+
+void nrf_uarte_task_trigger(NRF_UARTE_Type *p_reg, nrf_uarte_task_t task);
+bool nrf_uarte_event_check(NRF_UARTE_Type *p_reg, nrf_uarte_event_t event);
+void nrf_uarte_event_clear(NRF_UARTE_Type *p_reg, nrf_uarte_event_t event);
+void nrf_uarte_tx_buffer_set(NRF_UARTE_Type *p_reg, uint8_t const *p_buffer, uint32_t length);
+void nrf_uarte_rx_buffer_set(NRF_UARTE_Type *p_reg, uint8_t *p_buffer, uint32_t length);
+uint32_t nrf_uarte_rx_amount_get(NRF_UARTE_Type *p_reg);
+uint32_t nrf_uarte_errorsrc_get_and_clear(NRF_UARTE_Type *p_reg);
+void nrf_uarte_baudrate_set(NRF_UARTE_Type *p_reg, nrf_uarte_baudrate_t baudrate);
+void nrf_uarte_int_enable(NRF_UARTE_Type *p_reg, uint32_t mask);
+
+static inline void nrf_uarte_configure(NRF_UARTE_Type *p_reg, nrf_uarte_parity_t parity, nrf_uarte_hwfc_t hwfc)
+{
+  (void) p_reg; (void) parity; (void) hwfc;
+}
+
+static inline void nrf_uarte_txrx_pins_set(NRF_UARTE_Type *p_reg, uint32_t pseltxd, uint32_t pselrxd)
+{
+  (void) p_reg; (void) pseltxd; (void) pselrxd;
+}
+
+static inline void nrf_uarte_enable(NRF_UARTE_Type *p_reg) { (void) p_reg; }
+
+static inline uint32_t nrf_uarte_task_address_get(NRF_UARTE_Type *p_reg, nrf_uarte_task_t task)
+{
+  (void) task;
+  return (uint32_t) (uintptr_t) p_reg;
+}
+
+#endif
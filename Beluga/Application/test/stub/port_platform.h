@@ -0,0 +1,29 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   port_platform.h
+ *
+ *  @brief  Host wrapper of the DW1000 port header
+ *
+ *          On 64-bit hosts uint64_t is unsigned long, which clashes with the
+ *          unsigned long long uint64 of resp_main.c. The port header is
+ *          included with the ARM types instead.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_PORT_PLATFORM_H_
+#define _STUB_PORT_PLATFORM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define uint64_t unsigned long long
+#define int64_t signed long long
+#include_next "port_platform.h"
+#undef uint64_t
+#undef int64_t
+
+void deca_sleep(unsigned int time_ms);
+
+#endif
@@ -0,0 +1,16 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   portmacro_cmsis.h
+ *
+ *  @brief  Host stand-in for the FreeRTOS Cortex-M port macros, see FreeRTOS.h
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_PORTMACRO_CMSIS_H_
+#define _STUB_PORTMACRO_CMSIS_H_
+
+#include "FreeRTOS.h"
+
+#endif
@@ -0,0 +1,21 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   sdk_common.h
+ *
+ *  @brief  Host stand-in for the nRF5 SDK common header, enough for the SDK
+ *          libraries built by the host tests
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_SDK_COMMON_H_
+#define _STUB_SDK_COMMON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define NRF_MODULE_ENABLED(module)  1
+
+#endif
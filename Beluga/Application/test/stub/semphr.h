@@ -0,0 +1,25 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   semphr.h
+ *
+ *  @brief  Host stand-in for the FreeRTOS semaphore API, implemented by fake_rtos.c
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_SEMPHR_H_
+#define _STUB_SEMPHR_H_
+
+#include "FreeRTOS.h"
+
+typedef struct fake_queue *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
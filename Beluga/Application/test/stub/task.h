@@ -0,0 +1,40 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   task.h
+ *
+ *  @brief  Host stand-in for the FreeRTOS task API, implemented by fake_rtos.c
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_TASK_H_
+#define _STUB_TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef struct fake_task *TaskHandle_t;
+
+typedef enum {
+  eNoAction = 0,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite
+} eNotifyAction;
+
+#define taskSCHEDULER_SUSPENDED    ((BaseType_t) 0)
+#define taskSCHEDULER_NOT_STARTED  ((BaseType_t) 1)
+#define taskSCHEDULER_RUNNING      ((BaseType_t) 2)
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskGetSchedulerState(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#endif
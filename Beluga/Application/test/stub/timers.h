@@ -0,0 +1,18 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   timers.h
+ *
+ *  @brief  Host stand-in for the FreeRTOS software timer API
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _STUB_TIMERS_H_
+#define _STUB_TIMERS_H_
+
+#include "FreeRTOS.h"
+
+typedef struct fake_timer *TimerHandle_t;
+
+#endif
@@ -0,0 +1,52 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test.h
+ *
+ *  @brief  Minimal check macros of the host tests
+ *
+ *          Each test program includes this file once, runs its cases with
+ *          TEST_RUN() and returns TEST_RESULT() from main().
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <time.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long) (a), _b = (long long) (b); \
+    if (_a != _b) { \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define TEST_RUN(fn) do { printf("  %s\n", #fn); fn(); } while (0)
+
+#define TEST_RESULT() (printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "passed"), test_failures != 0)
+
+/**
+ * @brief Monotonic host time in nanoseconds, for the benchmarks
+ */
+static inline double test_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#endif
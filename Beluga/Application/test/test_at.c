@@ -0,0 +1,172 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_at.c
+ *
+ *  @brief  Host test of the AT command parsing
+ *
+ *          Checks the table lookup, the argument kinds and the line errors
+ *          of at_cmd.c, and that the command table of main.c is sorted for
+ *          the binary search.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "at_cmd.h"
+#include "test.h"
+
+#define MAIN_C  "../src/main.c"
+
+static int m_calls;
+
+static void handler(const at_args_t *args)
+{
+  m_calls++;
+}
+
+static const at_command_t m_table[] = {
+  { "BAUD",     AT_ARG_INT,  handler },
+  { "ID",       AT_ARG_INT,  handler },
+  { "RATE",     AT_ARG_INT,  handler },
+  { "RESET",    AT_ARG_NONE, handler },
+  { "STATS",    AT_ARG_OPT,  handler },
+  { "STOPBLE",  AT_ARG_NONE, handler },
+  { "STOPUWB",  AT_ARG_NONE, handler },
+};
+
+#define TABLE_LEN  (sizeof(m_table) / sizeof(m_table[0]))
+
+
+static void test_find(void)
+{
+  for (unsigned i = 0; i < TABLE_LEN; i++) {
+    CHECK(at_find(m_table, TABLE_LEN, m_table[i].name) == &m_table[i]);
+    /* Every table size down to one entry */
+    CHECK(at_find(m_table, i + 1, m_table[i].name) == &m_table[i]);
+  }
+
+  CHECK(at_find(m_table, TABLE_LEN, "") == NULL);
+  CHECK(at_find(m_table, TABLE_LEN, "RAT") == NULL);
+  CHECK(at_find(m_table, TABLE_LEN, "RATES") == NULL);
+  CHECK(at_find(m_table, TABLE_LEN, "rate") == NULL);
+  CHECK(at_find(m_table, TABLE_LEN, "AAA") == NULL);
+  CHECK(at_find(m_table, TABLE_LEN, "ZZZ") == NULL);
+  CHECK(at_find(m_table, 0, "BAUD") == NULL);
+}
+
+static void test_args(void)
+{
+  at_args_t args;
+
+  CHECK(at_parse_args("", AT_ARG_NONE, &args));
+  CHECK(at_parse_args(" whatever", AT_ARG_NONE, &args));
+  CHECK(!args.given);
+
+  CHECK(!at_parse_args("", AT_ARG_INT, &args));
+  CHECK(!at_parse_args("   ", AT_ARG_INT, &args));
+  CHECK(!at_parse_args("x", AT_ARG_INT, &args));
+  CHECK(!at_parse_args("5x", AT_ARG_INT, &args));
+  CHECK(!at_parse_args("5 6", AT_ARG_INT, &args));
+
+  CHECK(at_parse_args("  42  ", AT_ARG_INT, &args));
+  CHECK(args.given);
+  CHECK_EQ(args.value, 42);
+  CHECK(at_parse_args("-7", AT_ARG_INT, &args));
+  CHECK_EQ(args.value, -7);
+
+  CHECK(at_parse_args("", AT_ARG_OPT, &args));
+  CHECK(!args.given);
+  CHECK_EQ(args.value, 0);
+  CHECK(at_parse_args(" 0", AT_ARG_OPT, &args));
+  CHECK(args.given);
+  CHECK(!at_parse_args("on", AT_ARG_OPT, &args));
+}
+
+/**
+ * @brief Parse a copy of a line, as the input line is cut in place
+ */
+static at_status_t parse(const char *text, const at_command_t **cmd, at_args_t *args)
+{
+  char line[64];
+
+  strcpy(line, text);
+  return at_parse_line(line, m_table, TABLE_LEN, cmd, args);
+}
+
+static void test_lines(void)
+{
+  const at_command_t *cmd;
+  at_args_t args;
+
+  CHECK_EQ(parse("hello", &cmd, &args), AT_ERR_NOT_AT);
+  CHECK_EQ(parse("", &cmd, &args), AT_ERR_NOT_AT);
+  CHECK_EQ(parse("AT", &cmd, &args), AT_ERR_NO_PLUS);
+  CHECK_EQ(parse("ATRATE 5", &cmd, &args), AT_ERR_NO_PLUS);
+  CHECK_EQ(parse("AT+", &cmd, &args), AT_ERR_UNKNOWN);
+  CHECK_EQ(parse("AT+FOO 5", &cmd, &args), AT_ERR_UNKNOWN);
+  CHECK_EQ(parse("AT+RATE", &cmd, &args), AT_ERR_PARAM);
+  CHECK_EQ(parse("AT+RATE fast", &cmd, &args), AT_ERR_PARAM);
+
+  CHECK_EQ(parse("AT+RATE 250", &cmd, &args), AT_OK);
+  CHECK(cmd == at_find(m_table, TABLE_LEN, "RATE"));
+  CHECK_EQ(args.value, 250);
+
+  CHECK_EQ(parse("AT+STATS", &cmd, &args), AT_OK);
+  CHECK(!args.given);
+  CHECK_EQ(parse("AT+STATS 1", &cmd, &args), AT_OK);
+  CHECK(args.given);
+  CHECK_EQ(parse("AT+RESET now", &cmd, &args), AT_OK);
+
+  m_calls = 0;
+  cmd->handler(&args);
+  CHECK_EQ(m_calls, 1);
+}
+
+static void test_main_table_sorted(void)
+{
+  FILE *f = fopen(MAIN_C, "r");
+  char text[256];
+  char prev[32] = "";
+  int count = 0;
+  bool in_table = false;
+
+  CHECK(f != NULL);
+  if (f == NULL) return;
+
+  /* Entries of at_commands[] look like { "NAME", AT_ARG_..., handler }, */
+  while (fgets(text, sizeof(text), f) != NULL) {
+    char name[32];
+
+    if (strstr(text, "at_command_t at_commands[]") != NULL) {
+      in_table = true;
+      continue;
+    }
+    if (!in_table) continue;
+    if (strncmp(text, "};", 2) == 0) break;
+    if (sscanf(text, " { \"%31[^\"]\"", name) != 1) continue;
+
+    if (strcmp(prev, name) >= 0) {
+      printf("    %s listed after %s\n", name, prev);
+    }
+    CHECK(strcmp(prev, name) < 0);
+    strcpy(prev, name);
+    count++;
+  }
+  fclose(f);
+
+  CHECK(count > 20);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_find);
+  TEST_RUN(test_args);
+  TEST_RUN(test_lines);
+  TEST_RUN(test_main_table_sorted);
+  return TEST_RESULT();
+}
@@ -0,0 +1,435 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_neighbor.c
+ *
+ *  @brief  Host test of the neighbor table
+ *
+ *          Checks lookup, eviction, the RSSI order, backward shift deletion and
+ *          the expiry timer wheel, then runs random operations against a plain
+ *          array model of the table.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "app_util_platform.h"
+#include "neighbor.h"
+#include "test.h"
+
+#define MODEL_IDS  400
+
+#define STRESS_IDS      (MAX_ANCHOR_COUNT + MAX_ANCHOR_COUNT / 2)  /**< More nodes than slots, so slots are evicted and reused */
+#define STRESS_EVENTS   1000000
+#define STRESS_READERS  2
+
+/**
+ * @brief Home bucket of an ID, as hashed by neighbor.c
+ */
+static uint32_t home_of(uint16_t id)
+{
+  return ((uint32_t) id * 2654435761U) >> (32 - NEIGHBOR_HASH_BITS);
+}
+
+/**
+ * @brief Table invariants: count, ID lookup and RSSI order
+ */
+static void check_table(void)
+{
+  int occupied = 0;
+
+  for (int s = 0; s < MAX_ANCHOR_COUNT; s++) {
+    if (seen_list[s].UUID != 0) {
+      occupied++;
+      CHECK_EQ(neighbor_find(seen_list[s].UUID), s);
+    }
+  }
+  CHECK_EQ(neighbor_count(), occupied);
+
+  for (int r = 1; r < neighbor_count(); r++) {
+    CHECK(seen_list[neighbor_at_rank(r - 1)].RSSI >= seen_list[neighbor_at_rank(r)].RSSI);
+  }
+  CHECK_EQ(neighbor_at_rank(neighbor_count()), -1);
+}
+
+
+static void test_insert_find(void)
+{
+  neighbor_init();
+
+  CHECK_EQ(neighbor_find(7), -1);
+  CHECK_EQ(neighbor_insert(0, -40), -1);
+
+  int s = neighbor_insert(7, -40);
+  CHECK(s >= 0);
+  CHECK_EQ(neighbor_insert(7, -90), s);
+  CHECK_EQ(neighbor_find(7), s);
+  CHECK_EQ(seen_list[s].UUID, 7);
+  CHECK_EQ(seen_list[s].RSSI, -40);
+  CHECK_EQ(neighbor_count(), 1);
+
+  neighbor_remove(s);
+  CHECK_EQ(neighbor_find(7), -1);
+  CHECK_EQ(neighbor_count(), 0);
+  CHECK_EQ(seen_list[s].UUID, 0);
+  check_table();
+}
+
+static void test_full_table_eviction(void)
+{
+  neighbor_init();
+
+  for (int i = 0; i < MAX_ANCHOR_COUNT; i++) {
+    CHECK(neighbor_insert(100 + i, -50 - (i % 20)) >= 0);
+  }
+  CHECK_EQ(neighbor_count(), MAX_ANCHOR_COUNT);
+
+  /* Weaker or equal nodes do not get in */
+  CHECK_EQ(neighbor_insert(1000, -69), -1);
+  CHECK_EQ(neighbor_insert(1001, -90), -1);
+
+  /* A stronger one evicts the weakest */
+  int weakest = seen_list[neighbor_at_rank(MAX_ANCHOR_COUNT - 1)].UUID;
+  CHECK(neighbor_insert(1002, -30) >= 0);
+  CHECK_EQ(neighbor_find(weakest), -1);
+  CHECK_EQ(seen_list[neighbor_at_rank(0)].UUID, 1002);
+  CHECK_EQ(neighbor_count(), MAX_ANCHOR_COUNT);
+  check_table();
+}
+
+static void test_rssi_order(void)
+{
+  neighbor_init();
+
+  int a = neighbor_insert(1, -70);
+  int b = neighbor_insert(2, -60);
+  int c = neighbor_insert(3, -80);
+  CHECK_EQ(neighbor_at_rank(0), b);
+  CHECK_EQ(neighbor_at_rank(1), a);
+  CHECK_EQ(neighbor_at_rank(2), c);
+
+  seen_list[c].RSSI = -10;
+  neighbor_reorder(c);
+  CHECK_EQ(neighbor_at_rank(0), c);
+
+  seen_list[c].RSSI = -100;
+  neighbor_reorder(c);
+  CHECK_EQ(neighbor_at_rank(2), c);
+
+  neighbor_remove(a);
+  CHECK_EQ(neighbor_at_rank(0), b);
+  CHECK_EQ(neighbor_at_rank(1), c);
+  check_table();
+}
+
+static void test_collisions(void)
+{
+  uint16_t ids[4] = { 0 };
+  int n = 0;
+
+  /* IDs sharing a home bucket are probed in a run, removing one keeps the others reachable */
+  for (uint32_t id = 2; id < 0xFFFF && n < 4; id++) {
+    if (home_of(id) == home_of(1)) {
+      ids[n++] = id;
+    }
+  }
+  CHECK_EQ(n, 4);
+
+  neighbor_init();
+  neighbor_insert(1, -50);
+  for (int i = 0; i < n; i++) {
+    neighbor_insert(ids[i], -50);
+  }
+
+  neighbor_remove(neighbor_find(ids[0]));
+  neighbor_remove(neighbor_find(1));
+  CHECK_EQ(neighbor_find(1), -1);
+  CHECK_EQ(neighbor_find(ids[0]), -1);
+  for (int i = 1; i < n; i++) {
+    CHECK(neighbor_find(ids[i]) >= 0);
+  }
+  check_table();
+}
+
+static void test_expiry(void)
+{
+  uint32_t due;
+
+  neighbor_init();
+  CHECK(!neighbor_next_expiry(&due));
+
+  int a = neighbor_insert(1, -50);
+  int b = neighbor_insert(2, -50);
+  seen_list[a].ble_time_stamp = 0;
+  seen_list[b].ble_time_stamp = 1000;
+
+  /* New slots are checked at once and moved to the bucket of their expiry */
+  CHECK(neighbor_next_expiry(&due));
+  CHECK_EQ(due, 0);
+  CHECK_EQ(neighbor_expire(0, 3000), 0);
+  CHECK(neighbor_next_expiry(&due));
+  CHECK_EQ(due, 3000 / NEIGHBOR_EXPIRY_MS * NEIGHBOR_EXPIRY_MS);
+
+  /* An advertisement heard meanwhile postpones the expiry */
+  seen_list[a].ble_time_stamp = 2000;
+  CHECK_EQ(neighbor_expire(3500, 3000), 0);
+  CHECK_EQ(neighbor_count(), 2);
+
+  CHECK_EQ(neighbor_expire(4000, 3000), 1);
+  CHECK_EQ(neighbor_find(2), -1);
+  CHECK_EQ(neighbor_expire(5000, 3000), 1);
+  CHECK_EQ(neighbor_count(), 0);
+  CHECK(!neighbor_next_expiry(&due));
+
+  /* After a long stall every slot is still checked once */
+  a = neighbor_insert(3, -50);
+  seen_list[a].ble_time_stamp = 5000;
+  CHECK_EQ(neighbor_expire(1000000, 3000), 1);
+  check_table();
+}
+
+static void test_seqlock(void)
+{
+  node copy;
+
+  neighbor_init();
+  int s = neighbor_insert(9, -50);
+
+  CHECK(neighbor_read(s, &copy));
+  CHECK_EQ(copy.UUID, 9);
+
+  /* A reader never returns an entry in the middle of a write */
+  neighbor_write_begin(s);
+  seen_list[s].range = 1.5f;
+  CHECK(!neighbor_read(s, &copy));
+  neighbor_write_end(s);
+  CHECK(neighbor_read(s, &copy));
+  CHECK(copy.range == 1.5f);
+
+  neighbor_flag_set(s, NEIGHBOR_UPDATED | NEIGHBOR_POLLING);
+  neighbor_flag_clear(s, NEIGHBOR_UPDATED);
+  CHECK_EQ(seen_list[s].flags, NEIGHBOR_POLLING);
+
+  neighbor_remove(s);
+  CHECK(!neighbor_read(s, &copy));
+  CHECK(!neighbor_read(-1, &copy));
+}
+
+static void test_random_model(void)
+{
+  static int8_t model[MODEL_IDS];   /* RSSI of each ID in the table, 0 if absent */
+  int n = 0;
+
+  neighbor_init();
+  memset(model, 0, sizeof(model));
+  srand(3);
+
+  for (int it = 0; it < 200000; it++) {
+    uint16_t id = 1 + rand() % (MODEL_IDS - 1);
+    int8_t rssi = -1 - rand() % 100;
+    int op = rand() % 10;
+    int s = neighbor_find(id);
+
+    CHECK_EQ(s >= 0, model[id] != 0);
+
+    if (op < 5 && s < 0) {
+      s = neighbor_insert(id, rssi);
+      if (n < MAX_ANCHOR_COUNT) {
+        CHECK(s >= 0);
+      }
+      if (s >= 0) {
+        /* An eviction removed some weaker ID, resync the model from the table */
+        if (n == MAX_ANCHOR_COUNT) {
+          memset(model, 0, sizeof(model));
+          for (int r = 0; r < neighbor_count(); r++) {
+            model[seen_list[neighbor_at_rank(r)].UUID] = seen_list[neighbor_at_rank(r)].RSSI;
+          }
+        }
+        model[id] = rssi;
+      }
+    }
+    else if (op < 8 && s >= 0) {
+      seen_list[s].RSSI = rssi;
+      model[id] = rssi;
+      neighbor_reorder(s);
+    }
+    else if (s >= 0) {
+      neighbor_remove(s);
+      model[id] = 0;
+    }
+
+    n = 0;
+    for (int i = 0; i < MODEL_IDS; i++) {
+      n += model[i] != 0;
+    }
+    CHECK_EQ(neighbor_count(), n);
+
+    if (it % 1000 == 0) {
+      check_table();
+    }
+    if (test_failures > 10) {
+      return;
+    }
+  }
+}
+
+
+static volatile bool m_stress_done;
+static uint32_t m_stress_reads, m_stress_torn, m_stress_ranges;
+
+/**
+ * @brief BLE event interrupt: advertisements and evictions
+ *
+ * The critical region stands for the interrupt, which tasks mask with it.
+ * RSSI and ble_time_stamp are written as a pair.
+ */
+static void *stress_ble(void *arg)
+{
+  unsigned seed = 1;
+
+  for (uint32_t i = 1; i <= STRESS_EVENTS; i++) {
+    uint16_t id = 1 + rand_r(&seed) % STRESS_IDS;
+    int8_t rssi = -1 - (int8_t)(i % 100);
+    uint8_t nested = 0;
+
+    app_util_critical_region_enter(&nested);
+    int slot = neighbor_find(id);
+    if (slot >= 0 && rand_r(&seed) % 8 == 0) {
+      neighbor_remove(slot);
+    }
+    else {
+      if (slot < 0) {
+        slot = neighbor_insert(id, rssi);
+      }
+      if (slot >= 0) {
+        neighbor_write_begin(slot);
+        seen_list[slot].RSSI = rssi;
+        seen_list[slot].ble_time_stamp = i;
+        neighbor_write_end(slot);
+        neighbor_reorder(slot);
+      }
+    }
+    app_util_critical_region_exit(nested);
+
+    if (i % 64 == 0) sched_yield();
+  }
+  m_stress_done = true;
+  return NULL;
+}
+
+/**
+ * @brief Ranging task: picks a node, ranges without the lock, then writes the result
+ *
+ * Like neighbor_range_update() of main.c, the ID is checked again inside the
+ * write, as the slot may have been reused meanwhile. The range, its time
+ * and the filter state all carry the ID of the node they belong to.
+ */
+static void *stress_ranging(void *arg)
+{
+  unsigned seed = 2;
+  uint32_t t = 0;
+
+  while (!m_stress_done) {
+    int n = neighbor_count();
+    if (n == 0) continue;
+
+    int slot = neighbor_at_rank(rand_r(&seed) % n);
+    if (slot < 0) continue;
+    uint16_t id = seen_list[slot].UUID;
+
+    sched_yield();
+
+    uint8_t nested = 0;
+    app_util_critical_region_enter(&nested);
+    if (seen_list[slot].UUID == id && id != 0) {
+      t++;
+      neighbor_write_begin(slot);
+      seen_list[slot].time_stamp = t;
+      seen_list[slot].filter.last_ms = t;
+      seen_list[slot].filter.err_mm = id;
+      seen_list[slot].range = (float)(t % 4096);
+      neighbor_write_end(slot);
+      m_stress_ranges++;
+    }
+    app_util_critical_region_exit(nested);
+  }
+  return NULL;
+}
+
+/**
+ * @brief List task: copies entries without the lock and checks them
+ */
+static void *stress_reader(void *arg)
+{
+  uint32_t reads = 0, torn = 0;
+  node copy;
+
+  while (!m_stress_done) {
+    for (int slot = 0; slot < MAX_ANCHOR_COUNT; slot++) {
+      if (!neighbor_read(slot, &copy)) continue;
+      reads++;
+
+      bool ok = copy.UUID != 0 && copy.RSSI == -1 - (int8_t)(copy.ble_time_stamp % 100);
+      if (copy.time_stamp != 0) {
+        ok &= copy.filter.err_mm == copy.UUID && copy.filter.last_ms == copy.time_stamp &&
+              copy.range == (float)(copy.time_stamp % 4096);
+      }
+      else {
+        ok &= copy.filter.err_mm == 0 && copy.range == 0;
+      }
+      torn += !ok;
+    }
+    sched_yield();
+  }
+  __sync_fetch_and_add(&m_stress_reads, reads);
+  __sync_fetch_and_add(&m_stress_torn, torn);
+  return NULL;
+}
+
+/**
+ * @brief Consistent copies only, and no range of an evicted node on its successor
+ */
+static void test_threads(void)
+{
+  pthread_t ble, ranging, readers[STRESS_READERS];
+
+  neighbor_init();
+  m_stress_done = false;
+  m_stress_reads = m_stress_torn = m_stress_ranges = 0;
+
+  pthread_create(&ble, NULL, stress_ble, NULL);
+  pthread_create(&ranging, NULL, stress_ranging, NULL);
+  for (int i = 0; i < STRESS_READERS; i++) {
+    pthread_create(&readers[i], NULL, stress_reader, NULL);
+  }
+  pthread_join(ble, NULL);
+  pthread_join(ranging, NULL);
+  for (int i = 0; i < STRESS_READERS; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  printf("    %u ranges written, %u consistent reads, %u torn\n", m_stress_ranges, m_stress_reads, m_stress_torn);
+  CHECK_EQ(m_stress_torn, 0);
+  CHECK(m_stress_reads > 0);
+  CHECK(m_stress_ranges > 0);
+  check_table();
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_insert_find);
+  TEST_RUN(test_full_table_eviction);
+  TEST_RUN(test_rssi_order);
+  TEST_RUN(test_collisions);
+  TEST_RUN(test_expiry);
+  TEST_RUN(test_seqlock);
+  TEST_RUN(test_random_model);
+  TEST_RUN(test_threads);
+  return TEST_RESULT();
+}
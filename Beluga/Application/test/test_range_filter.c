@@ -0,0 +1,264 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_range_filter.c
+ *
+ *  @brief  Host test of the per-neighbor range filters
+ *
+ *          Checks the median window, outlier rejection, restarts after
+ *          repeated rejections, gaps and mode changes, and the quality
+ *          figure. Then runs range sequences of a static and a walking node,
+ *          with 100 mm of noise and multipath outliers every 5 s, through
+ *          each filter. The sequences are generated, no recorded ranges of
+ *          real nodes with a known truth are available, so the bounds show
+ *          the filters work on this noise model rather than on the channel.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "range_filter.h"
+#include "uwb_range.h"
+#include "test.h"
+
+#define SEQ_LEN         3000
+#define SEQ_PERIOD_MS   100
+#define SEQ_OUTLIER     50      /**< One multipath range every SEQ_OUTLIER ranges */
+#define SEQ_WARMUP      20
+
+typedef struct {
+  int32_t truth[SEQ_LEN];
+  int32_t range[SEQ_LEN];
+  bool outlier[SEQ_LEN];
+} sequence_t;
+
+static sequence_t m_static, m_walk;
+
+
+/**
+ * @brief Build a range sequence, the truth is given per range
+ */
+static void make_sequence(sequence_t *seq, unsigned seed, bool walking)
+{
+  srand(seed);
+  for (int i = 0; i < SEQ_LEN; i++) {
+    double t = i * SEQ_PERIOD_MS / 1000.0;
+    /* Walking back and forth between 2 and 8 m at up to about 1.3 m/s */
+    seq->truth[i] = walking ? 5000 + 3000 * sin(t * 0.44) : 3200;
+    seq->range[i] = seq->truth[i] + (rand() % 2001 - 1000) / 10;
+    seq->outlier[i] = (i % SEQ_OUTLIER) == 7;
+    if (seq->outlier[i]) {
+      seq->range[i] += 4000 + rand() % 4000;
+    }
+  }
+}
+
+static uint32_t rejected(void)
+{
+  range_filter_stats_t stats;
+
+  range_filter_stats_get(&stats);
+  return stats.rejected;
+}
+
+static uint32_t resets(void)
+{
+  range_filter_stats_t stats;
+
+  range_filter_stats_get(&stats);
+  return stats.resets;
+}
+
+
+static void test_off(void)
+{
+  range_filter_t f;
+
+  memset(&f, 0, sizeof(f));
+  CHECK_EQ(range_filter_update(&f, RANGE_FILTER_OFF, 1234, 0), 1234);
+  CHECK_EQ(range_filter_update(&f, RANGE_FILTER_OFF, 99999, 10), 99999);
+  CHECK_EQ(f.count, 0);
+}
+
+static void test_median(void)
+{
+  static const int32_t in[]  = { 1000, 1040, 980, 1010, 990, 1200, 1000, 1020 };
+  static const int32_t out[] = { 1000, 1020, 1000, 1005, 1000, 1010, 1000, 1010 };
+  range_filter_t f;
+
+  memset(&f, 0, sizeof(f));
+  for (unsigned i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+    CHECK_EQ(range_filter_update(&f, RANGE_FILTER_MEDIAN, in[i], i * 100), out[i]);
+  }
+  CHECK_EQ(sizeof(range_filter_t), 32);
+}
+
+/**
+ * @brief A single outlier is rejected by every filter and costs quality
+ */
+static void test_outlier(void)
+{
+  for (int mode = RANGE_FILTER_MEDIAN; mode < RANGE_FILTER_MODES; mode++) {
+    range_filter_t f;
+    uint32_t t = 0;
+
+    memset(&f, 0, sizeof(f));
+    for (int i = 0; i < 20; i++, t += 100) {
+      CHECK(range_filter_update(&f, mode, 3000 + (i % 3) * 20 - 20, t) != UWB_RANGE_NONE);
+    }
+    uint8_t q = range_filter_quality(&f);
+    CHECK(q >= 80);
+
+    uint32_t before = rejected();
+    CHECK_EQ(range_filter_update(&f, mode, 9000, t), UWB_RANGE_NONE);
+    CHECK_EQ(rejected(), before + 1);
+    CHECK_EQ(range_filter_quality(&f), q / 2);
+
+    /* The next good range is accepted near the track and restores the quality */
+    int32_t out = range_filter_update(&f, mode, 3000, t + 100);
+    CHECK(abs(out - 3000) < 50);
+    CHECK(range_filter_quality(&f) >= 80);
+  }
+}
+
+/**
+ * @brief A node that really moved is followed after FILTER_MAX_REJECTS ranges
+ */
+static void test_jump(void)
+{
+  for (int mode = RANGE_FILTER_MEDIAN; mode < RANGE_FILTER_MODES; mode++) {
+    range_filter_t f;
+    uint32_t t = 0;
+
+    memset(&f, 0, sizeof(f));
+    for (int i = 0; i < 10; i++, t += 100) {
+      range_filter_update(&f, mode, 2000, t);
+    }
+
+    uint32_t before = resets();
+    CHECK_EQ(range_filter_update(&f, mode, 8000, t), UWB_RANGE_NONE);
+    CHECK_EQ(range_filter_update(&f, mode, 8000, t + 100), UWB_RANGE_NONE);
+    CHECK_EQ(range_filter_update(&f, mode, 8000, t + 200), 8000);
+    CHECK_EQ(resets(), before + 1);
+    int32_t out = range_filter_update(&f, mode, 8010, t + 300);
+    CHECK(out >= 8000 && out <= 8010);
+  }
+}
+
+/**
+ * @brief Gaps and mode changes restart the filter from the new range
+ */
+static void test_restart(void)
+{
+  range_filter_t f;
+
+  memset(&f, 0, sizeof(f));
+  range_filter_update(&f, RANGE_FILTER_AB, 2000, 0);
+  range_filter_update(&f, RANGE_FILTER_AB, 2010, 100);
+
+  uint32_t before = resets();
+  CHECK_EQ(range_filter_update(&f, RANGE_FILTER_AB, 7000, 100 + 5001), 7000);
+  CHECK_EQ(resets(), before + 1);
+  CHECK_EQ(f.count, 1);
+
+  CHECK_EQ(range_filter_update(&f, RANGE_FILTER_KALMAN, 7500, 5200), 7500);
+  CHECK_EQ(f.mode, RANGE_FILTER_KALMAN);
+  CHECK_EQ(resets(), before + 2);
+
+  /* Quality ramps up over the warm up */
+  CHECK_EQ(range_filter_quality(&f), 100 / RANGE_FILTER_WINDOW);
+  range_filter_update(&f, RANGE_FILTER_KALMAN, 7500, 5300);
+  CHECK_EQ(range_filter_quality(&f), 2 * 100 / RANGE_FILTER_WINDOW);
+}
+
+/**
+ * @brief Run a sequence through a filter
+ *
+ * @return RMS error of the filtered ranges in mm, after the warm up
+ */
+static double run_sequence(const sequence_t *seq, int mode, int *missed, int *false_rejects)
+{
+  range_filter_t f;
+  double se = 0;
+  int n = 0;
+
+  memset(&f, 0, sizeof(f));
+  *missed = 0;
+  *false_rejects = 0;
+  for (int i = 0; i < SEQ_LEN; i++) {
+    int32_t out = range_filter_update(&f, mode, seq->range[i], i * SEQ_PERIOD_MS);
+
+    if (out == UWB_RANGE_NONE) {
+      *false_rejects += !seq->outlier[i];
+      continue;
+    }
+    *missed += seq->outlier[i];
+    if (i >= SEQ_WARMUP && !seq->outlier[i]) {
+      se += (double)(out - seq->truth[i]) * (out - seq->truth[i]);
+      n++;
+    }
+  }
+  return sqrt(se / n);
+}
+
+static double raw_rms(const sequence_t *seq)
+{
+  double se = 0;
+  int n = 0;
+
+  for (int i = SEQ_WARMUP; i < SEQ_LEN; i++) {
+    if (!seq->outlier[i]) {
+      se += (double)(seq->range[i] - seq->truth[i]) * (seq->range[i] - seq->truth[i]);
+      n++;
+    }
+  }
+  return sqrt(se / n);
+}
+
+static void test_sequences(void)
+{
+  static const char *const names[] = { "off", "median", "alpha-beta", "kalman" };
+
+  make_sequence(&m_static, 1, false);
+  make_sequence(&m_walk, 2, true);
+  printf("    RMS error in mm, static node %.1f raw, walking node %.1f raw\n", raw_rms(&m_static), raw_rms(&m_walk));
+
+  for (int mode = RANGE_FILTER_MEDIAN; mode < RANGE_FILTER_MODES; mode++) {
+    int missed_s, false_s, missed_w, false_w;
+    double rms_s = run_sequence(&m_static, mode, &missed_s, &false_s);
+    double rms_w = run_sequence(&m_walk, mode, &missed_w, &false_w);
+
+    printf("    %-10s static %5.1f (%d outliers passed)  walking %5.1f (%d outliers passed, %d good ranges rejected)\n",
+           names[mode], rms_s, missed_s, rms_w, missed_w, false_w);
+
+    /* Every multipath range is caught and the noise is reduced */
+    CHECK_EQ(missed_s, 0);
+    CHECK_EQ(missed_w, 0);
+    CHECK_EQ(false_s, 0);
+    CHECK(false_w <= SEQ_LEN / 100);
+    CHECK(rms_s < raw_rms(&m_static));
+    if (mode == RANGE_FILTER_MEDIAN) {
+      /* The median lags two ranges behind a moving node, up to 260 mm at 1.3 m/s */
+      CHECK(rms_w < 250);
+    }
+    else {
+      CHECK(rms_w < raw_rms(&m_walk));
+    }
+  }
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_off);
+  TEST_RUN(test_median);
+  TEST_RUN(test_outlier);
+  TEST_RUN(test_jump);
+  TEST_RUN(test_restart);
+  TEST_RUN(test_sequences);
+  return TEST_RESULT();
+}
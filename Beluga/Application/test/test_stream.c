@@ -0,0 +1,284 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_stream.c
+ *
+ *  @brief  Host test of the binary range stream
+ *
+ *          Checks the COBS encoder against the reference vectors, including
+ *          runs reaching the 0xFF block code, the SDK CRC16 against its check
+ *          value, and decodes the frames of stream.c with stream_decode.c.
+ *          stream.c is included to reach its static encoder.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "../src/stream.c"
+#include "stream_decode.h"
+#include "test.h"
+
+#define SINK_LEN  4096
+
+static uint8_t m_sink[SINK_LEN];
+static uint32_t m_sink_len;
+static uint32_t m_writes;
+
+
+bool uart_write(uart_channel_t ch, const uint8_t *data, uint32_t len)
+{
+  CHECK_EQ(ch, UART_CH_STREAM);
+  m_writes++;
+  if (m_sink_len + len > SINK_LEN) return false;
+  memcpy(&m_sink[m_sink_len], data, len);
+  m_sink_len += len;
+  return true;
+}
+
+static void sink_reset(void)
+{
+  m_sink_len = 0;
+  m_writes = 0;
+}
+
+/**
+ * @brief Encode, compare with the expected encoding and decode back
+ */
+static void check_cobs(const uint8_t *data, uint32_t len, const uint8_t *expected, uint32_t expected_len)
+{
+  uint8_t enc[300];
+  uint8_t dec[300];
+
+  uint32_t enc_len = cobs_encode(data, len, enc);
+  CHECK_EQ(enc_len, expected_len);
+  CHECK(memcmp(enc, expected, expected_len) == 0);
+  CHECK(memchr(enc, 0, enc_len - 1) == NULL);
+  CHECK(enc_len <= len + len / 254 + 2);
+
+  CHECK_EQ(stream_cobs_decode(enc, enc_len - 1, dec), len);
+  CHECK(memcmp(dec, data, len) == 0);
+}
+
+
+static void test_cobs_vectors(void)
+{
+  check_cobs((const uint8_t[]) { 0x00 }, 1, (const uint8_t[]) { 0x01, 0x01, 0x00 }, 3);
+  check_cobs((const uint8_t[]) { 0x00, 0x00 }, 2, (const uint8_t[]) { 0x01, 0x01, 0x01, 0x00 }, 4);
+  check_cobs((const uint8_t[]) { 0x00, 0x11, 0x00 }, 3, (const uint8_t[]) { 0x01, 0x02, 0x11, 0x01, 0x00 }, 5);
+  check_cobs((const uint8_t[]) { 0x11, 0x22, 0x00, 0x33 }, 4, (const uint8_t[]) { 0x03, 0x11, 0x22, 0x02, 0x33, 0x00 }, 6);
+  check_cobs((const uint8_t[]) { 0x11, 0x22, 0x33, 0x44 }, 4, (const uint8_t[]) { 0x05, 0x11, 0x22, 0x33, 0x44, 0x00 }, 6);
+  check_cobs((const uint8_t[]) { 0x11, 0x00, 0x00, 0x00 }, 4, (const uint8_t[]) { 0x02, 0x11, 0x01, 0x01, 0x01, 0x00 }, 6);
+}
+
+static void test_cobs_block_boundary(void)
+{
+  uint8_t data[256];
+  uint8_t expected[260];
+
+  /* 254 non-zero bytes fill one block exactly: FF 01..FE 00 */
+  for (int i = 0; i < 254; i++) data[i] = i + 1;
+  expected[0] = 0xFF;
+  memcpy(&expected[1], data, 254);
+  expected[255] = 0x00;
+  check_cobs(data, 254, expected, 256);
+
+  /* A leading zero: 01 FF 01..FE 00 */
+  data[0] = 0x00;
+  for (int i = 1; i < 255; i++) data[i] = i;
+  expected[0] = 0x01;
+  expected[1] = 0xFF;
+  memcpy(&expected[2], &data[1], 254);
+  expected[256] = 0x00;
+  check_cobs(data, 255, expected, 257);
+
+  /* 255 non-zero bytes overflow into a second block: FF 01..FE 02 FF 00 */
+  for (int i = 0; i < 255; i++) data[i] = i + 1;
+  expected[0] = 0xFF;
+  memcpy(&expected[1], data, 254);
+  expected[255] = 0x02;
+  expected[256] = 0xFF;
+  expected[257] = 0x00;
+  check_cobs(data, 255, expected, 258);
+
+  /* A full block followed by a zero: FF 02..FF 01 01 00 */
+  for (int i = 0; i < 254; i++) data[i] = i + 2;
+  data[254] = 0x00;
+  expected[0] = 0xFF;
+  memcpy(&expected[1], data, 254);
+  expected[255] = 0x01;
+  expected[256] = 0x01;
+  expected[257] = 0x00;
+  check_cobs(data, 255, expected, 258);
+
+  /* Zero then one byte after 253 non-zero bytes: FE 03..FF 02 01 00 */
+  for (int i = 0; i < 253; i++) data[i] = i + 3;
+  data[253] = 0x00;
+  data[254] = 0x01;
+  expected[0] = 0xFE;
+  memcpy(&expected[1], data, 253);
+  expected[254] = 0x02;
+  expected[255] = 0x01;
+  expected[256] = 0x00;
+  check_cobs(data, 255, expected, 257);
+}
+
+static void test_cobs_decode_errors(void)
+{
+  uint8_t dec[8];
+
+  CHECK_EQ(stream_cobs_decode((const uint8_t[]) { 0x03, 0x11 }, 2, dec), STREAM_ERR_COBS);
+  CHECK_EQ(stream_cobs_decode((const uint8_t[]) { 0x03, 0x11, 0x00 }, 3, dec), STREAM_ERR_COBS);
+  CHECK_EQ(stream_cobs_decode((const uint8_t[]) { 0x00 }, 1, dec), STREAM_ERR_COBS);
+  CHECK_EQ(stream_cobs_decode(dec, 0, dec), 0);
+}
+
+static void test_crc_vectors(void)
+{
+  /* CRC-16/CCITT-FALSE check value */
+  CHECK_EQ(crc16_compute((const uint8_t *) "123456789", 9, NULL), 0x29B1);
+  CHECK_EQ(crc16_compute(NULL, 0, NULL), 0xFFFF);
+
+  /* Chaining over two parts gives the CRC of the whole */
+  uint16_t part = crc16_compute((const uint8_t *) "1234", 4, NULL);
+  CHECK_EQ(crc16_compute((const uint8_t *) "56789", 5, &part), 0x29B1);
+}
+
+static void test_frame_layout(void)
+{
+  sink_reset();
+  stream_add_range(0x1234, 1.5f, -60, 0x01020304, -1);
+  stream_flush();
+
+  /* type, count, record, CRC, then COBS: no zero in the raw bytes before the CRC */
+  const uint8_t raw[] = { STREAM_TYPE_RANGE, 1, 0x34, 0x12, 0xDC, 0x05, 0x00, 0x00, 0xC4, 0x04, 0x03, 0x02, 0x01 };
+  uint16_t crc = crc16_compute(raw, sizeof(raw), NULL);
+  uint8_t dec[32];
+
+  CHECK_EQ(m_writes, 1);
+  CHECK_EQ(m_sink[m_sink_len - 1], 0);
+  CHECK_EQ(stream_cobs_decode(m_sink, m_sink_len - 1, dec), sizeof(raw) + 2);
+  CHECK(memcmp(dec, raw, sizeof(raw)) == 0);
+  CHECK_EQ(dec[sizeof(raw)], crc & 0xFF);
+  CHECK_EQ(dec[sizeof(raw) + 1], crc >> 8);
+
+  /* Nothing to send */
+  stream_flush();
+  CHECK_EQ(m_writes, 1);
+}
+
+static void test_round_trip(void)
+{
+  stream_record_t recs[STREAM_MAX_RECORDS];
+
+  sink_reset();
+  for (int i = 0; i < STREAM_MAX_RECORDS + 3; i++) {
+    stream_add_range(i + 1, -0.25f + i * 2.0005f, -40 - i, 1000 * i, -1);
+  }
+  /* A full batch is sent at once, the rest on the flush */
+  CHECK_EQ(m_writes, 1);
+  stream_flush();
+  CHECK_EQ(m_writes, 2);
+
+  uint8_t *frame = m_sink;
+  uint8_t *end = (uint8_t *) memchr(frame, 0, m_sink_len);
+  CHECK_EQ(stream_decode_frame(frame, end - frame, recs), STREAM_MAX_RECORDS);
+  for (int i = 0; i < STREAM_MAX_RECORDS; i++) {
+    CHECK_EQ(recs[i].id, i + 1);
+    CHECK_EQ(recs[i].range_mm, (int32_t) lroundf((-0.25f + i * 2.0005f) * 1000.0f));
+    CHECK_EQ(recs[i].rssi, -40 - i);
+    CHECK_EQ(recs[i].time_stamp, 1000 * i);
+    CHECK_EQ(recs[i].quality, -1);
+  }
+
+  frame = end + 1;
+  end = (uint8_t *) memchr(frame, 0, m_sink + m_sink_len - frame);
+  CHECK_EQ(stream_decode_frame(frame, end - frame, recs), 3);
+  CHECK_EQ(recs[2].id, STREAM_MAX_RECORDS + 3);
+  CHECK_EQ(end + 1, m_sink + m_sink_len);
+}
+
+static void test_quality_switch(void)
+{
+  stream_record_t recs[STREAM_MAX_RECORDS];
+
+  /* A record of the other type closes the batch */
+  sink_reset();
+  stream_add_range(1, 1.0f, -50, 10, -1);
+  stream_add_range(2, 2.0f, -51, 20, 87);
+  stream_add_range(3, 3.0f, -52, 30, 0);
+  CHECK_EQ(m_writes, 1);
+  stream_flush();
+  CHECK_EQ(m_writes, 2);
+
+  uint8_t *end = (uint8_t *) memchr(m_sink, 0, m_sink_len);
+  CHECK_EQ(stream_decode_frame(m_sink, end - m_sink, recs), 1);
+  CHECK_EQ(recs[0].quality, -1);
+
+  uint8_t *frame = end + 1;
+  end = (uint8_t *) memchr(frame, 0, m_sink + m_sink_len - frame);
+  CHECK_EQ(stream_decode_frame(frame, end - frame, recs), 2);
+  CHECK_EQ(recs[0].id, 2);
+  CHECK_EQ(recs[0].quality, 87);
+  CHECK_EQ(recs[1].quality, 0);
+  CHECK_EQ(recs[1].range_mm, 3000);
+}
+
+static void test_largest_frame(void)
+{
+  stream_record_t recs[STREAM_MAX_RECORDS];
+
+  /* No zero anywhere: the longest COBS blocks and the largest encoding */
+  sink_reset();
+  for (int i = 0; i < STREAM_MAX_RECORDS; i++) {
+    stream_add_range(0x0101 + i, 16843.009f, -1, 0x01010101, 100);
+  }
+  CHECK_EQ(m_writes, 1);
+  CHECK(m_sink_len <= STREAM_COBS_MAX);
+  CHECK_EQ(stream_decode_frame(m_sink, m_sink_len - 1, recs), STREAM_MAX_RECORDS);
+  CHECK_EQ(recs[STREAM_MAX_RECORDS - 1].range_mm, (int32_t)(16843.009f * 1000.0f + 0.5f));
+}
+
+static void test_corrupt_frames(void)
+{
+  stream_record_t recs[STREAM_MAX_RECORDS];
+  uint8_t frame[64];
+
+  sink_reset();
+  for (int i = 0; i < 4; i++) {
+    stream_add_range(100 + i, 1.0f + i, -70, 5000 + i, -1);
+  }
+  stream_flush();
+  uint32_t len = m_sink_len - 1;
+
+  /* Any single bit flip that keeps the COBS structure is caught by the CRC */
+  for (uint32_t i = 0; i < len; i++) {
+    for (int b = 0; b < 8; b++) {
+      memcpy(frame, m_sink, len);
+      frame[i] ^= 1 << b;
+      CHECK(stream_decode_frame(frame, len, recs) < 0);
+    }
+  }
+
+  /* A frame cut by a lost byte */
+  CHECK(stream_decode_frame(m_sink, len - 1, recs) < 0);
+  CHECK(stream_decode_frame(m_sink + 1, len - 1, recs) < 0);
+  CHECK_EQ(stream_decode_frame(m_sink, 0, recs), STREAM_ERR_FORMAT);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_cobs_vectors);
+  TEST_RUN(test_cobs_block_boundary);
+  TEST_RUN(test_cobs_decode_errors);
+  TEST_RUN(test_crc_vectors);
+  TEST_RUN(test_frame_layout);
+  TEST_RUN(test_round_trip);
+  TEST_RUN(test_quality_switch);
+  TEST_RUN(test_largest_frame);
+  TEST_RUN(test_corrupt_frames);
+  return TEST_RESULT();
+}
@@ -0,0 +1,532 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_uart.c
+ *
+ *  @brief  Host test of the UART TX rings and the RX line assembly
+ *
+ *          Checks queueing, drop accounting, wrap around, the DMA length
+ *          limit, round robin between producers and uart_flush() against
+ *          fake_uarte.c, then writes from several threads while another
+ *          thread ends the transfers like the ENDTX interrupt. On the RX side
+ *          checks idle line framing, lines across DMA buffers, overlong lines,
+ *          the line ring limit and the blocking reader.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "uart.h"
+#include "task.h"
+#include "fake_rtos.h"
+#include "fake_uarte.h"
+#include "test.h"
+
+#define RING_SIZE        1024   /* UART_CONSOLE_BUF_SIZE and UART_STREAM_BUF_SIZE */
+#define DMA_MAX          255
+
+#define RX_CHUNK         64     /* UART_RX_CHUNK */
+#define RX_LINES         4      /* UART_RX_LINES, one slot is being assembled */
+
+#define STRESS_WRITES    200000
+#define STRESS_MSG_LEN   13
+#define STRESS_CONSOLES  2
+
+static uint8_t m_data[4 * RING_SIZE];
+
+
+/**
+ * @brief End transfers until the transmitter is idle
+ *
+ * @return number of transfers
+ */
+static int drain(void)
+{
+  int n = 0;
+
+  while (fake_uarte_tx_end() > 0) n++;
+  return n;
+}
+
+/**
+ * @brief uart.c has no reset, start each case with both rings empty
+ */
+static void setup(void)
+{
+  drain();
+  fake_uarte_wire_clear();
+  fake_rtos_reset();
+  fake_rtos_set_block_hook(NULL);
+}
+
+static void check_stats(uart_channel_t ch, uint32_t queued, uint32_t dropped, uint32_t pending)
+{
+  uart_stats_t stats;
+
+  uart_get_stats(ch, &stats);
+  CHECK_EQ(stats.queued, queued);
+  CHECK_EQ(stats.dropped, dropped);
+  CHECK_EQ(stats.pending, pending);
+}
+
+
+static void test_write_sends(void)
+{
+  uart_stats_t before;
+  uint32_t len;
+
+  setup();
+  uart_get_stats(UART_CH_STREAM, &before);
+
+  /* The first write starts the DMA at once */
+  CHECK(uart_write(UART_CH_STREAM, m_data, 100));
+  CHECK(fake_uarte_tx_busy());
+  check_stats(UART_CH_STREAM, before.queued + 100, before.dropped, 100);
+
+  /* Bytes written meanwhile wait for ENDTX */
+  CHECK(uart_write(UART_CH_STREAM, m_data + 100, 50));
+  CHECK_EQ(fake_uarte_tx_end(), 100);
+  CHECK_EQ(fake_uarte_tx_end(), 50);
+  CHECK(!fake_uarte_tx_busy());
+
+  const uint8_t *wire = fake_uarte_wire(&len);
+  CHECK_EQ(len, 150);
+  CHECK(memcmp(wire, m_data, 150) == 0);
+  check_stats(UART_CH_STREAM, before.queued + 150, before.dropped, 0);
+
+  /* Nothing to send */
+  CHECK(uart_write(UART_CH_STREAM, m_data, 0));
+  CHECK(!fake_uarte_tx_busy());
+}
+
+static void test_full_ring_drops(void)
+{
+  uart_stats_t before;
+
+  setup();
+  uart_get_stats(UART_CH_STREAM, &before);
+
+  /* The transfer in flight still holds its bytes in the ring */
+  CHECK(uart_write(UART_CH_STREAM, m_data, 1000));
+  CHECK(!uart_write(UART_CH_STREAM, m_data, 25));
+  CHECK(uart_write(UART_CH_STREAM, m_data, 24));
+  CHECK(!uart_write(UART_CH_STREAM, m_data, 1));
+  check_stats(UART_CH_STREAM, before.queued + 1024, before.dropped + 26, RING_SIZE);
+
+  /* A drop on one channel leaves the other alone */
+  CHECK(uart_write(UART_CH_CONSOLE, m_data, 10));
+
+  /* Space comes back as transfers end */
+  CHECK_EQ(fake_uarte_tx_end(), DMA_MAX);
+  CHECK(uart_write(UART_CH_STREAM, m_data, DMA_MAX));
+  CHECK(!uart_write(UART_CH_STREAM, m_data, 1));
+  check_stats(UART_CH_STREAM, before.queued + 1024 + DMA_MAX, before.dropped + 27, RING_SIZE);
+  drain();
+}
+
+static void test_dma_chunks(void)
+{
+  fake_uarte_stats_t stats;
+  uint32_t len;
+
+  setup();
+  for (int i = 0; i < (int) sizeof(m_data); i++) m_data[i] = i * 7 + 3;
+
+  /* Move the ring index close to the end so the next write wraps */
+  uart_stats_t before;
+  uart_get_stats(UART_CH_STREAM, &before);
+  uint32_t offset = before.queued % RING_SIZE;
+  uint32_t fill = (RING_SIZE - offset + RING_SIZE - 100) % RING_SIZE;
+  while (fill > 0) {
+    uint32_t n = fill > 500 ? 500 : fill;
+    CHECK(uart_write(UART_CH_STREAM, m_data, n));
+    drain();
+    fill -= n;
+  }
+  fake_uarte_wire_clear();
+
+  /* 900 bytes, 100 up to the end of the ring: 100, then 255, 255, 255, 35 */
+  CHECK(uart_write(UART_CH_STREAM, m_data, 900));
+  CHECK_EQ(fake_uarte_tx_end(), 100);
+  CHECK_EQ(fake_uarte_tx_end(), DMA_MAX);
+  CHECK_EQ(fake_uarte_tx_end(), DMA_MAX);
+  CHECK_EQ(fake_uarte_tx_end(), DMA_MAX);
+  CHECK_EQ(fake_uarte_tx_end(), 35);
+  CHECK_EQ(fake_uarte_tx_end(), 0);
+
+  const uint8_t *wire = fake_uarte_wire(&len);
+  CHECK_EQ(len, 900);
+  CHECK(memcmp(wire, m_data, 900) == 0);
+
+  fake_uarte_stats(&stats);
+  CHECK(stats.tx_max_len <= DMA_MAX);
+  CHECK_EQ(stats.tx_overlaps, 0);
+}
+
+static void test_round_robin(void)
+{
+  uint32_t len;
+
+  setup();
+
+  /* While the console transfer is in flight both rings fill up */
+  CHECK(uart_write(UART_CH_CONSOLE, (const uint8_t *) "c0", 2));
+  CHECK(uart_write(UART_CH_CONSOLE, (const uint8_t *) "c1", 2));
+  CHECK(uart_write(UART_CH_STREAM, (const uint8_t *) "s0", 2));
+  CHECK_EQ(fake_uarte_tx_end(), 2);
+
+  /* The stream is served next, then the console again */
+  CHECK(uart_write(UART_CH_STREAM, (const uint8_t *) "s1", 2));
+  CHECK_EQ(fake_uarte_tx_end(), 2);
+  CHECK(uart_write(UART_CH_STREAM, (const uint8_t *) "s2", 2));
+  drain();
+
+  const uint8_t *wire = fake_uarte_wire(&len);
+  CHECK_EQ(len, 10);
+  CHECK(memcmp(wire, "c0s0c1s1s2", 10) == 0);
+}
+
+/**
+ * @brief Block hook ending one transfer per tick
+ */
+static void end_one(TickType_t until)
+{
+  (void) fake_uarte_tx_end();
+}
+
+static void test_flush(void)
+{
+  fake_uarte_stats_t before, after;
+
+  setup();
+  CHECK(uart_flush(10));
+
+  /* One tick per transfer */
+  fake_uarte_stats(&before);
+  CHECK(uart_write(UART_CH_STREAM, m_data, 3 * DMA_MAX + 1));
+  fake_rtos_set_block_hook(end_one);
+  CHECK(uart_flush(10));
+  fake_uarte_stats(&after);
+  CHECK(after.tx_starts - before.tx_starts >= 4);
+  CHECK_EQ(fake_rtos_blocks(), after.tx_starts - before.tx_starts);
+  CHECK(!fake_uarte_tx_busy());
+
+  /* A stuck transmitter times out */
+  CHECK(uart_write(UART_CH_CONSOLE, m_data, 10));
+  fake_rtos_set_block_hook(NULL);
+  TickType_t start = xTaskGetTickCount();
+  CHECK(!uart_flush(10));
+  CHECK_EQ(xTaskGetTickCount() - start, 10);
+  drain();
+}
+
+static void test_baudrate(void)
+{
+  setup();
+  CHECK(uart_set_baudrate(1000000));
+  CHECK_EQ(fake_uarte_baudrate(), NRF_UARTE_BAUDRATE_1000000);
+  /* Three characters of 10 bits at 1 MHz */
+  CHECK_EQ(NRF_TIMER2->CC[0], 31);
+
+  CHECK(!uart_set_baudrate(12345));
+  CHECK_EQ(fake_uarte_baudrate(), NRF_UARTE_BAUDRATE_1000000);
+
+  CHECK(uart_set_baudrate(9600));
+  CHECK_EQ(fake_uarte_baudrate(), NRF_UARTE_BAUDRATE_9600);
+  CHECK_EQ(NRF_TIMER2->CC[0], 3126);
+
+  CHECK(uart_set_baudrate(115200));
+  CHECK_EQ(fake_uarte_baudrate(), NRF_UARTE_BAUDRATE_115200);
+}
+
+
+/**
+ * @brief Receive a string followed by an idle line
+ */
+static void rx_send(const char *text)
+{
+  fake_uarte_receive((const uint8_t *) text, strlen(text), true);
+}
+
+static void check_line(const char *expected)
+{
+  char line[UART_LINE_LEN];
+
+  CHECK(uart_read_line(line, sizeof(line), 0));
+  CHECK(strcmp(line, expected) == 0);
+}
+
+static void test_rx_idle_line(void)
+{
+  fake_uarte_stats_t before, after;
+  char line[UART_LINE_LEN];
+
+  setup();
+  CHECK(!uart_read_line(line, sizeof(line), 0));
+
+  /* A command costs the interrupts of the idle stop, not one per byte */
+  fake_uarte_stats(&before);
+  rx_send("AT+RATE 100\r\n");
+  fake_uarte_stats(&after);
+  CHECK(after.irqs - before.irqs <= 2);
+  check_line("AT+RATE 100");
+  CHECK(!uart_read_line(line, sizeof(line), 0));
+
+  /* A line without terminator waits for the rest */
+  rx_send("AT+ID");
+  CHECK(!uart_read_line(line, sizeof(line), 0));
+  rx_send(" 7\n");
+  check_line("AT+ID 7");
+
+  /* CR LF, LF CR and empty lines end one line each */
+  rx_send("AT\r\n\r\n\nAT+STOPBLE\n\r");
+  check_line("AT");
+  check_line("AT+STOPBLE");
+  CHECK(!uart_read_line(line, sizeof(line), 0));
+  CHECK_EQ(after.rx_lost, 0);
+}
+
+static void test_rx_across_buffers(void)
+{
+  char text[4 * RX_CHUNK];
+  char expected[8][24];
+  fake_uarte_stats_t stats;
+
+  setup();
+
+  /* A burst longer than one DMA buffer, the last line crosses into the other one */
+  text[0] = '\0';
+  for (int i = 0; i < RX_LINES - 1; i++) {
+    snprintf(expected[i], sizeof(expected[i]), "AT+PRIORITY %d", 1000 + i);
+    strcat(text, expected[i]);
+    strcat(text, "\r\n");
+  }
+  strcat(text, "AT+BAUD 115200\r\n");
+  CHECK(strlen(text) > RX_CHUNK);
+
+  /* Not split by an idle line, the receiver runs on */
+  fake_uarte_receive((const uint8_t *) text, RX_CHUNK, false);
+  for (int i = 0; i < RX_LINES - 1; i++) {
+    check_line(expected[i]);
+  }
+  rx_send(text + RX_CHUNK);
+  check_line("AT+BAUD 115200");
+
+  /* A buffer filled exactly, then an idle stop with nothing new */
+  memset(text, 'A', RX_CHUNK - 1);
+  text[RX_CHUNK - 1] = '\n';
+  text[RX_CHUNK] = '\0';
+  rx_send(text);
+  text[UART_LINE_LEN - 1] = '\0';
+  check_line(text);
+  rx_send("AT\n");
+  check_line("AT");
+
+  fake_uarte_stats(&stats);
+  CHECK_EQ(stats.rx_lost, 0);
+}
+
+static void test_rx_long_line(void)
+{
+  char text[3 * UART_LINE_LEN];
+  char line[UART_LINE_LEN];
+
+  setup();
+
+  /* Cut at UART_LINE_LEN - 1 characters, the rest makes a line of its own */
+  for (int i = 0; i < UART_LINE_LEN + 9; i++) text[i] = 'a' + i % 26;
+  text[UART_LINE_LEN + 9] = '\n';
+  text[UART_LINE_LEN + 10] = '\0';
+  rx_send(text);
+
+  CHECK(uart_read_line(line, sizeof(line), 0));
+  CHECK_EQ(strlen(line), UART_LINE_LEN - 1);
+  CHECK(strncmp(line, text, UART_LINE_LEN - 1) == 0);
+  CHECK(uart_read_line(line, sizeof(line), 0));
+  CHECK(strncmp(line, text + UART_LINE_LEN - 1, 10) == 0);
+
+  /* A reader with a short buffer gets the line truncated */
+  rx_send("AT+CHANNEL 5\n");
+  CHECK(uart_read_line(line, 6, 0));
+  CHECK(strcmp(line, "AT+CH") == 0);
+}
+
+static void test_rx_ring_full(void)
+{
+  char line[UART_LINE_LEN];
+  uint32_t dropped = uart_rx_dropped();
+
+  setup();
+
+  /* Lines beyond the ring are dropped and counted, the ones held stay intact */
+  rx_send("AT+A\nAT+B\nAT+C\nAT+D\nAT+E\n");
+  CHECK_EQ(uart_rx_dropped() - dropped, 5 - (RX_LINES - 1));
+  check_line("AT+A");
+  check_line("AT+B");
+  check_line("AT+C");
+  CHECK(!uart_read_line(line, sizeof(line), 0));
+
+  rx_send("AT+F\n");
+  check_line("AT+F");
+}
+
+/**
+ * @brief Block hook of the reader: a command arrives 3 ticks after it blocks
+ */
+static void rx_arrives(TickType_t until)
+{
+  CHECK(until > xTaskGetTickCount() + 3);
+  fake_rtos_set_tick(xTaskGetTickCount() + 3);
+  rx_send("AT+STARTUWB\r\n");
+}
+
+static void test_rx_reader_blocks(void)
+{
+  char line[UART_LINE_LEN];
+
+  setup();
+
+  /* Woken by the notification of the interrupt, not by a poll */
+  fake_rtos_set_block_hook(rx_arrives);
+  CHECK(uart_read_line(line, sizeof(line), 100));
+  CHECK(strcmp(line, "AT+STARTUWB") == 0);
+  CHECK_EQ(xTaskGetTickCount(), 3);
+  CHECK_EQ(fake_rtos_blocks(), 1);
+
+  /* Nothing arrives, the reader times out */
+  fake_rtos_set_block_hook(NULL);
+  CHECK(!uart_read_line(line, sizeof(line), 50));
+  CHECK_EQ(xTaskGetTickCount(), 53);
+}
+
+
+static volatile bool m_stress_done;
+static uint32_t m_attempted[UART_CH_COUNT];
+
+/**
+ * @brief Producer writing messages of one repeated byte
+ *
+ * Bit 7 tells the channel, console threads also differ in bit 6, the low
+ * bits count the messages of the thread. Yielding now and then lets the
+ * other threads preempt the writes at varying points.
+ */
+static void *stress_producer(void *arg)
+{
+  int id = (int)(intptr_t) arg;
+  uart_channel_t ch = (id == 0) ? UART_CH_STREAM : UART_CH_CONSOLE;
+  uint8_t msg[STRESS_MSG_LEN];
+
+  for (int i = 0; i < STRESS_WRITES; i++) {
+    uint8_t tag = (ch == UART_CH_CONSOLE ? 0x80 : 0x00) | ((id == 2) ? 0x40 : 0x00) | (i & 0x3F);
+    memset(msg, tag, sizeof(msg));
+    (void) uart_write(ch, msg, sizeof(msg));
+    if (i % 16 == 0) sched_yield();
+  }
+  __sync_fetch_and_add(&m_attempted[ch], STRESS_WRITES * STRESS_MSG_LEN);
+  return NULL;
+}
+
+/**
+ * @brief The ENDTX interrupt, one transfer per turn so the console ring overflows at times
+ */
+static void *stress_dma(void *arg)
+{
+  while (!m_stress_done) {
+    (void) fake_uarte_tx_end();
+    sched_yield();
+  }
+  return NULL;
+}
+
+static void test_threads(void)
+{
+  pthread_t producers[1 + STRESS_CONSOLES];
+  pthread_t dma;
+  uart_stats_t before[UART_CH_COUNT], after;
+  fake_uarte_stats_t stats;
+  uint32_t len;
+
+  setup();
+  for (int ch = 0; ch < UART_CH_COUNT; ch++) {
+    uart_get_stats(ch, &before[ch]);
+  }
+  fake_uarte_stats(&stats);
+  uint32_t overlaps = stats.tx_overlaps;
+
+  m_stress_done = false;
+  pthread_create(&dma, NULL, stress_dma, NULL);
+  for (int i = 0; i <= STRESS_CONSOLES; i++) {
+    pthread_create(&producers[i], NULL, stress_producer, (void *)(intptr_t) i);
+  }
+  for (int i = 0; i <= STRESS_CONSOLES; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  m_stress_done = true;
+  pthread_join(dma, NULL);
+  drain();
+
+  /* Every byte is either sent once or counted as dropped */
+  const uint8_t *wire = fake_uarte_wire(&len);
+  uint32_t sent[UART_CH_COUNT] = { 0 };
+  for (int ch = 0; ch < UART_CH_COUNT; ch++) {
+    uart_get_stats(ch, &after);
+    sent[ch] = after.queued - before[ch].queued;
+    CHECK_EQ(after.pending, 0);
+    CHECK_EQ(sent[ch] + after.dropped - before[ch].dropped, m_attempted[ch]);
+  }
+  CHECK_EQ(len, sent[UART_CH_CONSOLE] + sent[UART_CH_STREAM]);
+
+  /* Messages of each producer arrive whole, never interleaved with other bytes */
+  uint32_t run[4] = { 0 };
+  int last[4] = { -1, -1, -1, -1 };
+  uint32_t msgs = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    int p = wire[i] >> 6;
+    if (run[p] == 0) {
+      last[p] = wire[i];
+      msgs++;
+    }
+    else {
+      CHECK_EQ(wire[i], last[p]);
+    }
+    run[p] = (run[p] + 1) % STRESS_MSG_LEN;
+    if (test_failures > 10) return;
+  }
+  for (int p = 0; p < 4; p++) {
+    CHECK_EQ(run[p], 0);
+  }
+  CHECK_EQ(last[1], -1);
+
+  fake_uarte_stats(&stats);
+  CHECK_EQ(stats.tx_overlaps, overlaps);
+  printf("    %u messages sent, %u bytes dropped, %u transfers\n", msgs,
+         m_attempted[UART_CH_CONSOLE] + m_attempted[UART_CH_STREAM] - len, stats.tx_starts);
+}
+
+
+int main(void)
+{
+  for (int i = 0; i < (int) sizeof(m_data); i++) m_data[i] = i;
+
+  fake_uarte_reset();
+  fake_rtos_reset();
+  uart_init();
+
+  TEST_RUN(test_write_sends);
+  TEST_RUN(test_full_ring_drops);
+  TEST_RUN(test_dma_chunks);
+  TEST_RUN(test_round_robin);
+  TEST_RUN(test_flush);
+  TEST_RUN(test_baudrate);
+  TEST_RUN(test_threads);
+  TEST_RUN(test_rx_idle_line);
+  TEST_RUN(test_rx_across_buffers);
+  TEST_RUN(test_rx_long_line);
+  TEST_RUN(test_rx_ring_full);
+  TEST_RUN(test_rx_reader_blocks);
+  return TEST_RESULT();
+}
@@ -0,0 +1,356 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_uwb_irq.c
+ *
+ *  @brief  Host test of the interrupt driven ranging against a scripted DW1000
+ *
+ *          uwb_irq.c, the DS-TWR initiator and responder and the Decawave
+ *          driver run unmodified on top of fake_dw1000.c and fake_rtos.c. The
+ *          SPI transactions of a full exchange are counted and must not depend
+ *          on how long the radio takes, which is what polling SYS_STATUS did.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "port_platform.h"
+#include "init_main.h"
+#include "resp_main.h"
+#include "uwb_irq.h"
+#include "uwb_frame.h"
+#include "uwb_range.h"
+#include "fake_rtos.h"
+#include "fake_dw1000.h"
+#include "test.h"
+
+#define INIT_ID   1
+#define RESP_ID   2
+#define TOF_DTU   1000                  /**< True time of flight of the scripted exchanges */
+#define REPLY_DTU (1500ULL * 65536)     /**< Responder reply delay */
+
+/* Offsets of the prebuilt frames in the TX buffer, see NOTE 8 of init_main.c */
+#define FINAL_TX_BUF_OFFSET 128
+#define RESP_TX_BUF_OFFSET  128
+
+SemaphoreHandle_t rxSemaphore, txSemaphore, sus_resp, sus_init;
+int debug_print = 0;
+uint16_t NODE_UUID = INIT_ID;
+
+static int m_beacons = 0;
+
+void tdma_beacon_rx(const uint8_t *frame, uint32_t len)
+{
+  m_beacons++;
+}
+
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++) {
+    p[i] = (uint8_t) (v >> (8 * i));
+  }
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * @brief Build a ranging frame with CRC room, return its length
+ */
+static uint16_t frame(uint8_t *buf, uint8_t func, uint16_t src, uint16_t dst, uint16_t len)
+{
+  memset(buf, 0, len);
+  buf[FRAME_FCTRL_IDX] = 0x41;
+  buf[FRAME_FCTRL_IDX + 1] = 0x88;
+  buf[FRAME_PAN_IDX] = UWB_PAN_ID & 0xFF;
+  buf[FRAME_PAN_IDX + 1] = UWB_PAN_ID >> 8;
+  buf[FRAME_DST_IDX] = dst & 0xFF;
+  buf[FRAME_DST_IDX + 1] = dst >> 8;
+  buf[FRAME_SRC_IDX] = src & 0xFF;
+  buf[FRAME_SRC_IDX + 1] = src >> 8;
+  buf[FRAME_FUNC_IDX] = func;
+  return len;
+}
+
+/**
+ * @brief Fresh radio, kernel and interrupt state for node id
+ */
+static void setup(uint16_t id)
+{
+  fake_rtos_reset();
+  fake_dw_reset();
+
+  sus_resp = xSemaphoreCreateBinary();
+  sus_init = xSemaphoreCreateBinary();
+  NODE_UUID = id;
+  uwb_frame_set_address(id);
+
+  uwb_irq_init();
+  uwb_rx_continuous(false);
+  uwb_clear_events();
+  fake_dw_stats_clear();
+}
+
+
+static void test_tx_done(void)
+{
+  setup(INIT_ID);
+  fake_dw_event(2, SYS_STATUS_TXFRS, NULL, 0, 0);
+
+  CHECK_EQ(uwb_wait_event(UWB_EVT_TX_DONE, 10), UWB_EVT_TX_DONE);
+  CHECK_EQ(xTaskGetTickCount(), 2);
+  CHECK(!fake_dw_irq());
+  CHECK_EQ(fake_dw_status() & SYS_STATUS_ALL_TX, 0);
+}
+
+static void test_timeout(void)
+{
+  setup(INIT_ID);
+
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 10), 0);
+  CHECK_EQ(xTaskGetTickCount(), 10);
+  CHECK_EQ(fake_rtos_blocks(), 1);
+  CHECK_EQ(fake_dw_stats()->xfers, 0);
+}
+
+static void test_rx_ok(void)
+{
+  uint8_t buf[12];
+
+  setup(RESP_ID);
+  fake_dw_event(1, SYS_STATUS_RXFCG, buf, frame(buf, FRAME_FUNC_POLL, INIT_ID, RESP_ID, sizeof(buf)), 0);
+
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 10), UWB_EVT_RX_OK);
+  CHECK_EQ(uwb_rx_length(), sizeof(buf));
+  CHECK(!fake_dw_irq());
+}
+
+static void test_rx_timeout_and_error(void)
+{
+  setup(RESP_ID);
+  fake_dw_event(1, SYS_STATUS_RXPTO, NULL, 0, 0);
+  fake_dw_event(1, SYS_STATUS_RXFCE, NULL, 0, 0);
+
+  /* The preamble timeout is not cleared by dwt_isr(), rx_to_cb() has to release the line */
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 10), UWB_EVT_RX_TO);
+  CHECK(!fake_dw_irq());
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 10), UWB_EVT_RX_ERR);
+  CHECK(!fake_dw_irq());
+}
+
+static void test_cancel(void)
+{
+  setup(RESP_ID);
+
+  uwb_cancel_wait(xTaskGetCurrentTaskHandle());
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 1000), UWB_EVT_CANCEL);
+  CHECK_EQ(xTaskGetTickCount(), 0);
+}
+
+static void test_unmasked_events_kept(void)
+{
+  uint8_t buf[12];
+
+  setup(INIT_ID);
+  fake_dw_event(1, SYS_STATUS_TXFRS, NULL, 0, 0);
+  fake_dw_event(1, SYS_STATUS_RXFCG, buf, frame(buf, FRAME_FUNC_RESP, RESP_ID, INIT_ID, sizeof(buf)), 0);
+
+  /* TX done arrives while waiting for RX, and is still reported afterwards */
+  CHECK_EQ(uwb_wait_event(UWB_EVT_RX_ANY, 10), UWB_EVT_RX_OK);
+  CHECK_EQ(uwb_wait_event(UWB_EVT_TX_DONE, 0), UWB_EVT_TX_DONE);
+}
+
+static void test_rx_continuous_queue(void)
+{
+  uint8_t buf[16], out[UWB_RX_FRAME_MAX], ts[5];
+
+  setup(RESP_ID);
+  uwb_rx_continuous(true);
+  uwb_rx_listen();
+  CHECK_EQ(fake_dw_stats()->rx_enables, 1);
+
+  for (int i = 0; i < UWB_RX_QUEUE_LEN; i++) {
+    frame(buf, FRAME_FUNC_POLL, 10 + i, RESP_ID, sizeof(buf));
+    fake_dw_event(1, SYS_STATUS_RXFCG, buf, sizeof(buf), 1000 + i);
+  }
+  for (int i = 0; i < UWB_RX_QUEUE_LEN; i++) {
+    CHECK_EQ(uwb_wait_event(UWB_EVT_RX_OK, 10), UWB_EVT_RX_OK);
+  }
+
+  /* The receiver keeps listening, the last frame did not fit in the queue */
+  uwb_rx_listen();
+  CHECK_EQ(fake_dw_stats()->rx_enables, 1);
+  for (int i = 0; i < UWB_RX_QUEUE_LEN - 1; i++) {
+    CHECK_EQ(uwb_rx_wait(0), UWB_EVT_RX_OK);
+    CHECK_EQ(uwb_rx_pop(out, sizeof(out), ts), sizeof(buf));
+    CHECK_EQ(uwb_frame_src(out), 10 + i);
+    CHECK_EQ(ts[0] | (ts[1] << 8), 1000 + i);
+  }
+  CHECK_EQ(uwb_rx_pop(out, sizeof(out), ts), 0);
+  CHECK_EQ(uwb_rx_wait(5), 0);
+
+  uwb_rx_continuous(false);
+}
+
+/**
+ * @brief Script the DW1000 side of a DS-TWR initiator exchange with gap ticks between events
+ *
+ * @return time of flight reported by the scripted responder
+ */
+static uint32_t script_initiator(TickType_t gap, uint64_t *poll_tx, uint64_t *resp_rx)
+{
+  uint8_t resp[20], report[16];
+
+  *poll_tx = 0x1000000000ULL;
+  *resp_rx = *poll_tx + 2 * TOF_DTU + REPLY_DTU;
+
+  frame(resp, FRAME_FUNC_RESP, RESP_ID, INIT_ID, sizeof(resp));
+  frame(report, FRAME_FUNC_REPORT, RESP_ID, INIT_ID, sizeof(report));
+  put32(&report[10], TOF_DTU);
+
+  fake_dw_event(gap, SYS_STATUS_TXFRS, NULL, 0, *poll_tx);
+  fake_dw_event(gap, SYS_STATUS_RXFCG, resp, sizeof(resp), *resp_rx);
+  fake_dw_event(gap, SYS_STATUS_TXFRS, NULL, 0, 0);
+  fake_dw_event(gap, SYS_STATUS_RXFCG, report, sizeof(report), 0);
+  return TOF_DTU;
+}
+
+static void test_ds_initiator(void)
+{
+  uint64_t poll_tx, resp_rx;
+  fake_dw_stats_t fast, slow;
+
+  setup(INIT_ID);
+  uint32_t tof = script_initiator(0, &poll_tx, &resp_rx);
+  CHECK_EQ(ds_init_run(RESP_ID), uwb_range_mm(tof));
+  CHECK_EQ(fake_dw_pending(), 0);
+  fast = *fake_dw_stats();
+
+  /* The final carries the poll TX, response RX and programmed final TX times */
+  const uint8_t *final = fake_dw_reg(TX_BUFFER_ID, FINAL_TX_BUF_OFFSET);
+  CHECK_EQ(final[FRAME_FUNC_IDX], FRAME_FUNC_FINAL);
+  CHECK_EQ(uwb_frame_src(final), INIT_ID);
+  CHECK_EQ(get32(&final[10]), (uint32_t) poll_tx);
+  CHECK_EQ(get32(&final[14]), (uint32_t) resp_rx);
+  uint32_t dly = (uint32_t) ((resp_rx + 2000ULL * 65536) >> 8);
+  CHECK_EQ(get32(&final[18]), (uint32_t) (((uint64_t) (dly & 0xFFFFFFFEUL) << 8) + TX_ANT_DLY));
+  CHECK_EQ(fast.tx_starts, 2);
+
+  /* A slower radio costs no SPI traffic, the task only sleeps longer */
+  setup(INIT_ID);
+  script_initiator(3, &poll_tx, &resp_rx);
+  CHECK_EQ(ds_init_run(RESP_ID), uwb_range_mm(tof));
+  slow = *fake_dw_stats();
+  CHECK_EQ(slow.xfers, fast.xfers);
+  CHECK_EQ(slow.status_reads, fast.status_reads);
+  CHECK_EQ(xTaskGetTickCount(), 12);
+
+  printf("    DS initiator exchange: %u SPI transactions, %u bytes, %u SYS_STATUS reads, %u blocks\n",
+         (unsigned) fast.xfers, (unsigned) fast.bytes, (unsigned) fast.status_reads, (unsigned) fake_rtos_blocks());
+}
+
+static void test_ds_initiator_failures(void)
+{
+  uint8_t resp[20];
+
+  /* No response at all: bounded by the safety timeout, the radio is reset */
+  setup(INIT_ID);
+  fake_dw_event(0, SYS_STATUS_TXFRS, NULL, 0, 0);
+  CHECK_EQ(ds_init_run(RESP_ID), UWB_RANGE_NONE);
+  CHECK_EQ(xTaskGetTickCount(), 10);
+  CHECK_EQ(fake_dw_stats()->trx_offs, 1);
+
+  /* Frame wait timeout of the DW1000 ends the exchange at once */
+  setup(INIT_ID);
+  fake_dw_event(0, SYS_STATUS_TXFRS, NULL, 0, 0);
+  fake_dw_event(1, SYS_STATUS_RXRFTO, NULL, 0, 0);
+  CHECK_EQ(ds_init_run(RESP_ID), UWB_RANGE_NONE);
+  CHECK_EQ(xTaskGetTickCount(), 1);
+
+  /* Response of another node is not answered */
+  setup(INIT_ID);
+  fake_dw_event(0, SYS_STATUS_TXFRS, NULL, 0, 0);
+  fake_dw_event(0, SYS_STATUS_RXFCG, resp, frame(resp, FRAME_FUNC_RESP, RESP_ID + 1, INIT_ID, sizeof(resp)), 0);
+  CHECK_EQ(ds_init_run(RESP_ID), UWB_RANGE_NONE);
+  CHECK_EQ(fake_dw_stats()->tx_starts, 1);
+}
+
+static void test_ds_responder(void)
+{
+  uint8_t poll[12], final[24];
+  uint64_t poll_tx = 0x2000000000ULL;
+  uint64_t poll_rx = poll_tx + TOF_DTU;
+  uint64_t resp_tx = poll_rx + REPLY_DTU;
+  uint64_t resp_rx = resp_tx + TOF_DTU;
+  uint64_t final_tx = resp_rx + 2 * REPLY_DTU;
+  uint64_t final_rx = final_tx + TOF_DTU;
+
+  setup(RESP_ID);
+  xSemaphoreGive(sus_resp);
+
+  frame(poll, FRAME_FUNC_POLL, INIT_ID, RESP_ID, sizeof(poll));
+  frame(final, FRAME_FUNC_FINAL, INIT_ID, RESP_ID, sizeof(final));
+  put32(&final[10], (uint32_t) poll_tx);
+  put32(&final[14], (uint32_t) resp_rx);
+  put32(&final[18], (uint32_t) final_tx);
+
+  fake_dw_event(5, SYS_STATUS_RXFCG, poll, sizeof(poll), poll_rx);
+  fake_dw_event(1, SYS_STATUS_TXFRS, NULL, 0, resp_tx);
+  fake_dw_event(1, SYS_STATUS_RXFCG, final, sizeof(final), final_rx);
+  fake_dw_event(1, SYS_STATUS_TXFRS, NULL, 0, 0);
+
+  CHECK_EQ(ds_resp_run(), 1);
+  CHECK_EQ(fake_dw_pending(), 0);
+
+  const uint8_t *resp = fake_dw_reg(TX_BUFFER_ID, RESP_TX_BUF_OFFSET);
+  CHECK_EQ(resp[FRAME_FUNC_IDX], FRAME_FUNC_RESP);
+  CHECK_EQ(resp[FRAME_DST_IDX], INIT_ID);
+  CHECK_EQ(uwb_frame_src(resp), RESP_ID);
+
+  const uint8_t *report = fake_dw_reg(TX_BUFFER_ID, 0);
+  CHECK_EQ(report[FRAME_FUNC_IDX], FRAME_FUNC_REPORT);
+  CHECK_EQ(get32(&report[10]), TOF_DTU);
+
+  const fake_dw_stats_t *st = fake_dw_stats();
+  CHECK_EQ(st->tx_starts, 2);
+  printf("    DS responder exchange: %u SPI transactions, %u bytes, %u SYS_STATUS reads\n",
+         (unsigned) st->xfers, (unsigned) st->bytes, (unsigned) st->status_reads);
+}
+
+static void test_responder_suspended(void)
+{
+  setup(RESP_ID);
+
+  /* Suspended: returns without touching the radio */
+  CHECK_EQ(ds_resp_run(), 1);
+  CHECK_EQ(fake_dw_stats()->xfers, 0);
+
+  /* No poll: the task sleeps for the whole listen window */
+  xSemaphoreGive(sus_resp);
+  CHECK_EQ(ds_resp_run(), 1);
+  CHECK_EQ(fake_rtos_blocks(), 1);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_tx_done);
+  TEST_RUN(test_timeout);
+  TEST_RUN(test_rx_ok);
+  TEST_RUN(test_rx_timeout_and_error);
+  TEST_RUN(test_cancel);
+  TEST_RUN(test_unmasked_events_kept);
+  TEST_RUN(test_rx_continuous_queue);
+  TEST_RUN(test_ds_initiator);
+  TEST_RUN(test_ds_initiator_failures);
+  TEST_RUN(test_ds_responder);
+  TEST_RUN(test_responder_suspended);
+  return TEST_RESULT();
+}
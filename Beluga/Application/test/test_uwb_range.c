@@ -0,0 +1,258 @@
+/*! ----------------------------------------------------------------------------
+ *  @file   test_uwb_range.c
+ *
+ *  @brief  Host test of the fixed-point ranging math
+ *
+ *          Checks uwb_range.c on fixed exchanges with exact expected values,
+ *          then on random exchanges of realistic reply times, distances and
+ *          clock drifts against the double formulas of the original
+ *          ds_resp_run(), ds_init_run() and ss_init_run(). The random
+ *          exchanges are synthetic, no recorded timestamps of real nodes
+ *          are available.
+ *
+ *  @date   2020/07
+ *
+ *  @author WiseLab-CMU
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include "deca_device_api.h"
+#include "uwb_range.h"
+#include "test.h"
+
+#define SPEED_OF_LIGHT   299702547
+#define UUS_TO_DWT_TIME  65536
+#define RANDOM_ROUNDS    1000000
+
+/* DW1000 time units per mm of time of flight */
+#define DTU_PER_MM       (63897600.0 / SPEED_OF_LIGHT)
+
+typedef struct {
+  uint32_t round_a, reply_a, round_b, reply_b;
+  int64_t tof;
+  int32_t mm;
+} ds_vector_t;
+
+typedef struct {
+  int32_t rtd_init, rtd_resp, carrier_int;
+  int32_t mm;
+} ss_vector_t;
+
+/* Exchanges of 0.5 to 120 m with 1100 and 2000 us replies and up to 20 ppm of
+ * drift, expected values computed with exact rational arithmetic */
+static const ds_vector_t m_ds_vectors[] = {
+  { 72089813, 131072000, 131072213, 72089600,   106,    497 },
+  { 72091829, 131073572, 131072446, 72089095,   682,   3199 },
+  { 72092422, 131069378, 131078885, 72091041,  2132,  10000 },
+  { 85217395, 140903104, 140925105, 85198333, 10084,  47298 },
+  { 72139686, 131070033, 131122775, 72089383, 25584, 119998 },
+  /* Zero distance, the drift makes the products cross */
+  { 72090320, 131073310, 131070689, 72088879,    -1, UWB_RANGE_NONE },
+};
+
+/* Same exchanges, the time of flight is kept to 1/16 time unit so results are within a mm of these */
+static const ss_vector_t m_ss_vectors[] = {
+  { 72089813, 72089600,      0,    500 },
+  { 72091829, 72089095,  33152,   3200 },
+  { 72092422, 72091041, -69792,  10001 },
+  { 85217395, 85198333, -22682,  47301 },
+  { 72139686, 72089383, -20938, 119998 },
+  { 72090320, 72088879,  34897,     -2 },
+};
+
+#define COUNT(a)  (sizeof(a) / sizeof((a)[0]))
+
+
+/**
+ * @brief Time of flight of the original ds_resp_run()
+ */
+static int64_t double_ds_tof(uint32_t round_a, uint32_t reply_a, uint32_t round_b, uint32_t reply_b)
+{
+  double roundA = round_a, replyA = reply_a, roundB = round_b, replyB = reply_b;
+
+  if ((roundA * roundB - replyA * replyB) <= 0) return -1;
+  return (int64_t)(uint64_t)((roundA * roundB - replyA * replyB) / (roundA + roundB + replyA + replyB));
+}
+
+/**
+ * @brief Distance of the original ds_init_run(), in metres
+ */
+static double double_distance(int64_t tof_dtu)
+{
+  return tof_dtu * DWT_TIME_UNITS * SPEED_OF_LIGHT;
+}
+
+/**
+ * @brief Distance of the original ss_init_run(), in single precision like the firmware
+ */
+static double float_ss_distance(int32_t rtd_init, int32_t rtd_resp, int32_t carrier_int)
+{
+  float clockOffsetRatio = carrier_int * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_5 / 1.0e6);
+  double tof = ((rtd_init - rtd_resp * (1.0f - clockOffsetRatio)) / 2.0f) * DWT_TIME_UNITS;
+
+  return tof * SPEED_OF_LIGHT;
+}
+
+/**
+ * @brief Same formula in double precision
+ */
+static double double_ss_distance(int32_t rtd_init, int32_t rtd_resp, int32_t carrier_int)
+{
+  double clockOffsetRatio = carrier_int * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_5 / 1.0e6);
+  double tof = ((rtd_init - rtd_resp * (1.0 - clockOffsetRatio)) / 2.0) * DWT_TIME_UNITS;
+
+  return tof * SPEED_OF_LIGHT;
+}
+
+static double uniform(double lo, double hi)
+{
+  return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+
+static void test_ds_vectors(void)
+{
+  for (unsigned i = 0; i < COUNT(m_ds_vectors); i++) {
+    const ds_vector_t *v = &m_ds_vectors[i];
+    int64_t tof = uwb_range_ds_tof(v->round_a, v->reply_a, v->round_b, v->reply_b);
+
+    CHECK_EQ(tof, v->tof);
+    if (tof >= 0) {
+      CHECK_EQ(uwb_range_mm(tof), v->mm);
+    }
+  }
+
+  /* Degenerate intervals */
+  CHECK_EQ(uwb_range_ds_tof(0, 0, 0, 0), -1);
+  CHECK_EQ(uwb_range_ds_tof(100, 100, 100, 100), -1);
+  CHECK_EQ(uwb_range_ds_tof(UINT32_MAX, 0, UINT32_MAX, 0), ((uint64_t) UINT32_MAX * UINT32_MAX) / (2ULL * UINT32_MAX));
+}
+
+static void test_range_mm(void)
+{
+  CHECK_EQ(uwb_range_mm(0), 0);
+  CHECK_EQ(uwb_range_mm(1), 5);            /* 4.69 mm */
+  CHECK_EQ(uwb_range_mm(63897600), 299702547);
+  CHECK_EQ(uwb_range_mm(-1), -5);
+
+  /* Every time of flight with a range in 32 bits, up to about 2000 km, against the double formula */
+  for (int64_t tof = 0; tof < (1LL << 28); tof += 257) {
+    CHECK_EQ(uwb_range_mm(tof), llround(double_distance(tof) * 1000));
+    if (test_failures > 10) return;
+  }
+}
+
+static void test_ss_vectors(void)
+{
+  for (unsigned i = 0; i < COUNT(m_ss_vectors); i++) {
+    const ss_vector_t *v = &m_ss_vectors[i];
+
+    CHECK(abs(uwb_range_ss_mm(v->rtd_init, v->rtd_resp, v->carrier_int) - v->mm) <= 1);
+  }
+
+  /* Round trips more than about 1 ms apart are not an exchange */
+  CHECK_EQ(uwb_range_ss_mm(72089600 + (1 << 26), 72089600, 0), UWB_RANGE_NONE);
+  CHECK_EQ(uwb_range_ss_mm(72089600, 72089600 + (1 << 26), 0), UWB_RANGE_NONE);
+  CHECK(uwb_range_ss_mm(72089600 + (1 << 26) - 1, 72089600, 0) != UWB_RANGE_NONE);
+}
+
+/**
+ * @brief DS-TWR on random exchanges
+ *
+ * The time of flight is the exact truncated quotient. The double products of
+ * the original exceed 53 bits and can be one unit off. Ranges match the double
+ * conversion to the mm and stay within a time unit of the true distance.
+ */
+static void test_ds_random(void)
+{
+  int tof_off = 0;
+  double max_err = 0;
+
+  srand(19);
+  for (int i = 0; i < RANDOM_ROUNDS; i++) {
+    double dist_mm = uniform(0, 200000);
+    double tof = dist_mm * DTU_PER_MM;
+    double drift_a = 1 + uniform(-20e-6, 20e-6);
+    double drift_b = 1 + uniform(-20e-6, 20e-6);
+    double ra = uniform(300, 3000) * UUS_TO_DWT_TIME;
+    double rb = uniform(300, 3000) * UUS_TO_DWT_TIME;
+    uint32_t round_a = (2 * tof + rb) * drift_a;
+    uint32_t reply_a = ra * drift_a;
+    uint32_t round_b = (2 * tof + ra) * drift_b;
+    uint32_t reply_b = rb * drift_b;
+
+    int64_t fixed = uwb_range_ds_tof(round_a, reply_a, round_b, reply_b);
+    int64_t ref = double_ds_tof(round_a, reply_a, round_b, reply_b);
+
+    /* Exact truncated quotient */
+    if (fixed >= 0) {
+      unsigned __int128 num = (unsigned __int128) round_a * round_b - (unsigned __int128) reply_a * reply_b;
+      uint64_t sum = (uint64_t) round_a + round_b + reply_a + reply_b;
+      CHECK(num / sum == (uint64_t) fixed);
+    }
+
+    CHECK(llabs(fixed - ref) <= 1);
+    tof_off += fixed != ref;
+
+    if (fixed >= 0) {
+      int32_t mm = uwb_range_mm(fixed);
+      CHECK_EQ(mm, llround(double_distance(fixed) * 1000));
+
+      double err = fabs(mm - dist_mm);
+      if (err > max_err) max_err = err;
+    }
+    if (test_failures > 10) return;
+  }
+
+  printf("    %d of %d times of flight one unit off the double ones, max error %.2f mm\n", tof_off, RANDOM_ROUNDS, max_err);
+  /* Truncation, integer timestamps and drift within a time unit */
+  CHECK(max_err < 2.5 / DTU_PER_MM);
+}
+
+/**
+ * @brief SS-TWR on random exchanges
+ *
+ * The fixed point result is within a mm of the double formula, the single
+ * precision one of the original is off by centimetres.
+ */
+static void test_ss_random(void)
+{
+  double max_fixed = 0, max_float = 0;
+
+  srand(20);
+  for (int i = 0; i < RANDOM_ROUNDS; i++) {
+    double dist_mm = uniform(0, 200000);
+    double tof = dist_mm * DTU_PER_MM;
+    double drift_a = 1 + uniform(-20e-6, 20e-6);
+    double drift_b = 1 + uniform(-20e-6, 20e-6);
+    double rb = uniform(300, 3000) * UUS_TO_DWT_TIME;
+    int32_t rtd_init = (2 * tof + rb) * drift_a;
+    int32_t rtd_resp = rb * drift_b;
+    int32_t carrier_int = lround((drift_a - drift_b) / drift_b * 1744830464.0);
+
+    double ref = double_ss_distance(rtd_init, rtd_resp, carrier_int) * 1000;
+    double err_fixed = fabs(uwb_range_ss_mm(rtd_init, rtd_resp, carrier_int) - ref);
+    double err_float = fabs(float_ss_distance(rtd_init, rtd_resp, carrier_int) * 1000 - ref);
+
+    CHECK(err_fixed <= 1.0);
+    if (err_fixed > max_fixed) max_fixed = err_fixed;
+    if (err_float > max_float) max_float = err_float;
+    if (test_failures > 10) return;
+  }
+
+  printf("    max error against double: fixed %.2f mm, single precision %.1f mm\n", max_fixed, max_float);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_ds_vectors);
+  TEST_RUN(test_range_mm);
+  TEST_RUN(test_ss_vectors);
+  TEST_RUN(test_ds_random);
+  TEST_RUN(test_ss_random);
+  return TEST_RESULT();
+}
@@ -13,6 +13,10 @@
 
 #include "port_platform.h"
 #include "deca_device_api.h"
+#include "nrf_drv_common.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 
 /****************************************************************************//**
  *
@@ -71,11 +75,23 @@ void setup_DW1000RSTnIRQ(int enable)
 
 
 
+/* Time DW_CS must be held low to wake the DW1000 from DEEPSLEEP */
+#define DW_WAKE_CS_US       500
+
+/* Crystal startup time assumed when DW_RESET is not watched */
+#define DW_WAKE_XTAL_MS     5
+
 /* @fn      port_wakeup_dw1000
  * @brief   "slow" waking up of DW1000 using DW_CS only
+ *          DW_CS is held low long enough to wake the device, then the
+ *          worst case crystal startup time is waited out.
  * */
 void port_wakeup_dw1000(void)
 {
+    nrf_gpio_pin_clear(SPI_CS_PIN);
+    nrf_delay_us(DW_WAKE_CS_US);
+    nrf_gpio_pin_set(SPI_CS_PIN);
+    deca_sleep(DW_WAKE_XTAL_MS);
 }
 
 /* @fn      port_wakeup_dw1000_fast
@@ -85,9 +101,28 @@ void port_wakeup_dw1000(void)
  * */
 void port_wakeup_dw1000_fast(void)
 {
+    nrf_gpio_pin_clear(SPI_CS_PIN);
+    nrf_delay_us(DW_WAKE_CS_US);
+    (void) port_wait_dw1000_reset(DW_WAKE_XTAL_MS);
+    nrf_gpio_pin_set(SPI_CS_PIN);
 }
 
 
+/* Largest EasyDMA transfer supported by SPIM on nRF52832 (8-bit MAXCNT). */
+#define SPI_DMA_MAX_LEN     255
+
+/* Staging buffer, only used for buffers EasyDMA cannot reach (i.e. constants in flash). */
+#define SPI_STAGE_BUF_LEN   64
+
+/* Transfers at least this long block on a semaphore instead of spinning.
+ * Shorter ones complete in a few microseconds at 8 MHz, less than a context switch. */
+#define SPI_YIELD_MIN_LEN   64
+
+static volatile bool spi_xfer_done;  /**< Flag used to indicate that SPI instance completed the transfer. */
+static volatile bool spi_xfer_yield; /**< Current transfer is waited on with spi_done_sem. */
+static SemaphoreHandle_t spi_done_sem = NULL;
+static uint8 spi_stage_buf[SPI_STAGE_BUF_LEN];
+
 /**
  * @brief SPI user event handler.
  * @param event
@@ -95,35 +130,88 @@ void port_wakeup_dw1000_fast(void)
 void spi_event_handler(nrf_drv_spi_evt_t const * p_event, void * p_context)
 {
     spi_xfer_done = true;
-}
 
-//================================================================================================
-int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
-{ uint8 * p1;
-  uint32 idatalength=0;
-
-  idatalength= headerLength + readlength;
-
-  uint8 idatabuf[idatalength];
-  uint8 itempbuf[idatalength];
+    if (spi_xfer_yield)
+    {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(spi_done_sem, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
 
-  memset(idatabuf, 0, idatalength);
-  memset(itempbuf, 0, idatalength);	
+/* @fn      spi_dma_xfer
+ * @brief   run one EasyDMA transfer straight from/to the given RAM buffers and wait for it.
+ *          The calling task sleeps on spi_done_sem for long transfers once the scheduler
+ *          runs, short transfers and transfers during boot spin on spi_xfer_done.
+ * */
+static void spi_dma_xfer(const uint8 *tx, uint8 tx_len, uint8 *rx, uint8 rx_len)
+{
+    uint8 len = (tx_len > rx_len) ? tx_len : rx_len;
+
+    spi_xfer_yield = (len >= SPI_YIELD_MIN_LEN) && (spi_done_sem != NULL) &&
+                     (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+    spi_xfer_done = false;
+
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, tx, tx_len, rx, rx_len));
+
+    if (spi_xfer_yield)
+    {
+        xSemaphoreTake(spi_done_sem, portMAX_DELAY);
+    }
+    else
+    {
+        while(!spi_xfer_done)
+        ;
+    }
+}
 
-  p1=idatabuf;	
-  memcpy(p1,headerBuffer, headerLength);
+/* @fn      spi_write_buf
+ * @brief   clock out a buffer of any length, directly if it is in RAM, through the
+ *          staging buffer otherwise.
+ * */
+static void spi_write_buf(const uint8 *buf, uint32 length)
+{
+    while (length > 0)
+    {
+        uint32 n;
+
+        if (nrf_drv_is_in_RAM(buf))
+        {
+            n = (length > SPI_DMA_MAX_LEN) ? SPI_DMA_MAX_LEN : length;
+            spi_dma_xfer(buf, n, NULL, 0);
+        }
+        else
+        {
+            n = (length > SPI_STAGE_BUF_LEN) ? SPI_STAGE_BUF_LEN : length;
+            memcpy(spi_stage_buf, buf, n);
+            spi_dma_xfer(spi_stage_buf, n, NULL, 0);
+        }
+
+        buf += n;
+        length -= n;
+    }
+}
 
-  p1 += headerLength;
-  memset(p1,0x00,readlength);
+//================================================================================================
+/* Header and body are sent as consecutive EasyDMA transfers while DW_CS is held low, so the
+ * body is clocked straight into (or out of) the caller's buffer without staging copies.
+ * Reads clock out the ORC byte while receiving. A one byte read may clock an extra byte
+ * (nRF52832 anomaly 58), which only makes the DW1000 output one more register byte. */
+int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
+{
+  nrf_gpio_pin_clear(SPI_CS_PIN);
 
-  spi_xfer_done = false;
-  nrf_drv_spi_transfer(&spi, idatabuf, idatalength, itempbuf, idatalength);
-  while(!spi_xfer_done)				
-  ;
+  spi_write_buf(headerBuffer, headerLength);
 
-  p1=itempbuf + headerLength;
+  while (readlength > 0)
+  {
+    uint32 n = (readlength > SPI_DMA_MAX_LEN) ? SPI_DMA_MAX_LEN : readlength;
+    spi_dma_xfer(NULL, 0, readBuffer, n);
+    readBuffer += n;
+    readlength -= n;
+  }
 
-  memcpy(readBuffer, p1, readlength);
+  nrf_gpio_pin_set(SPI_CS_PIN);
 
   return 0;
 } 
@@ -131,26 +219,12 @@ int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlengt
 
 int writetospi( uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
 {
-  uint8 * p1;
-  uint32 idatalength=0;
-
-  idatalength= headerLength + bodylength;
-
-  uint8 idatabuf[idatalength];
-  uint8 itempbuf[idatalength];
-
-  memset(idatabuf, 0, idatalength);
-  memset(itempbuf, 0, idatalength);		 
-  
-  p1=idatabuf;	
-  memcpy(p1,headerBuffer, headerLength);
-  p1 += headerLength;
-  memcpy(p1,bodyBuffer,bodylength);
-  
-  spi_xfer_done = false;
-  nrf_drv_spi_transfer(&spi, idatabuf, idatalength, itempbuf, idatalength);
-  while(!spi_xfer_done)
-                          ;
+  nrf_gpio_pin_clear(SPI_CS_PIN);
+
+  spi_write_buf(headerBuffer, headerLength);
+  spi_write_buf(bodyBuffer, bodylength);
+
+  nrf_gpio_pin_set(SPI_CS_PIN);
 
   return 0;
 } 
@@ -194,11 +268,40 @@ void reset_DW1000(void)
 {
   nrf_gpio_cfg_output(DW1000_RST);   
   nrf_gpio_pin_clear(DW1000_RST);  
-  nrf_delay_ms(2); 
+  nrf_delay_us(10); 
   //nrf_gpio_pin_set(DW1000_RST);  
   //nrf_delay_ms(50); 
   nrf_gpio_cfg_input(DW1000_RST, NRF_GPIO_PIN_NOPULL); 
-  nrf_delay_ms(2); 
+}
+
+/* @fn      port_wait_dw1000_reset
+ * @brief   Wait until the DW1000 releases DW_RESET
+ *          The DW1000 holds the pin low until its crystal is stable and it
+ *          enters the INIT state, so SPI may be used once the pin is high.
+ *          Waits between checks sleep when the scheduler runs.
+ * @param   timeout_ms  maximum wait
+ * @return  0 once released, -1 on timeout
+ * */
+int port_wait_dw1000_reset(uint32_t timeout_ms)
+{
+  uint32_t waited_us = 0;
+
+  while (nrf_gpio_pin_read(DW1000_RST) == 0)
+  {
+    if (waited_us >= timeout_ms * 1000) return -1;
+
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+      vTaskDelay(1);
+      waited_us += 1000000 / configTICK_RATE_HZ;
+    }
+    else
+    {
+      nrf_delay_us(50);
+      waited_us += 50;
+    }
+  }
+  return 0;
 }
 
 /* @fn      port_set_dw1000_slowrate
@@ -208,9 +311,15 @@ void reset_DW1000(void)
 void port_set_dw1000_slowrate(void)
 {
 	nrf_drv_spi_config_t  spi_config = NRF_DRV_SPI_DEFAULT_CONFIG_2M(SPI_INSTANCE);
-	spi_config.ss_pin = SPI_CS_PIN;
+
+	/* DW_CS is driven by readfromspi()/writetospi() to span header and body transfers */
+	nrf_gpio_pin_set(SPI_CS_PIN);
+	nrf_gpio_cfg_output(SPI_CS_PIN);
+	if (spi_done_sem == NULL)
+	{
+		spi_done_sem = xSemaphoreCreateBinary();
+	}
 	APP_ERROR_CHECK( nrf_drv_spi_init(&spi, &spi_config, spi_event_handler, NULL) );
-	nrf_delay_ms(2);	
 }
 
 /* @fn      port_set_dw1000_fastrate
@@ -220,9 +329,7 @@ void port_set_dw1000_slowrate(void)
 void port_set_dw1000_fastrate(void)
 { nrf_drv_spi_uninit(&spi);
 	nrf_drv_spi_config_t  spi_config = NRF_DRV_SPI_DEFAULT_CONFIG_8M(SPI_INSTANCE);
-	spi_config.ss_pin = SPI_CS_PIN;
 	APP_ERROR_CHECK( nrf_drv_spi_init(&spi, &spi_config, spi_event_handler,NULL) );
-	nrf_delay_ms(2);	
 }
 
 
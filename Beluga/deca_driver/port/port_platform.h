@@ -59,7 +59,6 @@ void decamutexoff(decaIrqStatus_t s);
 
 #define SPI_INSTANCE  1 /**< SPI instance index. */
 static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE);  /**< SPI instance. */
-static volatile bool spi_xfer_done;  /**< Flag used to indicate that SPI instance completed the transfer. */
 
 /**
  * @brief SPI user event handler.
@@ -144,6 +143,7 @@ void process_deca_irq(void);
 void setup_DW1000RSTnIRQ(int enable);
 
 void reset_DW1000(void);
+int port_wait_dw1000_reset(uint32_t timeout_ms);
 
 #if 0
 ITStatus EXTI_GetITEnStatus(uint32_t x);
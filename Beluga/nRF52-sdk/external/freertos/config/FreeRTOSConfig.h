@@ -94,8 +94,8 @@
 
 #define configUSE_PREEMPTION                                                      1
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION                                   0
-#define configUSE_TICKLESS_IDLE                                                   0
-#define configUSE_TICKLESS_IDLE_SIMPLE_DEBUG                                      1 /* See into vPortSuppressTicksAndSleep source code for explanation */
+#define configUSE_TICKLESS_IDLE                                                   1
+#define configUSE_TICKLESS_IDLE_SIMPLE_DEBUG                                      0 /* See into vPortSuppressTicksAndSleep source code for explanation */
 #define configCPU_CLOCK_HZ                                                        ( SystemCoreClock )
 #define configTICK_RATE_HZ                                                        1024
 #define configMAX_PRIORITIES                                                      ( 3 )
@@ -117,11 +117,13 @@
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK                                                       0
 #define configUSE_TICK_HOOK                                                       0
-#define configCHECK_FOR_STACK_OVERFLOW                                            0
+#define configCHECK_FOR_STACK_OVERFLOW                                            2
 #define configUSE_MALLOC_FAILED_HOOK                                              0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS                                             0
+#define configGENERATE_RUN_TIME_STATS                                             1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()                                  /* Counted by the tick RTC until AT+STATS switches to a TIMER */
+#define portGET_RUN_TIME_COUNTER_VALUE()                                          task_stats_counter()
 #define configUSE_TRACE_FACILITY                                                  1
 #define configUSE_STATS_FORMATTING_FUNCTIONS                                      1
 
@@ -221,6 +223,10 @@ standard names - or at least those used in the unmodified vector table. */
         #error "This port requires __NVIC_PRIO_BITS to be defined"
     #endif
 
+    /* Run time stats clock, see task_stats.c */
+    #include <stdint.h>
+    extern uint32_t task_stats_counter(void);
+
     /* Access to current system core clock is required only if we are ticking the system by systimer */
     #if (configTICK_SOURCE == FREERTOS_USE_SYSTICK)
         #include <stdint.h>